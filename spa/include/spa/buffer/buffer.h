@@ -76,6 +76,11 @@ struct spa_chunk {
 	int32_t stride;			/**< stride of valid data */
 };
 
+#define SPA_DATA_FLAG_NONE	 0
+#define SPA_DATA_FLAG_READONLY	(1 << 0)	/**< the data is shared with the producer and
+						  *  must not be modified, consumers that want
+						  *  to write to it need to make a copy */
+
 /** Data for a buffer */
 struct spa_data {
 	uint32_t type;			/**< memory type */
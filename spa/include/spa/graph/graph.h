@@ -24,6 +24,8 @@
 extern "C" {
 #endif
 
+#include <time.h>
+
 #include <spa/utils/defs.h>
 #include <spa/utils/list.h>
 #include <spa/node/node.h>
@@ -45,16 +47,86 @@ struct spa_graph_callbacks {
 	int (*have_output) (void *data, struct spa_graph_node *node);
 };
 
+/** Hook called after every process call of a node in the graph */
+struct spa_graph_trace {
+#define SPA_VERSION_GRAPH_TRACE	0
+	uint32_t version;
+
+	void (*process) (void *data, struct spa_graph_node *node,
+			 enum spa_direction direction,
+			 uint64_t start, uint64_t end, int res);
+};
+
 struct spa_graph {
 	struct spa_list nodes;
 	const struct spa_graph_callbacks *callbacks;
 	void *callbacks_data;
+	const struct spa_graph_trace *trace;
+	void *trace_data;
 };
 
 #define spa_graph_need_input(g,n)	((g)->callbacks->need_input((g)->callbacks_data, (n)))
 #define spa_graph_have_output(g,n)	((g)->callbacks->have_output((g)->callbacks_data, (n)))
 #define spa_graph_reuse_buffer(g,n,p,i)	((g)->callbacks->reuse_buffer((g)->callbacks_data, (n),(p),(i)))
 
+#define SPA_GRAPH_STATS_HISTOGRAM	24
+
+/** Timing statistics of a node. They are updated by the data thread without
+ * locks and can be read from any other thread with spa_graph_stats_read(). */
+struct spa_graph_stats {
+	uint32_t seq;			/**< odd while being updated */
+	uint32_t errors;		/**< number of calls that returned an error */
+	uint64_t count;			/**< number of calls */
+	uint64_t min;			/**< shortest call in nanoseconds */
+	uint64_t max;			/**< longest call in nanoseconds */
+	uint64_t total;			/**< total time of all calls in nanoseconds */
+	uint32_t histogram[SPA_GRAPH_STATS_HISTOGRAM];	/**< bucket 0 counts the calls
+							  *  below 1us, bucket n the calls
+							  *  below 2^n us */
+};
+
+static inline uint64_t spa_graph_stats_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static inline void
+spa_graph_stats_update(struct spa_graph_stats *stats, uint64_t elapsed, bool error)
+{
+	uint64_t us = elapsed / 1000;
+	uint32_t bucket = us ? 64 - __builtin_clzll(us) : 0;
+
+	__atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (stats->count == 0 || elapsed < stats->min)
+		stats->min = elapsed;
+	if (elapsed > stats->max)
+		stats->max = elapsed;
+	stats->total += elapsed;
+	stats->count++;
+	if (error)
+		stats->errors++;
+	stats->histogram[SPA_MIN(bucket, SPA_GRAPH_STATS_HISTOGRAM - 1)]++;
+
+	__atomic_store_n(&stats->seq, stats->seq + 1, __ATOMIC_RELEASE);
+}
+
+/** Make a consistent copy of \a stats in \a copy */
+static inline void
+spa_graph_stats_read(const struct spa_graph_stats *stats, struct spa_graph_stats *copy)
+{
+	uint32_t seq;
+
+	do {
+		seq = __atomic_load_n(&stats->seq, __ATOMIC_ACQUIRE);
+		memcpy(copy, stats, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&stats->seq, __ATOMIC_RELAXED));
+}
+
 struct spa_graph_node {
 	struct spa_list link;		/**< link in graph nodes list */
 	struct spa_graph *graph;	/**< owner graph */
@@ -67,6 +139,7 @@ struct spa_graph_node {
 	int state;			/**< state of the node */
 	struct spa_node *implementation;/**< node implementation */
 	void *scheduler_data;		/**< scheduler private data */
+	struct spa_graph_stats *stats;	/**< timing of the process calls or NULL */
 };
 
 struct spa_graph_port {
@@ -84,6 +157,7 @@ struct spa_graph_port {
 static inline void spa_graph_init(struct spa_graph *graph)
 {
 	spa_list_init(&graph->nodes);
+	graph->trace = NULL;
 }
 
 static inline void
@@ -95,6 +169,17 @@ spa_graph_set_callbacks(struct spa_graph *graph,
 	graph->callbacks_data = data;
 }
 
+/** Install a hook that is called with the start and end time of every
+ * process call, NULL to remove */
+static inline void
+spa_graph_set_trace(struct spa_graph *graph,
+		    const struct spa_graph_trace *trace,
+		    void *data)
+{
+	graph->trace_data = data;
+	graph->trace = trace;
+}
+
 static inline void
 spa_graph_node_init(struct spa_graph_node *node)
 {
@@ -103,6 +188,7 @@ spa_graph_node_init(struct spa_graph_node *node)
 	node->flags = 0;
 	node->required[SPA_DIRECTION_INPUT] = node->ready[SPA_DIRECTION_INPUT] = 0;
 	node->required[SPA_DIRECTION_OUTPUT] = node->ready[SPA_DIRECTION_OUTPUT] = 0;
+	node->stats = NULL;
 	spa_debug("node %p init", node);
 }
 
@@ -113,6 +199,44 @@ spa_graph_node_set_implementation(struct spa_graph_node *node,
 	node->implementation = implementation;
 }
 
+static inline void
+spa_graph_node_set_stats(struct spa_graph_node *node,
+			 struct spa_graph_stats *stats)
+{
+	node->stats = stats;
+}
+
+/** Call process_input or process_output on the node implementation. The
+ * time of the call is recorded when the node has stats and passed to the
+ * trace hook of the graph when there is one. */
+static inline int
+spa_graph_node_process(struct spa_graph_node *node, enum spa_direction direction)
+{
+	const struct spa_graph_trace *trace = node->graph ? node->graph->trace : NULL;
+	uint64_t start, end;
+	int res;
+
+	if (node->stats == NULL && trace == NULL)
+		return direction == SPA_DIRECTION_INPUT ?
+			spa_node_process_input(node->implementation) :
+			spa_node_process_output(node->implementation);
+
+	start = spa_graph_stats_now();
+	res = direction == SPA_DIRECTION_INPUT ?
+		spa_node_process_input(node->implementation) :
+		spa_node_process_output(node->implementation);
+	end = spa_graph_stats_now();
+
+	if (node->stats)
+		spa_graph_stats_update(node->stats, end - start, res < 0);
+	if (trace)
+		trace->process(node->graph->trace_data, node, direction, start, end, res);
+	return res;
+}
+
+#define spa_graph_node_process_input(n)		spa_graph_node_process(n, SPA_DIRECTION_INPUT)
+#define spa_graph_node_process_output(n)	spa_graph_node_process(n, SPA_DIRECTION_OUTPUT)
+
 static inline void
 spa_graph_node_add(struct spa_graph *graph,
 		   struct spa_graph_node *node)
@@ -0,0 +1,278 @@
+/* Simple Plugin API
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_RINGBUFFER_MP_H__
+#define __SPA_RINGBUFFER_MP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <sched.h>
+
+#include <spa/utils/ringbuffer.h>
+
+/** number of committed regions that can wait for the regions before them */
+#define SPA_RINGBUFFER_MP_PENDING	32
+
+/**
+ * A multi-producer, multi-consumer ringbuffer.
+ *
+ * Writers first reserve a region of the ringbuffer by moving the write head
+ * with an atomic compare-and-swap, then fill the region and commit it with
+ * spa_ringbuffer_mp_write_update(). Readers only see a region once it and
+ * all regions reserved before it are committed. Readers do the same with the
+ * read head.
+ *
+ * A writer never waits for the writers that reserved before it. When the
+ * regions before its own are not committed yet, its region is left in a
+ * table of pending regions and the writer that commits the region right
+ * before it publishes it. Only when more than SPA_RINGBUFFER_MP_PENDING
+ * regions are pending does a writer wait for a free entry.
+ */
+struct spa_ringbuffer_mp {
+	uint32_t write_head;	/*< reserved by writers */
+	uint32_t writeindex;	/*< published by writers */
+	uint32_t padding1[14];	/*< keep readers and writers on their own cache line */
+	uint32_t read_head;	/*< reserved by readers */
+	uint32_t readindex;	/*< released by readers */
+	uint32_t padding2[14];
+	uint64_t write_pending[SPA_RINGBUFFER_MP_PENDING];	/*< committed, not published */
+	uint64_t read_pending[SPA_RINGBUFFER_MP_PENDING];	/*< released, not published */
+};
+
+#define SPA_RINGBUFFER_MP_INIT()	(struct spa_ringbuffer_mp) { 0, }
+
+/**
+ * Initialize a spa_ringbuffer_mp.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ */
+static inline void spa_ringbuffer_mp_init(struct spa_ringbuffer_mp *rbuf)
+{
+	*rbuf = SPA_RINGBUFFER_MP_INIT();
+}
+
+/* A pending region is stored as its index in the upper and its length in the
+ * lower 32 bits, 0 is a free entry. The seq_cst order between adding a
+ * pending region and reading the published index on one side, and publishing
+ * the index and looking for pending regions on the other, makes sure that
+ * a region is either seen by the one that publishes the region before it or
+ * sees that it can publish itself. */
+
+/* publish the pending regions that follow \a index, the caller has just
+ * published \a index */
+static inline void spa_ringbuffer_mp_publish_pending(uint32_t *published, uint64_t *pending,
+						     uint32_t index)
+{
+	uint64_t p;
+	int i;
+
+      again:
+	for (i = 0; i < SPA_RINGBUFFER_MP_PENDING; i++) {
+		p = __atomic_load_n(&pending[i], __ATOMIC_SEQ_CST);
+		if (p == 0 || (uint32_t) (p >> 32) != index)
+			continue;
+		/* the owner of the region can take it back at the same time */
+		if (!__atomic_compare_exchange_n(&pending[i], &p, 0,
+						 false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			return;
+		index += (uint32_t) p;
+		__atomic_store_n(published, index, __ATOMIC_SEQ_CST);
+		goto again;
+	}
+}
+
+/* commit the \a len bytes at \a index, publish them when all regions before
+ * it are published or leave them to the one that publishes the region
+ * before it */
+static inline void spa_ringbuffer_mp_commit(uint32_t *published, uint64_t *pending,
+					    uint32_t index, uint32_t len)
+{
+	uint64_t p = ((uint64_t) index << 32) | len, free;
+	int i;
+
+	if (len == 0)
+		return;
+
+	while (__atomic_load_n(published, __ATOMIC_SEQ_CST) != index) {
+		for (i = 0; i < SPA_RINGBUFFER_MP_PENDING; i++) {
+			free = 0;
+			if (__atomic_compare_exchange_n(&pending[i], &free, p,
+							false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+				break;
+		}
+		if (i == SPA_RINGBUFFER_MP_PENDING) {
+			/* no free entry, wait for one or for our turn */
+#if defined(__i386__) || defined(__x86_64__)
+			__builtin_ia32_pause();
+#endif
+			sched_yield();
+			continue;
+		}
+		/* the region before was published before ours was seen, take it
+		 * back and publish it ourselves, unless someone else did */
+		if (__atomic_load_n(published, __ATOMIC_SEQ_CST) != index ||
+		    !__atomic_compare_exchange_n(&pending[i], &p, 0,
+						 false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			return;
+		break;
+	}
+	index += len;
+	__atomic_store_n(published, index, __ATOMIC_SEQ_CST);
+	spa_ringbuffer_mp_publish_pending(published, pending, index);
+}
+
+/**
+ * Get the write head and the number of bytes inside the ringbuffer,
+ * including the regions that are reserved but not yet published.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param index the value of the write head, pass it to
+ *         spa_ringbuffer_mp_write_reserve()
+ * \return the fill level of \a rbuf. Subtract from the buffer size to get
+ *         the number of bytes available for writing.
+ */
+static inline int32_t spa_ringbuffer_mp_get_write_index(struct spa_ringbuffer_mp *rbuf,
+							uint32_t *index)
+{
+	*index = __atomic_load_n(&rbuf->write_head, __ATOMIC_RELAXED);
+	return (int32_t) (*index - __atomic_load_n(&rbuf->readindex, __ATOMIC_ACQUIRE));
+}
+
+/**
+ * Try to reserve \a len bytes for writing at \a index.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param index the write head from spa_ringbuffer_mp_get_write_index()
+ * \param len number of bytes to reserve
+ * \return true when the region was reserved, false when an other writer
+ *         reserved first and the write index should be fetched again.
+ */
+static inline bool spa_ringbuffer_mp_write_reserve(struct spa_ringbuffer_mp *rbuf,
+						   uint32_t index, uint32_t len)
+{
+	return __atomic_compare_exchange_n(&rbuf->write_head, &index, index + len,
+					   false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * Write \a len bytes to \a buffer starting \a offset. \a offset must be taken
+ * modulo \a size and len should be smaller than \a size.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param buffer memory to write to
+ * \param size the size of \a buffer
+ * \param offset offset in \a buffer to write to
+ * \param data source memory
+ * \param len number of bytes to write
+ */
+static inline void
+spa_ringbuffer_mp_write_data(struct spa_ringbuffer_mp *rbuf,
+			     void *buffer, uint32_t size,
+			     uint32_t offset, const void *data, uint32_t len)
+{
+	spa_ringbuffer_write_data(NULL, buffer, size, offset, data, len);
+}
+
+/**
+ * Commit the \a len bytes reserved at \a index. They are published when the
+ * regions reserved before them are committed, this does not wait for them.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param index the reserved index
+ * \param len the reserved number of bytes
+ */
+static inline void spa_ringbuffer_mp_write_update(struct spa_ringbuffer_mp *rbuf,
+						  uint32_t index, uint32_t len)
+{
+	spa_ringbuffer_mp_commit(&rbuf->writeindex, rbuf->write_pending, index, len);
+}
+
+/**
+ * Get the read head and the number of published bytes after it.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param index the value of the read head, pass it to
+ *         spa_ringbuffer_mp_read_reserve()
+ * \return number of available bytes to read.
+ */
+static inline int32_t spa_ringbuffer_mp_get_read_index(struct spa_ringbuffer_mp *rbuf,
+						       uint32_t *index)
+{
+	*index = __atomic_load_n(&rbuf->read_head, __ATOMIC_RELAXED);
+	return (int32_t) (__atomic_load_n(&rbuf->writeindex, __ATOMIC_ACQUIRE) - *index);
+}
+
+/**
+ * Try to reserve \a len bytes for reading at \a index.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param index the read head from spa_ringbuffer_mp_get_read_index()
+ * \param len number of bytes to reserve
+ * \return true when the region was reserved, false when an other reader
+ *         reserved first and the read index should be fetched again.
+ */
+static inline bool spa_ringbuffer_mp_read_reserve(struct spa_ringbuffer_mp *rbuf,
+						  uint32_t index, uint32_t len)
+{
+	return __atomic_compare_exchange_n(&rbuf->read_head, &index, index + len,
+					   false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * Read \a len bytes from \a buffer starting \a offset. \a offset must be taken
+ * modulo \a size and len should be smaller than \a size.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param buffer memory to read from
+ * \param size the size of \a buffer
+ * \param offset offset in \a buffer to read from
+ * \param data destination memory
+ * \param len number of bytes to read
+ */
+static inline void
+spa_ringbuffer_mp_read_data(struct spa_ringbuffer_mp *rbuf,
+			    const void *buffer, uint32_t size,
+			    uint32_t offset, void *data, uint32_t len)
+{
+	spa_ringbuffer_read_data(NULL, buffer, size, offset, data, len);
+}
+
+/**
+ * Release the \a len bytes reserved for reading at \a index so that they
+ * can be written again once the regions reserved before them are released,
+ * this does not wait for them.
+ *
+ * \param rbuf a spa_ringbuffer_mp
+ * \param index the reserved index
+ * \param len the reserved number of bytes
+ */
+static inline void spa_ringbuffer_mp_read_update(struct spa_ringbuffer_mp *rbuf,
+						 uint32_t index, uint32_t len)
+{
+	spa_ringbuffer_mp_commit(&rbuf->readindex, rbuf->read_pending, index, len);
+}
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif /* __SPA_RINGBUFFER_MP_H__ */
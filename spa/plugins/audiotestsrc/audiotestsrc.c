@@ -101,6 +101,10 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 enum wave_type {
 	WAVE_SINE,
 	WAVE_SQUARE,
+	WAVE_SAW,
+	WAVE_TRIANGLE,
+	WAVE_WHITE_NOISE,
+	WAVE_PINK_NOISE,
 };
 
 #define DEFAULT_LIVE false
@@ -126,6 +130,16 @@ static void reset_props(struct props *props)
 #define MAX_BUFFERS 16
 #define MAX_PORTS 1
 
+/* wavetable oscillator, see render.c */
+#define TABLE_BITS 11
+#define TABLE_SIZE (1 << TABLE_BITS)
+#define N_LEVELS 11
+/* highest frequency of the first table, relative to the sample rate */
+#define BASE_FREQ (20.0 / 48000.0)
+/* sine, square, saw and triangle have a table */
+#define N_TABLE_WAVES (WAVE_TRIANGLE + 1)
+#define BLOCK_SIZE 256
+
 struct buffer {
 	struct spa_buffer *outbuf;
 	bool outstanding;
@@ -168,7 +182,10 @@ struct impl {
 	struct spa_audio_info current_format;
 	size_t bpf;
 	render_func_t render_func;
-	double accumulator;
+	uint32_t phase;
+	uint32_t noise_seed[4];
+	float pink[3];
+	float block[BLOCK_SIZE];
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -234,7 +251,11 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propType, "i", p->wave,
 				":", t->param.propLabels, "[-i",
 					"i", WAVE_SINE, "s", "Sine wave",
-					"i", WAVE_SQUARE, "s", "Square wave", "]");
+					"i", WAVE_SQUARE, "s", "Square wave",
+					"i", WAVE_SAW, "s", "Saw wave",
+					"i", WAVE_TRIANGLE, "s", "Triangle wave",
+					"i", WAVE_WHITE_NOISE, "s", "White noise",
+					"i", WAVE_PINK_NOISE, "s", "Pink noise", "]");
 			break;
 		case 2:
 			param = spa_pod_builder_object(&b,
@@ -740,7 +761,11 @@ impl_node_port_enum_params(struct spa_node *node,
 				":", t->param.propType,   "i", p->wave,
 				":", t->param.propLabels, "[-i",
 					"i", WAVE_SINE,   "s", "Sine wave",
-					"i", WAVE_SQUARE, "s", "Square wave", "]");
+					"i", WAVE_SQUARE, "s", "Square wave",
+					"i", WAVE_SAW,    "s", "Saw wave",
+					"i", WAVE_TRIANGLE, "s", "Triangle wave",
+					"i", WAVE_WHITE_NOISE, "s", "White noise",
+					"i", WAVE_PINK_NOISE, "s", "Pink noise", "]");
 			break;
 		case 1:
 			param = spa_pod_builder_object(&b,
@@ -829,7 +854,7 @@ port_set_format(struct impl *this,
 		this->bpf = sizes[idx] * info.info.raw.channels;
 		this->current_format = info;
 		this->have_format = true;
-		this->render_func = sine_funcs[idx];
+		this->render_func = render_funcs[idx];
 	}
 
 	if (this->have_format) {
@@ -1182,6 +1207,7 @@ impl_init(const struct spa_handle_factory *factory,
 		return -EINVAL;
 	}
 	init_type(&this->type, this->map);
+	init_tables();
 
 	this->node = impl_node;
 	this->clock = impl_clock;
@@ -1191,6 +1217,11 @@ impl_init(const struct spa_handle_factory *factory,
 	this->io_freq = &this->props.freq;
 	this->io_volume = &this->props.volume;
 
+	this->noise_seed[0] = 0x9e3779b9;
+	this->noise_seed[1] = 0x7f4a7c15;
+	this->noise_seed[2] = 0x2545f491;
+	this->noise_seed[3] = 0x6c078965;
+
 	spa_list_init(&this->empty);
 
 	this->timer_source.func = on_output;
@@ -18,41 +18,301 @@
  */
 
 #include <math.h>
+#include <pthread.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #define M_PI_M2 ( M_PI + M_PI )
 
-#define DEFINE_SINE(type,scale)								\
-static void										\
-audio_test_src_create_sine_##type (struct impl *this, type *samples, size_t n_samples)	\
+/* the fractional part of the 32 bits phase between two table entries */
+#define FRAC_BITS	(32 - TABLE_BITS)
+#define FRAC_MASK	((1u << FRAC_BITS) - 1)
+#define FRAC_SCALE	(1.0f / (1u << FRAC_BITS))
+
+/* The oscillators read from one cycle of the waveform. Waveforms with
+ * harmonics have a table per octave of the frequency relative to the sample
+ * rate, that only holds the harmonics below the Nyquist frequency for the
+ * highest frequency of that octave, so that they don't alias. The tables
+ * don't depend on the format and are shared by all nodes, they are built
+ * once when the first node is created. */
+static float wave_tables[N_TABLE_WAVES][N_LEVELS][TABLE_SIZE + 1];
+static pthread_once_t wave_tables_once = PTHREAD_ONCE_INIT;
+
+static int table_level(uint32_t wave, double freq)
+{
+	int level = 0;
+
+	if (wave == WAVE_SINE)
+		return 0;
+
+	while (level < N_LEVELS - 1 && freq >= BASE_FREQ * (2 << level))
+		level++;
+	return level;
+}
+
+static void build_table(uint32_t wave, int level)
+{
+	float *table = wave_tables[wave][level];
+	double max = 0.0;
+	int i, k, n_harmonics;
+
+	if (wave == WAVE_SINE)
+		n_harmonics = 1;
+	else
+		n_harmonics = SPA_CLAMP((int) (0.5 / (BASE_FREQ * (2 << level))),
+					1, TABLE_SIZE / 2 - 1);
+
+	for (i = 0; i < TABLE_SIZE; i++) {
+		double x = M_PI_M2 * i / TABLE_SIZE;
+		double c2 = 2.0 * cos(x), s0 = 0.0, s1 = sin(x), s, val = 0.0;
+
+		/* sin(k * x) with the chebyshev recurrence */
+		for (k = 1; k <= n_harmonics; k++) {
+			switch (wave) {
+			case WAVE_SQUARE:
+				if (k & 1)
+					val += s1 / k;
+				break;
+			case WAVE_SAW:
+				val += (k & 1 ? s1 : -s1) / k;
+				break;
+			case WAVE_TRIANGLE:
+				if (k & 1)
+					val += (k & 2 ? -s1 : s1) / ((double) k * k);
+				break;
+			default:
+				val += s1;
+				break;
+			}
+			s = c2 * s1 - s0;
+			s0 = s1;
+			s1 = s;
+		}
+		table[i] = val;
+		max = SPA_MAX(max, fabs(val));
+	}
+	/* normalize, this also removes the Gibbs overshoot */
+	for (i = 0; i < TABLE_SIZE; i++)
+		table[i] /= max;
+	/* guard point for the interpolation */
+	table[TABLE_SIZE] = table[0];
+}
+
+static void build_tables(void)
+{
+	uint32_t wave;
+	int level;
+
+	build_table(WAVE_SINE, 0);
+	for (wave = WAVE_SQUARE; wave < N_TABLE_WAVES; wave++) {
+		for (level = 0; level < N_LEVELS; level++)
+			build_table(wave, level);
+	}
+}
+
+static void init_tables(void)
+{
+	pthread_once(&wave_tables_once, build_tables);
+}
+
+static void render_osc(struct impl *this, uint32_t wave, float *out, int n_samples)
+{
+	double freq = *this->io_freq / this->current_format.info.raw.rate;
+	const float *table = wave_tables[wave][table_level(wave, freq)];
+	uint32_t phase = this->phase;
+	uint32_t inc = (uint32_t) (uint64_t) (freq * 4294967296.0);
+	int i = 0;
+
+#if defined(__SSE2__)
+	{
+		uint32_t idx[4] __attribute__ ((aligned (16)));
+		float t0[4] __attribute__ ((aligned (16)));
+		float t1[4] __attribute__ ((aligned (16)));
+		__m128i ph = _mm_set_epi32(phase + 3 * inc, phase + 2 * inc, phase + inc, phase);
+		__m128i inc4 = _mm_set1_epi32(inc * 4);
+		__m128i mask = _mm_set1_epi32(FRAC_MASK);
+		__m128 scale = _mm_set1_ps(FRAC_SCALE);
+		__m128 frac, a, b;
+		int j;
+
+		for (; i + 4 <= n_samples; i += 4) {
+			_mm_store_si128((__m128i *) idx, _mm_srli_epi32(ph, FRAC_BITS));
+			frac = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(ph, mask)), scale);
+			for (j = 0; j < 4; j++) {
+				t0[j] = table[idx[j]];
+				t1[j] = table[idx[j] + 1];
+			}
+			a = _mm_load_ps(t0);
+			b = _mm_load_ps(t1);
+			_mm_storeu_ps(&out[i], _mm_add_ps(a, _mm_mul_ps(frac, _mm_sub_ps(b, a))));
+			ph = _mm_add_epi32(ph, inc4);
+		}
+		phase += (uint32_t) i * inc;
+	}
+#endif
+	for (; i < n_samples; i++) {
+		uint32_t idx = phase >> FRAC_BITS;
+		float frac = (phase & FRAC_MASK) * FRAC_SCALE;
+
+		out[i] = table[idx] + frac * (table[idx + 1] - table[idx]);
+		phase += inc;
+	}
+	this->phase = phase;
+}
+
+/* xorshift32 in 4 independent lanes */
+static void render_white(struct impl *this, float *out, int n_samples)
+{
+	uint32_t *seed = this->noise_seed;
+	const float scale = 1.0f / 2147483648.0f;
+	int i = 0, j;
+
+#if defined(__SSE2__)
+	{
+		__m128i s = _mm_loadu_si128((__m128i *) seed);
+		__m128 sc = _mm_set1_ps(scale);
+
+		for (; i + 4 <= n_samples; i += 4) {
+			s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+			s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+			s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+			_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(s), sc));
+		}
+		_mm_storeu_si128((__m128i *) seed, s);
+	}
+#endif
+	for (j = 0; i < n_samples; i++, j = (j + 1) & 3) {
+		uint32_t s = seed[j];
+		s ^= s << 13;
+		s ^= s >> 17;
+		s ^= s << 5;
+		seed[j] = s;
+		out[i] = (int32_t) s * scale;
+	}
+}
+
+/* white noise through Paul Kellet's economy -3dB/octave filter */
+static void render_pink(struct impl *this, float *out, int n_samples)
+{
+	float *b = this->pink;
+	int i;
+
+	render_white(this, out, n_samples);
+
+	for (i = 0; i < n_samples; i++) {
+		float w = out[i];
+		b[0] = 0.99765f * b[0] + w * 0.0990460f;
+		b[1] = 0.96300f * b[1] + w * 0.2965164f;
+		b[2] = 0.57000f * b[2] + w * 1.0526913f;
+		out[i] = SPA_CLAMP((b[0] + b[1] + b[2] + w * 0.1848f) * 0.11f, -1.0f, 1.0f);
+	}
+}
+
+static void render_block(struct impl *this, float *out, int n_samples)
+{
+	uint32_t wave = *this->io_wave;
+
+	switch (wave) {
+	case WAVE_WHITE_NOISE:
+		render_white(this, out, n_samples);
+		break;
+	case WAVE_PINK_NOISE:
+		render_pink(this, out, n_samples);
+		break;
+	case WAVE_SQUARE:
+	case WAVE_SAW:
+	case WAVE_TRIANGLE:
+		render_osc(this, wave, out, n_samples);
+		break;
+	default:
+		render_osc(this, WAVE_SINE, out, n_samples);
+		break;
+	}
+}
+
+/* Render a block of mono samples and copy it, scaled and converted, to all
+ * channels. The common mono and stereo cases are vectorized. */
+#define DEFINE_RENDER(type,scale,convert)						\
+static int										\
+audio_test_src_render_##type (struct impl *this, type *samples, size_t n_samples)	\
 {											\
-	int i, c, channels;								\
-	double step, amp;								\
-	double freq = *this->io_freq;							\
-	double volume = *this->io_volume;						\
-											\
-	channels = this->current_format.info.raw.channels;				\
-	step = M_PI_M2 * freq / this->current_format.info.raw.rate;			\
-	amp = volume * scale;								\
+	int i, c, n, channels = this->current_format.info.raw.channels;			\
+	float amp = *this->io_volume * scale;						\
+	float *block = this->block;							\
 											\
-	for (i = 0; i < n_samples; i++) {						\
-		type val;								\
-		this->accumulator += step;						\
-		if (this->accumulator >= M_PI_M2)					\
-			this->accumulator -= M_PI_M2;					\
-		val = (type) (sin (this->accumulator) * amp);				\
-		for (c = 0; c < channels; ++c)						\
-			*samples++ = val;						\
+	while (n_samples > 0) {								\
+		n = SPA_MIN(n_samples, BLOCK_SIZE);					\
+		render_block(this, block, n);						\
+		i = 0;									\
+		convert;								\
+		for (; i < n; i++) {							\
+			type val = (type) (block[i] * amp);				\
+			for (c = 0; c < channels; ++c)					\
+				*samples++ = val;					\
+		}									\
+		n_samples -= n;								\
 	}										\
+	return 0;									\
 }
 
-DEFINE_SINE(int16_t, 32767.0);
-DEFINE_SINE(int32_t, 2147483647.0);
-DEFINE_SINE(float, 1.0);
-DEFINE_SINE(double, 1.0);
+#if defined(__SSE2__)
+#define CONVERT_SSE2(store)								\
+	if (channels <= 2) {								\
+		__m128 a = _mm_set1_ps(amp);						\
+		for (; i + 4 <= n; i += 4) {						\
+			__m128 v = _mm_mul_ps(_mm_loadu_ps(&block[i]), a);		\
+			store;								\
+		}									\
+	}
+
+#define STORE_S16									\
+	__m128i s = _mm_cvttps_epi32(v);						\
+	s = _mm_packs_epi32(s, s);							\
+	if (channels == 1) {								\
+		_mm_storel_epi64((__m128i *) samples, s);				\
+		samples += 4;								\
+	} else {									\
+		_mm_storeu_si128((__m128i *) samples, _mm_unpacklo_epi16(s, s));	\
+		samples += 8;								\
+	}
+
+#define STORE_S32									\
+	__m128i s = _mm_cvttps_epi32(v);						\
+	if (channels == 1) {								\
+		_mm_storeu_si128((__m128i *) samples, s);				\
+		samples += 4;								\
+	} else {									\
+		_mm_storeu_si128((__m128i *) samples, _mm_unpacklo_epi32(s, s));	\
+		_mm_storeu_si128((__m128i *) (samples + 4), _mm_unpackhi_epi32(s, s));	\
+		samples += 8;								\
+	}
+
+#define STORE_F32									\
+	if (channels == 1) {								\
+		_mm_storeu_ps(samples, v);						\
+		samples += 4;								\
+	} else {									\
+		_mm_storeu_ps(samples, _mm_unpacklo_ps(v, v));				\
+		_mm_storeu_ps(samples + 4, _mm_unpackhi_ps(v, v));			\
+		samples += 8;								\
+	}
+
+DEFINE_RENDER(int16_t, 32767.0f, CONVERT_SSE2(STORE_S16));
+/* the largest float below 2^31 */
+DEFINE_RENDER(int32_t, 2147483520.0f, CONVERT_SSE2(STORE_S32));
+DEFINE_RENDER(float, 1.0f, CONVERT_SSE2(STORE_F32));
+#else
+DEFINE_RENDER(int16_t, 32767.0f, );
+DEFINE_RENDER(int32_t, 2147483520.0f, );
+DEFINE_RENDER(float, 1.0f, );
+#endif
+DEFINE_RENDER(double, 1.0f, );
 
-static const render_func_t sine_funcs[] = {
-	(render_func_t) audio_test_src_create_sine_int16_t,
-	(render_func_t) audio_test_src_create_sine_int32_t,
-	(render_func_t) audio_test_src_create_sine_float,
-	(render_func_t) audio_test_src_create_sine_double
+static const render_func_t render_funcs[] = {
+	(render_func_t) audio_test_src_render_int16_t,
+	(render_func_t) audio_test_src_render_int32_t,
+	(render_func_t) audio_test_src_render_float,
+	(render_func_t) audio_test_src_render_double
 };
@@ -23,6 +23,7 @@
 #include <sys/timerfd.h>
 #include <arpa/inet.h>
 #include <sys/ioctl.h>
+#include <linux/sockios.h>
 
 #include <spa/support/type-map.h>
 #include <spa/support/loop.h>
@@ -53,6 +54,13 @@ struct props {
 #define MAX_FRAME_COUNT 32
 #define MAX_BUFFERS 32
 
+/* bitpool controller, the queue thresholds are expressed in full
+ * sized packets so that they scale with the negotiated rate and mtu */
+#define CTL_QUEUE_HIGH		FILL_FRAMES
+#define CTL_QUEUE_MAX		(4 * FILL_FRAMES)
+#define CTL_DOWN_HOLD		(200 * SPA_NSEC_PER_MSEC)
+#define CTL_UP_HOLD		(3 * SPA_NSEC_PER_SEC)
+
 struct buffer {
 	struct spa_buffer *outbuf;
 	struct spa_meta_header *h;
@@ -67,6 +75,10 @@ struct type {
 	uint32_t props;
 	uint32_t prop_min_latency;
 	uint32_t prop_max_latency;
+	uint32_t prop_bitpool;
+	uint32_t prop_frames_per_packet;
+	uint32_t prop_queue_latency;
+	uint32_t prop_write_latency;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
@@ -90,6 +102,10 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
 	type->prop_min_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__minLatency);
 	type->prop_max_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__maxLatency);
+	type->prop_bitpool = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "bitpool");
+	type->prop_frames_per_packet = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "framesPerPacket");
+	type->prop_queue_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "queueLatency");
+	type->prop_write_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "writeLatency");
 
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
@@ -164,9 +180,15 @@ struct impl {
 
 	int min_bitpool;
 	int max_bitpool;
+	int frames_per_packet;
+	int max_frames_per_packet;
+
+	int64_t queue_time;
+	int64_t write_time;
+	uint64_t last_change;
+	uint64_t good_since;
 
 	uint64_t last_time;
-	uint64_t last_error;
 
 	struct timespec now;
 	int64_t start_time;
@@ -243,6 +265,34 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propType, "ir", p->max_latency,
 					SPA_POD_PROP_MIN_MAX(1, INT32_MAX));
 			break;
+		case 2:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_bitpool,
+				":", t->param.propName, "s", "The current SBC bitpool",
+				":", t->param.propType, "i-r", this->sbc.bitpool);
+			break;
+		case 3:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_frames_per_packet,
+				":", t->param.propName, "s", "The current SBC frames per packet",
+				":", t->param.propType, "i-r", this->frames_per_packet);
+			break;
+		case 4:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_queue_latency,
+				":", t->param.propName, "s", "The socket queue latency in usec",
+				":", t->param.propType, "i-r", (int) (this->queue_time / SPA_NSEC_PER_USEC));
+			break;
+		case 5:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_write_latency,
+				":", t->param.propName, "s", "The write latency in usec",
+				":", t->param.propType, "i-r", (int) (this->write_time / SPA_NSEC_PER_USEC));
+			break;
 		default:
 			return 0;
 		}
@@ -254,8 +304,12 @@ static int impl_node_enum_params(struct spa_node *node,
 		case 0:
 			param = spa_pod_builder_object(&b,
 				id, t->props,
-				":", t->prop_min_latency, "i",   p->min_latency,
-				":", t->prop_max_latency, "i",   p->max_latency);
+				":", t->prop_min_latency,       "i",   p->min_latency,
+				":", t->prop_max_latency,       "i",   p->max_latency,
+				":", t->prop_bitpool,           "i-r", this->sbc.bitpool,
+				":", t->prop_frames_per_packet, "i-r", this->frames_per_packet,
+				":", t->prop_queue_latency,     "i-r", (int) (this->queue_time / SPA_NSEC_PER_USEC),
+				":", t->prop_write_latency,     "i-r", (int) (this->write_time / SPA_NSEC_PER_USEC));
 			break;
 		default:
 			return 0;
@@ -343,6 +397,8 @@ static int send_buffer(struct impl *this)
 	int val, written;
 	struct rtp_header *header;
 	struct rtp_payload *payload;
+	struct timespec ts;
+	int64_t t1, t2, samples, queued;
 
 	header = (struct rtp_header *)this->buffer;
 	payload = (struct rtp_payload *)(this->buffer + sizeof(struct rtp_header));
@@ -355,17 +411,32 @@ static int send_buffer(struct impl *this)
 	header->timestamp = htonl(this->timestamp);
 	header->ssrc = htonl(1);
 
-	ioctl(this->transport->fd, TIOCOUTQ, &val);
+	if (ioctl(this->transport->fd, SIOCOUTQ, &val) < 0)
+		val = 0;
 
 	spa_log_trace(this->log, "a2dp-sink %p: send %d %u %u %u %lu %d",
 			this, this->frame_count, this->seqnum, this->timestamp, this->buffer_used,
 			this->sample_time, val);
 
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t1 = SPA_TIMESPEC_TO_TIME(&ts);
 	written = write(this->transport->fd, this->buffer, this->buffer_used);
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	t2 = SPA_TIMESPEC_TO_TIME(&ts);
+
 	spa_log_trace(this->log, "a2dp-sink %p: send %d", this, written);
 	if (written < 0)
 		return -errno;
 
+	/* convert the bytes still in the socket to time using the packet
+	 * we just wrote and smooth both measurements */
+	samples = this->frame_count * this->codesize / this->frame_size;
+	queued = (int64_t) val * samples * SPA_NSEC_PER_SEC /
+		((int64_t) this->buffer_used * this->current_format.info.raw.rate);
+
+	this->queue_time += (queued - this->queue_time) / 4;
+	this->write_time += ((t2 - t1) - this->write_time) / 4;
+
 	this->timestamp = this->sample_count;
 	this->seqnum++;
 	reset_buffer(this);
@@ -405,7 +476,7 @@ static int encode_buffer(struct impl *this, const void *data, int size)
 static bool need_flush(struct impl *this)
 {
 	return (this->buffer_used + this->frame_length > this->write_size) ||
-		this->frame_count > MAX_FRAME_COUNT;
+		this->frame_count >= this->frames_per_packet;
 }
 
 static int flush_buffer(struct impl *this, bool force)
@@ -473,7 +544,9 @@ static int set_bitpool(struct impl *this, int bitpool)
 	if (bitpool > this->max_bitpool)
 		bitpool = this->max_bitpool;
 
-	if (this->sbc.bitpool == bitpool)
+	/* after init_sbc frames_per_packet is 0 and the sizes must be computed
+	 * again, even when the bitpool did not change */
+	if (this->sbc.bitpool == bitpool && this->frames_per_packet != 0)
 		return 0;
 
 	this->sbc.bitpool = bitpool;
@@ -487,21 +560,84 @@ static int set_bitpool(struct impl *this, int bitpool)
 		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
 	this->write_size = this->transport->write_mtu
 		- sizeof(struct rtp_header) - sizeof(struct rtp_payload) - 24;
-	this->write_samples = (this->write_size / this->frame_length) * (this->codesize / this->frame_size);
+
+	this->max_frames_per_packet = SPA_MIN(this->write_size / this->frame_length, MAX_FRAME_COUNT);
+	if (this->frames_per_packet == 0 || this->frames_per_packet > this->max_frames_per_packet)
+		this->frames_per_packet = this->max_frames_per_packet;
+
+	this->write_samples = this->frames_per_packet * (this->codesize / this->frame_size);
+
+	return 0;
+}
+
+static int set_frames_per_packet(struct impl *this, int frames)
+{
+	frames = SPA_CLAMP(frames, 1, this->max_frames_per_packet);
+
+	if (this->frames_per_packet == frames)
+		return 0;
+
+	this->frames_per_packet = frames;
+
+	spa_log_debug(this->log, "set frames per packet %d", this->frames_per_packet);
+
+	this->write_samples = this->frames_per_packet * (this->codesize / this->frame_size);
 
 	return 0;
 }
 
 static int reduce_bitpool(struct impl *this)
 {
-	return set_bitpool(this, this->sbc.bitpool - 2);
+	/* lower the bitpool first, when we reach the minimum, make the
+	 * packets smaller */
+	if (this->sbc.bitpool > this->min_bitpool)
+		return set_bitpool(this, this->sbc.bitpool - 2);
+	return set_frames_per_packet(this, this->frames_per_packet - 1);
 }
 
 static int increase_bitpool(struct impl *this)
 {
+	/* undo in the reverse order */
+	if (this->frames_per_packet < this->max_frames_per_packet)
+		return set_frames_per_packet(this, this->frames_per_packet + 1);
 	return set_bitpool(this, this->sbc.bitpool + 1);
 }
 
+static void update_bitpool(struct impl *this, uint64_t now_time, bool congested)
+{
+	int64_t packet_time, high, low;
+
+	packet_time = (int64_t) this->max_frames_per_packet * (this->codesize / this->frame_size) *
+		SPA_NSEC_PER_SEC / this->current_format.info.raw.rate;
+	high = CTL_QUEUE_HIGH * packet_time;
+	low = packet_time / 2;
+
+	spa_log_trace(this->log, "a2dp-sink %p: queue %ld write %ld congested %d",
+			this, this->queue_time, this->write_time, congested);
+
+	if (congested || this->queue_time > high) {
+		this->good_since = now_time;
+		/* only wait for the hold time when the queue is still bounded */
+		if (now_time - this->last_change > CTL_DOWN_HOLD ||
+		    this->queue_time > CTL_QUEUE_MAX * packet_time) {
+			reduce_bitpool(this);
+			this->last_change = now_time;
+		}
+	}
+	else if (this->queue_time < low) {
+		if (now_time - this->good_since > CTL_UP_HOLD &&
+		    now_time - this->last_change > CTL_UP_HOLD) {
+			increase_bitpool(this);
+			this->last_change = now_time;
+			this->good_since = now_time;
+		}
+	}
+	else {
+		/* inside the hysteresis band, keep the current settings */
+		this->good_since = now_time;
+	}
+}
+
 static int flush_data(struct impl *this, uint64_t now_time)
 {
 	uint32_t total_frames, written;
@@ -560,6 +696,7 @@ static int flush_data(struct impl *this, uint64_t now_time)
 	written = flush_buffer(this, false);
 	if (written == -EAGAIN) {
 		spa_log_trace(this->log, "delay flush %ld", this->sample_time);
+		update_bitpool(this, now_time, true);
 		if ((this->flush_source.mask & SPA_IO_OUT) == 0) {
 			this->flush_source.mask = SPA_IO_OUT;
 			spa_loop_update_source(this->data_loop, &this->flush_source);
@@ -573,10 +710,7 @@ static int flush_data(struct impl *this, uint64_t now_time)
 		return written;
 	}
 	else if (written > 0) {
-		if (now_time - this->last_error > SPA_NSEC_PER_SEC * 3) {
-			increase_bitpool(this);
-			this->last_error = now_time;
-		}
+		update_bitpool(this, now_time, false);
 	}
 
 	this->flush_source.mask = 0;
@@ -600,11 +734,8 @@ static int flush_data(struct impl *this, uint64_t now_time)
 			this->sample_time = queued;
 			this->start_time = now_time;
 		}
-		if (!spa_list_is_empty(&this->ready) &&
-		    now_time - this->last_error > SPA_NSEC_PER_SEC / 2) {
-			reduce_bitpool(this);
-			this->last_error = now_time;
-		}
+		if (!spa_list_is_empty(&this->ready))
+			update_bitpool(this, now_time, true);
 
 	}
 	calc_timeout(queued,
@@ -734,8 +865,14 @@ static int init_sbc(struct impl *this)
 	this->min_bitpool = SPA_MAX(conf->min_bitpool, 12);
 	this->max_bitpool = conf->max_bitpool;
 
+	this->frames_per_packet = 0;
 	set_bitpool(this, conf->max_bitpool);
 
+	this->queue_time = 0;
+	this->write_time = 0;
+	this->last_change = 0;
+	this->good_since = 0;
+
 	this->seqnum = 0;
 
         spa_log_debug(this->log, "a2dp-sink %p: codesize %d frame_length %d size %d:%d %d",
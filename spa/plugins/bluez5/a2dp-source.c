@@ -0,0 +1,1393 @@
+/* Spa A2DP Source
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <unistd.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include <spa/support/type-map.h>
+#include <spa/support/loop.h>
+#include <spa/support/log.h>
+#include <spa/utils/list.h>
+#include <spa/utils/ringbuffer.h>
+
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
+#include <spa/param/audio/format.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/pod/filter.h>
+
+#include <sbc/sbc.h>
+
+#include "defs.h"
+#include "rtp.h"
+#include "a2dp-codecs.h"
+
+struct props {
+	uint32_t min_latency;
+	uint32_t max_latency;
+};
+
+#define MAX_BUFFERS 32
+
+/* decoded samples, must be a power of 2 */
+#define RING_SIZE	(1u << 17)
+#define RING_MASK	(RING_SIZE - 1)
+
+/* maximum number of frames we produce per output buffer */
+#define MAX_QUANTUM	1024
+
+/* number of frames we produce per timer wakeup */
+#define PERIOD		512
+
+/* maximum clock correction, in parts per million */
+#define MAX_CORRECTION	5000
+
+/* time constant of the clock correction loop, in periods */
+#define LOOP_PERIODS	128
+
+struct buffer {
+	struct spa_buffer *outbuf;
+	struct spa_meta_header *h;
+	bool outstanding;
+	struct spa_list link;
+};
+
+struct type {
+	uint32_t node;
+	uint32_t format;
+	uint32_t props;
+	uint32_t prop_min_latency;
+	uint32_t prop_max_latency;
+	uint32_t prop_jitter;
+	uint32_t prop_target_latency;
+	uint32_t prop_rate_correction;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_audio media_subtype_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_event_node event_node;
+	struct spa_type_command_node command_node;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->prop_min_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__minLatency);
+	type->prop_max_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS__maxLatency);
+	type->prop_jitter = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "jitter");
+	type->prop_target_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "targetLatency");
+	type->prop_rate_correction = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "rateCorrection");
+
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_audio_map(map, &type->media_subtype_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_event_node_map(map, &type->event_node);
+	spa_type_command_node_map(map, &type->command_node);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
+}
+
+struct impl {
+	struct spa_handle handle;
+	struct spa_node node;
+
+	struct type type;
+	struct spa_type_map *map;
+	struct spa_log *log;
+	struct spa_loop *main_loop;
+	struct spa_loop *data_loop;
+
+	const struct spa_node_callbacks *callbacks;
+	void *callbacks_data;
+
+	struct props props;
+
+	struct spa_bt_transport *transport;
+
+	bool have_format;
+	struct spa_audio_info current_format;
+	int frame_size;
+
+	struct spa_port_info info;
+	struct spa_io_buffers *io;
+
+	struct buffer buffers[MAX_BUFFERS];
+	unsigned int n_buffers;
+
+	struct spa_list free;
+
+	bool started;
+	struct spa_source source;
+
+	/* the output is clocked by this timer, not by the packet arrival */
+	struct spa_source timer_source;
+	struct itimerspec timerspec;
+	uint64_t start_time;
+	uint64_t timer_frames;
+	uint32_t period;
+
+	sbc_t sbc;
+	uint8_t read_buffer[4096];
+	uint8_t decode_buffer[4096];
+
+	/* jitter buffer */
+	struct spa_ringbuffer ring;
+	uint8_t ring_data[RING_SIZE];
+	uint8_t resample_buffer[(MAX_QUANTUM * (1000000 + MAX_CORRECTION) / 1000000 + 2) * 4];
+	bool buffering;
+	bool have_packet;
+	uint16_t seqnum;
+	uint32_t timestamp;
+	uint64_t last_arrival;
+	uint32_t last_samples;
+	int64_t jitter;
+	uint32_t target;
+
+	/* clock tracking */
+	double avg_error;
+	double drift;
+	double rate;
+	double phase;
+
+	uint64_t sample_count;
+	uint64_t lost;
+	uint64_t overrun;
+	uint64_t underrun;
+};
+
+#define NAME "a2dp-source"
+
+#define CHECK_PORT(this,d,p)    ((d) == SPA_DIRECTION_OUTPUT && (p) == 0)
+
+static const uint32_t default_min_latency = 1024;
+static const uint32_t default_max_latency = 8192;
+
+static void reset_props(struct props *props)
+{
+	props->min_latency = default_min_latency;
+	props->max_latency = default_max_latency;
+}
+
+static int impl_node_enum_params(struct spa_node *node,
+				 uint32_t id, uint32_t *index,
+				 const struct spa_pod *filter,
+				 struct spa_pod **result,
+				 struct spa_pod_builder *builder)
+{
+	struct impl *this;
+	struct type *t;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+	spa_return_val_if_fail(builder != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		struct props *p = &this->props;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_min_latency,
+				":", t->param.propName, "s", "The minimum latency",
+				":", t->param.propType, "ir", p->min_latency,
+					SPA_POD_PROP_MIN_MAX(1, RING_SIZE / 4));
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_max_latency,
+				":", t->param.propName, "s", "The maximum latency",
+				":", t->param.propType, "ir", p->max_latency,
+					SPA_POD_PROP_MIN_MAX(1, RING_SIZE / 4));
+			break;
+		case 2:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_jitter,
+				":", t->param.propName, "s", "The packet arrival jitter in usec",
+				":", t->param.propType, "i-r", (int) (this->jitter / SPA_NSEC_PER_USEC));
+			break;
+		case 3:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_target_latency,
+				":", t->param.propName, "s", "The jitter buffer target in samples",
+				":", t->param.propType, "i-r", this->target);
+			break;
+		case 4:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_rate_correction,
+				":", t->param.propName, "s", "The clock correction",
+				":", t->param.propType, "d-r", this->rate);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->props,
+				":", t->prop_min_latency,     "i",   p->min_latency,
+				":", t->prop_max_latency,     "i",   p->max_latency,
+				":", t->prop_jitter,          "i-r", (int) (this->jitter / SPA_NSEC_PER_USEC),
+				":", t->prop_target_latency,  "i-r", this->target,
+				":", t->prop_rate_correction, "d-r", this->rate);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
+}
+
+static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
+			       const struct spa_pod *param)
+{
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
+		if (param == NULL) {
+			reset_props(p);
+			return 0;
+		}
+		spa_pod_object_parse(param,
+			":", t->prop_min_latency, "?i", &p->min_latency,
+			":", t->prop_max_latency, "?i", &p->max_latency, NULL);
+	}
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static void reset_jitter_buffer(struct impl *this)
+{
+	spa_ringbuffer_init(&this->ring);
+	this->buffering = true;
+	this->have_packet = false;
+	this->jitter = 0;
+	this->target = this->props.min_latency;
+	this->avg_error = 0.0;
+	this->drift = 0.0;
+	this->rate = 1.0;
+	this->phase = 0.0;
+}
+
+static void write_ring(struct impl *this, const void *data, uint32_t size)
+{
+	uint32_t index;
+	int32_t filled;
+
+	filled = spa_ringbuffer_get_write_index(&this->ring, &index);
+	if (filled + size > RING_SIZE) {
+		uint32_t rindex;
+
+		/* drop the oldest samples to make room */
+		spa_ringbuffer_get_read_index(&this->ring, &rindex);
+		spa_ringbuffer_read_update(&this->ring, rindex + filled + size - RING_SIZE);
+		this->overrun++;
+	}
+	spa_ringbuffer_write_data(&this->ring, this->ring_data, RING_SIZE,
+				  index & RING_MASK, data, size);
+	spa_ringbuffer_write_update(&this->ring, index + size);
+}
+
+static void write_silence(struct impl *this, uint32_t frames)
+{
+	uint32_t size = SPA_MIN(frames * this->frame_size, sizeof(this->decode_buffer));
+
+	memset(this->decode_buffer, 0, size);
+	while (frames > 0) {
+		uint32_t n = SPA_MIN(frames * this->frame_size, size);
+		write_ring(this, this->decode_buffer, n);
+		frames -= n / this->frame_size;
+	}
+}
+
+static int decode_packet(struct impl *this, const uint8_t *data, int size)
+{
+	int frames = 0;
+
+	while (size > 0) {
+		ssize_t processed;
+		size_t written;
+
+		processed = sbc_decode(&this->sbc, data, size,
+				       this->decode_buffer, sizeof(this->decode_buffer),
+				       &written);
+		if (processed <= 0) {
+			spa_log_warn(this->log, NAME " %p: decode error %zd", this, processed);
+			break;
+		}
+		write_ring(this, this->decode_buffer, written);
+
+		frames += written / this->frame_size;
+		data += processed;
+		size -= processed;
+	}
+	return frames;
+}
+
+/* update the interarrival jitter as in RFC 3550, section 6.4.1 and derive
+ * the jitter buffer target from it */
+static void update_jitter(struct impl *this, uint64_t now_time, uint32_t timestamp, uint32_t samples)
+{
+	uint32_t rate = this->current_format.info.raw.rate;
+	int64_t d;
+
+	d = (int64_t) (now_time - this->last_arrival) -
+		(int64_t) (int32_t) (timestamp - this->timestamp) * SPA_NSEC_PER_SEC / rate;
+	if (d < 0)
+		d = -d;
+
+	this->jitter += (d - this->jitter) / 16;
+
+	/* a packet, the frames we take out in one period and a margin for the
+	 * jitter */
+	this->target = samples + this->period + 4 * this->jitter * rate / SPA_NSEC_PER_SEC;
+	this->target = SPA_CLAMP(this->target, this->props.min_latency, this->props.max_latency);
+}
+
+/* a critically damped PI loop on the fill level, called once per period.
+ * The integral term follows the clock drift of the remote device, the
+ * proportional term moves the fill level back to the target */
+static void update_rate(struct impl *this, int32_t filled)
+{
+	double error, corr, max = MAX_CORRECTION / 1000000.0;
+
+	/* a positive error means the remote clock runs faster than ours and
+	 * we need to consume more */
+	error = (double) filled - this->target;
+	this->avg_error += (error - this->avg_error) * 0.05;
+
+	this->drift += this->avg_error / (4.0 * LOOP_PERIODS * LOOP_PERIODS * this->period);
+	this->drift = SPA_CLAMP(this->drift, -max, max);
+
+	corr = this->drift + this->avg_error / ((double) LOOP_PERIODS * this->period);
+	corr = SPA_CLAMP(corr, -max, max);
+
+	this->rate = 1.0 + corr;
+}
+
+static void resample(struct impl *this, int16_t *dst, uint32_t out_frames, uint32_t *in_frames)
+{
+	int16_t *src = (int16_t *) this->resample_buffer;
+	int i, c, channels = this->current_format.info.raw.channels;
+	double pos;
+
+	for (i = 0; i < out_frames; i++) {
+		int idx;
+		double frac;
+
+		pos = this->phase + i * this->rate;
+		idx = (int) pos;
+		frac = pos - idx;
+
+		for (c = 0; c < channels; c++) {
+			int16_t s0 = src[idx * channels + c];
+			int16_t s1 = src[(idx + 1) * channels + c];
+			dst[i * channels + c] = lrint(s0 + (s1 - s0) * frac);
+		}
+	}
+	pos = this->phase + out_frames * this->rate;
+	*in_frames = (uint32_t) pos;
+	this->phase = pos - *in_frames;
+}
+
+/* make a buffer of \a frames from the jitter buffer, silence is produced
+ * while the jitter buffer is filling up */
+static int push_frames(struct impl *this, uint32_t frames)
+{
+	struct spa_io_buffers *io = this->io;
+	struct buffer *b;
+	struct spa_data *d;
+	uint32_t index, out_frames, in_frames, need = 0;
+	int32_t filled;
+
+	if (spa_list_is_empty(&this->free)) {
+		spa_log_trace(this->log, NAME " %p: no more buffers", this);
+		return -EPIPE;
+	}
+
+	b = spa_list_first(&this->free, struct buffer, link);
+	d = b->outbuf->datas;
+
+	out_frames = SPA_MIN(frames, d[0].maxsize / this->frame_size);
+	out_frames = SPA_MIN(out_frames, MAX_QUANTUM);
+
+	filled = spa_ringbuffer_get_read_index(&this->ring, &index) / this->frame_size;
+
+	if (!this->buffering) {
+		update_rate(this, filled);
+
+		need = (uint32_t) ceil(this->phase + out_frames * this->rate) + 1;
+		if (need > filled) {
+			spa_log_debug(this->log, NAME " %p: underrun %d < %d", this, filled, need);
+			this->underrun++;
+			this->buffering = true;
+		}
+	}
+
+	spa_list_remove(&b->link);
+
+	if (this->buffering) {
+		memset(d[0].data, 0, out_frames * this->frame_size);
+		in_frames = 0;
+	} else {
+		spa_ringbuffer_read_data(&this->ring, this->ring_data, RING_SIZE,
+					 index & RING_MASK, this->resample_buffer,
+					 need * this->frame_size);
+		resample(this, d[0].data, out_frames, &in_frames);
+		spa_ringbuffer_read_update(&this->ring, index + in_frames * this->frame_size);
+	}
+
+	if (b->h) {
+		b->h->seq = this->sample_count;
+		b->h->pts = this->start_time + this->timer_frames * SPA_NSEC_PER_SEC /
+			this->current_format.info.raw.rate;
+		b->h->dts_offset = 0;
+	}
+	this->sample_count += out_frames;
+
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = out_frames * this->frame_size;
+	d[0].chunk->stride = this->frame_size;
+
+	spa_log_trace(this->log, NAME " %p: output %u frames, consumed %u, rate %f",
+			this, out_frames, in_frames, this->rate);
+
+	b->outstanding = true;
+	io->buffer_id = b->outbuf->id;
+	io->status = SPA_STATUS_HAVE_BUFFER;
+
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+static int handle_packet(struct impl *this, uint64_t now_time, const uint8_t *data, int size)
+{
+	struct rtp_header *header;
+	struct rtp_payload *payload;
+	uint32_t timestamp, samples;
+	uint16_t seqnum;
+	int32_t gap, filled;
+	uint32_t index;
+	int frames;
+
+	if (size < sizeof(struct rtp_header) + sizeof(struct rtp_payload))
+		return -EINVAL;
+
+	header = (struct rtp_header *) data;
+	payload = (struct rtp_payload *) (data + sizeof(struct rtp_header));
+
+	if (header->v != 2)
+		return -EINVAL;
+
+	seqnum = ntohs(header->sequence_number);
+	timestamp = ntohl(header->timestamp);
+
+	if (this->have_packet) {
+		gap = (int32_t) (timestamp - (this->timestamp + this->last_samples));
+		if (gap < 0) {
+			spa_log_debug(this->log, NAME " %p: late packet %u", this, seqnum);
+			return 0;
+		}
+		if (seqnum != (uint16_t) (this->seqnum + 1)) {
+			spa_log_debug(this->log, NAME " %p: lost %d packets",
+					this, (uint16_t) (seqnum - this->seqnum - 1));
+			this->lost += (uint16_t) (seqnum - this->seqnum - 1);
+		}
+		if (gap > 0)
+			write_silence(this, SPA_MIN(gap, this->props.max_latency));
+	}
+
+	data += sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+	size -= sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+
+	frames = decode_packet(this, data, size);
+	samples = frames;
+
+	if (this->have_packet)
+		update_jitter(this, now_time, timestamp, samples);
+
+	this->have_packet = true;
+	this->seqnum = seqnum;
+	this->timestamp = timestamp;
+	this->last_arrival = now_time;
+	this->last_samples = samples;
+
+	filled = spa_ringbuffer_get_read_index(&this->ring, &index) / this->frame_size;
+
+	spa_log_trace(this->log, NAME " %p: packet %u %u frames %d filled %d target %u jitter %ld",
+			this, seqnum, timestamp, payload->frame_count, filled, this->target,
+			this->jitter);
+
+	if (filled > this->props.max_latency + this->target) {
+		/* way too much data, skip ahead to the target */
+		spa_ringbuffer_read_update(&this->ring,
+				index + (filled - this->target) * this->frame_size);
+		this->overrun++;
+		filled = this->target;
+	}
+
+	if (this->buffering && filled >= this->target) {
+		spa_log_debug(this->log, NAME " %p: buffering done %d", this, filled);
+		this->buffering = false;
+	}
+	return 0;
+}
+
+static void set_timer(struct impl *this, bool enabled)
+{
+	if (enabled) {
+		uint64_t next_time = this->start_time + this->timer_frames * SPA_NSEC_PER_SEC /
+			this->current_format.info.raw.rate;
+		this->timerspec.it_value.tv_sec = next_time / SPA_NSEC_PER_SEC;
+		this->timerspec.it_value.tv_nsec = next_time % SPA_NSEC_PER_SEC;
+	} else {
+		this->timerspec.it_value.tv_sec = 0;
+		this->timerspec.it_value.tv_nsec = 0;
+	}
+	timerfd_settime(this->timer_source.fd, TFD_TIMER_ABSTIME, &this->timerspec, NULL);
+}
+
+static void a2dp_on_timer(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	uint64_t expirations;
+
+	if (read(this->timer_source.fd, &expirations, sizeof(uint64_t)) != sizeof(uint64_t))
+		spa_log_warn(this->log, NAME " %p: error reading timerfd: %m", this);
+
+	if (this->io == NULL || this->io->status == SPA_STATUS_HAVE_BUFFER)
+		spa_log_trace(this->log, NAME " %p: previous buffer not consumed", this);
+	else if (push_frames(this, this->period) == SPA_STATUS_HAVE_BUFFER)
+		this->callbacks->have_output(this->callbacks_data);
+
+	this->timer_frames += this->period;
+	set_timer(this, true);
+}
+
+static void a2dp_on_ready_read(struct spa_source *source)
+{
+	struct impl *this = source->data;
+	struct timespec now;
+	int size;
+
+	if (source->rmask & (SPA_IO_ERR | SPA_IO_HUP)) {
+		spa_log_error(this->log, NAME " %p: transport error %d", this, source->rmask);
+		spa_loop_remove_source(this->data_loop, &this->source);
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	while (true) {
+		size = read(this->transport->fd, this->read_buffer, sizeof(this->read_buffer));
+		if (size < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				spa_log_error(this->log, NAME " %p: read error %m", this);
+			return;
+		}
+		break;
+	}
+
+	if (size == 0) {
+		spa_log_warn(this->log, NAME " %p: transport closed", this);
+		spa_loop_remove_source(this->data_loop, &this->source);
+		return;
+	}
+
+	handle_packet(this, SPA_TIMESPEC_TO_TIME(&now), this->read_buffer, size);
+}
+
+static int do_start(struct impl *this)
+{
+	int res, val;
+	struct timespec now;
+
+	if (this->started)
+		return 0;
+
+	spa_log_trace(this->log, NAME " %p: start", this);
+
+	if ((res = this->transport->acquire(this->transport, false)) < 0)
+		return res;
+
+	sbc_init(&this->sbc, 0);
+	this->sbc.endian = SBC_LE;
+
+	val = 6;
+	if (setsockopt(this->transport->fd, SOL_SOCKET, SO_PRIORITY, &val, sizeof(val)) < 0)
+		spa_log_warn(this->log, "SO_PRIORITY failed: %m");
+
+	reset_jitter_buffer(this);
+
+	this->period = SPA_MIN(PERIOD, this->buffers[0].outbuf->datas[0].maxsize / this->frame_size);
+	this->timer_frames = this->period;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	this->start_time = SPA_TIMESPEC_TO_TIME(&now);
+
+	this->source.data = this;
+	this->source.fd = this->transport->fd;
+	this->source.func = a2dp_on_ready_read;
+	this->source.mask = SPA_IO_IN;
+	this->source.rmask = 0;
+	spa_loop_add_source(this->data_loop, &this->source);
+
+	spa_loop_add_source(this->data_loop, &this->timer_source);
+	set_timer(this, true);
+
+	this->started = true;
+
+	return 0;
+}
+
+static int do_remove_source(struct spa_loop *loop,
+			    bool async,
+			    uint32_t seq,
+			    const void *data,
+			    size_t size,
+			    void *user_data)
+{
+	struct impl *this = user_data;
+
+	if (this->source.loop)
+		spa_loop_remove_source(this->data_loop, &this->source);
+	set_timer(this, false);
+	spa_loop_remove_source(this->data_loop, &this->timer_source);
+
+	return 0;
+}
+
+static int do_stop(struct impl *this)
+{
+	int res;
+
+	if (!this->started)
+		return 0;
+
+	spa_log_trace(this->log, NAME " %p: stop", this);
+
+	spa_loop_invoke(this->data_loop, do_remove_source, 0, NULL, 0, true, this);
+
+	this->started = false;
+
+	sbc_finish(&this->sbc);
+
+	res = this->transport->release(this->transport);
+
+	return res;
+}
+
+static int impl_node_send_command(struct spa_node *node, const struct spa_command *command)
+{
+	struct impl *this;
+	int res;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(command != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (SPA_COMMAND_TYPE(command) == this->type.command_node.Start) {
+		if (!this->have_format)
+			return -EIO;
+		if (this->n_buffers == 0)
+			return -EIO;
+
+		if ((res = do_start(this)) < 0)
+			return res;
+
+	} else if (SPA_COMMAND_TYPE(command) == this->type.command_node.Pause) {
+		if ((res = do_stop(this)) < 0)
+			return res;
+	} else
+		return -ENOTSUP;
+
+	return 0;
+}
+
+static int
+impl_node_set_callbacks(struct spa_node *node,
+			const struct spa_node_callbacks *callbacks,
+			void *data)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	this->callbacks = callbacks;
+	this->callbacks_data = data;
+
+	return 0;
+}
+
+static int
+impl_node_get_n_ports(struct spa_node *node,
+		      uint32_t *n_input_ports,
+		      uint32_t *max_input_ports,
+		      uint32_t *n_output_ports,
+		      uint32_t *max_output_ports)
+{
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	if (n_input_ports)
+		*n_input_ports = 0;
+	if (max_input_ports)
+		*max_input_ports = 0;
+	if (n_output_ports)
+		*n_output_ports = 1;
+	if (max_output_ports)
+		*max_output_ports = 1;
+
+	return 0;
+}
+
+static int
+impl_node_get_port_ids(struct spa_node *node,
+		       uint32_t *input_ids,
+		       uint32_t n_input_ids,
+		       uint32_t *output_ids,
+		       uint32_t n_output_ids)
+{
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	if (n_output_ids > 0 && output_ids != NULL)
+		output_ids[0] = 0;
+
+	return 0;
+}
+
+
+static int impl_node_add_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_remove_port(struct spa_node *node, enum spa_direction direction, uint32_t port_id)
+{
+	return -ENOTSUP;
+}
+
+static int
+impl_node_port_get_info(struct spa_node *node,
+			enum spa_direction direction, uint32_t port_id, const struct spa_port_info **info)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	*info = &this->info;
+
+	return 0;
+}
+
+static int
+impl_node_port_enum_params(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t id, uint32_t *index,
+			   const struct spa_pod *filter,
+			   struct spa_pod **result,
+			   struct spa_pod_builder *builder)
+{
+
+	struct impl *this;
+	struct type *t;
+	struct spa_pod *param;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+	spa_return_val_if_fail(builder != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idEnumFormat,
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idEnumFormat) {
+		if (*index > 0)
+			return 0;
+
+		if (this->transport->codec == 0) {
+			a2dp_sbc_t *config = this->transport->configuration;
+			int rate, channels;
+
+			if ((rate = a2dp_sbc_get_frequency(config)) < 0)
+				return -EIO;
+			if ((channels = a2dp_sbc_get_channels(config)) < 0)
+				return -EIO;
+
+			param = spa_pod_builder_object(&b,
+				id, t->format,
+				"I", t->media_type.audio,
+				"I", t->media_subtype.raw,
+				":", t->format_audio.format,   "I", t->audio_format.S16,
+				":", t->format_audio.rate,     "i", rate,
+				":", t->format_audio.channels, "i", channels);
+		}
+		else
+			return -EIO;
+	}
+	else if (id == t->param.idFormat) {
+		if (!this->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		param = spa_pod_builder_object(&b,
+			id, t->format,
+			"I", t->media_type.audio,
+			"I", t->media_subtype.raw,
+			":", t->format_audio.format,   "I", this->current_format.info.raw.format,
+			":", t->format_audio.rate,     "i", this->current_format.info.raw.rate,
+			":", t->format_audio.channels, "i", this->current_format.info.raw.channels);
+	}
+	else if (id == t->param.idBuffers) {
+		if (!this->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		param = spa_pod_builder_object(&b,
+			id, t->param_buffers.Buffers,
+			":", t->param_buffers.size,    "iru", MAX_QUANTUM * this->frame_size,
+				SPA_POD_PROP_MIN_MAX(16 * this->frame_size,
+						     INT32_MAX / this->frame_size),
+			":", t->param_buffers.stride,  "i", 0,
+			":", t->param_buffers.buffers, "ir", 2,
+				SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+			":", t->param_buffers.align,   "i", 16);
+	}
+	else if (id == t->param.idMeta) {
+		if (!this->have_format)
+			return -EIO;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
+}
+
+static int clear_buffers(struct impl *this)
+{
+	do_stop(this);
+	if (this->n_buffers > 0) {
+		spa_list_init(&this->free);
+		this->n_buffers = 0;
+	}
+	return 0;
+}
+
+static int port_set_format(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t flags,
+			   const struct spa_pod *format)
+{
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	int err;
+
+	if (format == NULL) {
+		spa_log_info(this->log, "clear format");
+		clear_buffers(this);
+		this->have_format = false;
+	} else {
+		struct spa_audio_info info = { 0 };
+
+		if ((err = spa_pod_object_parse(format,
+			"I", &info.media_type,
+			"I", &info.media_subtype)) < 0)
+			return err;
+
+		if (info.media_type != this->type.media_type.audio ||
+		    info.media_subtype != this->type.media_subtype.raw)
+			return -EINVAL;
+
+		if (spa_format_audio_raw_parse(format, &info.info.raw, &this->type.format_audio) < 0)
+			return -EINVAL;
+
+		if (info.info.raw.format != this->type.audio_format.S16 ||
+		    info.info.raw.channels < 1 || info.info.raw.channels > 2)
+			return -EINVAL;
+
+		this->frame_size = info.info.raw.channels * 2;
+		this->current_format = info;
+		this->have_format = true;
+	}
+
+	if (this->have_format) {
+		this->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS | SPA_PORT_INFO_FLAG_LIVE;
+		this->info.rate = this->current_format.info.raw.rate;
+	}
+
+	return 0;
+}
+
+static int
+impl_node_port_set_param(struct spa_node *node,
+			 enum spa_direction direction, uint32_t port_id,
+			 uint32_t id, uint32_t flags,
+			 const struct spa_pod *param)
+{
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	if (id == t->param.idFormat) {
+		return port_set_format(node, direction, port_id, flags, param);
+	}
+	else
+		return -ENOENT;
+}
+
+static int
+impl_node_port_use_buffers(struct spa_node *node,
+			   enum spa_direction direction,
+			   uint32_t port_id, struct spa_buffer **buffers, uint32_t n_buffers)
+{
+	struct impl *this;
+	int i;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	spa_log_info(this->log, "use buffers %d", n_buffers);
+
+	if (!this->have_format)
+		return -EIO;
+
+	clear_buffers(this);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &this->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->outbuf = buffers[i];
+		b->outstanding = false;
+
+		b->h = spa_buffer_find_meta(b->outbuf, this->type.meta.Header);
+
+		if (!((d[0].type == this->type.data.MemFd ||
+		       d[0].type == this->type.data.DmaBuf ||
+		       d[0].type == this->type.data.MemPtr) && d[0].data != NULL)) {
+			spa_log_error(this->log, NAME " %p: need mapped memory", this);
+			return -EINVAL;
+		}
+		spa_list_append(&this->free, &b->link);
+	}
+	this->n_buffers = n_buffers;
+
+	return 0;
+}
+
+static int
+impl_node_port_alloc_buffers(struct spa_node *node,
+			     enum spa_direction direction,
+			     uint32_t port_id,
+			     struct spa_pod **params,
+			     uint32_t n_params,
+			     struct spa_buffer **buffers,
+			     uint32_t *n_buffers)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(buffers != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	if (!this->have_format)
+		return -EIO;
+
+	return -ENOTSUP;
+}
+
+static int
+impl_node_port_set_io(struct spa_node *node,
+		      enum spa_direction direction,
+		      uint32_t port_id,
+		      uint32_t id,
+		      void *data, size_t size)
+{
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	spa_return_val_if_fail(CHECK_PORT(this, direction, port_id), -EINVAL);
+
+	if (id == t->io.Buffers)
+		this->io = data;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static void recycle_buffer(struct impl *this, uint32_t buffer_id)
+{
+	struct buffer *b = &this->buffers[buffer_id];
+
+	spa_return_if_fail(b->outstanding);
+
+	spa_log_trace(this->log, NAME " %p: recycle buffer %u", this, buffer_id);
+
+	b->outstanding = false;
+	spa_list_append(&this->free, &b->link);
+}
+
+static int impl_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	spa_return_val_if_fail(port_id == 0, -EINVAL);
+
+	if (this->n_buffers == 0)
+		return -EIO;
+
+	if (buffer_id >= this->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, buffer_id);
+
+	return 0;
+}
+
+static int
+impl_node_port_send_command(struct spa_node *node,
+			    enum spa_direction direction, uint32_t port_id, const struct spa_command *command)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_process_input(struct spa_node *node)
+{
+	return -ENOTSUP;
+}
+
+static int impl_node_process_output(struct spa_node *node)
+{
+	struct impl *this;
+	struct spa_io_buffers *io;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	io = this->io;
+	spa_return_val_if_fail(io != NULL, -EIO);
+
+	if (io->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	if (io->buffer_id < this->n_buffers) {
+		recycle_buffer(this, io->buffer_id);
+		io->buffer_id = SPA_ID_INVALID;
+	}
+	return SPA_STATUS_OK;
+}
+
+static const struct spa_dict_item node_info_items[] = {
+	{ "media.class", "Audio/Source" },
+};
+
+static const struct spa_dict node_info = {
+	node_info_items,
+	SPA_N_ELEMENTS(node_info_items)
+};
+
+static const struct spa_node impl_node = {
+	SPA_VERSION_NODE,
+	&node_info,
+	impl_node_enum_params,
+	impl_node_set_param,
+	impl_node_send_command,
+	impl_node_set_callbacks,
+	impl_node_get_n_ports,
+	impl_node_get_port_ids,
+	impl_node_add_port,
+	impl_node_remove_port,
+	impl_node_port_get_info,
+	impl_node_port_enum_params,
+	impl_node_port_set_param,
+	impl_node_port_use_buffers,
+	impl_node_port_alloc_buffers,
+	impl_node_port_set_io,
+	impl_node_port_reuse_buffer,
+	impl_node_port_send_command,
+	impl_node_process_input,
+	impl_node_process_output,
+};
+
+static int impl_get_interface(struct spa_handle *handle, uint32_t interface_id, void **interface)
+{
+	struct impl *this;
+
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+	spa_return_val_if_fail(interface != NULL, -EINVAL);
+
+	this = (struct impl *) handle;
+
+	if (interface_id == this->type.node)
+		*interface = &this->node;
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static int impl_clear(struct spa_handle *handle)
+{
+	struct impl *this = (struct impl *) handle;
+
+	close(this->timer_source.fd);
+	return 0;
+}
+
+static int
+impl_init(const struct spa_handle_factory *factory,
+	  struct spa_handle *handle,
+	  const struct spa_dict *info,
+	  const struct spa_support *support,
+	  uint32_t n_support)
+{
+	struct impl *this;
+	uint32_t i;
+
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(handle != NULL, -EINVAL);
+
+	handle->get_interface = impl_get_interface;
+	handle->clear = impl_clear;
+
+	this = (struct impl *) handle;
+
+	for (i = 0; i < n_support; i++) {
+		if (strcmp(support[i].type, SPA_TYPE__TypeMap) == 0)
+			this->map = support[i].data;
+		else if (strcmp(support[i].type, SPA_TYPE__Log) == 0)
+			this->log = support[i].data;
+		else if (strcmp(support[i].type, SPA_TYPE_LOOP__DataLoop) == 0)
+			this->data_loop = support[i].data;
+		else if (strcmp(support[i].type, SPA_TYPE_LOOP__MainLoop) == 0)
+			this->main_loop = support[i].data;
+	}
+	if (this->map == NULL) {
+		spa_log_error(this->log, "a type-map is needed");
+		return -EINVAL;
+	}
+	if (this->data_loop == NULL) {
+		spa_log_error(this->log, "a data loop is needed");
+		return -EINVAL;
+	}
+	if (this->main_loop == NULL) {
+		spa_log_error(this->log, "a main loop is needed");
+		return -EINVAL;
+	}
+	init_type(&this->type, this->map);
+
+	this->node = impl_node;
+	reset_props(&this->props);
+
+	this->info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+
+	spa_list_init(&this->free);
+	reset_jitter_buffer(this);
+
+	this->timer_source.func = a2dp_on_timer;
+	this->timer_source.data = this;
+	this->timer_source.fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+	this->timer_source.mask = SPA_IO_IN;
+	this->timer_source.rmask = 0;
+
+	for (i = 0; info && i < info->n_items; i++) {
+		if (strcmp(info->items[i].key, "bluez5.transport") == 0)
+			sscanf(info->items[i].value, "%p", &this->transport);
+	}
+	if (this->transport == NULL) {
+		spa_log_error(this->log, "a transport is needed");
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static const struct spa_interface_info impl_interfaces[] = {
+	{SPA_TYPE__Node,},
+};
+
+static int
+impl_enum_interface_info(const struct spa_handle_factory *factory,
+			 const struct spa_interface_info **info, uint32_t *index)
+{
+	spa_return_val_if_fail(factory != NULL, -EINVAL);
+	spa_return_val_if_fail(info != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+
+	switch (*index) {
+	case 0:
+		*info = &impl_interfaces[*index];
+		break;
+	default:
+		return 0;
+	}
+	(*index)++;
+	return 1;
+}
+
+static const struct spa_dict_item info_items[] = {
+	{ "factory.author", "Wim Taymans <wim.taymans@gmail.com>" },
+	{ "factory.description", "Capture audio with the a2dp" },
+};
+
+static const struct spa_dict info = {
+	info_items,
+	SPA_N_ELEMENTS(info_items),
+};
+
+struct spa_handle_factory spa_a2dp_source_factory = {
+	SPA_VERSION_HANDLE_FACTORY,
+	NAME,
+	&info,
+	sizeof(struct impl),
+	impl_init,
+	impl_enum_interface_info,
+};
@@ -76,12 +76,21 @@ struct spa_bt_monitor {
 };
 
 struct spa_handle_factory spa_a2dp_sink_factory;
+struct spa_handle_factory spa_a2dp_source_factory;
 
 static void fill_item(struct spa_bt_monitor *this, struct spa_bt_transport *transport,
 		struct spa_pod **result, struct spa_pod_builder *builder)
 {
 	struct type *t = &this->type;
 	char trans[16];
+	const struct spa_handle_factory *factory;
+
+	/* the profile is the one of our endpoint, when we are the sink, the
+	 * remote device streams to us */
+	if (transport->profile == SPA_BT_PROFILE_A2DP_SINK)
+		factory = &spa_a2dp_source_factory;
+	else
+		factory = &spa_a2dp_sink_factory;
 
 	spa_pod_builder_add(builder,
 		"<", 0, t->monitor.MonitorItem,
@@ -90,7 +99,7 @@ static void fill_item(struct spa_bt_monitor *this, struct spa_bt_transport *tran
 		":", t->monitor.state,   "i", SPA_MONITOR_ITEM_STATE_AVAILABLE,
 		":", t->monitor.name,    "s", transport->path,
 		":", t->monitor.klass,   "s", "Adapter/Bluetooth",
-		":", t->monitor.factory, "p", t->handle_factory, &spa_a2dp_sink_factory,
+		":", t->monitor.factory, "p", t->handle_factory, factory,
 		":", t->monitor.info,    "[",
 		NULL);
 
@@ -937,6 +946,15 @@ static int register_a2dp_endpoint(struct spa_bt_monitor *monitor,
 			return -ENOTSUP;
 		}
 		break;
+	case SPA_BT_PROFILE_A2DP_SINK:
+		switch (codec) {
+		case A2DP_CODEC_SBC:
+			profile_path = "/A2DP/SBC/Sink";
+			break;
+		default:
+			return -ENOTSUP;
+		}
+		break;
 	default:
 		return -ENOTSUP;
 	}
@@ -1006,6 +1024,11 @@ static int adapter_register_endpoints(struct spa_bt_adapter *a)
 			       SPA_BT_PROFILE_A2DP_SOURCE,
 			       A2DP_CODEC_SBC,
 			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
+	register_a2dp_endpoint(monitor, a->path,
+			       SPA_BT_UUID_A2DP_SINK,
+			       SPA_BT_PROFILE_A2DP_SINK,
+			       A2DP_CODEC_SBC,
+			       &bluez_a2dp_sbc, sizeof(bluez_a2dp_sbc));
 	return 0;
 }
 
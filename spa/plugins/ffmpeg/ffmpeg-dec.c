@@ -19,58 +19,112 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <string.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 #include <spa/support/type-map.h>
 #include <spa/support/log.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
 #include <spa/param/video/format-utils.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
+#include <spa/param/props.h>
 #include <spa/pod/filter.h>
 
+#include "ffmpeg-utils.h"
+
+#define NAME "ffmpeg-dec"
+
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
 #define GET_OUT_PORT(this,p)		(&this->out_ports[p])
 #define GET_PORT(this,d,p)		(d == SPA_DIRECTION_INPUT ? GET_IN_PORT(this,p) : GET_OUT_PORT(this,p))
 
 #define MAX_BUFFERS    32
+#define FRAME_ALIGN    64
+
+struct props {
+	int threads;
+	int max_queued;
+};
+
+static void reset_props(struct props *props)
+{
+	props->threads = DEFAULT_THREADS;
+	props->max_queued = DEFAULT_MAX_QUEUED;
+}
+
+struct impl;
 
 struct buffer {
+	struct impl *impl;
 	struct spa_buffer *outbuf;
-	bool outstanding;
-	struct buffer *next;
+	struct spa_meta_header *h;
+	void *ptr;
+	size_t size;
+	/* one ref for libavcodec and one for the consumer, the buffer
+	 * goes back to the free list when both are released */
+	int refs;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+
+	struct spa_list empty;
 };
 
 struct type {
 	uint32_t node;
+	uint32_t format;
+	uint32_t props;
+	uint32_t prop_threads;
+	uint32_t prop_max_queued;
 	struct spa_type_io io;
 	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
 	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
 	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->prop_threads = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "threads");
+	type->prop_max_queued = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "maxQueued");
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
 	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
 	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
 }
 
 struct impl {
@@ -81,12 +135,31 @@ struct impl {
 	struct spa_type_map *map;
 	struct spa_log *log;
 
+	struct props props;
+
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	char name[128];		/**< the factory name, ffenc_<codec> or ffdec_<codec> */
+	AVCodec *codec;
+	AVCodecContext *context;
+	AVPacket *packet;
+	enum AVPixelFormat pix_fmt;
+
+	/* protects the free list of the output port, libavcodec can
+	 * release frames from its worker threads */
+	pthread_mutex_t lock;
+
+	/* decoded frames waiting to be pushed out */
+	AVFrame *queue[MAX_QUEUED];
+	uint32_t queue_head;
+	uint32_t n_queued;
+	uint32_t max_queued;
+	uint32_t seq;
+
 	bool started;
 };
 
@@ -96,14 +169,125 @@ static int spa_ffmpeg_dec_node_enum_params(struct spa_node *node,
 					   struct spa_pod **result,
 					   struct spa_pod_builder *builder)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct props *p;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+	spa_return_val_if_fail(builder != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+	p = &this->props;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_threads,
+				":", t->param.propName, "s", "Decoder threads, 0 is automatic",
+				":", t->param.propType, "ir", p->threads,
+					SPA_POD_PROP_MIN_MAX(0, 64));
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_max_queued,
+				":", t->param.propName, "s", "Maximum number of decoded frames in flight",
+				":", t->param.propType, "ir", p->max_queued,
+					SPA_POD_PROP_MIN_MAX(1, MAX_QUEUED));
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param.idProps) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->props,
+				":", t->prop_threads,    "i", p->threads,
+				":", t->prop_max_queued, "i", p->max_queued);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
 }
 
 static int spa_ffmpeg_dec_node_set_param(struct spa_node *node,
 					 uint32_t id, uint32_t flags,
 					 const struct spa_pod *param)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
+		if (param == NULL) {
+			reset_props(p);
+			return 0;
+		}
+		spa_pod_object_parse(param,
+			":", t->prop_threads,    "?i", &p->threads,
+			":", t->prop_max_queued, "?i", &p->max_queued, NULL);
+
+		p->max_queued = SPA_CLAMP(p->max_queued, 1, MAX_QUEUED);
+	}
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static void clear_queue(struct impl *this)
+{
+	while (this->n_queued > 0) {
+		av_frame_free(&this->queue[this->queue_head]);
+		this->queue_head = (this->queue_head + 1) % MAX_QUEUED;
+		this->n_queued--;
+	}
+	this->queue_head = 0;
+}
+
+static void close_codec(struct impl *this)
+{
+	clear_queue(this);
+	if (this->context)
+		avcodec_free_context(&this->context);
 }
 
 static int spa_ffmpeg_dec_node_send_command(struct spa_node *node, const struct spa_command *command)
@@ -229,22 +413,46 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	//struct impl *this;
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
+	struct port *in_port = GET_IN_PORT(this, 0);
+	enum AVPixelFormat pix_fmt;
+	uint32_t subtype;
 
-	if (node == NULL || index == NULL)
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	//this = SPA_CONTAINER_OF (node, struct impl, node);
+	if (direction == SPA_DIRECTION_INPUT) {
+		if (*index > 0)
+			return 0;
 
-	if (!IS_VALID_PORT(this, direction, port_id))
-		return -EINVAL;
+		subtype = ffmpeg_codec_id_to_media_subtype(&t->media_subtype_video, this->codec->id);
+		if (subtype == SPA_ID_INVALID)
+			return 0;
 
-	switch (*index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
-		return 0;
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.video,
+			"I", subtype);
+	} else {
+		struct spa_video_info_mjpg *info = &in_port->current_format.info.mjpg;
+
+		/* the raw size follows from the stream */
+		if (!in_port->have_format)
+			return -EIO;
+
+		if ((pix_fmt = ffmpeg_codec_pix_fmt(this->codec, &t->video_format, *index)) ==
+		    AV_PIX_FMT_NONE)
+			return 0;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I",
+				ffmpeg_pix_fmt_to_video_format(&t->video_format, pix_fmt),
+			":", t->format_video.size,      "R", &info->size,
+			":", t->format_video.framerate, "F", &info->framerate);
 	}
 	return 1;
 }
@@ -257,6 +465,7 @@ static int port_get_format(struct spa_node *node,
 			   struct spa_pod_builder *builder)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
 	struct port *port;
 
 	port = GET_PORT(this, direction, port_id);
@@ -267,11 +476,50 @@ static int port_get_format(struct spa_node *node,
 	if (*index > 0)
 		return 0;
 
-	*param = NULL;
-
+	if (direction == SPA_DIRECTION_INPUT) {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", port->current_format.media_type,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.size,      "R", &port->current_format.info.mjpg.size,
+			":", t->format_video.framerate, "F", &port->current_format.info.mjpg.framerate);
+	} else {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I", port->current_format.info.raw.format,
+			":", t->format_video.size,      "R", &port->current_format.info.raw.size,
+			":", t->format_video.framerate, "F", &port->current_format.info.raw.framerate);
+	}
 	return 1;
 }
 
+/* layout of a frame as we place it in an output buffer, the planes are
+ * packed with the padded height libavcodec wants to write to */
+static int frame_layout(struct impl *this, int width, int height,
+			int linesize[4], int *padded_height, size_t *size)
+{
+	int i, res, w = width, h = height;
+	int stride_align[AV_NUM_DATA_POINTERS];
+	uint8_t *data[4];
+
+	if (this->context)
+		avcodec_align_dimensions2(this->context, &w, &h, stride_align);
+
+	if ((res = av_image_fill_linesizes(linesize, this->pix_fmt, w)) < 0)
+		return res;
+	for (i = 0; i < 4; i++)
+		linesize[i] = SPA_ROUND_UP_N(linesize[i], FRAME_ALIGN);
+
+	if ((res = av_image_fill_pointers(data, this->pix_fmt, h, NULL, linesize)) < 0)
+		return res;
+
+	*padded_height = h;
+	*size = res + FRAME_ALIGN;
+	return 0;
+}
+
 static int
 spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 				     enum spa_direction direction, uint32_t port_id,
@@ -285,14 +533,22 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct port *port;
 	int res;
 
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	port = GET_PORT(this, direction, port_id);
+
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
 		uint32_t list[] = { t->param.idEnumFormat,
-				    t->param.idFormat };
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -308,6 +564,55 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
+	else if (id == t->param.idBuffers) {
+		struct spa_rectangle *size = &port->current_format.info.raw.size;
+		int linesize[4], height;
+		size_t frame_size;
+
+		if (!port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i", 512 * 1024,
+				":", t->param_buffers.stride,  "i", 0,
+				":", t->param_buffers.buffers, "iru", 4,
+					SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
+				":", t->param_buffers.align,   "i", 16);
+		} else {
+			if ((res = frame_layout(this, size->width, size->height,
+						linesize, &height, &frame_size)) < 0)
+				return -EINVAL;
+
+			/* libavcodec keeps reference frames and queued frames
+			 * around, make room for those */
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i", frame_size,
+				":", t->param_buffers.stride,  "i", linesize[0],
+				":", t->param_buffers.buffers, "iru", 8 + this->props.max_queued,
+					SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+				":", t->param_buffers.align,   "i", FRAME_ALIGN);
+		}
+	}
+	else if (id == t->param.idMeta) {
+		if (!port->have_format)
+			return -EIO;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -319,6 +624,44 @@ spa_ffmpeg_dec_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static int get_buffer(AVCodecContext *context, AVFrame *frame, int flags);
+
+static int open_codec(struct impl *this, struct spa_video_info *info)
+{
+	struct spa_video_info_mjpg *i = &info->info.mjpg;
+	int res;
+
+	close_codec(this);
+
+	if ((this->context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	this->context->opaque = this;
+	this->context->width = i->size.width;
+	this->context->height = i->size.height;
+	if (i->framerate.num > 0) {
+		this->context->framerate.num = i->framerate.num;
+		this->context->framerate.den = i->framerate.denom;
+	}
+	this->context->thread_count = this->props.threads;
+	this->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+	this->context->get_buffer2 = get_buffer;
+
+	if ((res = avcodec_open2(this->context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %s", this,
+				this->codec->name, av_err2str(res));
+		avcodec_free_context(&this->context);
+		return -EIO;
+	}
+	this->max_queued = this->props.max_queued;
+
+	spa_log_info(this->log, NAME " %p: opened %s with %d threads (type %d)", this,
+			this->codec->name, this->context->thread_count,
+			this->context->active_thread_type);
+
+	return 0;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags,
@@ -326,11 +669,14 @@ static int port_set_format(struct spa_node *node,
 {
 	struct impl *this;
 	struct port *port;
+	struct type *t;
+	int res;
 
-	if (node == NULL || format == NULL)
+	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
 
 	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
@@ -339,6 +685,8 @@ static int port_set_format(struct spa_node *node,
 
 	if (format == NULL) {
 		port->have_format = false;
+		if (direction == SPA_DIRECTION_INPUT)
+			close_codec(this);
 		return 0;
 	} else {
 		struct spa_video_info info = { 0 };
@@ -347,14 +695,37 @@ static int port_set_format(struct spa_node *node,
 			"I", &info.media_type,
 			"I", &info.media_subtype);
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (info.media_type != t->media_type.video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype !=
+			    ffmpeg_codec_id_to_media_subtype(&t->media_subtype_video, this->codec->id))
+				return -EINVAL;
+
+			/* all encoded formats share the size and framerate layout */
+			if (spa_format_video_mjpg_parse(format, &info.info.mjpg, &t->format_video) < 0)
+				return -EINVAL;
+		} else {
+			if (info.media_subtype != t->media_subtype.raw)
+				return -EINVAL;
+
+			if (spa_format_video_raw_parse(format, &info.info.raw, &t->format_video) < 0)
+				return -EINVAL;
+
+			if (ffmpeg_video_format_to_pix_fmt(&t->video_format,
+							   info.info.raw.format) == AV_PIX_FMT_NONE)
+				return -EINVAL;
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
+			if (direction == SPA_DIRECTION_INPUT) {
+				if ((res = open_codec(this, &info)) < 0)
+					return res;
+			} else {
+				this->pix_fmt = ffmpeg_video_format_to_pix_fmt(&t->video_format,
+								info.info.raw.format);
+			}
 			port->current_format = info;
 			port->have_format = true;
 		}
@@ -378,6 +749,24 @@ spa_ffmpeg_dec_node_port_set_param(struct spa_node *node,
 		return -ENOENT;
 }
 
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		if (port == GET_OUT_PORT(this, 0)) {
+			/* drop the frames that could still point into the buffers */
+			clear_queue(this);
+			if (this->context)
+				avcodec_flush_buffers(this->context);
+		}
+		pthread_mutex_lock(&this->lock);
+		port->n_buffers = 0;
+		spa_list_init(&port->empty);
+		pthread_mutex_unlock(&this->lock);
+	}
+	return 0;
+}
+
 static int
 spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
@@ -385,13 +774,53 @@ spa_ffmpeg_dec_node_port_use_buffers(struct spa_node *node,
 				     struct spa_buffer **buffers,
 				     uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	pthread_mutex_lock(&this->lock);
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->impl = this;
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+
+		if ((d[0].type == this->type.data.MemPtr ||
+		     d[0].type == this->type.data.MemFd ||
+		     d[0].type == this->type.data.DmaBuf) && d[0].data != NULL) {
+			b->ptr = d[0].data;
+			b->size = d[0].maxsize;
+		} else {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+				      buffers[i]);
+			pthread_mutex_unlock(&this->lock);
+			return -EINVAL;
+		}
+		b->refs = 0;
+		if (direction == SPA_DIRECTION_OUTPUT)
+			spa_list_append(&port->empty, &b->link);
+	}
+	port->n_buffers = n_buffers;
+	pthread_mutex_unlock(&this->lock);
+
+	return 0;
 }
 
 static int
@@ -436,46 +865,322 @@ spa_ffmpeg_dec_node_port_set_io(struct spa_node *node,
 	return 0;
 }
 
+static struct buffer *dequeue_buffer(struct impl *this)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = NULL;
+
+	pthread_mutex_lock(&this->lock);
+	if (!spa_list_is_empty(&port->empty)) {
+		b = spa_list_first(&port->empty, struct buffer, link);
+		spa_list_remove(&b->link);
+		b->refs = 1;
+	}
+	pthread_mutex_unlock(&this->lock);
+
+	return b;
+}
+
+static void release_buffer(struct impl *this, struct buffer *b)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+
+	pthread_mutex_lock(&this->lock);
+	if (b->refs == 0)
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, b->outbuf->id);
+	else if (--b->refs == 0)
+		spa_list_append(&port->empty, &b->link);
+	pthread_mutex_unlock(&this->lock);
+}
+
+static void frame_buffer_free(void *opaque, uint8_t *data)
+{
+	struct buffer *b = opaque;
+	release_buffer(b->impl, b);
+}
+
+/* Let the decoder write straight into a free output buffer. This is only
+ * done when the padded frame has the same layout as a packed frame so that
+ * consumers can find the planes from the stride alone, otherwise, or when
+ * no buffer is free, the default allocator is used and the frame is copied
+ * out later. */
+static int get_buffer(AVCodecContext *context, AVFrame *frame, int flags)
+{
+	struct impl *this = context->opaque;
+	struct buffer *b;
+	int linesize[4], height, i;
+	uint8_t *data[4];
+	size_t size;
+
+	if (!(this->codec->capabilities & AV_CODEC_CAP_DR1) ||
+	    !GET_OUT_PORT(this, 0)->have_format ||
+	    frame->format != this->pix_fmt ||
+	    frame_layout(this, frame->width, frame->height, linesize, &height, &size) < 0 ||
+	    height != frame->height)
+		goto fallback;
+
+	if ((b = dequeue_buffer(this)) == NULL)
+		goto fallback;
+
+	if (size > b->size ||
+	    av_image_fill_pointers(data, this->pix_fmt, height,
+				   (uint8_t *) SPA_ROUND_UP_N((uintptr_t) b->ptr, FRAME_ALIGN), linesize) < 0)
+		goto release;
+
+	if ((frame->buf[0] = av_buffer_create(b->ptr, b->size, frame_buffer_free, b, 0)) == NULL)
+		goto release;
+
+	for (i = 0; i < 4; i++) {
+		frame->data[i] = data[i];
+		frame->linesize[i] = linesize[i];
+	}
+	frame->extended_data = frame->data;
+
+	return 0;
+
+      release:
+	release_buffer(this, b);
+      fallback:
+	return avcodec_default_get_buffer2(context, frame, flags);
+}
+
+static struct buffer *frame_get_buffer(struct impl *this, AVFrame *frame)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	uint32_t i;
+
+	if (frame->buf[0] == NULL || frame->buf[1] != NULL)
+		return NULL;
+
+	for (i = 0; i < port->n_buffers; i++) {
+		if (port->buffers[i].ptr == frame->buf[0]->data)
+			return &port->buffers[i];
+	}
+	return NULL;
+}
+
+/* hand the oldest decoded frame to the output port */
+static int push_frame(struct impl *this, struct spa_io_buffers *output)
+{
+	AVFrame *frame;
+	struct buffer *b;
+	struct spa_data *d;
+	uint8_t *data[4];
+	int stride, res;
+
+	if (this->n_queued == 0)
+		return SPA_STATUS_NEED_BUFFER;
+
+	frame = this->queue[this->queue_head];
+
+	if ((b = frame_get_buffer(this, frame)) != NULL) {
+		/* decoded in place, add a ref for the consumer */
+		pthread_mutex_lock(&this->lock);
+		b->refs++;
+		pthread_mutex_unlock(&this->lock);
+
+		d = b->outbuf->datas;
+		d[0].chunk->offset = frame->data[0] - (uint8_t *) b->ptr;
+		d[0].chunk->size = av_image_fill_pointers(data, frame->format,
+				frame->height, NULL, frame->linesize);
+		d[0].chunk->stride = frame->linesize[0];
+	} else {
+		if ((b = dequeue_buffer(this)) == NULL)
+			return SPA_STATUS_OK;
+
+		d = b->outbuf->datas;
+		stride = av_image_get_linesize(frame->format, frame->width, 0);
+		res = av_image_copy_to_buffer(b->ptr, b->size,
+				(const uint8_t * const *) frame->data, frame->linesize,
+				frame->format, frame->width, frame->height, 1);
+		if (res < 0) {
+			spa_log_error(this->log, NAME " %p: can't copy frame: %s", this,
+					av_err2str(res));
+			release_buffer(this, b);
+			res = -EIO;
+			goto done;
+		}
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = res;
+		d[0].chunk->stride = stride;
+	}
+
+	if (b->h) {
+		b->h->seq = this->seq++;
+		b->h->pts = frame->best_effort_timestamp;
+		b->h->dts_offset = 0;
+		b->h->flags = frame->key_frame ? 0 : SPA_META_HEADER_FLAG_DELTA_UNIT;
+	}
+	output->buffer_id = b->outbuf->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+	res = SPA_STATUS_HAVE_BUFFER;
+
+      done:
+	av_frame_free(&this->queue[this->queue_head]);
+	this->queue_head = (this->queue_head + 1) % MAX_QUEUED;
+	this->n_queued--;
+
+	return res;
+}
+
+/* collect decoded frames as long as there is room in the queue */
+static int receive_frames(struct impl *this)
+{
+	AVFrame *frame;
+	int res;
+
+	while (this->n_queued < this->max_queued) {
+		if ((frame = av_frame_alloc()) == NULL)
+			return -ENOMEM;
+
+		if ((res = avcodec_receive_frame(this->context, frame)) < 0) {
+			av_frame_free(&frame);
+			if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+				return 0;
+			spa_log_warn(this->log, NAME " %p: decode error: %s", this, av_err2str(res));
+			return -EIO;
+		}
+		this->queue[(this->queue_head + this->n_queued) % MAX_QUEUED] = frame;
+		this->n_queued++;
+	}
+	return 0;
+}
+
 static int spa_ffmpeg_dec_node_process_input(struct spa_node *node)
 {
-	return -EINVAL;
+	struct impl *this;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+	struct buffer *b;
+	struct spa_data *d;
+	AVPacket *pkt;
+	int res;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	out_port = GET_OUT_PORT(this, 0);
+	if ((output = out_port->io) == NULL)
+		return -EIO;
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	in_port = GET_IN_PORT(this, 0);
+	if ((input = in_port->io) == NULL)
+		return -EIO;
+
+	if (this->context == NULL || !out_port->have_format) {
+		input->status = -EIO;
+		return -EIO;
+	}
+	if (input->buffer_id >= in_port->n_buffers) {
+		input->status = -EINVAL;
+		return -EINVAL;
+	}
+
+	/* make room in the decoder before feeding it */
+	if ((res = receive_frames(this)) < 0)
+		return res;
+
+	if (input->status == SPA_STATUS_HAVE_BUFFER) {
+		b = &in_port->buffers[input->buffer_id];
+		d = b->outbuf->datas;
+
+		pkt = this->packet;
+		/* the packet is not refcounted, libavcodec makes a padded copy
+		 * so that the input buffer can be recycled right away */
+		pkt->data = SPA_MEMBER(b->ptr, d[0].chunk->offset, uint8_t);
+		pkt->size = SPA_MIN(d[0].chunk->size, d[0].maxsize - d[0].chunk->offset);
+		pkt->pts = b->h ? (int64_t) b->h->pts : AV_NOPTS_VALUE;
+
+		res = avcodec_send_packet(this->context, pkt);
+		if (res == 0) {
+			input->status = SPA_STATUS_OK;
+			if ((res = receive_frames(this)) < 0)
+				return res;
+		} else if (res != AVERROR(EAGAIN)) {
+			/* drop the packet and carry on with the next one */
+			spa_log_warn(this->log, NAME " %p: can't decode packet: %s", this,
+					av_err2str(res));
+			input->status = SPA_STATUS_OK;
+		}
+		/* on EAGAIN the queue is full, keep the packet until frames
+		 * have been pushed out */
+	}
+
+	return push_frame(this, output);
 }
 
 static int spa_ffmpeg_dec_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+	int res;
 
 	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	port = &this->out_ports[0];
-
-	if ((output = port->io) == NULL)
+	out_port = GET_OUT_PORT(this, 0);
+	if ((output = out_port->io) == NULL)
 		return -EIO;
 
-	if (!port->have_format) {
+	if (!out_port->have_format) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	/* recycle */
+	if (output->buffer_id < out_port->n_buffers) {
+		release_buffer(this, &out_port->buffers[output->buffer_id]);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (this->context && (res = receive_frames(this)) < 0)
+		return res;
+
+	if ((res = push_frame(this, output)) == SPA_STATUS_HAVE_BUFFER)
+		return res;
 
-	return SPA_STATUS_OK;
+	in_port = GET_IN_PORT(this, 0);
+	if ((input = in_port->io) == NULL)
+		return -EIO;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER)
+		input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
 }
 
 static int
 spa_ffmpeg_dec_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
 {
+	struct impl *this;
+	struct port *port;
+
 	if (node == NULL)
 		return -EINVAL;
 
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
 	if (port_id != 0)
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	release_buffer(this, &port->buffers[buffer_id]);
+
+	return 0;
 }
 
 static int
@@ -529,8 +1234,31 @@ spa_ffmpeg_dec_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return 0;
 }
 
+static int spa_ffmpeg_dec_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return -EINVAL;
+
+	this = (struct impl *) handle;
+
+	/* frames still held by the codec release into our buffers */
+	close_codec(this);
+	av_packet_free(&this->packet);
+	pthread_mutex_destroy(&this->lock);
+
+	return 0;
+}
+
+size_t spa_ffmpeg_dec_get_size(void)
+{
+	return sizeof(struct impl);
+}
+
 int
-spa_ffmpeg_dec_init(struct spa_handle *handle,
+spa_ffmpeg_dec_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
 		    const struct spa_support *support,
 		    uint32_t n_support)
@@ -539,6 +1267,7 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	uint32_t i;
 
 	handle->get_interface = spa_ffmpeg_dec_get_interface;
+	handle->clear = spa_ffmpeg_dec_clear;
 
 	this = (struct impl *) handle;
 
@@ -554,10 +1283,26 @@ spa_ffmpeg_dec_init(struct spa_handle *handle,
 	}
 	init_type(&this->type, this->map);
 
-	this->node = ffmpeg_dec_node;
+	/* factory names are ffdec_<codec> */
+	snprintf(this->name, sizeof(this->name), "%s", factory->name);
+	if ((this->codec = avcodec_find_decoder_by_name(this->name + 6)) == NULL) {
+		spa_log_error(this->log, NAME " %p: unknown decoder %s", this, this->name);
+		return -ENOENT;
+	}
+	if ((this->packet = av_packet_alloc()) == NULL)
+		return -ENOMEM;
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	pthread_mutex_init(&this->lock, NULL);
+
+	this->node = ffmpeg_dec_node;
+	reset_props(&this->props);
+	this->max_queued = this->props.max_queued;
+	this->pix_fmt = AV_PIX_FMT_NONE;
+
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->in_ports[0].empty);
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->out_ports[0].empty);
 
 	return 0;
 }
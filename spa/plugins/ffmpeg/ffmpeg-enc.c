@@ -19,17 +19,26 @@
 
 #include <errno.h>
 #include <stddef.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
+#include <string.h>
 
 #include <spa/support/log.h>
 #include <spa/support/type-map.h>
+#include <spa/support/plugin.h>
+#include <spa/utils/list.h>
 #include <spa/node/node.h>
 #include <spa/node/io.h>
+#include <spa/buffer/buffer.h>
 #include <spa/param/video/format-utils.h>
+#include <spa/param/buffers.h>
+#include <spa/param/meta.h>
+#include <spa/param/props.h>
 #include <spa/pod/filter.h>
 
+#include <libavutil/mathematics.h>
+
+#include "ffmpeg-utils.h"
+
+#define NAME "ffmpeg-enc"
 
 #define IS_VALID_PORT(this,d,id)	((id) == 0)
 #define GET_IN_PORT(this,p)		(&this->in_ports[p])
@@ -38,44 +47,78 @@
 
 #define MAX_BUFFERS    32
 
+#define NSEC_TIME_BASE	(AVRational) { 1, SPA_NSEC_PER_SEC }
+
+struct props {
+	int threads;
+	int max_queued;
+};
+
+static void reset_props(struct props *props)
+{
+	props->threads = DEFAULT_THREADS;
+	props->max_queued = DEFAULT_MAX_QUEUED;
+}
+
 struct buffer {
-	struct spa_buffer buffer;
-	struct spa_meta metas[1];
-	struct spa_meta_header header;
-	struct spa_data datas[1];
-	struct spa_buffer *imported;
+	struct spa_buffer *outbuf;
+	struct spa_meta_header *h;
+	void *ptr;
+	size_t size;
 	bool outstanding;
-	struct buffer *next;
+	struct spa_list link;
 };
 
 struct port {
 	bool have_format;
 	struct spa_video_info current_format;
-	bool have_buffers;
 	struct buffer buffers[MAX_BUFFERS];
+	uint32_t n_buffers;
 	struct spa_port_info info;
 	struct spa_io_buffers *io;
+
+	struct spa_list empty;
 };
 
 struct type {
 	uint32_t node;
+	uint32_t format;
+	uint32_t props;
+	uint32_t prop_threads;
+	uint32_t prop_max_queued;
 	struct spa_type_io io;
 	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
 	struct spa_type_media_type media_type;
 	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_video media_subtype_video;
 	struct spa_type_format_video format_video;
+	struct spa_type_video_format video_format;
 	struct spa_type_command_node command_node;
+	struct spa_type_param_buffers param_buffers;
+	struct spa_type_param_meta param_meta;
 };
 
 static inline void init_type(struct type *type, struct spa_type_map *map)
 {
 	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->prop_threads = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "threads");
+	type->prop_max_queued = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "maxQueued");
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
 	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_media_subtype_video_map(map, &type->media_subtype_video);
 	spa_type_format_video_map(map, &type->format_video);
+	spa_type_video_format_map(map, &type->video_format);
 	spa_type_command_node_map(map, &type->command_node);
+	spa_type_param_buffers_map(map, &type->param_buffers);
+	spa_type_param_meta_map(map, &type->param_meta);
 }
 
 struct impl {
@@ -86,28 +129,154 @@ struct impl {
 	struct spa_type_map *map;
 	struct spa_log *log;
 
+	struct props props;
+
 	const struct spa_node_callbacks *callbacks;
 	void *user_data;
 
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	char name[128];		/**< the factory name, ffenc_<codec> or ffdec_<codec> */
+	AVCodec *codec;
+	AVCodecContext *context;
+	enum AVPixelFormat pix_fmt;
+
+	/* encoded packets waiting to be pushed out */
+	AVPacket *queue[MAX_QUEUED];
+	uint32_t queue_head;
+	uint32_t n_queued;
+	uint32_t max_queued;
+	uint32_t seq;
+
 	bool started;
 };
 
 static int spa_ffmpeg_enc_node_enum_params(struct spa_node *node,
 					   uint32_t id, uint32_t *index,
 					   const struct spa_pod *filter,
-					   struct spa_pod **param,
+					   struct spa_pod **result,
 					   struct spa_pod_builder *builder)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+	struct spa_pod *param;
+	struct props *p;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+	spa_return_val_if_fail(index != NULL, -EINVAL);
+	spa_return_val_if_fail(builder != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+	p = &this->props;
+
+      next:
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+
+	if (id == t->param.idList) {
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
+			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_threads,
+				":", t->param.propName, "s", "Encoder threads, 0 is automatic",
+				":", t->param.propType, "ir", p->threads,
+					SPA_POD_PROP_MIN_MAX(0, 64));
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_max_queued,
+				":", t->param.propName, "s", "Maximum number of encoded packets in flight",
+				":", t->param.propType, "ir", p->max_queued,
+					SPA_POD_PROP_MIN_MAX(1, MAX_QUEUED));
+			break;
+		default:
+			return 0;
+		}
+	}
+	else if (id == t->param.idProps) {
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->props,
+				":", t->prop_threads,    "i", p->threads,
+				":", t->prop_max_queued, "i", p->max_queued);
+			break;
+		default:
+			return 0;
+		}
+	}
+	else
+		return -ENOENT;
+
+	(*index)++;
+
+	if (spa_pod_filter(builder, result, param, filter) < 0)
+		goto next;
+
+	return 1;
 }
 
-static int spa_ffmpeg_enc_node_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
+static int spa_ffmpeg_enc_node_set_param(struct spa_node *node,
+					 uint32_t id, uint32_t flags,
 					 const struct spa_pod *param)
 {
-	return -ENOTSUP;
+	struct impl *this;
+	struct type *t;
+
+	spa_return_val_if_fail(node != NULL, -EINVAL);
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
+		if (param == NULL) {
+			reset_props(p);
+			return 0;
+		}
+		spa_pod_object_parse(param,
+			":", t->prop_threads,    "?i", &p->threads,
+			":", t->prop_max_queued, "?i", &p->max_queued, NULL);
+
+		p->max_queued = SPA_CLAMP(p->max_queued, 1, MAX_QUEUED);
+	}
+	else
+		return -ENOENT;
+
+	return 0;
+}
+
+static void clear_queue(struct impl *this)
+{
+	while (this->n_queued > 0) {
+		av_packet_free(&this->queue[this->queue_head]);
+		this->queue_head = (this->queue_head + 1) % MAX_QUEUED;
+		this->n_queued--;
+	}
+	this->queue_head = 0;
+}
+
+static void close_codec(struct impl *this)
+{
+	clear_queue(this);
+	if (this->context)
+		avcodec_free_context(&this->context);
 }
 
 static int spa_ffmpeg_enc_node_send_command(struct spa_node *node, const struct spa_command *command)
@@ -230,17 +399,52 @@ static int port_enum_formats(struct spa_node *node,
 			     struct spa_pod **param,
 			     struct spa_pod_builder *builder)
 {
-	//struct impl *this = SPA_CONTAINER_OF (node, struct impl, node);
-	//struct port *port;
+	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
+	struct port *in_port = GET_IN_PORT(this, 0);
+	enum AVPixelFormat pix_fmt;
+	uint32_t subtype;
 
-	//port = GET_PORT(this, direction, port_id);
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
 
-	switch (*index) {
-	case 0:
-		*param = NULL;
-		break;
-	default:
-		return 0;
+	if (direction == SPA_DIRECTION_INPUT) {
+		if ((pix_fmt = ffmpeg_codec_pix_fmt(this->codec, &t->video_format, *index)) ==
+		    AV_PIX_FMT_NONE)
+			return 0;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I",
+				ffmpeg_pix_fmt_to_video_format(&t->video_format, pix_fmt),
+			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
+				SPA_POD_PROP_MIN_MAX(&SPA_RECTANGLE(16, 16),
+						     &SPA_RECTANGLE(8192, 8192)),
+			":", t->format_video.framerate, "Fru", &SPA_FRACTION(25,1),
+				SPA_POD_PROP_MIN_MAX(&SPA_FRACTION(1, 1),
+						     &SPA_FRACTION(INT32_MAX, 1)));
+	} else {
+		struct spa_video_info_raw *info = &in_port->current_format.info.raw;
+
+		/* the encoded size follows from the raw input */
+		if (!in_port->have_format)
+			return -EIO;
+
+		if (*index > 0)
+			return 0;
+
+		subtype = ffmpeg_codec_id_to_media_subtype(&t->media_subtype_video, this->codec->id);
+		if (subtype == SPA_ID_INVALID)
+			return 0;
+
+		*param = spa_pod_builder_object(builder,
+			t->param.idEnumFormat, t->format,
+			"I", t->media_type.video,
+			"I", subtype,
+			":", t->format_video.size,      "R", &info->size,
+			":", t->format_video.framerate, "F", &info->framerate);
 	}
 	return 1;
 }
@@ -253,6 +457,7 @@ static int port_get_format(struct spa_node *node,
 			   struct spa_pod_builder *builder)
 {
 	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct type *t = &this->type;
 	struct port *port;
 
 	port = GET_PORT(this, direction, port_id);
@@ -263,8 +468,22 @@ static int port_get_format(struct spa_node *node,
 	if (*index > 0)
 		return 0;
 
-	*param = NULL;
-
+	if (direction == SPA_DIRECTION_INPUT) {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", t->media_type.video,
+			"I", t->media_subtype.raw,
+			":", t->format_video.format,    "I", port->current_format.info.raw.format,
+			":", t->format_video.size,      "R", &port->current_format.info.raw.size,
+			":", t->format_video.framerate, "F", &port->current_format.info.raw.framerate);
+	} else {
+		*param = spa_pod_builder_object(builder,
+			t->param.idFormat, t->format,
+			"I", port->current_format.media_type,
+			"I", port->current_format.media_subtype,
+			":", t->format_video.size,      "R", &port->current_format.info.mjpg.size,
+			":", t->format_video.framerate, "F", &port->current_format.info.mjpg.framerate);
+	}
 	return 1;
 }
 
@@ -281,14 +500,23 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
 	struct spa_pod *param;
+	struct port *port, *in_port;
 	int res;
 
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
+
+	port = GET_PORT(this, direction, port_id);
+	in_port = GET_IN_PORT(this, 0);
+
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
 		uint32_t list[] = { t->param.idEnumFormat,
-				    t->param.idFormat };
+				    t->param.idFormat,
+				    t->param.idBuffers,
+				    t->param.idMeta };
 
 		if (*index < SPA_N_ELEMENTS(list))
 			param = spa_pod_builder_object(&b, id, t->param.List,
@@ -304,6 +532,56 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
+	else if (id == t->param.idBuffers) {
+		struct spa_rectangle *size = &in_port->current_format.info.raw.size;
+		int frame_size;
+
+		if (!port->have_format || !in_port->have_format)
+			return -EIO;
+		if (*index > 0)
+			return 0;
+
+		frame_size = av_image_get_buffer_size(this->pix_fmt, size->width, size->height, 1);
+		if (frame_size < 0)
+			return -EINVAL;
+
+		if (direction == SPA_DIRECTION_INPUT) {
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i", frame_size,
+				":", t->param_buffers.stride,  "i",
+					av_image_get_linesize(this->pix_fmt, size->width, 0),
+				":", t->param_buffers.buffers, "iru", 4,
+					SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
+				":", t->param_buffers.align,   "i", 16);
+		} else {
+			/* an encoded frame is not expected to be larger than
+			 * the raw frame plus some headers */
+			param = spa_pod_builder_object(&b,
+				id, t->param_buffers.Buffers,
+				":", t->param_buffers.size,    "i",
+					frame_size + AV_INPUT_BUFFER_MIN_SIZE,
+				":", t->param_buffers.stride,  "i", 0,
+				":", t->param_buffers.buffers, "iru", 2 + this->props.max_queued,
+					SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+				":", t->param_buffers.align,   "i", 16);
+		}
+	}
+	else if (id == t->param.idMeta) {
+		if (!port->have_format)
+			return -EIO;
+
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param_meta.Meta,
+				":", t->param_meta.type, "I", t->meta.Header,
+				":", t->param_meta.size, "i", sizeof(struct spa_meta_header));
+			break;
+		default:
+			return 0;
+		}
+	}
 	else
 		return -ENOENT;
 
@@ -315,35 +593,113 @@ spa_ffmpeg_enc_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+/* the codec can only be opened when both the raw input and the
+ * encoded output format are known */
+static int open_codec(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0);
+	struct spa_video_info_raw *i = &in_port->current_format.info.raw;
+	int res;
+
+	close_codec(this);
+
+	if ((this->context = avcodec_alloc_context3(this->codec)) == NULL)
+		return -ENOMEM;
+
+	this->context->opaque = this;
+	this->context->width = i->size.width;
+	this->context->height = i->size.height;
+	this->context->pix_fmt = this->pix_fmt;
+	if (i->framerate.num > 0) {
+		this->context->time_base.num = i->framerate.denom;
+		this->context->time_base.den = i->framerate.num;
+		this->context->framerate.num = i->framerate.num;
+		this->context->framerate.den = i->framerate.denom;
+	} else {
+		this->context->time_base.num = 1;
+		this->context->time_base.den = 25;
+	}
+	this->context->thread_count = this->props.threads;
+	this->context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+	if ((res = avcodec_open2(this->context, this->codec, NULL)) < 0) {
+		spa_log_error(this->log, NAME " %p: can't open codec %s: %s", this,
+				this->codec->name, av_err2str(res));
+		avcodec_free_context(&this->context);
+		return -EIO;
+	}
+	this->max_queued = this->props.max_queued;
+
+	spa_log_info(this->log, NAME " %p: opened %s with %d threads (type %d)", this,
+			this->codec->name, this->context->thread_count,
+			this->context->active_thread_type);
+
+	return 0;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags, const struct spa_pod *format)
 {
-	struct impl *this = SPA_CONTAINER_OF(node, struct impl, node);
+	struct impl *this;
 	struct port *port;
+	struct type *t;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+	t = &this->type;
+
+	if (!IS_VALID_PORT(this, direction, port_id))
+		return -EINVAL;
 
 	port = GET_PORT(this, direction, port_id);
 
 	if (format == NULL) {
 		port->have_format = false;
+		close_codec(this);
 		return 0;
 	} else {
 		struct spa_video_info info = { 0 };
+		enum AVPixelFormat pix_fmt = AV_PIX_FMT_NONE;
 
 		spa_pod_object_parse(format,
 			"I", &info.media_type,
 			"I", &info.media_subtype);
 
-		if (info.media_type != this->type.media_type.video &&
-		    info.media_subtype != this->type.media_subtype.raw)
+		if (info.media_type != t->media_type.video)
 			return -EINVAL;
 
-		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
-			return -EINVAL;
+		if (direction == SPA_DIRECTION_INPUT) {
+			if (info.media_subtype != t->media_subtype.raw)
+				return -EINVAL;
+
+			if (spa_format_video_raw_parse(format, &info.info.raw, &t->format_video) < 0)
+				return -EINVAL;
+
+			pix_fmt = ffmpeg_video_format_to_pix_fmt(&t->video_format, info.info.raw.format);
+			if (pix_fmt == AV_PIX_FMT_NONE)
+				return -EINVAL;
+		} else {
+			if (info.media_subtype !=
+			    ffmpeg_codec_id_to_media_subtype(&t->media_subtype_video, this->codec->id))
+				return -EINVAL;
+
+			/* all encoded formats share the size and framerate layout */
+			if (spa_format_video_mjpg_parse(format, &info.info.mjpg, &t->format_video) < 0)
+				return -EINVAL;
+		}
 
 		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
+			if (direction == SPA_DIRECTION_INPUT)
+				this->pix_fmt = pix_fmt;
 			port->current_format = info;
 			port->have_format = true;
+
+			if (GET_IN_PORT(this, 0)->have_format &&
+			    GET_OUT_PORT(this, 0)->have_format)
+				return open_codec(this);
 		}
 	}
 	return 0;
@@ -365,19 +721,65 @@ spa_ffmpeg_enc_node_port_set_param(struct spa_node *node,
 		return -ENOENT;
 }
 
+static int clear_buffers(struct impl *this, struct port *port)
+{
+	if (port->n_buffers > 0) {
+		spa_log_info(this->log, NAME " %p: clear buffers", this);
+		port->n_buffers = 0;
+		spa_list_init(&port->empty);
+	}
+	return 0;
+}
+
 static int
 spa_ffmpeg_enc_node_port_use_buffers(struct spa_node *node,
 				     enum spa_direction direction,
 				     uint32_t port_id,
 				     struct spa_buffer **buffers, uint32_t n_buffers)
 {
+	struct impl *this;
+	struct port *port;
+	uint32_t i;
+
 	if (node == NULL)
 		return -EINVAL;
 
-	if (!IS_VALID_PORT(node, direction, port_id))
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (!IS_VALID_PORT(this, direction, port_id))
 		return -EINVAL;
 
-	return -ENOTSUP;
+	port = GET_PORT(this, direction, port_id);
+
+	if (!port->have_format)
+		return -EIO;
+
+	clear_buffers(this, port);
+
+	for (i = 0; i < n_buffers; i++) {
+		struct buffer *b = &port->buffers[i];
+		struct spa_data *d = buffers[i]->datas;
+
+		b->outbuf = buffers[i];
+		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
+
+		if ((d[0].type == this->type.data.MemPtr ||
+		     d[0].type == this->type.data.MemFd ||
+		     d[0].type == this->type.data.DmaBuf) && d[0].data != NULL) {
+			b->ptr = d[0].data;
+			b->size = d[0].maxsize;
+		} else {
+			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
+				      buffers[i]);
+			return -EINVAL;
+		}
+		b->outstanding = false;
+		if (direction == SPA_DIRECTION_OUTPUT)
+			spa_list_append(&port->empty, &b->link);
+	}
+	port->n_buffers = n_buffers;
+
+	return 0;
 }
 
 static int
@@ -422,54 +824,296 @@ spa_ffmpeg_enc_node_port_set_io(struct spa_node *node,
 	return 0;
 }
 
-static int
-spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+static void recycle_buffer(struct impl *this, uint32_t id)
 {
-	if (node == NULL)
-		return -EINVAL;
+	struct port *port = GET_OUT_PORT(this, 0);
+	struct buffer *b = &port->buffers[id];
 
-	if (port_id != 0)
-		return -EINVAL;
+	if (!b->outstanding) {
+		spa_log_warn(this->log, NAME " %p: buffer %d not outstanding", this, id);
+		return;
+	}
 
-	return -ENOTSUP;
+	spa_list_append(&port->empty, &b->link);
+	b->outstanding = false;
+	spa_log_trace(this->log, NAME " %p: recycle buffer %d", this, id);
 }
 
-static int
-spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
-				      enum spa_direction direction,
-				      uint32_t port_id, const struct spa_command *command)
+static struct buffer *find_free_buffer(struct impl *this, struct port *port)
 {
-	return -ENOTSUP;
+	struct buffer *b;
+
+	if (spa_list_is_empty(&port->empty))
+		return NULL;
+
+	b = spa_list_first(&port->empty, struct buffer, link);
+	spa_list_remove(&b->link);
+	b->outstanding = true;
+
+	return b;
+}
+
+/* wrap the input buffer in a frame. The input buffer is recycled by
+ * upstream as soon as we return so the frame gets a copy that the encoder
+ * threads can hold on to. */
+static AVFrame *make_frame(struct impl *this, struct buffer *b)
+{
+	struct spa_video_info_raw *info = &GET_IN_PORT(this, 0)->current_format.info.raw;
+	struct spa_data *d = b->outbuf->datas;
+	uint8_t *src_data[4];
+	int i, src_linesize[4], stride;
+	AVFrame *frame;
+
+	if ((frame = av_frame_alloc()) == NULL)
+		return NULL;
+
+	frame->format = this->pix_fmt;
+	frame->width = info->size.width;
+	frame->height = info->size.height;
+	if (av_frame_get_buffer(frame, 32) < 0)
+		goto error;
+
+	if (av_image_fill_linesizes(src_linesize, this->pix_fmt, frame->width) < 0)
+		goto error;
+
+	/* scale the plane strides along with the stride of the first plane */
+	stride = d[0].chunk->stride;
+	if (stride > 0 && src_linesize[0] > 0 && stride != src_linesize[0]) {
+		for (i = 1; i < 4; i++)
+			src_linesize[i] = src_linesize[i] * stride / src_linesize[0];
+		src_linesize[0] = stride;
+	}
+	if (av_image_fill_pointers(src_data, this->pix_fmt, frame->height,
+				   SPA_MEMBER(b->ptr, d[0].chunk->offset, uint8_t),
+				   src_linesize) > (int) (d[0].maxsize - d[0].chunk->offset))
+		goto error;
+
+	av_image_copy(frame->data, frame->linesize,
+		      (const uint8_t **) src_data, src_linesize,
+		      this->pix_fmt, frame->width, frame->height);
+
+	/* the header has the time in nanoseconds, the codec counts in
+	 * time_base units */
+	frame->pts = b->h ? av_rescale_q(b->h->pts, NSEC_TIME_BASE, this->context->time_base) :
+		AV_NOPTS_VALUE;
+
+	return frame;
+
+      error:
+	av_frame_free(&frame);
+	return NULL;
+}
+
+/* collect encoded packets as long as there is room in the queue */
+static int receive_packets(struct impl *this)
+{
+	AVPacket *pkt;
+	int res;
+
+	while (this->n_queued < this->max_queued) {
+		if ((pkt = av_packet_alloc()) == NULL)
+			return -ENOMEM;
+
+		if ((res = avcodec_receive_packet(this->context, pkt)) < 0) {
+			av_packet_free(&pkt);
+			if (res == AVERROR(EAGAIN) || res == AVERROR_EOF)
+				return 0;
+			spa_log_warn(this->log, NAME " %p: encode error: %s", this, av_err2str(res));
+			return -EIO;
+		}
+		this->queue[(this->queue_head + this->n_queued) % MAX_QUEUED] = pkt;
+		this->n_queued++;
+	}
+	return 0;
+}
+
+/* hand the oldest encoded packet to the output port */
+static int push_packet(struct impl *this, struct spa_io_buffers *output)
+{
+	struct port *port = GET_OUT_PORT(this, 0);
+	AVPacket *pkt;
+	struct buffer *b;
+	struct spa_data *d;
+	int res;
+
+	if (this->n_queued == 0)
+		return SPA_STATUS_NEED_BUFFER;
+
+	if ((b = find_free_buffer(this, port)) == NULL)
+		return SPA_STATUS_OK;
+
+	pkt = this->queue[this->queue_head];
+	d = b->outbuf->datas;
+
+	if (pkt->size > (int) b->size) {
+		spa_log_warn(this->log, NAME " %p: packet of %d bytes too large", this, pkt->size);
+		recycle_buffer(this, b->outbuf->id);
+		res = SPA_STATUS_OK;
+		goto done;
+	}
+	memcpy(b->ptr, pkt->data, pkt->size);
+	d[0].chunk->offset = 0;
+	d[0].chunk->size = pkt->size;
+	d[0].chunk->stride = 0;
+
+	if (b->h) {
+		b->h->seq = this->seq++;
+		b->h->pts = pkt->pts != AV_NOPTS_VALUE ?
+			av_rescale_q(pkt->pts, this->context->time_base, NSEC_TIME_BASE) : -1;
+		b->h->dts_offset = pkt->pts != AV_NOPTS_VALUE && pkt->dts != AV_NOPTS_VALUE ?
+			av_rescale_q(pkt->dts - pkt->pts, this->context->time_base, NSEC_TIME_BASE) : 0;
+		b->h->flags = pkt->flags & AV_PKT_FLAG_KEY ? 0 : SPA_META_HEADER_FLAG_DELTA_UNIT;
+	}
+	output->buffer_id = b->outbuf->id;
+	output->status = SPA_STATUS_HAVE_BUFFER;
+	res = SPA_STATUS_HAVE_BUFFER;
+
+      done:
+	av_packet_free(&this->queue[this->queue_head]);
+	this->queue_head = (this->queue_head + 1) % MAX_QUEUED;
+	this->n_queued--;
+
+	return res;
 }
 
 static int spa_ffmpeg_enc_node_process_input(struct spa_node *node)
 {
-	return -EINVAL;
+	struct impl *this;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+	AVFrame *frame;
+	int res;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	out_port = GET_OUT_PORT(this, 0);
+	if ((output = out_port->io) == NULL)
+		return -EIO;
+
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
+
+	in_port = GET_IN_PORT(this, 0);
+	if ((input = in_port->io) == NULL)
+		return -EIO;
+
+	if (this->context == NULL) {
+		input->status = -EIO;
+		return -EIO;
+	}
+	if (input->buffer_id >= in_port->n_buffers) {
+		input->status = -EINVAL;
+		return -EINVAL;
+	}
+
+	/* make room in the encoder before feeding it */
+	if ((res = receive_packets(this)) < 0)
+		return res;
+
+	if (input->status == SPA_STATUS_HAVE_BUFFER) {
+		if ((frame = make_frame(this, &in_port->buffers[input->buffer_id])) == NULL) {
+			spa_log_warn(this->log, NAME " %p: invalid input buffer", this);
+			input->status = SPA_STATUS_OK;
+		} else {
+			res = avcodec_send_frame(this->context, frame);
+			if (res == 0) {
+				input->status = SPA_STATUS_OK;
+				if ((res = receive_packets(this)) < 0) {
+					av_frame_free(&frame);
+					return res;
+				}
+			} else if (res != AVERROR(EAGAIN)) {
+				spa_log_warn(this->log, NAME " %p: can't encode frame: %s", this,
+						av_err2str(res));
+				input->status = SPA_STATUS_OK;
+			}
+			/* on EAGAIN the queue is full, the frame is made again
+			 * from the pending input buffer later */
+			av_frame_free(&frame);
+		}
+	}
+
+	return push_packet(this, output);
 }
 
 static int spa_ffmpeg_enc_node_process_output(struct spa_node *node)
 {
 	struct impl *this;
-	struct port *port;
-	struct spa_io_buffers *output;
+	struct port *in_port, *out_port;
+	struct spa_io_buffers *input, *output;
+	int res;
 
 	if (node == NULL)
 		return -EINVAL;
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 
-	if ((output = this->out_ports[0].io) == NULL)
+	out_port = GET_OUT_PORT(this, 0);
+	if ((output = out_port->io) == NULL)
 		return -EIO;
 
-	port = &this->out_ports[0];
-
-	if (!port->have_format) {
+	if (!out_port->have_format) {
 		output->status = -EIO;
 		return -EIO;
 	}
-	output->status = SPA_STATUS_OK;
+	if (output->status == SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_HAVE_BUFFER;
 
-	return SPA_STATUS_OK;
+	/* recycle */
+	if (output->buffer_id < out_port->n_buffers) {
+		recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
+	if (this->context && (res = receive_packets(this)) < 0)
+		return res;
+
+	if ((res = push_packet(this, output)) == SPA_STATUS_HAVE_BUFFER)
+		return res;
+
+	in_port = GET_IN_PORT(this, 0);
+	if ((input = in_port->io) == NULL)
+		return -EIO;
+
+	if (input->status != SPA_STATUS_HAVE_BUFFER)
+		input->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_NEED_BUFFER;
+}
+
+static int
+spa_ffmpeg_enc_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id, uint32_t buffer_id)
+{
+	struct impl *this;
+	struct port *port;
+
+	if (node == NULL)
+		return -EINVAL;
+
+	this = SPA_CONTAINER_OF(node, struct impl, node);
+
+	if (port_id != 0)
+		return -EINVAL;
+
+	port = GET_OUT_PORT(this, port_id);
+
+	if (buffer_id >= port->n_buffers)
+		return -EINVAL;
+
+	recycle_buffer(this, buffer_id);
+
+	return 0;
+}
+
+static int
+spa_ffmpeg_enc_node_port_send_command(struct spa_node *node,
+				      enum spa_direction direction,
+				      uint32_t port_id, const struct spa_command *command)
+{
+	return -ENOTSUP;
 }
 
 static const struct spa_node ffmpeg_enc_node = {
@@ -513,15 +1157,36 @@ spa_ffmpeg_enc_get_interface(struct spa_handle *handle, uint32_t interface_id, v
 	return 0;
 }
 
+static int spa_ffmpeg_enc_clear(struct spa_handle *handle)
+{
+	struct impl *this;
+
+	if (handle == NULL)
+		return -EINVAL;
+
+	this = (struct impl *) handle;
+	close_codec(this);
+
+	return 0;
+}
+
+size_t spa_ffmpeg_enc_get_size(void)
+{
+	return sizeof(struct impl);
+}
+
 int
-spa_ffmpeg_enc_init(struct spa_handle *handle,
+spa_ffmpeg_enc_init(const struct spa_handle_factory *factory,
+		    struct spa_handle *handle,
 		    const struct spa_dict *info,
-		    const struct spa_support *support, uint32_t n_support)
+		    const struct spa_support *support,
+		    uint32_t n_support)
 {
 	struct impl *this;
 	uint32_t i;
 
 	handle->get_interface = spa_ffmpeg_enc_get_interface;
+	handle->clear = spa_ffmpeg_enc_clear;
 
 	this = (struct impl *) handle;
 
@@ -535,11 +1200,24 @@ spa_ffmpeg_enc_init(struct spa_handle *handle,
 		spa_log_error(this->log, "a type-map is needed");
 		return -EINVAL;
 	}
+	init_type(&this->type, this->map);
 
-	this->node = ffmpeg_enc_node;
+	/* factory names are ffenc_<codec> */
+	snprintf(this->name, sizeof(this->name), "%s", factory->name);
+	if ((this->codec = avcodec_find_encoder_by_name(this->name + 6)) == NULL) {
+		spa_log_error(this->log, NAME " %p: unknown encoder %s", this, this->name);
+		return -ENOENT;
+	}
 
-	this->in_ports[0].info.flags = 0;
-	this->out_ports[0].info.flags = 0;
+	this->node = ffmpeg_enc_node;
+	reset_props(&this->props);
+	this->max_queued = this->props.max_queued;
+	this->pix_fmt = AV_PIX_FMT_NONE;
+
+	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->in_ports[0].empty);
+	this->out_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS;
+	spa_list_init(&this->out_ports[0].empty);
 
 	return 0;
 }
@@ -0,0 +1,155 @@
+/* Spa FFMpeg support
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_FFMPEG_UTILS_H__
+#define __SPA_FFMPEG_UTILS_H__
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <libavcodec/avcodec.h>
+#include <libavutil/imgutils.h>
+
+#include <spa/param/format-utils.h>
+#include <spa/param/video/format-utils.h>
+
+#define DEFAULT_THREADS		0
+#define DEFAULT_MAX_QUEUED	4
+#define MAX_QUEUED		16
+
+#define FORMAT(f)	offsetof(struct spa_type_video_format, f)
+#define SUBTYPE(s)	offsetof(struct spa_type_media_subtype_video, s)
+
+static const struct {
+	enum AVPixelFormat pix_fmt;
+	size_t format;
+} ffmpeg_video_formats[] = {
+	{ AV_PIX_FMT_YUV420P, FORMAT(I420) },
+	{ AV_PIX_FMT_YUVJ420P, FORMAT(I420) },
+	{ AV_PIX_FMT_NV12, FORMAT(NV12) },
+	{ AV_PIX_FMT_NV21, FORMAT(NV21) },
+	{ AV_PIX_FMT_YUYV422, FORMAT(YUY2) },
+	{ AV_PIX_FMT_UYVY422, FORMAT(UYVY) },
+	{ AV_PIX_FMT_YUV411P, FORMAT(Y41B) },
+	{ AV_PIX_FMT_YUV422P, FORMAT(Y42B) },
+	{ AV_PIX_FMT_YUVJ422P, FORMAT(Y42B) },
+	{ AV_PIX_FMT_YUV444P, FORMAT(Y444) },
+	{ AV_PIX_FMT_YUVJ444P, FORMAT(Y444) },
+	{ AV_PIX_FMT_RGB24, FORMAT(RGB) },
+	{ AV_PIX_FMT_BGR24, FORMAT(BGR) },
+	{ AV_PIX_FMT_RGBA, FORMAT(RGBA) },
+	{ AV_PIX_FMT_BGRA, FORMAT(BGRA) },
+	{ AV_PIX_FMT_ARGB, FORMAT(ARGB) },
+	{ AV_PIX_FMT_ABGR, FORMAT(ABGR) },
+	{ AV_PIX_FMT_RGB0, FORMAT(RGBx) },
+	{ AV_PIX_FMT_BGR0, FORMAT(BGRx) },
+	{ AV_PIX_FMT_0RGB, FORMAT(xRGB) },
+	{ AV_PIX_FMT_0BGR, FORMAT(xBGR) },
+	{ AV_PIX_FMT_GRAY8, FORMAT(GRAY8) },
+};
+
+static const struct {
+	enum AVCodecID codec_id;
+	size_t subtype;
+} ffmpeg_video_codecs[] = {
+	{ AV_CODEC_ID_H264, SUBTYPE(h264) },
+	{ AV_CODEC_ID_MJPEG, SUBTYPE(mjpg) },
+	{ AV_CODEC_ID_DVVIDEO, SUBTYPE(dv) },
+	{ AV_CODEC_ID_H263, SUBTYPE(h263) },
+	{ AV_CODEC_ID_MPEG1VIDEO, SUBTYPE(mpeg1) },
+	{ AV_CODEC_ID_MPEG2VIDEO, SUBTYPE(mpeg2) },
+	{ AV_CODEC_ID_MPEG4, SUBTYPE(mpeg4) },
+	{ AV_CODEC_ID_VC1, SUBTYPE(vc1) },
+	{ AV_CODEC_ID_VP8, SUBTYPE(vp8) },
+	{ AV_CODEC_ID_VP9, SUBTYPE(vp9) },
+};
+
+#undef FORMAT
+#undef SUBTYPE
+
+static inline uint32_t
+ffmpeg_pix_fmt_to_video_format(struct spa_type_video_format *types, enum AVPixelFormat pix_fmt)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_video_formats); i++) {
+		if (ffmpeg_video_formats[i].pix_fmt == pix_fmt)
+			return *SPA_MEMBER(types, ffmpeg_video_formats[i].format, uint32_t);
+	}
+	return types->UNKNOWN;
+}
+
+static inline enum AVPixelFormat
+ffmpeg_video_format_to_pix_fmt(struct spa_type_video_format *types, uint32_t format)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_video_formats); i++) {
+		if (*SPA_MEMBER(types, ffmpeg_video_formats[i].format, uint32_t) == format)
+			return ffmpeg_video_formats[i].pix_fmt;
+	}
+	return AV_PIX_FMT_NONE;
+}
+
+static inline uint32_t
+ffmpeg_codec_id_to_media_subtype(struct spa_type_media_subtype_video *types, enum AVCodecID codec_id)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_video_codecs); i++) {
+		if (ffmpeg_video_codecs[i].codec_id == codec_id)
+			return *SPA_MEMBER(types, ffmpeg_video_codecs[i].subtype, uint32_t);
+	}
+	return SPA_ID_INVALID;
+}
+
+static inline bool ffmpeg_codec_is_supported(const AVCodec *codec)
+{
+	uint32_t i;
+
+	if (codec->type != AVMEDIA_TYPE_VIDEO)
+		return false;
+
+	for (i = 0; i < SPA_N_ELEMENTS(ffmpeg_video_codecs); i++) {
+		if (ffmpeg_video_codecs[i].codec_id == codec->id)
+			return true;
+	}
+	return false;
+}
+
+/* the raw formats a codec can produce or consume, index by index */
+static inline enum AVPixelFormat
+ffmpeg_codec_pix_fmt(const AVCodec *codec, struct spa_type_video_format *types, uint32_t index)
+{
+	const enum AVPixelFormat *p;
+	uint32_t i = 0;
+
+	if (codec->pix_fmts == NULL)
+		return index == 0 ? AV_PIX_FMT_YUV420P : AV_PIX_FMT_NONE;
+
+	for (p = codec->pix_fmts; *p != AV_PIX_FMT_NONE; p++) {
+		if (ffmpeg_pix_fmt_to_video_format(types, *p) == types->UNKNOWN)
+			continue;
+		if (i++ == index)
+			return *p;
+	}
+	return AV_PIX_FMT_NONE;
+}
+
+#endif /* __SPA_FFMPEG_UTILS_H__ */
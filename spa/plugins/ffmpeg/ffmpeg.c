@@ -19,6 +19,9 @@
 
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 
 #include <spa/support/plugin.h>
 #include <spa/node/node.h>
@@ -26,9 +29,15 @@
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 
-int spa_ffmpeg_dec_init(struct spa_handle *handle, const struct spa_dict *info,
+#include "ffmpeg-utils.h"
+
+size_t spa_ffmpeg_dec_get_size(void);
+int spa_ffmpeg_dec_init(const struct spa_handle_factory *factory,
+			struct spa_handle *handle, const struct spa_dict *info,
 			const struct spa_support *support, uint32_t n_support);
-int spa_ffmpeg_enc_init(struct spa_handle *handle, const struct spa_dict *info,
+size_t spa_ffmpeg_enc_get_size(void);
+int spa_ffmpeg_enc_init(const struct spa_handle_factory *factory,
+			struct spa_handle *handle, const struct spa_dict *info,
 			const struct spa_support *support, uint32_t n_support);
 
 static int
@@ -41,7 +50,7 @@ ffmpeg_dec_init(const struct spa_handle_factory *factory,
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_dec_init(handle, info, support, n_support);
+	return spa_ffmpeg_dec_init(factory, handle, info, support, n_support);
 }
 
 static int
@@ -54,7 +63,7 @@ ffmpeg_enc_init(const struct spa_handle_factory *factory,
 	if (factory == NULL || handle == NULL)
 		return -EINVAL;
 
-	return spa_ffmpeg_enc_init(handle, info, support, n_support);
+	return spa_ffmpeg_enc_init(factory, handle, info, support, n_support);
 }
 
 static const struct spa_interface_info ffmpeg_interfaces[] = {
@@ -77,39 +86,70 @@ ffmpeg_enum_interface_info(const struct spa_handle_factory *factory,
 	return 1;
 }
 
-int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t *index)
+/* the factories of the supported codecs, made once so that the factory
+ * and its name stay valid for as long as the plugin is loaded */
+struct ffmpeg_factory {
+	struct spa_handle_factory factory;
+	char name[128];
+};
+
+static struct ffmpeg_factory *factories;
+static uint32_t n_factories;
+static pthread_once_t factories_once = PTHREAD_ONCE_INIT;
+
+static void init_factories(void)
 {
-	static const AVCodec *c = NULL;
-	static int ci = 0;
-	static struct spa_handle_factory f;
-	static char name[128];
+	const AVCodec *c;
+	uint32_t n = 0;
 
 	av_register_all();
 
-	if (*index == 0) {
-		c = av_codec_next(NULL);
-		ci = 0;
+	for (c = av_codec_next(NULL); c; c = av_codec_next(c)) {
+		if (ffmpeg_codec_is_supported(c))
+			n++;
 	}
-	while (*index > ci && c) {
-		c = av_codec_next(c);
-		ci++;
+	if (n == 0 || (factories = calloc(n, sizeof(struct ffmpeg_factory))) == NULL)
+		return;
+
+	for (c = av_codec_next(NULL); c && n_factories < n; c = av_codec_next(c)) {
+		struct ffmpeg_factory *f = &factories[n_factories];
+
+		/* only expose the codecs we have formats for */
+		if (!ffmpeg_codec_is_supported(c))
+			continue;
+
+		if (av_codec_is_encoder(c)) {
+			struct spa_handle_factory enc = {
+				SPA_VERSION_HANDLE_FACTORY, f->name, NULL,
+				spa_ffmpeg_enc_get_size(), ffmpeg_enc_init, ffmpeg_enum_interface_info,
+			};
+			snprintf(f->name, sizeof(f->name), "ffenc_%s", c->name);
+			memcpy(&f->factory, &enc, sizeof(enc));
+		} else {
+			struct spa_handle_factory dec = {
+				SPA_VERSION_HANDLE_FACTORY, f->name, NULL,
+				spa_ffmpeg_dec_get_size(), ffmpeg_dec_init, ffmpeg_enum_interface_info,
+			};
+			snprintf(f->name, sizeof(f->name), "ffdec_%s", c->name);
+			memcpy(&f->factory, &dec, sizeof(dec));
+		}
+		n_factories++;
 	}
-	if (c == NULL)
-		return 0;
+}
 
-	if (av_codec_is_encoder(c)) {
-		snprintf(name, 128, "ffenc_%s", c->name);
-		f.init = ffmpeg_enc_init;
-	} else {
-		snprintf(name, 128, "ffdec_%s", c->name);
-		f.init = ffmpeg_dec_init;
-	}
-	f.name = name;
-	f.info = NULL;
-	f.enum_interface_info = ffmpeg_enum_interface_info;
+static void __attribute__((destructor)) clear_factories(void)
+{
+	free(factories);
+}
+
+int spa_handle_factory_enum(const struct spa_handle_factory **factory, uint32_t *index)
+{
+	pthread_once(&factories_once, init_factories);
+
+	if (*index >= n_factories)
+		return 0;
 
-	*factory = &f;
-	(*index)++;
+	*factory = &factories[(*index)++].factory;
 
 	return 1;
 }
@@ -28,7 +28,7 @@
 #include <spa/support/log.h>
 #include <spa/support/loop.h>
 #include <spa/support/plugin.h>
-#include <spa/utils/ringbuffer.h>
+#include <spa/utils/ringbuffer-mp.h>
 
 #define NAME "logger"
 
@@ -52,7 +52,7 @@ struct impl {
 	struct type type;
 	struct spa_type_map *map;
 
-	struct spa_ringbuffer trace_rb;
+	struct spa_ringbuffer_mp trace_rb;
 	uint8_t trace_data[TRACE_BUFFER];
 
 	bool have_source;
@@ -84,11 +84,19 @@ impl_log_logv(struct spa_log *log,
 	if (SPA_UNLIKELY(do_trace)) {
 		uint32_t index;
 		uint64_t count = 1;
+		int32_t filled;
 
-		spa_ringbuffer_get_write_index(&impl->trace_rb, &index);
-		spa_ringbuffer_write_data(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
-					  index & (TRACE_BUFFER - 1), location, size);
-		spa_ringbuffer_write_update(&impl->trace_rb, index + size);
+		/* traces can come from any thread, drop them when the reader
+		 * can't keep up instead of overwriting the unread ones */
+		do {
+			filled = spa_ringbuffer_mp_get_write_index(&impl->trace_rb, &index);
+			if (filled + size > TRACE_BUFFER)
+				return;
+		} while (!spa_ringbuffer_mp_write_reserve(&impl->trace_rb, index, size));
+
+		spa_ringbuffer_mp_write_data(&impl->trace_rb, impl->trace_data, TRACE_BUFFER,
+					     index & (TRACE_BUFFER - 1), location, size);
+		spa_ringbuffer_mp_write_update(&impl->trace_rb, index, size);
 
 		if (write(impl->source.fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
 			fprintf(stderr, "error signaling eventfd: %s\n", strerror(errno));
@@ -121,13 +129,12 @@ static void on_trace_event(struct spa_source *source)
 	if (read(source->fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
 		fprintf(stderr, "failed to read event fd: %s", strerror(errno));
 
-	while ((avail = spa_ringbuffer_get_read_index(&impl->trace_rb, &index)) > 0) {
+	while ((avail = spa_ringbuffer_mp_get_read_index(&impl->trace_rb, &index)) > 0) {
 		uint32_t offset, first;
 
-		if (avail > TRACE_BUFFER) {
-			index += avail - TRACE_BUFFER;
-			avail = TRACE_BUFFER;
-		}
+		if (!spa_ringbuffer_mp_read_reserve(&impl->trace_rb, index, avail))
+			continue;
+
 		offset = index & (TRACE_BUFFER - 1);
 		first = SPA_MIN(avail, TRACE_BUFFER - offset);
 
@@ -135,7 +142,7 @@ static void on_trace_event(struct spa_source *source)
 		if (SPA_UNLIKELY(avail > first)) {
 			fwrite(impl->trace_data, avail - first, 1, stderr);
 		}
-		spa_ringbuffer_read_update(&impl->trace_rb, index + avail);
+		spa_ringbuffer_mp_read_update(&impl->trace_rb, index, avail);
         }
 }
 
@@ -223,7 +230,7 @@ impl_init(const struct spa_handle_factory *factory,
 		this->have_source = true;
 	}
 
-	spa_ringbuffer_init(&this->trace_rb);
+	spa_ringbuffer_mp_init(&this->trace_rb);
 
 	spa_log_debug(&this->log, NAME " %p: initialized", this);
 
@@ -34,7 +34,7 @@
 #include <spa/support/type-map.h>
 #include <spa/support/plugin.h>
 #include <spa/utils/list.h>
-#include <spa/utils/ringbuffer.h>
+#include <spa/utils/ringbuffer-mp.h>
 
 #define NAME "loop"
 
@@ -42,15 +42,21 @@
 
 /** \cond */
 
+/* lives on the stack of a blocking caller, the queue slot is released
+ * as soon as the function ran so the result can't be kept there */
+struct invoke_ack {
+	int res;
+	bool done;
+};
+
 struct invoke_item {
 	size_t item_size;
 	spa_invoke_func_t func;
 	uint32_t seq;
 	void *data;
 	size_t size;
-	bool block;
+	struct invoke_ack *ack;
 	void *user_data;
-	int res;
 };
 
 struct type {
@@ -86,9 +92,10 @@ struct impl {
 	pthread_t thread;
 
 	struct spa_source *wakeup;
-	int ack_fd;
+	pthread_mutex_t ack_lock;
+	pthread_cond_t ack_cond;
 
-	struct spa_ringbuffer buffer;
+	struct spa_ringbuffer_mp buffer;
 	uint8_t buffer_data[DATAS_SIZE];
 };
 
@@ -203,62 +210,70 @@ loop_invoke(struct spa_loop *loop,
 	struct impl *impl = SPA_CONTAINER_OF(loop, struct impl, loop);
 	bool in_thread = pthread_equal(impl->thread, pthread_self());
 	struct invoke_item *item;
+	struct invoke_ack ack = { 0, false };
 	int res;
 
 	if (in_thread) {
 		res = func(loop, false, seq, data, size, user_data);
 	} else {
 		int32_t filled, avail;
-		uint32_t idx, offset, l0;
-
-		filled = spa_ringbuffer_get_write_index(&impl->buffer, &idx);
-		if (filled < 0 || filled > DATAS_SIZE) {
-			spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
-			return -EPIPE;
-		}
-		avail = DATAS_SIZE - filled;
-		if (avail < sizeof(struct invoke_item)) {
-			spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
-			return -EPIPE;
-		}
-		offset = idx & (DATAS_SIZE - 1);
-
-		l0 = DATAS_SIZE - offset;
+		uint32_t idx, offset, l0, item_size;
+
+		/* invoke can be called from any thread, reserve our item in the
+		 * queue before filling it */
+		do {
+			filled = spa_ringbuffer_mp_get_write_index(&impl->buffer, &idx);
+			if (filled < 0 || filled > DATAS_SIZE) {
+				spa_log_warn(impl->log, NAME " %p: queue xrun %d", impl, filled);
+				return -EPIPE;
+			}
+			avail = DATAS_SIZE - filled;
+			offset = idx & (DATAS_SIZE - 1);
+
+			l0 = DATAS_SIZE - offset;
+
+			if (l0 > sizeof(struct invoke_item) + size) {
+				item_size = sizeof(struct invoke_item) + size;
+				if (l0 < sizeof(struct invoke_item) + item_size)
+					item_size = l0;
+			} else {
+				item_size = l0 + size;
+			}
+			if (avail < item_size) {
+				spa_log_warn(impl->log, NAME " %p: queue full %d", impl, avail);
+				return -EPIPE;
+			}
+		} while (!spa_ringbuffer_mp_write_reserve(&impl->buffer, idx, item_size));
 
 		item = SPA_MEMBER(impl->buffer_data, offset, struct invoke_item);
 		item->func = func;
 		item->seq = seq;
 		item->size = size;
-		item->block = block;
+		item->ack = block ? &ack : NULL;
 		item->user_data = user_data;
+		item->item_size = item_size;
 
-		if (l0 > sizeof(struct invoke_item) + size) {
+		if (l0 > sizeof(struct invoke_item) + size)
 			item->data = SPA_MEMBER(item, sizeof(struct invoke_item), void);
-			item->item_size = sizeof(struct invoke_item) + size;
-			if (l0 < sizeof(struct invoke_item) + item->item_size)
-				item->item_size = l0;
-		} else {
+		else
 			item->data = impl->buffer_data;
-			item->item_size = l0 + size;
-		}
 		memcpy(item->data, data, size);
 
-		spa_ringbuffer_write_update(&impl->buffer, idx + item->item_size);
+		spa_ringbuffer_mp_write_update(&impl->buffer, idx, item_size);
 
 		spa_loop_utils_signal_event(&impl->utils, impl->wakeup);
 
 		if (block) {
-			uint64_t count = 1;
-
 			spa_loop_control_hook_before(&impl->hooks_list);
 
-			if (read(impl->ack_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-				spa_log_warn(impl->log, NAME " %p: failed to read event fd: %s",
-						impl, strerror(errno));
+			pthread_mutex_lock(&impl->ack_lock);
+			while (!ack.done)
+				pthread_cond_wait(&impl->ack_cond, &impl->ack_lock);
+			pthread_mutex_unlock(&impl->ack_lock);
 
 			spa_loop_control_hook_after(&impl->hooks_list);
 
-			res = item->res;
+			res = ack.res;
 		}
 		else {
 			if (seq != SPA_ID_INVALID)
@@ -274,18 +289,25 @@ static void wakeup_func(void *data, uint64_t count)
 {
 	struct impl *impl = data;
 	uint32_t index;
-	while (spa_ringbuffer_get_read_index(&impl->buffer, &index) > 0) {
+	while (spa_ringbuffer_mp_get_read_index(&impl->buffer, &index) > 0) {
 		struct invoke_item *item =
 		    SPA_MEMBER(impl->buffer_data, index & (DATAS_SIZE - 1), struct invoke_item);
-		item->res = item->func(&impl->loop, true, item->seq, item->data, item->size,
-			   item->user_data);
-		spa_ringbuffer_read_update(&impl->buffer, index + item->item_size);
+		struct invoke_ack *ack = item->ack;
+		int res;
 
-		if (item->block) {
-			uint64_t count = 1;
-			if (write(impl->ack_fd, &count, sizeof(uint64_t)) != sizeof(uint64_t))
-				spa_log_warn(impl->log, NAME " %p: failed to write event fd: %s",
-						impl, strerror(errno));
+		/* we are the only reader, the item can be overwritten by writers
+		 * once the slot is released */
+		spa_ringbuffer_mp_read_reserve(&impl->buffer, index, item->item_size);
+		res = item->func(&impl->loop, true, item->seq, item->data, item->size,
+			   item->user_data);
+		spa_ringbuffer_mp_read_update(&impl->buffer, index, item->item_size);
+
+		if (ack) {
+			pthread_mutex_lock(&impl->ack_lock);
+			ack->res = res;
+			ack->done = true;
+			pthread_cond_broadcast(&impl->ack_cond);
+			pthread_mutex_unlock(&impl->ack_lock);
 		}
 	}
 }
@@ -697,7 +719,8 @@ static int impl_clear(struct spa_handle *handle)
 
 	process_destroy(impl);
 
-	close(impl->ack_fd);
+	pthread_cond_destroy(&impl->ack_cond);
+	pthread_mutex_destroy(&impl->ack_lock);
 	close(impl->epoll_fd);
 
 	return 0;
@@ -744,10 +767,11 @@ impl_init(const struct spa_handle_factory *factory,
 	spa_list_init(&impl->destroy_list);
 	spa_hook_list_init(&impl->hooks_list);
 
-	spa_ringbuffer_init(&impl->buffer);
+	spa_ringbuffer_mp_init(&impl->buffer);
 
 	impl->wakeup = spa_loop_utils_add_event(&impl->utils, wakeup_func, impl);
-	impl->ack_fd = eventfd(0, EFD_SEMAPHORE | EFD_CLOEXEC);
+	pthread_mutex_init(&impl->ack_lock, NULL);
+	pthread_cond_init(&impl->ack_cond, NULL);
 
 	spa_log_debug(impl->log, NAME " %p: initialized", impl);
 
@@ -37,6 +37,8 @@
 #include <spa/pod/parser.h>
 #include <spa/pod/filter.h>
 
+#include "load.h"
+
 #define NAME "fakesink"
 
 struct type {
@@ -45,6 +47,7 @@ struct type {
 	uint32_t format;
 	uint32_t props;
 	uint32_t prop_live;
+	struct load_types load;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
@@ -62,6 +65,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
 	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
 	type->prop_live = spa_type_map_get_id(map, SPA_TYPE_PROPS__live);
+	load_types_map(map, &type->load);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_meta_map(map, &type->meta);
@@ -74,6 +78,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 
 struct props {
 	bool live;
+	struct load_props load;
 };
 
 #define MAX_BUFFERS 16
@@ -97,6 +102,7 @@ struct impl {
 	struct spa_loop *data_loop;
 
 	struct props props;
+	struct load load;
 
 	const struct spa_node_callbacks *callbacks;
 	void *callbacks_data;
@@ -128,6 +134,7 @@ struct impl {
 static void reset_props(struct impl *this, struct props *props)
 {
 	props->live = DEFAULT_LIVE;
+	load_props_reset(&props->load);
 }
 
 static int impl_node_enum_params(struct spa_node *node,
@@ -152,20 +159,50 @@ static int impl_node_enum_params(struct spa_node *node,
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
-		if (*index > 0)
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
 			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		struct props *p = &this->props;
 
-		param = spa_pod_builder_object(&b,
-			id, t->param.List,
-			":", t->param.listId,   "I",  t->param.idProps);
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_live,
+				":", t->param.propName, "s", "Configure live mode of the sink",
+				":", t->param.propType, "b", p->live);
+			break;
+		default:
+			param = load_build_prop_info(&t->load, &t->param, id, *index - 1,
+						     &p->load, &this->load.stats, &b);
+			if (param == NULL)
+				return 0;
+			break;
+		}
 	}
 	else if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
 		if (*index > 0)
 			return 0;
 
 		param = spa_pod_builder_object(&b,
 			id, t->props,
-			":", t->prop_live, "b", this->props.live);
+			":", t->prop_live,	    "b", p->live,
+			":", t->load.busy_time,	    "i", p->load.busy_time,
+			":", t->load.touch_bytes,   "i", p->load.touch_bytes,
+			":", t->load.jitter,	    "i", p->load.jitter,
+			":", t->load.jitter_time,   "i", p->load.jitter_time,
+			":", t->load.fail_rate,	    "d", p->load.fail_rate,
+			":", t->load.histogram,	    "a-r", sizeof(int32_t), SPA_POD_TYPE_INT,
+				LOAD_HISTOGRAM_SIZE, this->load.stats.histogram);
 	}
 	else
 		return -ENOENT;
@@ -190,12 +227,19 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 	t = &this->type;
 
 	if (id == t->param.idProps) {
+		struct props *p = &this->props;
+
 		if (param == NULL) {
-			reset_props(this, &this->props);
+			reset_props(this, p);
 			return 0;
 		}
 		spa_pod_object_parse(param,
-			":", t->prop_live, "?b", &this->props.live, NULL);
+			":", t->prop_live,	  "?b", &p->live,
+			":", t->load.busy_time,	  "?i", &p->load.busy_time,
+			":", t->load.touch_bytes, "?i", &p->load.touch_bytes,
+			":", t->load.jitter,	  "?i", &p->load.jitter,
+			":", t->load.jitter_time, "?i", &p->load.jitter_time,
+			":", t->load.fail_rate,	  "?d", &p->load.fail_rate, NULL);
 
 		if (this->props.live)
 			this->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
@@ -238,15 +282,18 @@ static inline void read_timer(struct impl *this)
 	}
 }
 
-static void render_buffer(struct impl *this, struct buffer *b)
+static int render_buffer(struct impl *this, struct buffer *b)
 {
+	struct spa_data *d = &b->outbuf->datas[0];
+
+	return load_process(&this->load, &this->props.load, d->data, d->maxsize, false);
 }
 
 static int consume_buffer(struct impl *this)
 {
 	struct buffer *b;
 	struct spa_io_buffers *io = this->io;
-	int n_bytes;
+	int n_bytes, res;
 
 	read_timer(this);
 
@@ -267,7 +314,7 @@ static int consume_buffer(struct impl *this)
 
 	spa_log_trace(this->log, NAME " %p: dequeue buffer %d", this, b->outbuf->id);
 
-	render_buffer(this, b);
+	res = render_buffer(this, b);
 
 	b->outbuf->datas[0].chunk->offset = 0;
 	b->outbuf->datas[0].chunk->size = n_bytes;
@@ -284,9 +331,15 @@ static int consume_buffer(struct impl *this)
 	set_timer(this, true);
 
 	io->buffer_id = b->outbuf->id;
-	io->status = SPA_STATUS_NEED_BUFFER;
 	b->outstanding = true;
 
+	if (res < 0) {
+		spa_log_trace(this->log, NAME " %p: failed buffer %d", this, b->outbuf->id);
+		io->status = res;
+		return res;
+	}
+	io->status = SPA_STATUS_NEED_BUFFER;
+
 	return SPA_STATUS_NEED_BUFFER;
 }
 
@@ -324,6 +377,7 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 			this->start_time = 0;
 		this->buffer_count = 0;
 		this->elapsed_time = 0;
+		load_stats_reset(&this->load.stats);
 
 		this->started = true;
 		set_timer(this, true);
@@ -338,6 +392,7 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 
 		this->started = false;
 		set_timer(this, false);
+		load_stats_log(&this->load.stats, this->log, this);
 	} else
 		return -ENOTSUP;
 
@@ -880,6 +935,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this->node = impl_node;
 	this->clock = impl_clock;
 	reset_props(this, &this->props);
+	load_init(&this->load, (uintptr_t) this);
 
 	spa_list_init(&this->ready);
 
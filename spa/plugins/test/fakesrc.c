@@ -37,6 +37,8 @@
 #include <spa/pod/parser.h>
 #include <spa/pod/filter.h>
 
+#include "load.h"
+
 #define NAME "fakesrc"
 
 struct type {
@@ -46,6 +48,7 @@ struct type {
 	uint32_t props;
 	uint32_t prop_live;
 	uint32_t prop_pattern;
+	struct load_types load;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
@@ -64,6 +67,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
 	type->prop_live = spa_type_map_get_id(map, SPA_TYPE_PROPS__live);
 	type->prop_pattern = spa_type_map_get_id(map, SPA_TYPE_PROPS__patternType);
+	load_types_map(map, &type->load);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_meta_map(map, &type->meta);
@@ -77,6 +81,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 struct props {
 	bool live;
 	uint32_t pattern;
+	struct load_props load;
 };
 
 #define MAX_BUFFERS 16
@@ -100,6 +105,7 @@ struct impl {
 	struct spa_loop *data_loop;
 
 	struct props props;
+	struct load load;
 
 	const struct spa_node_callbacks *callbacks;
 	void *callbacks_data;
@@ -134,6 +140,7 @@ static void reset_props(struct impl *this, struct props *props)
 {
 	props->live = DEFAULT_LIVE;
 	props->pattern = DEFAULT_PATTERN;
+	load_props_reset(&props->load);
 }
 
 static int impl_node_enum_params(struct spa_node *node,
@@ -159,12 +166,41 @@ static int impl_node_enum_params(struct spa_node *node,
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
 
 	if (id == t->param.idList) {
-		if (*index > 0)
+		uint32_t list[] = { t->param.idPropInfo,
+				    t->param.idProps };
+
+		if (*index < SPA_N_ELEMENTS(list))
+			param = spa_pod_builder_object(&b, id, t->param.List,
+				":", t->param.listId, "I", list[*index]);
+		else
 			return 0;
+	}
+	else if (id == t->param.idPropInfo) {
+		struct props *p = &this->props;
 
-		param = spa_pod_builder_object(&b,
-			id, t->param.List,
-			":", t->param.listId,   "I",  t->param.idProps);
+		switch (*index) {
+		case 0:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_live,
+				":", t->param.propName, "s", "Configure live mode of the source",
+				":", t->param.propType, "b", p->live);
+			break;
+		case 1:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_pattern,
+				":", t->param.propName, "s", "The pattern of the data",
+				":", t->param.propType, "Ie", p->pattern,
+					1, p->pattern);
+			break;
+		default:
+			param = load_build_prop_info(&t->load, &t->param, id, *index - 2,
+						     &p->load, &this->load.stats, &b);
+			if (param == NULL)
+				return 0;
+			break;
+		}
 	}
 	else if (id == t->param.idProps) {
 		struct props *p = &this->props;
@@ -175,8 +211,14 @@ static int impl_node_enum_params(struct spa_node *node,
 		param = spa_pod_builder_object(&b,
 			id, t->props,
 			":", t->prop_live,    "b", p->live,
-			":", t->prop_pattern, "Ie", p->pattern,
-						   1, p->pattern);
+			":", t->prop_pattern, "I", p->pattern,
+			":", t->load.busy_time,	    "i", p->load.busy_time,
+			":", t->load.touch_bytes,   "i", p->load.touch_bytes,
+			":", t->load.jitter,	    "i", p->load.jitter,
+			":", t->load.jitter_time,   "i", p->load.jitter_time,
+			":", t->load.fail_rate,	    "d", p->load.fail_rate,
+			":", t->load.histogram,	    "a-r", sizeof(int32_t), SPA_POD_TYPE_INT,
+				LOAD_HISTOGRAM_SIZE, this->load.stats.histogram);
 	}
 	else
 		return -ENOENT;
@@ -209,7 +251,12 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 		}
 		spa_pod_object_parse(param,
 				":", t->prop_live,    "?b", &p->live,
-				":", t->prop_pattern, "?I", &p->pattern, NULL);
+				":", t->prop_pattern, "?I", &p->pattern,
+				":", t->load.busy_time,	  "?i", &p->load.busy_time,
+				":", t->load.touch_bytes, "?i", &p->load.touch_bytes,
+				":", t->load.jitter,	  "?i", &p->load.jitter,
+				":", t->load.jitter_time, "?i", &p->load.jitter_time,
+				":", t->load.fail_rate,	  "?d", &p->load.fail_rate, NULL);
 
 		if (p->live)
 			this->info.flags |= SPA_PORT_INFO_FLAG_LIVE;
@@ -224,7 +271,9 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 
 static int fill_buffer(struct impl *this, struct buffer *b)
 {
-	return 0;
+	struct spa_data *d = &b->outbuf->datas[0];
+
+	return load_process(&this->load, &this->props.load, d->data, d->maxsize, true);
 }
 
 static void set_timer(struct impl *this, bool enabled)
@@ -261,7 +310,7 @@ static int make_buffer(struct impl *this)
 {
 	struct buffer *b;
 	struct spa_io_buffers *io = this->io;
-	int n_bytes;
+	int n_bytes, res;
 
 	read_timer(this);
 
@@ -279,7 +328,7 @@ static int make_buffer(struct impl *this)
 
 	spa_log_trace(this->log, NAME " %p: dequeue buffer %d", this, b->outbuf->id);
 
-	fill_buffer(this, b);
+	res = fill_buffer(this, b);
 
 	b->outbuf->datas[0].chunk->offset = 0;
 	b->outbuf->datas[0].chunk->size = n_bytes;
@@ -295,6 +344,14 @@ static int make_buffer(struct impl *this)
 	this->elapsed_time = this->buffer_count;
 	set_timer(this, true);
 
+	if (res < 0) {
+		spa_log_trace(this->log, NAME " %p: failed buffer %d", this, b->outbuf->id);
+		spa_list_append(&this->empty, &b->link);
+		b->outstanding = false;
+		io->status = res;
+		return res;
+	}
+
 	io->buffer_id = b->outbuf->id;
 	io->status = SPA_STATUS_HAVE_BUFFER;
 
@@ -340,6 +397,7 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 			this->start_time = 0;
 		this->buffer_count = 0;
 		this->elapsed_time = 0;
+		load_stats_reset(&this->load.stats);
 
 		this->started = true;
 		set_timer(this, true);
@@ -354,6 +412,7 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 
 		this->started = false;
 		set_timer(this, false);
+		load_stats_log(&this->load.stats, this->log, this);
 	} else
 		return -ENOTSUP;
 
@@ -915,6 +974,7 @@ impl_init(const struct spa_handle_factory *factory,
 	this->node = impl_node;
 	this->clock = impl_clock;
 	reset_props(this, &this->props);
+	load_init(&this->load, (uintptr_t) this);
 
 	spa_list_init(&this->empty);
 
@@ -0,0 +1,256 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <inttypes.h>
+
+#include <spa/utils/defs.h>
+
+#include "load.h"
+
+#define DEFAULT_BUSY_TIME	0
+#define DEFAULT_TOUCH_BYTES	0
+#define DEFAULT_JITTER		LOAD_JITTER_NONE
+#define DEFAULT_JITTER_TIME	0
+#define DEFAULT_FAIL_RATE	0.0
+
+#define CACHE_LINE		64
+
+static inline uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+/* xorshift64*, uniform in (0, 1] */
+static inline double random_uniform(struct load *load)
+{
+	uint64_t x = load->seed;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	load->seed = x;
+
+	return ((x * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0) +
+		(1.0 / 9007199254740992.0);
+}
+
+static int64_t busy_time(struct load *load, const struct load_props *p)
+{
+	double t = p->busy_time, u;
+
+	switch (p->jitter) {
+	case LOAD_JITTER_UNIFORM:
+		t += random_uniform(load) * p->jitter_time;
+		break;
+	case LOAD_JITTER_NORMAL:
+		/* Box-Muller */
+		u = random_uniform(load);
+		t += sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * random_uniform(load)) *
+			p->jitter_time;
+		break;
+	case LOAD_JITTER_EXPONENTIAL:
+		t += -log(random_uniform(load)) * p->jitter_time;
+		break;
+	default:
+		break;
+	}
+	return SPA_MAX(t, 0.0) * SPA_NSEC_PER_USEC;
+}
+
+/* touch one byte of every cache line, wrapping around the memory when
+ * more bytes are asked than there are. Only producers write the memory,
+ * consumers sum the bytes. */
+static void touch_memory(void *data, size_t size, size_t n_bytes, bool write)
+{
+	uint8_t *p = data;
+	volatile uint8_t sum = 0;
+	size_t i, offset = 0;
+
+	if (data == NULL || size == 0)
+		return;
+
+	for (i = 0; i < n_bytes; i += CACHE_LINE) {
+		if (write)
+			((volatile uint8_t *) p)[offset] = sum++;
+		else
+			sum += ((volatile uint8_t *) p)[offset];
+		offset += CACHE_LINE;
+		if (offset >= size)
+			offset = 0;
+	}
+}
+
+static void update_stats(struct load_stats *s, uint64_t elapsed)
+{
+	uint64_t us = elapsed / SPA_NSEC_PER_USEC;
+	int bucket = 0;
+
+	while (us > 0 && bucket < LOAD_HISTOGRAM_SIZE - 1) {
+		us >>= 1;
+		bucket++;
+	}
+	s->histogram[bucket]++;
+
+	if (s->count == 0 || elapsed < s->min)
+		s->min = elapsed;
+	if (elapsed > s->max)
+		s->max = elapsed;
+	s->total += elapsed;
+	s->count++;
+}
+
+void load_props_reset(struct load_props *props)
+{
+	props->busy_time = DEFAULT_BUSY_TIME;
+	props->touch_bytes = DEFAULT_TOUCH_BYTES;
+	props->jitter = DEFAULT_JITTER;
+	props->jitter_time = DEFAULT_JITTER_TIME;
+	props->fail_rate = DEFAULT_FAIL_RATE;
+}
+
+void load_stats_reset(struct load_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+}
+
+void load_init(struct load *load, uint64_t seed)
+{
+	load_stats_reset(&load->stats);
+	load->seed = seed ? seed : 0x9e3779b97f4a7c15ULL;
+}
+
+int load_process(struct load *load, const struct load_props *p,
+		 void *data, size_t size, bool write)
+{
+	uint64_t start, end;
+	int64_t busy;
+	int res = 0;
+
+	start = get_time();
+
+	if (p->touch_bytes > 0)
+		touch_memory(data, size, p->touch_bytes, write);
+
+	if (p->busy_time > 0 || p->jitter != LOAD_JITTER_NONE) {
+		busy = busy_time(load, p);
+		while (get_time() < start + (uint64_t) busy);
+	}
+
+	if (p->fail_rate > 0.0 && random_uniform(load) <= p->fail_rate) {
+		load->stats.failures++;
+		res = -EIO;
+	}
+
+	end = get_time();
+	update_stats(&load->stats, end - start);
+
+	return res;
+}
+
+struct spa_pod *load_build_prop_info(const struct load_types *t,
+				     const struct spa_type_param *param,
+				     uint32_t id, uint32_t index,
+				     const struct load_props *p,
+				     const struct load_stats *s,
+				     struct spa_pod_builder *b)
+{
+	switch (index) {
+	case 0:
+		return spa_pod_builder_object(b,
+			id, param->PropInfo,
+			":", param->propId,   "I", t->busy_time,
+			":", param->propName, "s", "Busy time per cycle in usec",
+			":", param->propType, "ir", p->busy_time,
+				SPA_POD_PROP_MIN_MAX(0, INT32_MAX));
+	case 1:
+		return spa_pod_builder_object(b,
+			id, param->PropInfo,
+			":", param->propId,   "I", t->touch_bytes,
+			":", param->propName, "s", "Buffer bytes to touch per cycle",
+			":", param->propType, "ir", p->touch_bytes,
+				SPA_POD_PROP_MIN_MAX(0, INT32_MAX));
+	case 2:
+		return spa_pod_builder_object(b,
+			id, param->PropInfo,
+			":", param->propId,   "I", t->jitter,
+			":", param->propName, "s", "Distribution of the busy time jitter",
+			":", param->propType, "ie", p->jitter,
+				SPA_POD_PROP_ENUM(4, LOAD_JITTER_NONE,
+						     LOAD_JITTER_UNIFORM,
+						     LOAD_JITTER_NORMAL,
+						     LOAD_JITTER_EXPONENTIAL),
+			":", param->propLabels, "[-i",
+				"i", LOAD_JITTER_NONE, "s", "No jitter",
+				"i", LOAD_JITTER_UNIFORM, "s", "Uniform",
+				"i", LOAD_JITTER_NORMAL, "s", "Normal",
+				"i", LOAD_JITTER_EXPONENTIAL, "s", "Exponential", "]");
+	case 3:
+		return spa_pod_builder_object(b,
+			id, param->PropInfo,
+			":", param->propId,   "I", t->jitter_time,
+			":", param->propName, "s", "Jitter time in usec",
+			":", param->propType, "ir", p->jitter_time,
+				SPA_POD_PROP_MIN_MAX(0, INT32_MAX));
+	case 4:
+		return spa_pod_builder_object(b,
+			id, param->PropInfo,
+			":", param->propId,   "I", t->fail_rate,
+			":", param->propName, "s", "Probability that a cycle fails",
+			":", param->propType, "dr", p->fail_rate,
+				SPA_POD_PROP_MIN_MAX(0.0, 1.0));
+	case 5:
+		return spa_pod_builder_object(b,
+			id, param->PropInfo,
+			":", param->propId,   "I", t->histogram,
+			":", param->propName, "s", "Cycle time histogram, power of 2 usec buckets",
+			":", param->propType, "a-r", sizeof(int32_t), SPA_POD_TYPE_INT,
+				LOAD_HISTOGRAM_SIZE, s->histogram);
+	default:
+		return NULL;
+	}
+}
+
+void load_stats_log(const struct load_stats *s, struct spa_log *log, void *object)
+{
+	uint64_t min, avg, max;
+	int i;
+
+	if (s->count == 0)
+		return;
+
+	min = s->min / SPA_NSEC_PER_USEC;
+	avg = s->total / s->count / SPA_NSEC_PER_USEC;
+	max = s->max / SPA_NSEC_PER_USEC;
+
+	spa_log_info(log, "%p: %" PRIu64 " cycles, %" PRIu64 " failed, "
+		     "min %" PRIu64 "us avg %" PRIu64 "us max %" PRIu64 "us", object,
+		     s->count, s->failures, min, avg, max);
+
+	for (i = 0; i < LOAD_HISTOGRAM_SIZE; i++) {
+		if (s->histogram[i] == 0)
+			continue;
+		spa_log_info(log, "%p:   < %8uus: %d", object, 1u << i, s->histogram[i]);
+	}
+}
@@ -0,0 +1,117 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_TEST_LOAD_H__
+#define __SPA_TEST_LOAD_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <spa/support/log.h>
+#include <spa/support/type-map.h>
+#include <spa/param/param.h>
+#include <spa/param/props.h>
+#include <spa/pod/builder.h>
+
+/** Simulated per-cycle cost of the fake nodes */
+#define SPA_TYPE_PROPS__loadBusyTime	SPA_TYPE_PROPS_BASE "loadBusyTime"
+#define SPA_TYPE_PROPS__loadTouchBytes	SPA_TYPE_PROPS_BASE "loadTouchBytes"
+#define SPA_TYPE_PROPS__loadJitter	SPA_TYPE_PROPS_BASE "loadJitter"
+#define SPA_TYPE_PROPS__loadJitterTime	SPA_TYPE_PROPS_BASE "loadJitterTime"
+#define SPA_TYPE_PROPS__loadFailRate	SPA_TYPE_PROPS_BASE "loadFailRate"
+#define SPA_TYPE_PROPS__loadHistogram	SPA_TYPE_PROPS_BASE "loadHistogram"
+
+struct load_types {
+	uint32_t busy_time;
+	uint32_t touch_bytes;
+	uint32_t jitter;
+	uint32_t jitter_time;
+	uint32_t fail_rate;
+	uint32_t histogram;
+};
+
+static inline void load_types_map(struct spa_type_map *map, struct load_types *type)
+{
+	type->busy_time = spa_type_map_get_id(map, SPA_TYPE_PROPS__loadBusyTime);
+	type->touch_bytes = spa_type_map_get_id(map, SPA_TYPE_PROPS__loadTouchBytes);
+	type->jitter = spa_type_map_get_id(map, SPA_TYPE_PROPS__loadJitter);
+	type->jitter_time = spa_type_map_get_id(map, SPA_TYPE_PROPS__loadJitterTime);
+	type->fail_rate = spa_type_map_get_id(map, SPA_TYPE_PROPS__loadFailRate);
+	type->histogram = spa_type_map_get_id(map, SPA_TYPE_PROPS__loadHistogram);
+}
+
+enum load_jitter {
+	LOAD_JITTER_NONE,
+	LOAD_JITTER_UNIFORM,		/**< extra busy time in [0, jitter_time] */
+	LOAD_JITTER_NORMAL,		/**< busy time +- normal with stddev jitter_time */
+	LOAD_JITTER_EXPONENTIAL,	/**< extra busy time with mean jitter_time */
+};
+
+struct load_props {
+	int32_t busy_time;		/**< busy loop per cycle in microseconds */
+	int32_t touch_bytes;		/**< bytes of buffer memory to touch per cycle */
+	uint32_t jitter;		/**< one of enum load_jitter */
+	int32_t jitter_time;		/**< jitter parameter in microseconds */
+	double fail_rate;		/**< probability that a cycle fails */
+};
+
+/** processing time histogram, bucket 0 counts cycles below 1us and bucket
+ * n the cycles in [2^(n-1), 2^n) us */
+#define LOAD_HISTOGRAM_SIZE	24
+
+struct load_stats {
+	uint64_t count;
+	uint64_t failures;
+	uint64_t min;			/**< in nanoseconds */
+	uint64_t max;
+	uint64_t total;
+	int32_t histogram[LOAD_HISTOGRAM_SIZE];
+};
+
+struct load {
+	struct load_stats stats;
+	uint64_t seed;
+};
+
+void load_init(struct load *load, uint64_t seed);
+
+void load_props_reset(struct load_props *props);
+
+void load_stats_reset(struct load_stats *stats);
+
+/** Run one cycle of the load described by \a props on \a size bytes
+ * of \a data and record its duration. The memory is only read unless
+ * \a write is true, consumers must not modify the buffers they get.
+ * \return 0 or -EIO when the cycle failed */
+int load_process(struct load *load, const struct load_props *props,
+		 void *data, size_t size, bool write);
+
+/** Build the PropInfo param \a index of the load properties
+ * \return the param or NULL when \a index is past the last property */
+struct spa_pod *load_build_prop_info(const struct load_types *t,
+				     const struct spa_type_param *param,
+				     uint32_t id, uint32_t index,
+				     const struct load_props *props,
+				     const struct load_stats *stats,
+				     struct spa_pod_builder *builder);
+
+void load_stats_log(const struct load_stats *stats, struct spa_log *log, void *object);
+
+#endif /* __SPA_TEST_LOAD_H__ */
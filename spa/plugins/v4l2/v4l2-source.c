@@ -21,6 +21,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <linux/videodev2.h>
 
@@ -63,7 +64,9 @@ struct buffer {
 	struct spa_meta_header *h;
 	uint32_t flags;
 	struct v4l2_buffer v4l2_buffer;
-	void *ptr;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
+	void *ptrs[VIDEO_MAX_PLANES];
+	size_t sizes[VIDEO_MAX_PLANES];
 };
 
 struct type {
@@ -83,6 +86,9 @@ struct type {
 	uint32_t prop_exposure;
 	uint32_t prop_gain;
 	uint32_t prop_sharpness;
+	uint32_t prop_frames_dequeued;
+	uint32_t prop_frames_dropped;
+	uint32_t prop_frames_late;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_media_type media_type;
@@ -117,6 +123,9 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->prop_exposure = spa_type_map_get_id(map, SPA_TYPE_PROPS__exposure);
 	type->prop_gain = spa_type_map_get_id(map, SPA_TYPE_PROPS__gain);
 	type->prop_sharpness = spa_type_map_get_id(map, SPA_TYPE_PROPS__sharpness);
+	type->prop_frames_dequeued = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "framesDequeued");
+	type->prop_frames_dropped = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "framesDropped");
+	type->prop_frames_late = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "framesLate");
 	spa_type_meta_map(map, &type->meta);
 	spa_type_data_map(map, &type->data);
 	spa_type_media_type_map(map, &type->media_type);
@@ -166,6 +175,9 @@ struct port {
 	struct v4l2_format fmt;
 	enum v4l2_buf_type type;
 	enum v4l2_memory memtype;
+	uint32_t n_planes;
+	uint32_t plane_stride[VIDEO_MAX_PLANES];
+	uint32_t plane_size[VIDEO_MAX_PLANES];
 
 	struct control controls[MAX_CONTROLS];
 	uint32_t n_controls;
@@ -180,6 +192,13 @@ struct port {
 
 	int64_t last_ticks;
 	int64_t last_monotonic;
+
+	uint64_t frame_duration;	/* in nanoseconds */
+	bool have_sequence;
+	uint32_t last_sequence;
+	uint64_t frames_dequeued;
+	uint64_t frames_dropped;
+	uint64_t frames_late;
 };
 
 struct impl {
@@ -216,6 +235,7 @@ static int impl_node_enum_params(struct spa_node *node,
 {
 	struct impl *this;
 	struct type *t;
+	struct port *port;
 	struct spa_pod *param;
 	struct spa_pod_builder b = { 0 };
 	uint8_t buffer[1024];
@@ -226,6 +246,7 @@ static int impl_node_enum_params(struct spa_node *node,
 
 	this = SPA_CONTAINER_OF(node, struct impl, node);
 	t = &this->type;
+	port = GET_OUT_PORT(this, 0);
 
       next:
 	spa_pod_builder_init(&b, buffer, sizeof(buffer));
@@ -265,6 +286,27 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propName, "s", "The V4L2 fd",
 				":", t->param.propType, "i-r", p->device_fd);
 			break;
+		case 3:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_frames_dequeued,
+				":", t->param.propName, "s", "Frames dequeued from the device",
+				":", t->param.propType, "l-r", port->frames_dequeued);
+			break;
+		case 4:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_frames_dropped,
+				":", t->param.propName, "s", "Frames dropped by the driver",
+				":", t->param.propType, "l-r", port->frames_dropped);
+			break;
+		case 5:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_frames_late,
+				":", t->param.propName, "s", "Frames dequeued more than a frame late",
+				":", t->param.propType, "l-r", port->frames_late);
+			break;
 		default:
 			return 0;
 		}
@@ -278,7 +320,10 @@ static int impl_node_enum_params(struct spa_node *node,
 				id, t->props,
 				":", t->prop_device,      "S", p->device, sizeof(p->device),
 				":", t->prop_device_name, "S-r", p->device_name, sizeof(p->device_name),
-				":", t->prop_device_fd,   "i-r", p->device_fd);
+				":", t->prop_device_fd,   "i-r", p->device_fd,
+				":", t->prop_frames_dequeued, "l-r", port->frames_dequeued,
+				":", t->prop_frames_dropped,  "l-r", port->frames_dropped,
+				":", t->prop_frames_late,     "l-r", port->frames_late);
 			break;
 		default:
 			return 0;
@@ -534,17 +579,23 @@ static int impl_node_port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
+		uint32_t i, size = 0;
+
 		if (!port->have_format)
 			return -EIO;
 		if (*index > 0)
 			return 0;
 
+		for (i = 0; i < port->n_planes; i++)
+			size = SPA_MAX(size, port->plane_size[i]);
+
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", port->fmt.fmt.pix.sizeimage,
-			":", t->param_buffers.stride,  "i", port->fmt.fmt.pix.bytesperline,
+			":", t->param_buffers.size,    "i", size,
+			":", t->param_buffers.stride,  "i", port->plane_stride[0],
 			":", t->param_buffers.buffers, "iru", MAX_BUFFERS,
 				SPA_POD_PROP_MIN_MAX(2, MAX_BUFFERS),
+			":", t->param_buffers.blocks,  "i", port->n_planes,
 			":", t->param_buffers.align,   "i", 16);
 	}
 	else if (id == t->param.idMeta) {
@@ -45,6 +45,7 @@ static int spa_v4l2_open(struct impl *this)
 	struct stat st;
 	struct props *props = &this->props;
 	int err;
+	uint32_t caps;
 
 	if (port->opened)
 		return 0;
@@ -83,9 +84,15 @@ static int spa_v4l2_open(struct impl *this)
 		return -err;
 	}
 
-	if ((port->cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0 ||
-	    ((port->cap.capabilities & V4L2_CAP_DEVICE_CAPS) &&
-	     (port->cap.device_caps & V4L2_CAP_VIDEO_CAPTURE) == 0)) {
+	caps = port->cap.capabilities;
+	if (caps & V4L2_CAP_DEVICE_CAPS)
+		caps = port->cap.device_caps;
+
+	if (caps & V4L2_CAP_VIDEO_CAPTURE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	else if (caps & V4L2_CAP_VIDEO_CAPTURE_MPLANE)
+		port->type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+	else {
 		spa_log_error(port->log, "v4l2: %s is no video capture device", props->device);
 		return -ENODEV;
 	}
@@ -101,6 +108,25 @@ static int spa_v4l2_open(struct impl *this)
 	return 0;
 }
 
+static inline bool is_mplane(struct port *port)
+{
+	return port->type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+}
+
+static void init_v4l2_buffer(struct port *port, struct buffer *b, uint32_t index)
+{
+	spa_zero(b->v4l2_buffer);
+	b->v4l2_buffer.type = port->type;
+	b->v4l2_buffer.memory = port->memtype;
+	b->v4l2_buffer.index = index;
+
+	if (is_mplane(port)) {
+		spa_zero(b->planes);
+		b->v4l2_buffer.m.planes = b->planes;
+		b->v4l2_buffer.length = port->n_planes;
+	}
+}
+
 static int spa_v4l2_buffer_recycle(struct impl *this, uint32_t buffer_id)
 {
 	struct port *port = &this->out_ports[0];
@@ -133,6 +159,7 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 	for (i = 0; i < port->n_buffers; i++) {
 		struct buffer *b;
 		struct spa_data *d;
+		uint32_t j;
 
 		b = &port->buffers[i];
 		d = b->outbuf->datas;
@@ -141,18 +168,21 @@ static int spa_v4l2_clear_buffers(struct impl *this)
 			spa_log_info(port->log, "v4l2: queueing outstanding buffer %p", b);
 			spa_v4l2_buffer_recycle(this, i);
 		}
-		if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_MAPPED)) {
-			munmap(SPA_MEMBER(b->ptr, -d[0].mapoffset, void),
-					d[0].maxsize - d[0].mapoffset);
-		}
-		if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_ALLOCATED)) {
-			close(d[0].fd);
+		for (j = 0; j < port->n_planes && j < b->outbuf->n_datas; j++) {
+			if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_MAPPED) && b->ptrs[j] != NULL) {
+				munmap(b->ptrs[j], b->sizes[j]);
+				b->ptrs[j] = NULL;
+			}
+			if (SPA_FLAG_CHECK(b->flags, BUFFER_FLAG_ALLOCATED) &&
+			    d[j].type == this->type.data.DmaBuf) {
+				close(d[j].fd);
+			}
+			d[j].type = SPA_ID_INVALID;
 		}
-		d[0].type = SPA_ID_INVALID;
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = 0;
 
@@ -540,7 +570,7 @@ spa_v4l2_enum_format(struct impl *this,
 	if (*index == 0) {
 		spa_zero(port->fmtdesc);
 		port->fmtdesc.index = 0;
-		port->fmtdesc.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		port->fmtdesc.type = port->type;
 		port->next_fmtdesc = true;
 		spa_zero(port->frmsize);
 		port->next_frmsize = true;
@@ -815,7 +845,8 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 {
 	struct port *port = &this->out_ports[0];
 	int res, cmd;
-	struct v4l2_format reqfmt, fmt;
+	uint32_t i, fourcc, width, height;
+	struct v4l2_format fmt;
 	struct v4l2_streamparm streamparm;
 	const struct format_info *info = NULL;
 	uint32_t video_format;
@@ -823,11 +854,6 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	struct spa_fraction *framerate = NULL;
 	struct type *t = &this->type;
 
-	spa_zero(fmt);
-	spa_zero(streamparm);
-	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	streamparm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
 	if (format->media_subtype == this->type.media_subtype.raw) {
 		video_format = format->info.raw.format;
 		size = &format->info.raw.size;
@@ -854,24 +880,34 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 		return -EINVAL;
 	}
 
+	if ((res = spa_v4l2_open(this)) < 0)
+		return res;
 
-	fmt.fmt.pix.pixelformat = info->fourcc;
-	fmt.fmt.pix.field = V4L2_FIELD_ANY;
-	fmt.fmt.pix.width = size->width;
-	fmt.fmt.pix.height = size->height;
+      again:
+	spa_zero(fmt);
+	spa_zero(streamparm);
+	fmt.type = port->type;
+	streamparm.type = port->type;
+
+	if (is_mplane(port)) {
+		fmt.fmt.pix_mp.pixelformat = info->fourcc;
+		fmt.fmt.pix_mp.field = V4L2_FIELD_ANY;
+		fmt.fmt.pix_mp.width = size->width;
+		fmt.fmt.pix_mp.height = size->height;
+	} else {
+		fmt.fmt.pix.pixelformat = info->fourcc;
+		fmt.fmt.pix.field = V4L2_FIELD_ANY;
+		fmt.fmt.pix.width = size->width;
+		fmt.fmt.pix.height = size->height;
+	}
 	streamparm.parm.capture.timeperframe.numerator = framerate->denom;
 	streamparm.parm.capture.timeperframe.denominator = framerate->num;
 
-	spa_log_info(port->log, "v4l2: set %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
-		     fmt.fmt.pix.width, fmt.fmt.pix.height,
+	spa_log_info(port->log, "v4l2: set %08x %dx%d %d/%d", info->fourcc,
+		     size->width, size->height,
 		     streamparm.parm.capture.timeperframe.denominator,
 		     streamparm.parm.capture.timeperframe.numerator);
 
-	reqfmt = fmt;
-
-	if ((res = spa_v4l2_open(this)) < 0)
-		return res;
-
 	cmd = try_only ? VIDIOC_TRY_FMT : VIDIOC_S_FMT;
 	if (xioctl(port->fd, cmd, &fmt) < 0) {
 		res = -errno;
@@ -883,24 +919,63 @@ static int spa_v4l2_set_format(struct impl *this, struct spa_video_info *format,
 	if (xioctl(port->fd, VIDIOC_S_PARM, &streamparm) < 0)
 		spa_log_warn(port->log, "VIDIOC_S_PARM: %m");
 
-	spa_log_info(port->log, "v4l2: got %08x %dx%d %d/%d", fmt.fmt.pix.pixelformat,
-		     fmt.fmt.pix.width, fmt.fmt.pix.height,
+	if (is_mplane(port)) {
+		fourcc = fmt.fmt.pix_mp.pixelformat;
+		width = fmt.fmt.pix_mp.width;
+		height = fmt.fmt.pix_mp.height;
+	} else {
+		fourcc = fmt.fmt.pix.pixelformat;
+		width = fmt.fmt.pix.width;
+		height = fmt.fmt.pix.height;
+	}
+
+	spa_log_info(port->log, "v4l2: got %08x %dx%d %d/%d", fourcc,
+		     width, height,
 		     streamparm.parm.capture.timeperframe.denominator,
 		     streamparm.parm.capture.timeperframe.numerator);
 
-	if (reqfmt.fmt.pix.pixelformat != fmt.fmt.pix.pixelformat ||
-	    reqfmt.fmt.pix.width != fmt.fmt.pix.width ||
-	    reqfmt.fmt.pix.height != fmt.fmt.pix.height)
+	if (fourcc != info->fourcc) {
+		/* try the next fourcc for the same format, NV12 can be
+		 * NV12 or NV12M depending on the driver */
+		info = find_format_info_by_media_type(t,
+					      format->media_type,
+					      format->media_subtype, video_format,
+					      (info - format_info) + 1);
+		if (info != NULL)
+			goto again;
+		return -EINVAL;
+	}
+	if (size->width != width || size->height != height)
 		return -EINVAL;
 
 	if (try_only)
 		return 0;
 
-	size->width = fmt.fmt.pix.width;
-	size->height = fmt.fmt.pix.height;
+	size->width = width;
+	size->height = height;
 	framerate->num = streamparm.parm.capture.timeperframe.denominator;
 	framerate->denom = streamparm.parm.capture.timeperframe.numerator;
 
+	if (framerate->num > 0)
+		port->frame_duration = SPA_NSEC_PER_SEC * framerate->denom / framerate->num;
+	else
+		port->frame_duration = 0;
+
+	if (is_mplane(port)) {
+		struct v4l2_pix_format_mplane *mp = &fmt.fmt.pix_mp;
+
+		port->n_planes = SPA_CLAMP(mp->num_planes, 1, VIDEO_MAX_PLANES);
+		for (i = 0; i < port->n_planes; i++) {
+			port->plane_stride[i] = mp->plane_fmt[i].bytesperline;
+			port->plane_size[i] = mp->plane_fmt[i].sizeimage;
+		}
+	} else {
+		port->n_planes = 1;
+		port->plane_stride[0] = fmt.fmt.pix.bytesperline;
+		port->plane_size[0] = fmt.fmt.pix.sizeimage;
+	}
+	spa_log_info(port->log, "v4l2: using %d planes", port->n_planes);
+
 	port->fmt = fmt;
 	port->info.flags = (port->export_buf ? SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS : 0) |
 		SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
@@ -1142,40 +1217,78 @@ static int mmap_read(struct impl *this)
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_buffer buf;
+	struct v4l2_plane planes[VIDEO_MAX_PLANES];
 	struct buffer *b;
 	struct spa_data *d;
-	int64_t pts;
+	struct timespec now;
+	int64_t pts, now_ns;
+	uint32_t i;
+	bool discont = false;
 	struct spa_io_buffers *io = port->io;
 
 	spa_zero(buf);
-	buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	buf.type = port->type;
 	buf.memory = port->memtype;
+	if (is_mplane(port)) {
+		spa_zero(planes);
+		buf.m.planes = planes;
+		buf.length = port->n_planes;
+	}
 
 	if (xioctl(port->fd, VIDIOC_DQBUF, &buf) < 0)
 		return -errno;
 
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = SPA_TIMESPEC_TO_TIME(&now);
+
 	port->last_ticks = (int64_t) buf.timestamp.tv_sec * SPA_USEC_PER_SEC +
 			    (uint64_t) buf.timestamp.tv_usec;
-	pts = port->last_ticks * 1000;
 
-	if (buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
-		port->last_monotonic = pts;
+	/* only trust the driver timestamp when it is on the monotonic clock,
+	 * otherwise use the dequeue time so that pts stays comparable with
+	 * other monotonic clocks */
+	if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC)
+		pts = port->last_ticks * SPA_NSEC_PER_USEC;
 	else
-		port->last_monotonic = SPA_TIME_INVALID;
+		pts = now_ns;
+	port->last_monotonic = pts;
+
+	port->frames_dequeued++;
+	if (port->have_sequence && buf.sequence != port->last_sequence + 1) {
+		port->frames_dropped += buf.sequence - port->last_sequence - 1;
+		discont = true;
+		spa_log_debug(port->log, "v4l2 %p: sequence gap %u -> %u", this,
+				port->last_sequence, buf.sequence);
+	}
+	port->have_sequence = true;
+	port->last_sequence = buf.sequence;
+
+	if (port->frame_duration > 0 && now_ns - pts > port->frame_duration)
+		port->frames_late++;
 
 	b = &port->buffers[buf.index];
 	if (b->h) {
 		b->h->flags = 0;
 		if (buf.flags & V4L2_BUF_FLAG_ERROR)
 			b->h->flags |= SPA_META_HEADER_FLAG_CORRUPTED;
+		if (discont)
+			b->h->flags |= SPA_META_HEADER_FLAG_DISCONT;
 		b->h->seq = buf.sequence;
 		b->h->pts = pts;
 	}
 
 	d = b->outbuf->datas;
-	d[0].chunk->offset = 0;
-	d[0].chunk->size = buf.bytesused;
-	d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
+	if (is_mplane(port)) {
+		for (i = 0; i < port->n_planes; i++) {
+			d[i].chunk->offset = planes[i].data_offset;
+			d[i].chunk->size = planes[i].bytesused - planes[i].data_offset;
+			d[i].chunk->stride = port->plane_stride[i];
+		}
+	} else {
+		d[0].chunk->offset = 0;
+		d[0].chunk->size = buf.bytesused;
+		d[0].chunk->stride = port->plane_stride[0];
+	}
 
 	SPA_FLAG_SET(b->flags, BUFFER_FLAG_OUTSTANDING);
 	io->buffer_id = b->outbuf->id;
@@ -1211,7 +1324,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	uint32_t i, j;
 	struct spa_data *d;
 
 	if (n_buffers > 0) {
@@ -1230,7 +1343,7 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 	}
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = n_buffers;
 
@@ -1254,43 +1367,54 @@ static int spa_v4l2_use_buffers(struct impl *this, struct spa_buffer **buffers,
 
 		spa_log_info(port->log, "v4l2: import buffer %p", buffers[i]);
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < port->n_planes) {
 			spa_log_error(port->log, "v4l2: invalid memory on buffer %p", buffers[i]);
 			return -EINVAL;
 		}
 		d = buffers[i]->datas;
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
-
-		if (port->memtype == V4L2_MEMORY_USERPTR) {
-			if (d[0].data == NULL) {
-				void *data;
-
-				data = mmap(NULL,
-					    d[0].maxsize + d[0].mapoffset,
-					    PROT_READ | PROT_WRITE, MAP_SHARED,
-					    d[0].fd,
-					    0);
-				if (data == MAP_FAILED)
-					return -errno;
+		init_v4l2_buffer(port, b, i);
 
-				b->ptr = SPA_MEMBER(data, d[0].mapoffset, void);
-				SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
-			}
-			else
-				b->ptr = d[0].data;
+		for (j = 0; j < port->n_planes; j++) {
+			void *ptr = NULL;
 
-			b->v4l2_buffer.m.userptr = (unsigned long) b->ptr;
-			b->v4l2_buffer.length = d[0].maxsize;
-		}
-		else if (port->memtype == V4L2_MEMORY_DMABUF) {
-			b->v4l2_buffer.m.fd = d[0].fd;
+			if (port->memtype == V4L2_MEMORY_USERPTR) {
+				if (d[j].data == NULL) {
+					void *data;
+
+					data = mmap(NULL,
+						    d[j].maxsize + d[j].mapoffset,
+						    PROT_READ | PROT_WRITE, MAP_SHARED,
+						    d[j].fd,
+						    0);
+					if (data == MAP_FAILED)
+						return -errno;
+
+					b->ptrs[j] = data;
+					b->sizes[j] = d[j].maxsize + d[j].mapoffset;
+					ptr = SPA_MEMBER(data, d[j].mapoffset, void);
+					SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
+				}
+				else
+					ptr = d[j].data;
+			}
+			else if (port->memtype != V4L2_MEMORY_DMABUF)
+				return -EIO;
+
+			if (is_mplane(port)) {
+				if (port->memtype == V4L2_MEMORY_USERPTR)
+					b->planes[j].m.userptr = (unsigned long) ptr;
+				else
+					b->planes[j].m.fd = d[j].fd;
+				b->planes[j].length = d[j].maxsize;
+			} else {
+				if (port->memtype == V4L2_MEMORY_USERPTR)
+					b->v4l2_buffer.m.userptr = (unsigned long) ptr;
+				else
+					b->v4l2_buffer.m.fd = d[j].fd;
+				b->v4l2_buffer.length = d[j].maxsize;
+			}
 		}
-		else
-			return -EIO;
 
 		spa_v4l2_buffer_recycle(this, buffers[i]->id);
 	}
@@ -1308,12 +1432,13 @@ mmap_init(struct impl *this,
 {
 	struct port *port = &this->out_ports[0];
 	struct v4l2_requestbuffers reqbuf;
-	int i;
+	uint32_t i, j;
+	bool export_buf;
 
 	port->memtype = V4L2_MEMORY_MMAP;
 
 	spa_zero(reqbuf);
-	reqbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	reqbuf.type = port->type;
 	reqbuf.memory = port->memtype;
 	reqbuf.count = *n_buffers;
 
@@ -1329,14 +1454,15 @@ mmap_init(struct impl *this,
 		spa_log_error(port->log, "v4l2: can't allocate enough buffers");
 		return -ENOMEM;
 	}
-	if (port->export_buf)
+	export_buf = port->export_buf;
+	if (export_buf)
 		spa_log_info(port->log, "v4l2: using EXPBUF");
 
 	for (i = 0; i < reqbuf.count; i++) {
 		struct buffer *b;
 		struct spa_data *d;
 
-		if (buffers[i]->n_datas < 1) {
+		if (buffers[i]->n_datas < port->n_planes) {
 			spa_log_error(port->log, "v4l2: invalid buffer data");
 			return -EINVAL;
 		}
@@ -1346,10 +1472,7 @@ mmap_init(struct impl *this,
 		b->flags = BUFFER_FLAG_OUTSTANDING;
 		b->h = spa_buffer_find_meta(b->outbuf, this->type.meta.Header);
 
-		spa_zero(b->v4l2_buffer);
-		b->v4l2_buffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		b->v4l2_buffer.memory = port->memtype;
-		b->v4l2_buffer.index = i;
+		init_v4l2_buffer(port, b, i);
 
 		if (xioctl(port->fd, VIDIOC_QUERYBUF, &b->v4l2_buffer) < 0) {
 			spa_log_error(port->log, "VIDIOC_QUERYBUF: %m");
@@ -1357,41 +1480,58 @@ mmap_init(struct impl *this,
 		}
 
 		d = buffers[i]->datas;
-		d[0].mapoffset = 0;
-		d[0].maxsize = b->v4l2_buffer.length;
-		d[0].chunk->offset = 0;
-		d[0].chunk->size = 0;
-		d[0].chunk->stride = port->fmt.fmt.pix.bytesperline;
-
-		if (port->export_buf) {
-			struct v4l2_exportbuffer expbuf;
-
-			spa_zero(expbuf);
-			expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			expbuf.index = i;
-			expbuf.flags = O_CLOEXEC | O_RDONLY;
-			if (xioctl(port->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
-				spa_log_error(port->log, "VIDIOC_EXPBUF: %m");
-				continue;
+		for (j = 0; j < port->n_planes; j++) {
+			uint32_t length, offset;
+
+			if (is_mplane(port)) {
+				length = b->planes[j].length;
+				offset = b->planes[j].m.mem_offset;
+			} else {
+				length = b->v4l2_buffer.length;
+				offset = b->v4l2_buffer.m.offset;
 			}
-			d[0].type = this->type.data.DmaBuf;
-			d[0].fd = expbuf.fd;
-			d[0].data = NULL;
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_ALLOCATED);
-		} else {
-			d[0].type = this->type.data.MemPtr;
-			d[0].fd = -1;
-			d[0].data = mmap(NULL,
-					 b->v4l2_buffer.length,
-					 PROT_READ, MAP_SHARED,
-					 port->fd,
-					 b->v4l2_buffer.m.offset);
-			if (d[0].data == MAP_FAILED) {
+
+			d[j].mapoffset = 0;
+			d[j].maxsize = length;
+			d[j].chunk->offset = 0;
+			d[j].chunk->size = 0;
+			d[j].chunk->stride = port->plane_stride[j];
+
+			d[j].type = this->type.data.MemPtr;
+			d[j].fd = -1;
+
+			if (export_buf) {
+				struct v4l2_exportbuffer expbuf;
+
+				spa_zero(expbuf);
+				expbuf.type = port->type;
+				expbuf.index = i;
+				expbuf.plane = j;
+				expbuf.flags = O_CLOEXEC | O_RDONLY;
+				if (xioctl(port->fd, VIDIOC_EXPBUF, &expbuf) < 0) {
+					/* not all drivers can export, fall back to plain mmap */
+					spa_log_warn(port->log, "VIDIOC_EXPBUF: %m, disabling export");
+					export_buf = false;
+				} else {
+					d[j].type = this->type.data.DmaBuf;
+					d[j].fd = expbuf.fd;
+					SPA_FLAG_SET(b->flags, BUFFER_FLAG_ALLOCATED);
+				}
+			}
+
+			/* also map exported buffers so that local nodes can read them,
+			 * remote clients only receive the fd */
+			d[j].data = mmap(NULL, length, PROT_READ, MAP_SHARED, port->fd, offset);
+			if (d[j].data == MAP_FAILED) {
 				spa_log_error(port->log, "mmap: %m");
-				continue;
+				d[j].data = NULL;
+				if (d[j].type != this->type.data.DmaBuf)
+					return -errno;
+			} else {
+				b->ptrs[j] = d[j].data;
+				b->sizes[j] = length;
+				SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
 			}
-			b->ptr = d[0].data;
-			SPA_FLAG_SET(b->flags, BUFFER_FLAG_MAPPED);
 		}
 		spa_v4l2_buffer_recycle(this, i);
 	}
@@ -1449,12 +1589,17 @@ static int spa_v4l2_stream_on(struct impl *this)
 
 	spa_log_debug(this->log, "starting");
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(port->fd, VIDIOC_STREAMON, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMON: %m");
 		return -errno;
 	}
 
+	port->have_sequence = false;
+	port->frames_dequeued = 0;
+	port->frames_dropped = 0;
+	port->frames_late = 0;
+
 	spa_loop_add_source(port->data_loop, &port->source);
 
 	port->started = true;
@@ -1490,7 +1635,7 @@ static int spa_v4l2_stream_off(struct impl *this)
 
 	spa_loop_invoke(port->data_loop, do_remove_source, 0, NULL, 0, true, port);
 
-	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	type = port->type;
 	if (xioctl(port->fd, VIDIOC_STREAMOFF, &type) < 0) {
 		spa_log_error(this->log, "VIDIOC_STREAMOFF: %m");
 		return -errno;
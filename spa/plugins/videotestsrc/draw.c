@@ -19,6 +19,10 @@
 
 #include <errno.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 typedef enum {
 	GRAY = 0,
 	YELLOW,
@@ -63,18 +67,27 @@ static Pixel colors[N_COLORS] = {
 	{29, 29, 29, 0, 0, 0},		/* LIGHT BLACK */
 };
 
+/* snow is gray, the chroma of gray is 128 */
+static Pixel snow_color = {128, 128, 128, 128, 128, 128};
+
 /* YUV values are computed in init_colors() */
 
 typedef struct _DrawingData DrawingData;
 
 typedef void (*DrawPixelFunc) (DrawingData * dd, int x, Pixel * pixel);
 
+/* write \a n snow pixels from the random bytes in \a rnd at \a x */
+typedef void (*DrawSnowFunc) (DrawingData * dd, int x, int n, const uint8_t * rnd);
+
 struct _DrawingData {
-	char *line;
+	uint8_t *line[MAX_PLANES];
+	int stride[MAX_PLANES];
+	int n_planes;
 	int width;
 	int height;
-	int stride;
+	int y;
 	DrawPixelFunc draw_pixel;
+	DrawSnowFunc draw_snow;
 };
 
 static inline void update_yuv(Pixel * pixel)
@@ -112,63 +125,264 @@ static void init_colors(void)
 
 static void draw_pixel_rgb(DrawingData * dd, int x, Pixel * color)
 {
-	dd->line[3 * x + 0] = color->R;
-	dd->line[3 * x + 1] = color->G;
-	dd->line[3 * x + 2] = color->B;
+	dd->line[0][3 * x + 0] = color->R;
+	dd->line[0][3 * x + 1] = color->G;
+	dd->line[0][3 * x + 2] = color->B;
+}
+
+static void draw_pixel_bgrx(DrawingData * dd, int x, Pixel * color)
+{
+	dd->line[0][4 * x + 0] = color->B;
+	dd->line[0][4 * x + 1] = color->G;
+	dd->line[0][4 * x + 2] = color->R;
+	dd->line[0][4 * x + 3] = 0xff;
+}
+
+static void draw_pixel_rgba(DrawingData * dd, int x, Pixel * color)
+{
+	dd->line[0][4 * x + 0] = color->R;
+	dd->line[0][4 * x + 1] = color->G;
+	dd->line[0][4 * x + 2] = color->B;
+	dd->line[0][4 * x + 3] = 0xff;
 }
 
 static void draw_pixel_uyvy(DrawingData * dd, int x, Pixel * color)
 {
 	if (x & 1) {
 		/* odd pixel */
-		dd->line[2 * (x - 1) + 3] = color->Y;
+		dd->line[0][2 * (x - 1) + 3] = color->Y;
 	} else {
 		/* even pixel */
-		dd->line[2 * x + 0] = color->U;
-		dd->line[2 * x + 1] = color->Y;
-		dd->line[2 * x + 2] = color->V;
+		dd->line[0][2 * x + 0] = color->U;
+		dd->line[0][2 * x + 1] = color->Y;
+		dd->line[0][2 * x + 2] = color->V;
+	}
+}
+
+static void draw_pixel_yuy2(DrawingData * dd, int x, Pixel * color)
+{
+	if (x & 1) {
+		/* odd pixel */
+		dd->line[0][2 * x] = color->Y;
+	} else {
+		/* even pixel */
+		dd->line[0][2 * x + 0] = color->Y;
+		dd->line[0][2 * x + 1] = color->U;
+		dd->line[0][2 * x + 3] = color->V;
+	}
+}
+
+/* for the 4:2:0 formats, the chroma of a 2x2 block comes from its top left pixel */
+static void draw_pixel_i420(DrawingData * dd, int x, Pixel * color)
+{
+	dd->line[0][x] = color->Y;
+	if (((x | dd->y) & 1) == 0) {
+		dd->line[1][x / 2] = color->U;
+		dd->line[2][x / 2] = color->V;
+	}
+}
+
+static void draw_pixel_nv12(DrawingData * dd, int x, Pixel * color)
+{
+	dd->line[0][x] = color->Y;
+	if (((x | dd->y) & 1) == 0) {
+		dd->line[1][x + 0] = color->U;
+		dd->line[1][x + 1] = color->V;
+	}
+}
+
+static void draw_snow_rgb(DrawingData * dd, int x, int n, const uint8_t * rnd)
+{
+	uint8_t *d = &dd->line[0][3 * x];
+	int i;
+
+	for (i = 0; i < n; i++) {
+		d[0] = d[1] = d[2] = rnd[i];
+		d += 3;
+	}
+}
+
+static void draw_snow_xrgb(DrawingData * dd, int x, int n, const uint8_t * rnd)
+{
+	uint8_t *d = &dd->line[0][4 * x];
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	__m128i r, rr;
+
+	for (; i + 16 <= n; i += 16) {
+		r = _mm_loadu_si128((const __m128i *) &rnd[i]);
+		rr = _mm_unpacklo_epi8(r, r);
+		_mm_storeu_si128((__m128i *) (d + 0), _mm_or_si128(_mm_unpacklo_epi16(rr, rr), alpha));
+		_mm_storeu_si128((__m128i *) (d + 16), _mm_or_si128(_mm_unpackhi_epi16(rr, rr), alpha));
+		rr = _mm_unpackhi_epi8(r, r);
+		_mm_storeu_si128((__m128i *) (d + 32), _mm_or_si128(_mm_unpacklo_epi16(rr, rr), alpha));
+		_mm_storeu_si128((__m128i *) (d + 48), _mm_or_si128(_mm_unpackhi_epi16(rr, rr), alpha));
+		d += 64;
+	}
+#endif
+	for (; i < n; i++) {
+		d[0] = d[1] = d[2] = rnd[i];
+		d[3] = 0xff;
+		d += 4;
 	}
 }
 
-static int drawing_data_init(DrawingData * dd, struct impl *this, char *data)
+/* luma and chroma bytes alternate, \a luma_first for YUY2, not for UYVY */
+static inline void draw_snow_packed_yuv(DrawingData * dd, int x, int n,
+					const uint8_t * rnd, bool luma_first)
+{
+	uint8_t *d = &dd->line[0][2 * x];
+	int i = 0;
+
+#if defined(__SSE2__)
+	const __m128i c = _mm_set1_epi8((char) 128);
+	__m128i r;
+
+	for (; i + 16 <= n; i += 16) {
+		r = _mm_loadu_si128((const __m128i *) &rnd[i]);
+		if (luma_first) {
+			_mm_storeu_si128((__m128i *) (d + 0), _mm_unpacklo_epi8(r, c));
+			_mm_storeu_si128((__m128i *) (d + 16), _mm_unpackhi_epi8(r, c));
+		} else {
+			_mm_storeu_si128((__m128i *) (d + 0), _mm_unpacklo_epi8(c, r));
+			_mm_storeu_si128((__m128i *) (d + 16), _mm_unpackhi_epi8(c, r));
+		}
+		d += 32;
+	}
+#endif
+	for (; i < n; i++) {
+		d[luma_first ? 0 : 1] = rnd[i];
+		d[luma_first ? 1 : 0] = 128;
+		d += 2;
+	}
+}
+
+static void draw_snow_uyvy(DrawingData * dd, int x, int n, const uint8_t * rnd)
+{
+	draw_snow_packed_yuv(dd, x, n, rnd, false);
+}
+
+static void draw_snow_yuy2(DrawingData * dd, int x, int n, const uint8_t * rnd)
+{
+	draw_snow_packed_yuv(dd, x, n, rnd, true);
+}
+
+/* the chroma planes of the snow are gray in the template already */
+static void draw_snow_planar(DrawingData * dd, int x, int n, const uint8_t * rnd)
+{
+	memcpy(&dd->line[0][x], rnd, n);
+}
+
+static int drawing_data_init(DrawingData * dd, struct impl *this, uint8_t *data)
 {
 	struct spa_video_info *format = &this->current_format;
 	struct spa_rectangle *size = &format->info.raw.size;
+	uint32_t f = format->info.raw.format;
+	int i;
 
 	if ((format->media_type != this->type.media_type.video) ||
 	    (format->media_subtype != this->type.media_subtype.raw))
 		return -ENOTSUP;
 
-	if (format->info.raw.format == this->type.video_format.RGB) {
+	if (f == this->type.video_format.RGB) {
 		dd->draw_pixel = draw_pixel_rgb;
-	} else if (format->info.raw.format == this->type.video_format.UYVY) {
+		dd->draw_snow = draw_snow_rgb;
+	} else if (f == this->type.video_format.BGRx) {
+		dd->draw_pixel = draw_pixel_bgrx;
+		dd->draw_snow = draw_snow_xrgb;
+	} else if (f == this->type.video_format.RGBA) {
+		dd->draw_pixel = draw_pixel_rgba;
+		dd->draw_snow = draw_snow_xrgb;
+	} else if (f == this->type.video_format.UYVY) {
 		dd->draw_pixel = draw_pixel_uyvy;
+		dd->draw_snow = draw_snow_uyvy;
+	} else if (f == this->type.video_format.YUY2) {
+		dd->draw_pixel = draw_pixel_yuy2;
+		dd->draw_snow = draw_snow_yuy2;
+	} else if (f == this->type.video_format.I420) {
+		dd->draw_pixel = draw_pixel_i420;
+		dd->draw_snow = draw_snow_planar;
+	} else if (f == this->type.video_format.NV12) {
+		dd->draw_pixel = draw_pixel_nv12;
+		dd->draw_snow = draw_snow_planar;
 	} else
 		return -ENOTSUP;
 
-	dd->line = data;
+	dd->n_planes = this->n_planes;
+	for (i = 0; i < dd->n_planes; i++) {
+		dd->line[i] = data + this->plane_offset[i];
+		dd->stride[i] = this->plane_stride[i];
+	}
 	dd->width = size->width;
 	dd->height = size->height;
-	dd->stride = this->stride;
+	dd->y = 0;
 
 	return 0;
 }
 
-static inline void draw_pixels(DrawingData * dd, int offset, Color color, int length)
+static inline void draw_pixels(DrawingData * dd, int offset, Pixel * pixel, int length)
 {
 	int x;
 
 	for (x = offset; x < offset + length; x++) {
-		dd->draw_pixel(dd, x, &colors[color]);
+		dd->draw_pixel(dd, x, pixel);
 	}
 }
 
 static inline void next_line(DrawingData * dd)
 {
-	dd->line += dd->stride;
+	int i;
+
+	dd->line[0] += dd->stride[0];
+	/* the chroma planes are subsampled vertically */
+	if (++dd->y & 1)
+		return;
+	for (i = 1; i < dd->n_planes; i++)
+		dd->line[i] += dd->stride[i];
+}
+
+/* xorshift32 in 4 independent lanes, 16 random bytes per round */
+static void fill_random(uint32_t *seed, uint8_t *rnd, int n)
+{
+	int i = 0, j;
+
+#if defined(__SSE2__)
+	__m128i s = _mm_loadu_si128((__m128i *) seed);
+
+	for (; i + 16 <= n; i += 16) {
+		s = _mm_xor_si128(s, _mm_slli_epi32(s, 13));
+		s = _mm_xor_si128(s, _mm_srli_epi32(s, 17));
+		s = _mm_xor_si128(s, _mm_slli_epi32(s, 5));
+		_mm_storeu_si128((__m128i *) &rnd[i], s);
+	}
+	_mm_storeu_si128((__m128i *) seed, s);
+#endif
+	for (; i < n; i += 4) {
+		for (j = 0; j < 4 && i + j < n; j++) {
+			uint32_t s = seed[j];
+			s ^= s << 13;
+			s ^= s >> 17;
+			s ^= s << 5;
+			seed[j] = s;
+			rnd[i + j] = s;
+		}
+	}
 }
 
-static void draw_smpte_snow(DrawingData * dd)
+/* the snow of the SMPTE pattern starts after the pluge, on a chroma pair */
+static inline int smpte_snow_x(int w)
+{
+	return (3 * (w / 6) + 3 * (w / 12)) & ~1;
+}
+
+static inline int smpte_snow_y(int h)
+{
+	return 3 * h / 4;
+}
+
+static void draw_smpte(DrawingData * dd)
 {
 	int h, w;
 	int y1, y2;
@@ -177,13 +391,13 @@ static void draw_smpte_snow(DrawingData * dd)
 	w = dd->width;
 	h = dd->height;
 	y1 = 2 * h / 3;
-	y2 = 3 * h / 4;
+	y2 = smpte_snow_y(h);
 
 	for (i = 0; i < y1; i++) {
 		for (j = 0; j < 7; j++) {
 			int x1 = j * w / 7;
 			int x2 = (j + 1) * w / 7;
-			draw_pixels(dd, x1, j, x2 - x1);
+			draw_pixels(dd, x1, &colors[j], x2 - x1);
 		}
 		next_line(dd);
 	}
@@ -194,7 +408,7 @@ static void draw_smpte_snow(DrawingData * dd)
 			int x2 = (j + 1) * w / 7;
 			Color c = (j & 1) ? BLACK : BLUE - j;
 
-			draw_pixels(dd, x1, c, x2 - x1);
+			draw_pixels(dd, x1, &colors[c], x2 - x1);
 		}
 		next_line(dd);
 	}
@@ -203,77 +417,114 @@ static void draw_smpte_snow(DrawingData * dd)
 		int x = 0;
 
 		/* negative I */
-		draw_pixels(dd, x, NEG_I, w / 6);
+		draw_pixels(dd, x, &colors[NEG_I], w / 6);
 		x += w / 6;
 
 		/* white */
-		draw_pixels(dd, x, WHITE, w / 6);
+		draw_pixels(dd, x, &colors[WHITE], w / 6);
 		x += w / 6;
 
 		/* positive Q */
-		draw_pixels(dd, x, POS_Q, w / 6);
+		draw_pixels(dd, x, &colors[POS_Q], w / 6);
 		x += w / 6;
 
 		/* pluge */
-		draw_pixels(dd, x, DARK_BLACK, w / 12);
+		draw_pixels(dd, x, &colors[DARK_BLACK], w / 12);
 		x += w / 12;
-		draw_pixels(dd, x, BLACK, w / 12);
-		x += w / 12;
-		draw_pixels(dd, x, LIGHT_BLACK, w / 12);
+		draw_pixels(dd, x, &colors[BLACK], w / 12);
 		x += w / 12;
+		draw_pixels(dd, x, &colors[LIGHT_BLACK], w / 12);
 
-		/* war of the ants (a.k.a. snow) */
-		for (j = x; j < w; j++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, j, &p);
-		}
+		/* war of the ants (a.k.a. snow), filled in every frame */
+		x = smpte_snow_x(w);
+		draw_pixels(dd, x, &snow_color, w - x);
 
 		next_line(dd);
 	}
 }
 
-static void draw_snow(DrawingData * dd)
+static void draw_gray(DrawingData * dd)
 {
-	int x, y;
+	int y;
 
 	for (y = 0; y < dd->height; y++) {
-		for (x = 0; x < dd->width; x++) {
-			Pixel p;
-			unsigned char r = rand();
-
-			p.R = r;
-			p.G = r;
-			p.B = r;
-			update_yuv(&p);
-			dd->draw_pixel(dd, x, &p);
-		}
-
+		draw_pixels(dd, 0, &snow_color, dd->width);
 		next_line(dd);
 	}
 }
 
-static int draw(struct impl *this, char *data)
+/* Static patterns, and the static parts of the others, are rendered once
+ * into a template when the format or pattern changes. */
+static int draw_template(struct impl *this)
 {
 	DrawingData dd;
 	int res;
 
 	init_colors();
 
-	if ((res = drawing_data_init(&dd, this, data)) < 0)
+	if ((res = drawing_data_init(&dd, this, this->tmpl)) < 0)
 		return res;
 
 	switch (this->props.pattern) {
+	case PATTERN_SMPTE:
+	case PATTERN_SMPTE_SNOW:
+		draw_smpte(&dd);
+		break;
+	case PATTERN_SNOW:
+		draw_gray(&dd);
+		break;
+	default:
+		return -ENOTSUP;
+	}
+	this->tmpl_pattern = this->props.pattern;
+	this->tmpl_valid = true;
+
+	return 0;
+}
+
+static void draw_snow(struct impl *this, DrawingData * dd, int x, int y)
+{
+	int i;
+
+	for (i = 0; i < y; i++)
+		next_line(dd);
+
+	for (; y < dd->height; y++) {
+		fill_random(this->snow_seed, this->snow, dd->width - x);
+		dd->draw_snow(dd, x, dd->width - x, this->snow);
+		next_line(dd);
+	}
+}
+
+static int draw(struct impl *this, struct buffer *b)
+{
+	struct spa_data *d = b->outbuf->datas;
+	DrawingData dd;
+	int res;
+
+	if (this->tmpl == NULL)
+		return -EIO;
+
+	if (!this->tmpl_valid || this->tmpl_pattern != this->props.pattern) {
+		if ((res = draw_template(this)) < 0)
+			return res;
+	}
+
+	/* not all consumers honour SPA_DATA_FLAG_READONLY yet, a buffer can
+	 * come back modified so always start from the template */
+	memcpy(d[0].data, this->tmpl, this->size);
+
+	if ((res = drawing_data_init(&dd, this, d[0].data)) < 0)
+		return res;
+
+	switch (this->props.pattern) {
+	case PATTERN_SMPTE:
+		break;
 	case PATTERN_SMPTE_SNOW:
-		draw_smpte_snow(&dd);
+		draw_snow(this, &dd, smpte_snow_x(dd.width), smpte_snow_y(dd.height));
 		break;
 	case PATTERN_SNOW:
-		draw_snow(&dd);
+		draw_snow(this, &dd, 0, 0);
 		break;
 	default:
 		return -ENOTSUP;
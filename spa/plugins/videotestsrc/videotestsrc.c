@@ -20,6 +20,7 @@
 
 #include <errno.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
@@ -88,6 +89,7 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 enum pattern {
 	PATTERN_SMPTE_SNOW,
 	PATTERN_SNOW,
+	PATTERN_SMPTE,
 };
 
 #define DEFAULT_LIVE false
@@ -106,6 +108,7 @@ static void reset_props(struct props *props)
 
 #define MAX_BUFFERS 16
 #define MAX_PORTS 1
+#define MAX_PLANES 3
 
 struct buffer {
 	struct spa_buffer *outbuf;
@@ -140,6 +143,16 @@ struct impl {
 	struct spa_video_info current_format;
 	size_t bpp;
 	int stride;
+	uint32_t size;
+	int n_planes;
+	uint32_t plane_offset[MAX_PLANES];
+	int plane_stride[MAX_PLANES];
+
+	uint8_t *tmpl;
+	bool tmpl_valid;
+	uint32_t tmpl_pattern;
+	uint8_t *snow;
+	uint32_t snow_seed[4];
 
 	struct buffer buffers[MAX_BUFFERS];
 	uint32_t n_buffers;
@@ -204,7 +217,8 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propType, "i", p->pattern,
 				":", t->param.propLabels, "[-i",
 					"i", PATTERN_SMPTE_SNOW, "s", "SMPTE snow",
-					"i", PATTERN_SNOW, "s", "Snow", "]");
+					"i", PATTERN_SNOW, "s", "Snow",
+					"i", PATTERN_SMPTE, "s", "SMPTE", "]");
 			break;
 		default:
 			return 0;
@@ -273,7 +287,7 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 
 static int fill_buffer(struct impl *this, struct buffer *b)
 {
-	return draw(this, b->outbuf->datas[0].data);
+	return draw(this, b);
 }
 
 static void set_timer(struct impl *this, bool enabled)
@@ -323,7 +337,7 @@ static int make_buffer(struct impl *this)
 	spa_list_remove(&b->link);
 	b->outstanding = true;
 
-	n_bytes = b->outbuf->datas[0].maxsize;
+	n_bytes = this->size;
 
 	spa_log_trace(this->log, NAME " %p: dequeue buffer %d", this, b->outbuf->id);
 
@@ -508,8 +522,13 @@ static int port_enum_formats(struct spa_node *node,
 			"I", t->media_type.video,
 			"I", t->media_subtype.raw,
 			":", t->format_video.format,    "Ieu", t->video_format.RGB,
-				SPA_POD_PROP_ENUM(2, t->video_format.RGB,
-						     t->video_format.UYVY),
+				SPA_POD_PROP_ENUM(7, t->video_format.RGB,
+						     t->video_format.UYVY,
+						     t->video_format.YUY2,
+						     t->video_format.BGRx,
+						     t->video_format.RGBA,
+						     t->video_format.NV12,
+						     t->video_format.I420),
 			":", t->format_video.size,      "Rru", &SPA_RECTANGLE(320, 240),
 				SPA_POD_PROP_MIN_MAX(&SPA_RECTANGLE(1, 1),
 						     &SPA_RECTANGLE(INT32_MAX, INT32_MAX)),
@@ -597,8 +616,6 @@ impl_node_port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-
 		if (!this->have_format)
 			return -EIO;
 		if (*index > 0)
@@ -606,7 +623,7 @@ impl_node_port_enum_params(struct spa_node *node,
 
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", this->stride * raw_info->size.height,
+			":", t->param_buffers.size,    "i", this->size,
 			":", t->param_buffers.stride,  "i", this->stride,
 			":", t->param_buffers.buffers, "ir", 2,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
@@ -651,6 +668,56 @@ static int clear_buffers(struct impl *this)
 	return 0;
 }
 
+static void free_template(struct impl *this)
+{
+	free(this->tmpl);
+	this->tmpl = NULL;
+	free(this->snow);
+	this->snow = NULL;
+	this->tmpl_valid = false;
+}
+
+/* the planar formats are stored in one memory block, plane after plane */
+static int setup_layout(struct impl *this, const struct spa_video_info_raw *info)
+{
+	struct type *t = &this->type;
+	int width = info->size.width, height = info->size.height;
+	int i;
+
+	this->n_planes = 1;
+	this->bpp = 1;
+
+	if (info->format == t->video_format.RGB)
+		this->bpp = 3;
+	else if (info->format == t->video_format.UYVY ||
+		 info->format == t->video_format.YUY2)
+		this->bpp = 2;
+	else if (info->format == t->video_format.BGRx ||
+		 info->format == t->video_format.RGBA)
+		this->bpp = 4;
+	else if (info->format == t->video_format.I420)
+		this->n_planes = 3;
+	else if (info->format == t->video_format.NV12)
+		this->n_planes = 2;
+	else
+		return -EINVAL;
+
+	this->stride = SPA_ROUND_UP_N(this->bpp * width, 4);
+	this->plane_stride[0] = this->stride;
+	this->plane_offset[0] = 0;
+	this->size = this->stride * height;
+
+	for (i = 1; i < this->n_planes; i++) {
+		if (this->n_planes == 2)
+			this->plane_stride[i] = this->stride;
+		else
+			this->plane_stride[i] = SPA_ROUND_UP_N(SPA_ROUND_UP_N(width, 2) / 2, 4);
+		this->plane_offset[i] = this->size;
+		this->size += this->plane_stride[i] * (SPA_ROUND_UP_N(height, 2) / 2);
+	}
+	return 0;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags,
@@ -661,6 +728,7 @@ static int port_set_format(struct spa_node *node,
 	if (format == NULL) {
 		this->have_format = false;
 		clear_buffers(this);
+		free_template(this);
 	} else {
 		struct spa_video_info info = { 0 };
 
@@ -675,22 +743,21 @@ static int port_set_format(struct spa_node *node,
 		if (spa_format_video_raw_parse(format, &info.info.raw, &this->type.format_video) < 0)
 			return -EINVAL;
 
-		if (info.info.raw.format == this->type.video_format.RGB)
-			this->bpp = 3;
-		else if (info.info.raw.format == this->type.video_format.UYVY)
-			this->bpp = 2;
-		else
+		if (setup_layout(this, &info.info.raw) < 0)
 			return -EINVAL;
 
+		free_template(this);
+		this->tmpl = malloc(this->size);
+		this->snow = malloc(info.info.raw.size.width);
+		if (this->tmpl == NULL || this->snow == NULL) {
+			free_template(this);
+			return -ENOMEM;
+		}
+
 		this->current_format = info;
 		this->have_format = true;
 	}
 
-	if (this->have_format) {
-		struct spa_video_info_raw *raw_info = &this->current_format.info.raw;
-		this->stride = SPA_ROUND_UP_N(this->bpp * raw_info->size.width, 4);
-	}
-
 	return 0;
 }
 
@@ -747,13 +814,17 @@ impl_node_port_use_buffers(struct spa_node *node,
 		b->outstanding = false;
 		b->h = spa_buffer_find_meta(buffers[i], this->type.meta.Header);
 
-		if ((d[0].type == this->type.data.MemPtr ||
-		     d[0].type == this->type.data.MemFd ||
-		     d[0].type == this->type.data.DmaBuf) && d[0].data == NULL) {
+		if (((d[0].type == this->type.data.MemPtr ||
+		      d[0].type == this->type.data.MemFd ||
+		      d[0].type == this->type.data.DmaBuf) && d[0].data == NULL) ||
+		    d[0].maxsize < this->size) {
 			spa_log_error(this->log, NAME " %p: invalid memory on buffer %p", this,
 				      buffers[i]);
 			return -EINVAL;
 		}
+		/* consumers must copy the frames before writing to them */
+		d[0].flags |= SPA_DATA_FLAG_READONLY;
+
 		spa_list_append(&this->empty, &b->link);
 	}
 	this->n_buffers = n_buffers;
@@ -988,6 +1059,8 @@ static int impl_clear(struct spa_handle *handle)
 		spa_loop_remove_source(this->data_loop, &this->timer_source);
 	close(this->timer_source.fd);
 
+	free_template(this);
+
 	return 0;
 }
 
@@ -1027,6 +1100,11 @@ impl_init(const struct spa_handle_factory *factory,
 	this->clock = impl_clock;
 	reset_props(&this->props);
 
+	this->snow_seed[0] = 0x9e3779b9;
+	this->snow_seed[1] = 0x7f4a7c15;
+	this->snow_seed[2] = 0x2545f491;
+	this->snow_seed[3] = 0x6c078965;
+
 	spa_list_init(&this->empty);
 
 	this->timer_source.func = on_output;
@@ -0,0 +1,318 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+#include <spa/utils/defs.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "volume-ops.h"
+
+#define S16_MIN		-32768.f
+#define S16_MAX		32767.f
+#define S32_MIN		-2147483648.f
+/* the largest float below 2^31 */
+#define S32_MAX		2147483520.f
+
+/* gains are never ramped exponentially from or to 0, they start or end
+ * at -80dB instead */
+#define RAMP_FLOOR	0.0001f
+
+static inline void advance_gain(int n_channels, float *gain, const float *step,
+				enum volume_ramp ramp)
+{
+	int c;
+
+	if (ramp == VOLUME_RAMP_LINEAR) {
+		for (c = 0; c < n_channels; c++)
+			gain[c] += step[c];
+	} else if (ramp == VOLUME_RAMP_EXPONENTIAL) {
+		for (c = 0; c < n_channels; c++)
+			gain[c] *= step[c];
+	}
+}
+
+static inline int16_t f32_to_s16(float v)
+{
+	v = SPA_CLAMP(v, S16_MIN, S16_MAX);
+	return (int16_t) (v < 0.0f ? v - 0.5f : v + 0.5f);
+}
+
+static inline int32_t f32_to_s32(float v)
+{
+	v = SPA_CLAMP(v, S32_MIN, S32_MAX);
+	return (int32_t) (v < 0.0f ? v - 0.5f : v + 0.5f);
+}
+
+static void
+apply_s16(void *dst, const void *src, int n_channels, int n_frames,
+	  float *gain, const float *step, enum volume_ramp ramp)
+{
+	const int16_t *s = src;
+	int16_t *d = dst;
+	int i, c;
+
+	for (i = 0; i < n_frames; i++) {
+		for (c = 0; c < n_channels; c++)
+			d[c] = f32_to_s16(s[c] * gain[c]);
+		advance_gain(n_channels, gain, step, ramp);
+		d += n_channels;
+		s += n_channels;
+	}
+}
+
+static void
+apply_s32(void *dst, const void *src, int n_channels, int n_frames,
+	  float *gain, const float *step, enum volume_ramp ramp)
+{
+	const int32_t *s = src;
+	int32_t *d = dst;
+	int i, c;
+
+	for (i = 0; i < n_frames; i++) {
+		for (c = 0; c < n_channels; c++)
+			d[c] = f32_to_s32(s[c] * gain[c]);
+		advance_gain(n_channels, gain, step, ramp);
+		d += n_channels;
+		s += n_channels;
+	}
+}
+
+static void
+apply_f32(void *dst, const void *src, int n_channels, int n_frames,
+	  float *gain, const float *step, enum volume_ramp ramp)
+{
+	const float *s = src;
+	float *d = dst;
+	int i, c;
+
+	for (i = 0; i < n_frames; i++) {
+		for (c = 0; c < n_channels; c++)
+			d[c] = s[c] * gain[c];
+		advance_gain(n_channels, gain, step, ramp);
+		d += n_channels;
+		s += n_channels;
+	}
+}
+
+#if defined(__SSE2__)
+/* The SSE2 kernels work on vectors of 4 samples. A run of lcm(n_channels, 4)
+ * samples always starts on a frame and maps every vector lane to a fixed
+ * channel, so the gains for such a period are laid out once in lane order
+ * and advanced by whole periods while ramping. */
+struct lanes {
+	int n_vecs;		/* vectors in a period */
+	int n_frames;		/* frames in a period */
+	__m128 gain[VOLUME_MAX_CHANNELS];
+	__m128 step[VOLUME_MAX_CHANNELS];
+};
+
+static inline int lanes_init(struct lanes *l, int n_channels,
+			     const float *gain, const float *step, enum volume_ramp ramp)
+{
+	float g[4 * VOLUME_MAX_CHANNELS] __attribute__ ((aligned (16)));
+	float s[4 * VOLUME_MAX_CHANNELS] __attribute__ ((aligned (16)));
+	int i, c, f, n_samples;
+
+	if (n_channels > VOLUME_MAX_CHANNELS)
+		return -1;
+
+	for (c = n_channels; c % 4; c += n_channels);
+	n_samples = c;
+	l->n_vecs = n_samples / 4;
+	l->n_frames = n_samples / n_channels;
+
+	for (i = 0; i < n_samples; i++) {
+		c = i % n_channels;
+		g[i] = gain[c];
+		s[i] = 0.0f;
+		if (ramp == VOLUME_RAMP_LINEAR) {
+			g[i] += step[c] * (i / n_channels);
+			s[i] = step[c] * l->n_frames;
+		} else if (ramp == VOLUME_RAMP_EXPONENTIAL) {
+			s[i] = 1.0f;
+			for (f = 0; f < l->n_frames; f++) {
+				if (f < i / n_channels)
+					g[i] *= step[c];
+				s[i] *= step[c];
+			}
+		}
+	}
+	for (i = 0; i < l->n_vecs; i++) {
+		l->gain[i] = _mm_load_ps(&g[4 * i]);
+		l->step[i] = _mm_load_ps(&s[4 * i]);
+	}
+	return 0;
+}
+
+/* store the gains of the first frame of the next period back */
+static inline void lanes_gain(struct lanes *l, int n_channels, float *gain)
+{
+	float g[4 * VOLUME_MAX_CHANNELS] __attribute__ ((aligned (16)));
+	int i;
+
+	for (i = 0; i < l->n_vecs; i++)
+		_mm_store_ps(&g[4 * i], l->gain[i]);
+	memcpy(gain, g, n_channels * sizeof(float));
+}
+
+static inline void lanes_advance(struct lanes *l, int v, enum volume_ramp ramp)
+{
+	if (ramp == VOLUME_RAMP_LINEAR)
+		l->gain[v] = _mm_add_ps(l->gain[v], l->step[v]);
+	else if (ramp == VOLUME_RAMP_EXPONENTIAL)
+		l->gain[v] = _mm_mul_ps(l->gain[v], l->step[v]);
+}
+
+static void
+apply_s16_sse2(void *dst, const void *src, int n_channels, int n_frames,
+	       float *gain, const float *step, enum volume_ramp ramp)
+{
+	const int16_t *s = src;
+	int16_t *d = dst;
+	struct lanes l;
+	int p, v, n_periods;
+	__m128i in;
+	__m128 t;
+
+	if (lanes_init(&l, n_channels, gain, step, ramp) < 0) {
+		apply_s16(dst, src, n_channels, n_frames, gain, step, ramp);
+		return;
+	}
+	n_periods = n_frames / l.n_frames;
+
+	for (p = 0; p < n_periods; p++) {
+		for (v = 0; v < l.n_vecs; v++) {
+			in = _mm_loadl_epi64((const __m128i *) s);
+			in = _mm_srai_epi32(_mm_unpacklo_epi16(in, in), 16);
+			t = _mm_mul_ps(_mm_cvtepi32_ps(in), l.gain[v]);
+			in = _mm_cvtps_epi32(t);
+			_mm_storel_epi64((__m128i *) d, _mm_packs_epi32(in, in));
+			lanes_advance(&l, v, ramp);
+			s += 4;
+			d += 4;
+		}
+	}
+	if (n_periods > 0)
+		lanes_gain(&l, n_channels, gain);
+
+	apply_s16(d, s, n_channels, n_frames - n_periods * l.n_frames, gain, step, ramp);
+}
+
+static void
+apply_s32_sse2(void *dst, const void *src, int n_channels, int n_frames,
+	       float *gain, const float *step, enum volume_ramp ramp)
+{
+	const __m128 min = _mm_set1_ps(S32_MIN), max = _mm_set1_ps(S32_MAX);
+	const int32_t *s = src;
+	int32_t *d = dst;
+	struct lanes l;
+	int p, v, n_periods;
+	__m128 t;
+
+	if (lanes_init(&l, n_channels, gain, step, ramp) < 0) {
+		apply_s32(dst, src, n_channels, n_frames, gain, step, ramp);
+		return;
+	}
+	n_periods = n_frames / l.n_frames;
+
+	for (p = 0; p < n_periods; p++) {
+		for (v = 0; v < l.n_vecs; v++) {
+			t = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) s));
+			t = _mm_mul_ps(t, l.gain[v]);
+			t = _mm_min_ps(_mm_max_ps(t, min), max);
+			_mm_storeu_si128((__m128i *) d, _mm_cvtps_epi32(t));
+			lanes_advance(&l, v, ramp);
+			s += 4;
+			d += 4;
+		}
+	}
+	if (n_periods > 0)
+		lanes_gain(&l, n_channels, gain);
+
+	apply_s32(d, s, n_channels, n_frames - n_periods * l.n_frames, gain, step, ramp);
+}
+
+static void
+apply_f32_sse2(void *dst, const void *src, int n_channels, int n_frames,
+	       float *gain, const float *step, enum volume_ramp ramp)
+{
+	const float *s = src;
+	float *d = dst;
+	struct lanes l;
+	int p, v, n_periods;
+
+	if (lanes_init(&l, n_channels, gain, step, ramp) < 0) {
+		apply_f32(dst, src, n_channels, n_frames, gain, step, ramp);
+		return;
+	}
+	n_periods = n_frames / l.n_frames;
+
+	for (p = 0; p < n_periods; p++) {
+		for (v = 0; v < l.n_vecs; v++) {
+			_mm_storeu_ps(d, _mm_mul_ps(_mm_loadu_ps(s), l.gain[v]));
+			lanes_advance(&l, v, ramp);
+			s += 4;
+			d += 4;
+		}
+	}
+	if (n_periods > 0)
+		lanes_gain(&l, n_channels, gain);
+
+	apply_f32(d, s, n_channels, n_frames - n_periods * l.n_frames, gain, step, ramp);
+}
+#endif
+
+void spa_volume_ramp_steps(enum volume_ramp ramp, int n_channels, int n_frames,
+			   float *gain, const float *to, float *step)
+{
+	int c;
+
+	for (c = 0; c < n_channels; c++) {
+		if (ramp == VOLUME_RAMP_LINEAR && n_frames > 0) {
+			step[c] = (to[c] - gain[c]) / n_frames;
+		} else if (ramp == VOLUME_RAMP_EXPONENTIAL && n_frames > 0) {
+			gain[c] = SPA_MAX(gain[c], RAMP_FLOOR);
+			step[c] = powf(SPA_MAX(to[c], RAMP_FLOOR) / gain[c], 1.0f / n_frames);
+		} else {
+			step[c] = ramp == VOLUME_RAMP_EXPONENTIAL ? 1.0f : 0.0f;
+		}
+	}
+}
+
+void spa_volume_get_ops(struct spa_volume_ops *ops)
+{
+	ops->sample_size[VOLUME_S16] = sizeof(int16_t);
+	ops->sample_size[VOLUME_S32] = sizeof(int32_t);
+	ops->sample_size[VOLUME_F32] = sizeof(float);
+#if defined(__SSE2__)
+	ops->apply[VOLUME_S16] = apply_s16_sse2;
+	ops->apply[VOLUME_S32] = apply_s32_sse2;
+	ops->apply[VOLUME_F32] = apply_f32_sse2;
+#else
+	ops->apply[VOLUME_S16] = apply_s16;
+	ops->apply[VOLUME_S32] = apply_s32;
+	ops->apply[VOLUME_F32] = apply_f32;
+#endif
+}
@@ -0,0 +1,64 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __SPA_VOLUME_OPS_H__
+#define __SPA_VOLUME_OPS_H__
+
+#include <spa/utils/defs.h>
+
+#define VOLUME_MAX_CHANNELS	64
+
+enum volume_ramp {
+	VOLUME_RAMP_NONE,
+	VOLUME_RAMP_LINEAR,
+	VOLUME_RAMP_EXPONENTIAL,
+};
+
+/** Multiply \a n_frames frames of \a n_channels interleaved channels from
+ * \a src with the per-channel \a gain and store them in \a dst. \a dst and
+ * \a src can be the same memory.
+ *
+ * With a \a ramp other than VOLUME_RAMP_NONE, the gain of each channel is
+ * advanced after every frame by adding (linear) or multiplying (exponential)
+ * the matching \a step and the advanced gains are written back to \a gain. */
+typedef void (*volume_func_t) (void *dst, const void *src,
+			       int n_channels, int n_frames,
+			       float *gain, const float *step, enum volume_ramp ramp);
+
+enum {
+	VOLUME_S16,
+	VOLUME_S32,
+	VOLUME_F32,
+	VOLUME_MAX,
+};
+
+struct spa_volume_ops {
+	int sample_size[VOLUME_MAX];
+	volume_func_t apply[VOLUME_MAX];
+};
+
+void spa_volume_get_ops(struct spa_volume_ops *ops);
+
+/** Calculate the per-frame steps that move \a n_channels gains from \a gain
+ * to \a to in \a n_frames frames with \a ramp. Exponential ramps can't start
+ * from silence so \a gain is raised to -80dB when needed. */
+void spa_volume_ramp_steps(enum volume_ramp ramp, int n_channels, int n_frames,
+			   float *gain, const float *to, float *step);
+
+#endif /* __SPA_VOLUME_OPS_H__ */
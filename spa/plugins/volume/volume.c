@@ -32,20 +32,28 @@
 #include <spa/param/io.h>
 #include <spa/pod/filter.h>
 
+#include "volume-ops.h"
+
 #define NAME "volume"
 
 #define DEFAULT_VOLUME 1.0
 #define DEFAULT_MUTE false
+#define DEFAULT_RAMP VOLUME_RAMP_LINEAR
 
 struct props {
 	double volume;
 	bool mute;
+	float channel_volumes[VOLUME_MAX_CHANNELS];
+	uint32_t n_channel_volumes;
+	uint32_t ramp;
 };
 
 static void reset_props(struct props *props)
 {
 	props->volume = DEFAULT_VOLUME;
 	props->mute = DEFAULT_MUTE;
+	props->n_channel_volumes = 0;
+	props->ramp = DEFAULT_RAMP;
 }
 
 #define MAX_BUFFERS     16
@@ -78,6 +86,8 @@ struct type {
 	uint32_t props;
 	uint32_t prop_volume;
 	uint32_t prop_mute;
+	uint32_t prop_channel_volumes;
+	uint32_t prop_ramp;
 	struct spa_type_io io;
 	struct spa_type_param param;
 	struct spa_type_meta meta;
@@ -100,6 +110,8 @@ static inline void init_type(struct type *type, struct spa_type_map *map)
 	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
 	type->prop_volume = spa_type_map_get_id(map, SPA_TYPE_PROPS__volume);
 	type->prop_mute = spa_type_map_get_id(map, SPA_TYPE_PROPS__mute);
+	type->prop_channel_volumes = spa_type_map_get_id(map, SPA_TYPE_PROPS__channelVolumes);
+	type->prop_ramp = spa_type_map_get_id(map, SPA_TYPE_PROPS__rampType);
 	spa_type_io_map(map, &type->io);
 	spa_type_param_map(map, &type->param);
 	spa_type_meta_map(map, &type->meta);
@@ -130,10 +142,19 @@ struct impl {
 
 	struct spa_audio_info current_format;
 	int bpf;
+	int fmt;
+	int n_channels;
+
+	struct spa_volume_ops ops;
+	/* the gains applied at the end of the last buffer */
+	float gain[VOLUME_MAX_CHANNELS];
 
 	struct port in_ports[1];
 	struct port out_ports[1];
 
+	/* both ports use the same buffers, process the input in place */
+	bool in_place;
+
 	bool started;
 };
 
@@ -195,6 +216,25 @@ static int impl_node_enum_params(struct spa_node *node,
 				":", t->param.propName, "s", "Mute",
 				":", t->param.propType, "b", p->mute);
 			break;
+		case 2:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_channel_volumes,
+				":", t->param.propName, "s", "Per channel volumes",
+				":", t->param.propType, "a", sizeof(float), SPA_POD_TYPE_FLOAT,
+					p->n_channel_volumes, p->channel_volumes);
+			break;
+		case 3:
+			param = spa_pod_builder_object(&b,
+				id, t->param.PropInfo,
+				":", t->param.propId,   "I", t->prop_ramp,
+				":", t->param.propName, "s", "Volume change ramp",
+				":", t->param.propType, "i", p->ramp,
+				":", t->param.propLabels, "[-i",
+					"i", VOLUME_RAMP_NONE, "s", "No ramp",
+					"i", VOLUME_RAMP_LINEAR, "s", "Linear ramp",
+					"i", VOLUME_RAMP_EXPONENTIAL, "s", "Exponential ramp", "]");
+			break;
 		default:
 			return 0;
 		}
@@ -205,7 +245,10 @@ static int impl_node_enum_params(struct spa_node *node,
 			param = spa_pod_builder_object(&b,
 				id, t->props,
 				":", t->prop_volume, "d", p->volume,
-				":", t->prop_mute,   "b", p->mute);
+				":", t->prop_mute,   "b", p->mute,
+				":", t->prop_channel_volumes, "a", sizeof(float), SPA_POD_TYPE_FLOAT,
+					p->n_channel_volumes, p->channel_volumes,
+				":", t->prop_ramp,   "i", p->ramp);
 			break;
 		default:
 			return 0;
@@ -222,6 +265,26 @@ static int impl_node_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static void parse_channel_volumes(struct props *p, const struct spa_pod *pod)
+{
+	struct spa_pod_array_body *body;
+	float *v;
+
+	if (pod == NULL || SPA_POD_TYPE(pod) != SPA_POD_TYPE_ARRAY)
+		return;
+
+	body = SPA_POD_BODY(pod);
+	if (body->child.type != SPA_POD_TYPE_FLOAT || body->child.size != sizeof(float))
+		return;
+
+	p->n_channel_volumes = 0;
+	SPA_POD_ARRAY_BODY_FOREACH(body, SPA_POD_BODY_SIZE(pod), v) {
+		if (p->n_channel_volumes == VOLUME_MAX_CHANNELS)
+			break;
+		p->channel_volumes[p->n_channel_volumes++] = SPA_CLAMP(*v, 0.0f, 10.0f);
+	}
+}
+
 static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flags,
 			       const struct spa_pod *param)
 {
@@ -235,6 +298,7 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 
 	if (id == t->param.idProps) {
 		struct props *p = &this->props;
+		struct spa_pod *volumes = NULL;
 
 		if (param == NULL) {
 			reset_props(p);
@@ -242,7 +306,13 @@ static int impl_node_set_param(struct spa_node *node, uint32_t id, uint32_t flag
 		}
 		spa_pod_object_parse(param,
 			":", t->prop_volume, "?d", &p->volume,
-			":", t->prop_mute,   "?b", &p->mute, NULL);
+			":", t->prop_mute,   "?b", &p->mute,
+			":", t->prop_channel_volumes, "?P", &volumes,
+			":", t->prop_ramp,   "?i", &p->ramp, NULL);
+
+		parse_channel_volumes(p, volumes);
+		if (p->ramp > VOLUME_RAMP_EXPONENTIAL)
+			p->ramp = DEFAULT_RAMP;
 	}
 	else
 		return -ENOENT;
@@ -375,12 +445,13 @@ static int port_enum_formats(struct spa_node *node,
 			"I", t->media_type.audio,
 			"I", t->media_subtype.raw,
 			":", t->format_audio.format,  "Ieu", t->audio_format.S16,
-				SPA_POD_PROP_ENUM(2, t->audio_format.S16,
-						     t->audio_format.S32),
+				SPA_POD_PROP_ENUM(3, t->audio_format.S16,
+						     t->audio_format.S32,
+						     t->audio_format.F32),
 			":", t->format_audio.rate,    "iru", 44100,
 				SPA_POD_PROP_MIN_MAX(1, INT32_MAX),
 			":", t->format_audio.channels,"iru", 2,
-				SPA_POD_PROP_MIN_MAX(1, INT32_MAX));
+				SPA_POD_PROP_MIN_MAX(1, VOLUME_MAX_CHANNELS));
 		break;
 	default:
 		return 0;
@@ -531,16 +602,56 @@ impl_node_port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+/* the host can give both ports the same buffers when the input can be
+ * processed in place, there is no output buffer to fill or copy then.
+ * Read-only input data always goes through a separate output buffer. */
+static void check_in_place(struct impl *this)
+{
+	struct port *in_port = GET_IN_PORT(this, 0);
+	struct port *out_port = GET_OUT_PORT(this, 0);
+	uint32_t i;
+
+	this->in_place = in_port->n_buffers > 0 &&
+			 in_port->n_buffers == out_port->n_buffers;
+
+	for (i = 0; this->in_place && i < in_port->n_buffers; i++) {
+		struct spa_buffer *b = in_port->buffers[i].outbuf;
+		uint32_t j;
+
+		if (b != out_port->buffers[i].outbuf)
+			this->in_place = false;
+
+		/* shared read-only data can't be scaled in place */
+		for (j = 0; this->in_place && j < b->n_datas; j++) {
+			if (b->datas[j].flags & SPA_DATA_FLAG_READONLY)
+				this->in_place = false;
+		}
+	}
+	spa_log_info(this->log, NAME " %p: in-place %d", this, this->in_place);
+}
+
 static int clear_buffers(struct impl *this, struct port *port)
 {
 	if (port->n_buffers > 0) {
 		spa_log_info(this->log, NAME " %p: clear buffers", this);
 		port->n_buffers = 0;
 		spa_list_init(&port->empty);
+		this->in_place = false;
 	}
 	return 0;
 }
 
+static int format_to_fmt(struct type *t, uint32_t format)
+{
+	if (format == t->audio_format.S16)
+		return VOLUME_S16;
+	else if (format == t->audio_format.S32)
+		return VOLUME_S32;
+	else if (format == t->audio_format.F32)
+		return VOLUME_F32;
+	return -EINVAL;
+}
+
 static int port_set_format(struct spa_node *node,
 			   enum spa_direction direction, uint32_t port_id,
 			   uint32_t flags,
@@ -556,6 +667,7 @@ static int port_set_format(struct spa_node *node,
 		clear_buffers(this, port);
 	} else {
 		struct spa_audio_info info = { 0 };
+		int fmt;
 
 		spa_pod_object_parse(format,
 			"I", &info.media_type,
@@ -568,7 +680,15 @@ static int port_set_format(struct spa_node *node,
 		if (spa_format_audio_raw_parse(format, &info.info.raw, &this->type.format_audio) < 0)
 			return -EINVAL;
 
-		this->bpf = 2 * info.info.raw.channels;
+		if ((fmt = format_to_fmt(&this->type, info.info.raw.format)) < 0)
+			return -EINVAL;
+		if (info.info.raw.channels == 0 ||
+		    info.info.raw.channels > VOLUME_MAX_CHANNELS)
+			return -EINVAL;
+
+		this->fmt = fmt;
+		this->n_channels = info.info.raw.channels;
+		this->bpf = this->ops.sample_size[fmt] * info.info.raw.channels;
 		this->current_format = info;
 		port->have_format = true;
 	}
@@ -647,6 +767,8 @@ impl_node_port_use_buffers(struct spa_node *node,
 	}
 	port->n_buffers = n_buffers;
 
+	check_in_place(this);
+
 	return 0;
 }
 
@@ -724,6 +846,12 @@ static int impl_node_port_reuse_buffer(struct spa_node *node, uint32_t port_id,
 	if (buffer_id >= port->n_buffers)
 		return -EINVAL;
 
+	/* in place, the buffer belongs to our upstream peer */
+	if (this->in_place) {
+		if (this->callbacks && this->callbacks->reuse_buffer)
+			this->callbacks->reuse_buffer(this->callbacks_data, 0, buffer_id);
+		return 0;
+	}
 	recycle_buffer(this, buffer_id);
 
 	return 0;
@@ -752,50 +880,96 @@ static struct spa_buffer *find_free_buffer(struct impl *this, struct port *port)
 	return b->outbuf;
 }
 
+static void update_gain(struct impl *this, float *target)
+{
+	struct props *p = &this->props;
+	int i;
+
+	for (i = 0; i < this->n_channels; i++) {
+		if (p->mute)
+			target[i] = 0.0f;
+		else if ((uint32_t) i < p->n_channel_volumes)
+			target[i] = p->volume * p->channel_volumes[i];
+		else
+			target[i] = p->volume;
+	}
+}
+
 static void do_volume(struct impl *this, struct spa_buffer *dbuf, struct spa_buffer *sbuf)
 {
-	uint32_t i, n_samples, n_bytes;
+	uint32_t n_bytes, n_frames;
 	struct spa_data *sd, *dd;
-	int16_t *src, *dst;
-	double volume;
+	void *src, *dst;
 	uint32_t written, towrite, savail, davail;
 	uint32_t sindex, dindex;
-
-	volume = this->props.volume;
+	float target[VOLUME_MAX_CHANNELS], step[VOLUME_MAX_CHANNELS];
+	enum volume_ramp ramp = VOLUME_RAMP_NONE;
+	bool unity = true;
+	int i;
 
 	sd = sbuf->datas;
 	dd = dbuf->datas;
 
 	savail = SPA_MIN(sd[0].chunk->size, sd[0].maxsize);
 	sindex = sd[0].chunk->offset;
-	davail = 0;
-	dindex = 0;
-	davail = dd[0].maxsize - davail;
-
+	if (sbuf == dbuf) {
+		davail = savail;
+		dindex = sindex;
+	} else {
+		davail = dd[0].maxsize;
+		dindex = 0;
+	}
 	towrite = SPA_MIN(savail, davail);
-	written = 0;
+	towrite -= towrite % this->bpf;
+
+	update_gain(this, target);
+	for (i = 0; i < this->n_channels; i++) {
+		if (target[i] != this->gain[i])
+			ramp = this->props.ramp;
+		if (target[i] != 1.0f)
+			unity = false;
+	}
+	if (ramp != VOLUME_RAMP_NONE)
+		spa_volume_ramp_steps(ramp, this->n_channels, towrite / this->bpf,
+				      this->gain, target, step);
+	else
+		memcpy(this->gain, target, this->n_channels * sizeof(float));
 
+	written = 0;
 	while (written < towrite) {
 		uint32_t soffset = sindex % sd[0].maxsize;
 		uint32_t doffset = dindex % dd[0].maxsize;
 
-		src = SPA_MEMBER(sd[0].data, soffset, int16_t);
-		dst = SPA_MEMBER(dd[0].data, doffset, int16_t);
+		src = SPA_MEMBER(sd[0].data, soffset, void);
+		dst = SPA_MEMBER(dd[0].data, doffset, void);
 
-		n_bytes = SPA_MIN(towrite, sd[0].maxsize - soffset);
+		n_bytes = SPA_MIN(towrite - written, sd[0].maxsize - soffset);
 		n_bytes = SPA_MIN(n_bytes, dd[0].maxsize - doffset);
+		n_frames = n_bytes / this->bpf;
+		n_bytes = n_frames * this->bpf;
+		if (n_frames == 0)
+			break;
 
-		n_samples = n_bytes / sizeof(int16_t);
-		for (i = 0; i < n_samples; i++)
-			dst[i] = src[i] * volume;
+		if (ramp == VOLUME_RAMP_NONE && unity) {
+			if (src != dst)
+				memcpy(dst, src, n_bytes);
+		} else {
+			this->ops.apply[this->fmt](dst, src, this->n_channels, n_frames,
+						   this->gain, step, ramp);
+		}
 
 		sindex += n_bytes;
 		dindex += n_bytes;
 		written += n_bytes;
 	}
-	dd[0].chunk->offset = 0;
-	dd[0].chunk->size = written;
-	dd[0].chunk->stride = 0;
+	/* don't let the ramp drift, it ends exactly on the target */
+	memcpy(this->gain, target, this->n_channels * sizeof(float));
+
+	if (sbuf != dbuf) {
+		dd[0].chunk->offset = 0;
+		dd[0].chunk->size = written;
+		dd[0].chunk->stride = 0;
+	}
 }
 
 static int impl_node_process_input(struct spa_node *node)
@@ -825,13 +999,15 @@ static int impl_node_process_input(struct spa_node *node)
 		return -EINVAL;
 	}
 
-	if ((dbuf = find_free_buffer(this, out_port)) == NULL) {
+	sbuf = in_port->buffers[input->buffer_id].outbuf;
+
+	if (this->in_place)
+		dbuf = sbuf;
+	else if ((dbuf = find_free_buffer(this, out_port)) == NULL) {
                 spa_log_error(this->log, NAME " %p: out of buffers", this);
 		return -EPIPE;
 	}
 
-	sbuf = in_port->buffers[input->buffer_id].outbuf;
-
 	input->status = SPA_STATUS_OK;
 
 	spa_log_trace(this->log, NAME " %p: do volume %d -> %d", this, sbuf->id, dbuf->id);
@@ -860,16 +1036,19 @@ static int impl_node_process_output(struct spa_node *node)
 	if (output->status == SPA_STATUS_HAVE_BUFFER)
 		return SPA_STATUS_HAVE_BUFFER;
 
-	/* recycle */
-	if (output->buffer_id < out_port->n_buffers) {
-		recycle_buffer(this, output->buffer_id);
-		output->buffer_id = SPA_ID_INVALID;
-	}
-
 	in_port = GET_IN_PORT(this, 0);
 	input = in_port->io;
 	spa_return_val_if_fail(input != NULL, -EIO);
 
+	/* recycle, in place the buffer goes back upstream */
+	if (output->buffer_id < out_port->n_buffers) {
+		if (this->in_place)
+			input->buffer_id = output->buffer_id;
+		else
+			recycle_buffer(this, output->buffer_id);
+		output->buffer_id = SPA_ID_INVALID;
+	}
+
 	if (in_port->range && out_port->range)
 		*in_port->range = *out_port->range;
 	input->status = SPA_STATUS_NEED_BUFFER;
@@ -954,6 +1133,9 @@ impl_init(const struct spa_handle_factory *factory,
 
 	this->node = impl_node;
 	reset_props(&this->props);
+	spa_volume_get_ops(&this->ops);
+	for (i = 0; i < VOLUME_MAX_CHANNELS; i++)
+		this->gain[i] = DEFAULT_VOLUME;
 
 	this->in_ports[0].info.flags = SPA_PORT_INFO_FLAG_CAN_USE_BUFFERS |
 	    SPA_PORT_INFO_FLAG_IN_PLACE;
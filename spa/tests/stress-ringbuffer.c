@@ -2,14 +2,20 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sched.h>
+#include <time.h>
 
 #include <spa/utils/ringbuffer.h>
+#include <spa/utils/ringbuffer-mp.h>
 
 #define ARRAY_SIZE 64
 #define MAX_VALUE 0x10000
+#define MAX_THREADS 16
 
 struct spa_ringbuffer rb;
+struct spa_ringbuffer_mp mprb;
 uint32_t size;
 uint8_t *data;
 
@@ -90,18 +96,220 @@ static void *writer_start(void *arg)
 	return NULL;
 }
 
+/* multi-producer, multi-consumer test. Every chunk starts with the id of
+ * the writer followed by a sequence number and values derived from it. A
+ * single reader also checks that the chunks of each writer arrive in order. */
+#define CHUNK_SIZE (ARRAY_SIZE * sizeof(int))
+
+struct thread_stats {
+	pthread_t thread;
+	int id;
+	unsigned long chunks;
+	unsigned long retries;
+	unsigned long failures;
+	unsigned long last_seq[MAX_THREADS];
+} __attribute__ ((aligned (64)));
+
+static struct thread_stats writers[MAX_THREADS];
+static struct thread_stats readers[MAX_THREADS];
+static int n_readers;
+static volatile int running;
+
+static void make_chunk(int *a, int id, int seq)
+{
+	int i;
+	a[0] = id;
+	a[1] = seq;
+	for (i = 2; i < ARRAY_SIZE; i++)
+		a[i] = seq * 31 + i;
+}
+
+static int check_chunk(const int *a)
+{
+	int i;
+	if (a[0] < 0 || a[0] >= MAX_THREADS)
+		return 0;
+	for (i = 2; i < ARRAY_SIZE; i++)
+		if (a[i] != a[1] * 31 + i)
+			return 0;
+	return 1;
+}
+
+static void *mp_writer_start(void *arg)
+{
+	struct thread_stats *s = arg;
+	int a[ARRAY_SIZE], seq = 0;
+
+	while (running) {
+		uint32_t index;
+		int32_t filled;
+
+		filled = spa_ringbuffer_mp_get_write_index(&mprb, &index);
+		if (filled + CHUNK_SIZE > size) {
+			sched_yield();
+			continue;
+		}
+		if (!spa_ringbuffer_mp_write_reserve(&mprb, index, CHUNK_SIZE)) {
+			s->retries++;
+			continue;
+		}
+		make_chunk(a, s->id, seq++);
+		spa_ringbuffer_mp_write_data(&mprb, data, size, index & (size - 1), a, CHUNK_SIZE);
+		spa_ringbuffer_mp_write_update(&mprb, index, CHUNK_SIZE);
+		s->chunks++;
+	}
+	return NULL;
+}
+
+static void *mp_reader_start(void *arg)
+{
+	struct thread_stats *s = arg;
+	int b[ARRAY_SIZE];
+
+	while (running) {
+		uint32_t index;
+
+		if (spa_ringbuffer_mp_get_read_index(&mprb, &index) < (int32_t) CHUNK_SIZE) {
+			sched_yield();
+			continue;
+		}
+		if (!spa_ringbuffer_mp_read_reserve(&mprb, index, CHUNK_SIZE)) {
+			s->retries++;
+			continue;
+		}
+		spa_ringbuffer_mp_read_data(&mprb, data, size, index & (size - 1), b, CHUNK_SIZE);
+		spa_ringbuffer_mp_read_update(&mprb, index, CHUNK_SIZE);
+
+		if (!check_chunk(b))
+			s->failures++;
+		else if (n_readers == 1) {
+			if (b[1] != 0 && (unsigned long) b[1] != s->last_seq[b[0]] + 1)
+				s->failures++;
+			s->last_seq[b[0]] = b[1];
+		}
+		s->chunks++;
+	}
+	return NULL;
+}
+
+static double run_mp(int n_writers, int n_rd, int seconds, int verbose)
+{
+	struct timespec start, end;
+	unsigned long written = 0, read = 0, wretries = 0, rretries = 0, failures = 0;
+	double elapsed;
+	int i;
+
+	spa_ringbuffer_mp_init(&mprb);
+	memset(writers, 0, sizeof(writers));
+	memset(readers, 0, sizeof(readers));
+	n_readers = n_rd;
+	running = 1;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < n_rd; i++) {
+		readers[i].id = i;
+		pthread_create(&readers[i].thread, NULL, mp_reader_start, &readers[i]);
+	}
+	for (i = 0; i < n_writers; i++) {
+		writers[i].id = i;
+		pthread_create(&writers[i].thread, NULL, mp_writer_start, &writers[i]);
+	}
+
+	sleep(seconds);
+	running = 0;
+
+	for (i = 0; i < n_writers; i++) {
+		pthread_join(writers[i].thread, NULL);
+		written += writers[i].chunks;
+		wretries += writers[i].retries;
+	}
+	for (i = 0; i < n_rd; i++) {
+		pthread_join(readers[i].thread, NULL);
+		read += readers[i].chunks;
+		rretries += readers[i].retries;
+		failures += readers[i].failures;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+	printf("%2d writers %2d readers: %10.0f chunks/s %8.1f MB/s, "
+	       "write retries %5.2f%% read retries %5.2f%%, %lu failures\n",
+	       n_writers, n_rd, read / elapsed, read * CHUNK_SIZE / elapsed / (1024 * 1024),
+	       written ? 100.0 * wretries / (written + wretries) : 0.0,
+	       read ? 100.0 * rretries / (read + rretries) : 0.0, failures);
+	if (verbose) {
+		for (i = 0; i < n_writers; i++)
+			printf("  writer %2d: %lu chunks\n", i, writers[i].chunks);
+	}
+	if (failures > 0 || written < read)
+		exit(1);
+
+	return read / elapsed;
+}
+
+static void usage(const char *name)
+{
+	printf("usage: %s <size> [-w writers] [-r readers] [-t seconds] [-b]\n"
+	       "  without options, runs the single producer/consumer test forever\n"
+	       "  -w, -r  run the multi-producer/consumer test with the given threads\n"
+	       "  -b      benchmark 1 to %d writers with 1 and 2 readers\n", name, MAX_THREADS);
+}
+
 int main(int argc, char *argv[])
 {
-	printf("starting ringbuffer stress test\n");
+	int opt, n_writers = 0, n_rd = 1, seconds = 2, bench = 0;
 
+	if (argc < 2) {
+		usage(argv[0]);
+		return 1;
+	}
 	sscanf(argv[1], "%d", &size);
 
+	optind = 2;
+	while ((opt = getopt(argc, argv, "w:r:t:b")) != -1) {
+		switch (opt) {
+		case 'w':
+			n_writers = SPA_CLAMP(atoi(optarg), 1, MAX_THREADS);
+			break;
+		case 'r':
+			n_rd = SPA_CLAMP(atoi(optarg), 1, MAX_THREADS);
+			if (n_writers == 0)
+				n_writers = 1;
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			break;
+		case 'b':
+			bench = 1;
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
 	printf("buffer size (bytes): %d\n", size);
 	printf("array size (bytes): %ld\n", sizeof(int) * ARRAY_SIZE);
 
-	spa_ringbuffer_init(&rb);
 	data = malloc(size);
 
+	if (bench) {
+		int w, r;
+		for (r = 1; r <= 2; r++)
+			for (w = 1; w <= MAX_THREADS; w *= 2)
+				run_mp(w, r, seconds, 0);
+		return 0;
+	}
+	if (n_writers > 0) {
+		run_mp(n_writers, n_rd, seconds, 1);
+		return 0;
+	}
+
+	printf("starting ringbuffer stress test\n");
+
+	spa_ringbuffer_init(&rb);
+
 	pthread_t reader_thread, writer_thread;
 	pthread_create(&reader_thread, NULL, reader_start, NULL);
 	pthread_create(&writer_thread, NULL, writer_start, NULL);
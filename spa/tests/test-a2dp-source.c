@@ -0,0 +1,641 @@
+/* Spa
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Feeds a2dp-source with RTP/SBC packets over a socketpair that stands in
+ * for the BlueZ transport. The packets are sent with a configurable jitter
+ * and clock drift.
+ *
+ * The test fails when the average rate correction over the second half of
+ * the run did not converge to the drift or when the jitter buffer ran empty
+ * after the warmup time.
+ *
+ *   test-a2dp-source [seconds] [jitter-ms] [drift-ppm]
+ */
+
+#include <math.h>
+#include <error.h>
+#include <string.h>
+#include <strings.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <spa/support/loop.h>
+#include <spa/support/log.h>
+#include <spa/support/type-map.h>
+#include <spa/utils/list.h>
+#include <spa/node/node.h>
+#include <spa/node/io.h>
+#include <spa/param/param.h>
+#include <spa/param/props.h>
+#include <spa/param/audio/format-utils.h>
+
+#include <sbc/sbc.h>
+
+#include "../plugins/bluez5/defs.h"
+#include "../plugins/bluez5/rtp.h"
+#include "../plugins/bluez5/a2dp-codecs.h"
+
+#define M_PI_M2 ( M_PI + M_PI )
+
+#define RATE		44100
+#define CHANNELS	2
+#define MTU		672
+#define N_BUFFERS	4
+#define BUFFER_SIZE	4096
+
+/* time to estimate the jitter and to lock on the remote clock */
+#define WARMUP		(3 * SPA_NSEC_PER_SEC)
+/* allowed error of the rate correction, in parts per million */
+#define MAX_RATE_ERROR	150
+
+struct type {
+	uint32_t node;
+	uint32_t props;
+	uint32_t format;
+	uint32_t prop_jitter;
+	uint32_t prop_target_latency;
+	uint32_t prop_rate_correction;
+	struct spa_type_io io;
+	struct spa_type_param param;
+	struct spa_type_meta meta;
+	struct spa_type_data data;
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_command_node command_node;
+};
+
+static inline void init_type(struct type *type, struct spa_type_map *map)
+{
+	type->node = spa_type_map_get_id(map, SPA_TYPE__Node);
+	type->props = spa_type_map_get_id(map, SPA_TYPE__Props);
+	type->format = spa_type_map_get_id(map, SPA_TYPE__Format);
+	type->prop_jitter = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "jitter");
+	type->prop_target_latency = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "targetLatency");
+	type->prop_rate_correction = spa_type_map_get_id(map, SPA_TYPE_PROPS_BASE "rateCorrection");
+	spa_type_io_map(map, &type->io);
+	spa_type_param_map(map, &type->param);
+	spa_type_meta_map(map, &type->meta);
+	spa_type_data_map(map, &type->data);
+	spa_type_media_type_map(map, &type->media_type);
+	spa_type_media_subtype_map(map, &type->media_subtype);
+	spa_type_format_audio_map(map, &type->format_audio);
+	spa_type_audio_format_map(map, &type->audio_format);
+	spa_type_command_node_map(map, &type->command_node);
+}
+
+struct buffer {
+	struct spa_buffer buffer;
+	struct spa_meta metas[1];
+	struct spa_meta_header header;
+	struct spa_data datas[1];
+	struct spa_chunk chunks[1];
+};
+
+struct data {
+	struct type type;
+	struct spa_type_map *map;
+	struct spa_log *log;
+
+	struct spa_loop *loop;
+	struct spa_loop_control *loop_control;
+	struct spa_loop_utils *loop_utils;
+	bool running;
+
+	struct spa_support support[4];
+	uint32_t n_support;
+
+	int fds[2];
+	a2dp_sbc_t config;
+	struct spa_bt_transport transport;
+
+	struct spa_node *source;
+	struct spa_io_buffers io;
+	struct spa_buffer *buffers[N_BUFFERS];
+	struct buffer buffer[N_BUFFERS];
+
+	/* the remote side */
+	sbc_t sbc;
+	struct spa_source *timer;
+	uint64_t start_time;
+	uint64_t duration;
+	double period;
+	double jitter;
+	double drift;
+	double accumulator;
+	uint16_t seqnum;
+	uint32_t timestamp;
+	uint32_t n_packets;
+
+	uint64_t received;
+	uint32_t n_outputs;
+	uint32_t n_silent;
+	uint64_t first_output;
+	double rate_sum;
+	uint32_t n_rates;
+};
+
+static int transport_acquire(struct spa_bt_transport *transport, bool optional)
+{
+	return 0;
+}
+
+static int transport_release(struct spa_bt_transport *transport)
+{
+	return 0;
+}
+
+static uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void send_packet(struct data *data)
+{
+	uint8_t packet[MTU];
+	int16_t samples[1024];
+	struct rtp_header *header = (struct rtp_header *) packet;
+	struct rtp_payload *payload = (struct rtp_payload *) (packet + sizeof(struct rtp_header));
+	size_t codesize, frame_length, used;
+	int i, frames = 0, n_samples = 0;
+
+	codesize = sbc_get_codesize(&data->sbc);
+	frame_length = sbc_get_frame_length(&data->sbc);
+
+	memset(packet, 0, sizeof(struct rtp_header) + sizeof(struct rtp_payload));
+	used = sizeof(struct rtp_header) + sizeof(struct rtp_payload);
+
+	while (used + frame_length <= MTU && frames < 15) {
+		ssize_t written;
+
+		for (i = 0; i < codesize / 2; i += CHANNELS) {
+			int16_t val = sin(data->accumulator) * 8000;
+			samples[i] = samples[i + 1] = val;
+			data->accumulator += M_PI_M2 * 440 / RATE;
+			if (data->accumulator >= M_PI_M2)
+				data->accumulator -= M_PI_M2;
+		}
+		if (sbc_encode(&data->sbc, samples, codesize, packet + used,
+			       MTU - used, &written) < 0)
+			break;
+
+		used += written;
+		frames++;
+		n_samples += codesize / (2 * CHANNELS);
+	}
+
+	header->v = 2;
+	header->pt = 1;
+	header->sequence_number = htons(data->seqnum++);
+	header->timestamp = htonl(data->timestamp);
+	header->ssrc = htonl(1);
+	payload->frame_count = frames;
+
+	data->timestamp += n_samples;
+	data->period = n_samples * (double) SPA_NSEC_PER_SEC / RATE;
+
+	if (write(data->fds[1], packet, used) < 0)
+		perror("write");
+
+	data->n_packets++;
+}
+
+static void on_timer(void *_data, uint64_t expirations)
+{
+	struct data *data = _data;
+	struct timespec value;
+	uint64_t now, next;
+
+	now = get_time();
+	if (now - data->start_time > data->duration) {
+		data->running = false;
+		return;
+	}
+
+	send_packet(data);
+
+	/* the nominal arrival time of the next packet, on the drifting remote
+	 * clock, plus some random jitter */
+	next = data->start_time + data->n_packets * data->period / (1.0 + data->drift);
+	next += data->jitter * ((double) rand() / RAND_MAX);
+
+	value.tv_sec = next / SPA_NSEC_PER_SEC;
+	value.tv_nsec = next % SPA_NSEC_PER_SEC;
+	spa_loop_utils_update_timer(data->loop_utils, data->timer, &value, NULL, true);
+}
+
+static void get_stats(struct data *data, int *jitter, int *target, double *rate)
+{
+	struct spa_pod *props;
+	uint32_t state = 0;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	if (spa_node_enum_params(data->source, data->type.param.idProps,
+				 &state, NULL, &props, &b) > 0) {
+		spa_pod_object_parse(props,
+			":", data->type.prop_jitter, "i", jitter,
+			":", data->type.prop_target_latency, "i", target,
+			":", data->type.prop_rate_correction, "d", rate, NULL);
+	}
+}
+
+static void on_source_have_output(void *_data)
+{
+	struct data *data = _data;
+	struct spa_buffer *b;
+	int16_t *samples;
+	uint32_t i, n_samples;
+
+	if (data->io.status != SPA_STATUS_HAVE_BUFFER ||
+	    data->io.buffer_id >= N_BUFFERS) {
+		printf("unexpected status %d %u\n", data->io.status, data->io.buffer_id);
+		return;
+	}
+
+	b = data->buffers[data->io.buffer_id];
+	n_samples = b->datas[0].chunk->size / sizeof(int16_t);
+	samples = SPA_MEMBER(b->datas[0].data, b->datas[0].chunk->offset, int16_t);
+
+	for (i = 0; i < n_samples && samples[i] == 0; i++);
+
+	if (i < n_samples) {
+		if (data->first_output == 0)
+			data->first_output = get_time();
+	}
+	else if (data->first_output != 0 &&
+		 get_time() - data->first_output > WARMUP) {
+		/* the jitter buffer ran empty */
+		data->n_silent++;
+	}
+	if (get_time() - data->start_time > data->duration / 2) {
+		int jitter, target;
+		double rate = 0.0;
+
+		get_stats(data, &jitter, &target, &rate);
+		data->rate_sum += rate;
+		data->n_rates++;
+	}
+	data->received += n_samples / CHANNELS;
+	data->n_outputs++;
+
+	data->io.status = SPA_STATUS_NEED_BUFFER;
+	spa_node_process_output(data->source);
+}
+
+static const struct spa_node_callbacks source_callbacks = {
+	SPA_VERSION_NODE_CALLBACKS,
+	.have_output = on_source_have_output,
+};
+
+static int get_handle(struct data *data,
+		      struct spa_handle **handle,
+		      const char *lib,
+		      const char *name)
+{
+	int res;
+	void *hnd;
+	spa_handle_factory_enum_func_t enum_func;
+	uint32_t i;
+
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return -errno;
+	}
+	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+		printf("can't find enum function\n");
+		return -errno;
+	}
+
+	for (i = 0;;) {
+		const struct spa_handle_factory *factory;
+
+		if ((res = enum_func(&factory, &i)) <= 0) {
+			if (res != 0)
+				printf("can't enumerate factories: %s\n", spa_strerror(res));
+			break;
+		}
+		if (strcmp(factory->name, name))
+			continue;
+
+		*handle = calloc(1, factory->size);
+		if ((res = spa_handle_factory_init(factory, *handle, NULL,
+						   data->support,
+						   data->n_support)) < 0) {
+			printf("can't make factory instance: %d\n", res);
+			free(*handle);
+			return res;
+		}
+		return 0;
+	}
+	return -ENOENT;
+}
+
+static int make_source(struct data *data, const char *lib)
+{
+	const struct spa_handle_factory *factory;
+	struct spa_handle *handle;
+	struct spa_dict_item items[1];
+	struct spa_dict info;
+	char trans[16];
+	void *hnd, *iface;
+	int res;
+
+	/* the a2dp nodes are not enumerated, they are normally created
+	 * by the monitor */
+	if ((hnd = dlopen(lib, RTLD_NOW)) == NULL) {
+		printf("can't load %s: %s\n", lib, dlerror());
+		return -errno;
+	}
+	if ((factory = dlsym(hnd, "spa_a2dp_source_factory")) == NULL) {
+		printf("can't find a2dp source factory\n");
+		return -ENOENT;
+	}
+
+	snprintf(trans, sizeof(trans), "%p", &data->transport);
+	items[0] = SPA_DICT_ITEM_INIT("bluez5.transport", trans);
+	info = SPA_DICT_INIT(items, 1);
+
+	handle = calloc(1, factory->size);
+	if ((res = spa_handle_factory_init(factory, handle, &info,
+					   data->support, data->n_support)) < 0)
+		return res;
+
+	if ((res = spa_handle_get_interface(handle, data->type.node, &iface)) < 0)
+		return res;
+
+	data->source = iface;
+
+	return 0;
+}
+
+static void init_buffers(struct data *data)
+{
+	int i;
+
+	for (i = 0; i < N_BUFFERS; i++) {
+		struct buffer *b = &data->buffer[i];
+		data->buffers[i] = &b->buffer;
+
+		b->buffer.id = i;
+		b->buffer.metas = b->metas;
+		b->buffer.n_metas = 1;
+		b->buffer.datas = b->datas;
+		b->buffer.n_datas = 1;
+
+		b->header.flags = 0;
+		b->header.seq = 0;
+		b->header.pts = 0;
+		b->header.dts_offset = 0;
+		b->metas[0].type = data->type.meta.Header;
+		b->metas[0].data = &b->header;
+		b->metas[0].size = sizeof(b->header);
+
+		b->datas[0].type = data->type.data.MemPtr;
+		b->datas[0].flags = 0;
+		b->datas[0].fd = -1;
+		b->datas[0].mapoffset = 0;
+		b->datas[0].maxsize = BUFFER_SIZE;
+		b->datas[0].data = malloc(BUFFER_SIZE);
+		b->datas[0].chunk = &b->chunks[0];
+		b->datas[0].chunk->offset = 0;
+		b->datas[0].chunk->size = 0;
+		b->datas[0].chunk->stride = 0;
+	}
+}
+
+static int negotiate_format(struct data *data)
+{
+	int res;
+	struct spa_pod *format;
+	uint32_t state = 0;
+	struct spa_pod_builder b = { 0 };
+	uint8_t buffer[1024];
+
+	spa_pod_builder_init(&b, buffer, sizeof(buffer));
+	if ((res = spa_node_port_enum_params(data->source,
+					     SPA_DIRECTION_OUTPUT, 0,
+					     data->type.param.idEnumFormat, &state,
+					     NULL, &format, &b)) <= 0)
+		return -EBADF;
+
+	if ((res = spa_node_port_set_param(data->source,
+					   SPA_DIRECTION_OUTPUT, 0,
+					   data->type.param.idFormat, 0,
+					   format)) < 0)
+		return res;
+
+	init_buffers(data);
+	if ((res = spa_node_port_use_buffers(data->source, SPA_DIRECTION_OUTPUT, 0,
+					     data->buffers, N_BUFFERS)) < 0)
+		return res;
+
+	data->io = SPA_IO_BUFFERS_INIT;
+	return spa_node_port_set_io(data->source, SPA_DIRECTION_OUTPUT, 0,
+				    data->type.io.Buffers, &data->io, sizeof(data->io));
+}
+
+static void print_stats(struct data *data)
+{
+	int jitter = 0, target = 0;
+	double rate = 0.0;
+
+	get_stats(data, &jitter, &target, &rate);
+
+	printf("packets %u: sent %u samples, received %"PRIu64" samples in %u buffers\n",
+			data->n_packets, data->timestamp, data->received, data->n_outputs);
+	printf("jitter %d usec, target %d samples, rate correction %f (drift %f)\n",
+			jitter, target, rate, 1.0 + data->drift);
+	printf("average rate correction %f, %u silent buffers after warmup\n",
+			data->n_rates ? data->rate_sum / data->n_rates : 0.0, data->n_silent);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data;
+	int res;
+	const char *str;
+	struct spa_handle *handle;
+	void *iface;
+	struct timespec value;
+	double rate_error;
+
+	spa_zero(data);
+
+	data.duration = (argc > 1 ? atoi(argv[1]) : 20) * SPA_NSEC_PER_SEC;
+	data.jitter = (argc > 2 ? atof(argv[2]) : 20.0) * SPA_NSEC_PER_MSEC;
+	data.drift = (argc > 3 ? atof(argv[3]) : 300.0) / 1000000.0;
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so",
+			     "mapper")) < 0) {
+		error(-1, res, "can't create mapper");
+	}
+	if ((res = spa_handle_get_interface(handle, 0, &iface)) < 0)
+		error(-1, res, "can't get mapper interface");
+
+	data.map = iface;
+	data.support[0].type = SPA_TYPE__TypeMap;
+	data.support[0].data = data.map;
+	data.n_support = 1;
+	init_type(&data.type, data.map);
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so",
+			     "logger")) < 0) {
+		error(-1, res, "can't create logger");
+	}
+
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__Log),
+					    &iface)) < 0)
+		error(-1, res, "can't get log interface");
+
+	data.log = iface;
+	data.support[1].type = SPA_TYPE__Log;
+	data.support[1].data = data.log;
+	data.n_support = 2;
+
+	if ((str = getenv("SPA_DEBUG")))
+		data.log->level = atoi(str);
+
+	if ((res = get_handle(&data, &handle,
+			     "build/spa/plugins/support/libspa-support.so",
+			     "loop")) < 0) {
+		error(-1, res, "can't create loop");
+	}
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__Loop),
+					    &iface)) < 0)
+		error(-1, res, "can't get loop interface");
+	data.loop = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__LoopControl),
+					    &iface)) < 0)
+		error(-1, res, "can't get loopcontrol interface");
+	data.loop_control = iface;
+
+	if ((res = spa_handle_get_interface(handle,
+					    spa_type_map_get_id(data.map, SPA_TYPE__LoopUtils),
+					    &iface)) < 0)
+		error(-1, res, "can't get looputils interface");
+	data.loop_utils = iface;
+
+	data.support[2].type = SPA_TYPE_LOOP__DataLoop;
+	data.support[2].data = data.loop;
+	data.support[3].type = SPA_TYPE_LOOP__MainLoop;
+	data.support[3].data = data.loop;
+	data.n_support = 4;
+
+	if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, data.fds) < 0)
+		error(-1, errno, "can't create socketpair");
+
+	data.config.frequency = SBC_SAMPLING_FREQ_44100;
+	data.config.channel_mode = SBC_CHANNEL_MODE_JOINT_STEREO;
+	data.config.block_length = SBC_BLOCK_LENGTH_16;
+	data.config.subbands = SBC_SUBBANDS_8;
+	data.config.allocation_method = SBC_ALLOCATION_LOUDNESS;
+	data.config.min_bitpool = MIN_BITPOOL;
+	data.config.max_bitpool = 53;
+
+	data.transport.profile = SPA_BT_PROFILE_A2DP_SINK;
+	data.transport.codec = A2DP_CODEC_SBC;
+	data.transport.configuration = &data.config;
+	data.transport.configuration_len = sizeof(data.config);
+	data.transport.fd = data.fds[0];
+	data.transport.read_mtu = MTU;
+	data.transport.write_mtu = MTU;
+	data.transport.acquire = transport_acquire;
+	data.transport.release = transport_release;
+
+	sbc_init(&data.sbc, 0);
+	data.sbc.frequency = SBC_FREQ_44100;
+	data.sbc.mode = SBC_MODE_JOINT_STEREO;
+	data.sbc.subbands = SBC_SB_8;
+	data.sbc.blocks = SBC_BLK_16;
+	data.sbc.allocation = SBC_AM_LOUDNESS;
+	data.sbc.bitpool = 53;
+	data.sbc.endian = SBC_LE;
+
+	if ((res = make_source(&data, "build/spa/plugins/bluez5/libspa-bluez5.so")) < 0)
+		error(-1, -res, "can't create a2dp source");
+
+	spa_node_set_callbacks(data.source, &source_callbacks, &data);
+
+	if ((res = negotiate_format(&data)) < 0)
+		error(-1, -res, "can't negotiate format");
+
+	{
+		struct spa_command cmd = SPA_COMMAND_INIT(data.type.command_node.Start);
+		if ((res = spa_node_send_command(data.source, &cmd)) < 0)
+			error(-1, -res, "can't start source");
+	}
+
+	data.timer = spa_loop_utils_add_timer(data.loop_utils, on_timer, &data);
+	data.start_time = get_time();
+	value.tv_sec = 0;
+	value.tv_nsec = 1;
+	spa_loop_utils_update_timer(data.loop_utils, data.timer, &value, NULL, false);
+
+	data.running = true;
+	spa_loop_control_enter(data.loop_control);
+	while (data.running) {
+		spa_loop_control_iterate(data.loop_control, -1);
+	}
+	/* pause while we are still the loop thread, the source is removed
+	 * with a blocking invoke */
+	{
+		struct spa_command cmd = SPA_COMMAND_INIT(data.type.command_node.Pause);
+		spa_node_send_command(data.source, &cmd);
+	}
+	spa_loop_control_leave(data.loop_control);
+
+	print_stats(&data);
+
+	if (data.received == 0) {
+		printf("no samples received\n");
+		return -1;
+	}
+	if (data.n_rates == 0) {
+		printf("no output in the second half of the run\n");
+		return -1;
+	}
+	rate_error = fabs(data.rate_sum / data.n_rates - (1.0 + data.drift)) * 1000000.0;
+	if (rate_error > MAX_RATE_ERROR) {
+		printf("rate correction did not converge, error %.0f ppm\n", rate_error);
+		return -1;
+	}
+	if (data.n_silent > 0) {
+		printf("jitter buffer underruns after warmup\n");
+		return -1;
+	}
+	return 0;
+}
@@ -25,6 +25,8 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <time.h>
+#include <pthread.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/command.h>
@@ -34,6 +36,34 @@
 
 #define DEFAULT_CONFIG_FILE PIPEWIRE_CONFIG_DIR "/pipewire.conf"
 
+struct preload {
+	struct pw_command **commands;	/**< the load-module commands */
+	void **handles;			/**< preloaded module for each command */
+	uint32_t n_commands;
+	pthread_t thread;
+	bool running;
+};
+
+/* set-prop <key> <value> */
+static int
+parse_set_prop(struct pw_daemon_config *config,
+	       const char *filename, char *line, unsigned int lineno, char **err)
+{
+	char **tokens;
+	int n_tokens, ret = 0;
+
+	tokens = pw_split_strv(pw_strip(line, "\n\r \t"), " \t", 2, &n_tokens);
+	if (tokens == NULL || n_tokens < 2) {
+		asprintf(err, "%s:%u: set-prop requires a key and a value", filename, lineno);
+		ret = -EINVAL;
+	} else {
+		pw_properties_set(config->properties, tokens[0], pw_strip(tokens[1], " \t"));
+	}
+	pw_free_strv(tokens);
+
+	return ret;
+}
+
 static int
 parse_line(struct pw_daemon_config *config,
 	   const char *filename, char *line, unsigned int lineno, char **err)
@@ -53,6 +83,9 @@ parse_line(struct pw_daemon_config *config,
 	if (*line == '\0')	/* empty line */
 		return 0;
 
+	if (strncmp(line, "set-prop", 8) == 0 && strchr(" \t", line[8]))
+		return parse_set_prop(config, filename, line + 8, lineno, err);
+
 	if ((command = pw_command_parse(line, &local_err)) == NULL) {
 		asprintf(err, "%s:%u: %s", filename, lineno, local_err);
 		free(local_err);
@@ -75,6 +108,7 @@ struct pw_daemon_config *pw_daemon_config_new(void)
 
 	config = calloc(1, sizeof(struct pw_daemon_config));
 	spa_list_init(&config->commands);
+	config->properties = pw_properties_new(NULL, NULL);
 
 	return config;
 }
@@ -92,6 +126,7 @@ void pw_daemon_config_free(struct pw_daemon_config *config)
 	spa_list_for_each_safe(cmd, tmp, &config->commands, link)
 	    pw_command_free(cmd);
 
+	pw_properties_free(config->properties);
 	free(config);
 }
 
@@ -170,6 +205,67 @@ int pw_daemon_config_load(struct pw_daemon_config *config, char **err)
 	return pw_daemon_config_load_file(config, filename, err);
 }
 
+static uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+static void *preload_thread(void *data)
+{
+	struct preload *p = data;
+	uint32_t i;
+
+	for (i = 0; i < p->n_commands; i++)
+		p->handles[i] = pw_module_preload(p->commands[i]->args[1]);
+
+	return NULL;
+}
+
+/* load the libraries of the modules, in config order, in a thread while the
+ * commands are run. dlopen() serializes on the loader lock so more threads
+ * would not load faster. This only hides the mapping and relocation of the
+ * libraries, the module inits are not made concurrent. */
+static void start_preload(struct pw_daemon_config *config, struct preload *p)
+{
+	struct pw_command *command;
+	uint32_t n_commands = 0;
+
+	spa_list_for_each(command, &config->commands, link)
+		n_commands++;
+
+	p->commands = calloc(n_commands, sizeof(struct pw_command *));
+	p->handles = calloc(n_commands, sizeof(void *));
+	p->n_commands = 0;
+	p->running = false;
+	if (p->commands == NULL || p->handles == NULL)
+		return;
+
+	spa_list_for_each(command, &config->commands, link) {
+		if (command->n_args > 1 && strcmp(command->args[0], "load-module") == 0)
+			p->commands[p->n_commands++] = command;
+	}
+
+	if (p->n_commands > 0)
+		p->running = pthread_create(&p->thread, NULL, preload_thread, p) == 0;
+}
+
+static void stop_preload(struct preload *p)
+{
+	uint32_t i;
+
+	if (p->running)
+		pthread_join(p->thread, NULL);
+
+	if (p->handles) {
+		for (i = 0; i < p->n_commands; i++)
+			pw_module_release_preload(p->handles[i]);
+	}
+	free(p->handles);
+	free(p->commands);
+}
+
 /**
  * pw_daemon_config_run_commands:
  * @config: A #struct pw_daemon_config
@@ -178,6 +274,12 @@ int pw_daemon_config_load(struct pw_daemon_config *config, char **err)
  * Run all commands that have been parsed. The list of commands will be cleared
  * when this function has been called.
  *
+ * The libraries of the modules are loaded in a background thread, the
+ * commands themselves, including the module init functions, are run one
+ * after the other in config order in the calling thread. Module inits
+ * create globals and listeners on the core, which is not thread safe.
+ * The time each command took is logged.
+ *
  * Returns: 0 if all commands where executed with success, otherwise < 0.
  */
 int pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_core *core)
@@ -185,15 +287,30 @@ int pw_daemon_config_run_commands(struct pw_daemon_config *config, struct pw_cor
 	char *err = NULL;
 	int ret = 0;
 	struct pw_command *command, *tmp;
+	struct preload preload;
+	uint64_t start, begin, end;
+
+	start = get_time();
+	start_preload(config, &preload);
 
 	spa_list_for_each(command, &config->commands, link) {
+		begin = get_time();
 		if ((ret = pw_command_run(command, core, &err)) < 0) {
 			pw_log_warn("could not run command %s: %s", command->args[0], err);
 			free(err);
 			break;
 		}
+		end = get_time();
+		pw_log_info("%s %s: %.3f ms", command->args[0],
+			    command->n_args > 1 ? command->args[1] : "",
+			    (end - begin) / (double) SPA_NSEC_PER_MSEC);
 	}
 
+	stop_preload(&preload);
+
+	pw_log_info("commands done in %.3f ms",
+		    (get_time() - start) / (double) SPA_NSEC_PER_MSEC);
+
 	spa_list_for_each_safe(command, tmp, &config->commands, link)
 		pw_command_free(command);
 
@@ -26,9 +26,11 @@ extern "C" {
 #endif
 
 #include <pipewire/core.h>
+#include <pipewire/properties.h>
 
 struct pw_daemon_config {
 	struct spa_list commands;
+	struct pw_properties *properties;	/**< properties set with set-prop */
 };
 
 struct pw_daemon_config * pw_daemon_config_new(void);
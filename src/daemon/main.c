@@ -53,6 +53,8 @@ int main(int argc, char *argv[])
 	struct pw_daemon_config *config;
 	char *err = NULL;
 	struct pw_properties *props;
+	const char *key;
+	void *state = NULL;
 	static const struct option long_options[] = {
 		{"help",	0, NULL, 'h'},
 		{"version",	0, NULL, 'v'},
@@ -96,6 +98,9 @@ int main(int argc, char *argv[])
 	props = pw_properties_new(PW_CORE_PROP_NAME, daemon_name,
 				  PW_CORE_PROP_DAEMON, "1", NULL);
 
+	while ((key = pw_properties_iterate(config->properties, &state)))
+		pw_properties_set(props, key, pw_properties_get(config->properties, key));
+
 	loop = pw_main_loop_new(props);
 	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGINT, do_quit, loop);
 	pw_loop_add_signal(pw_main_loop_get_loop(loop), SIGTERM, do_quit, loop);
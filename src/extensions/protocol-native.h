@@ -41,7 +41,7 @@ struct pw_protocol_native_demarshal {
 
 /** \ref pw_protocol_native_ext methods */
 struct pw_protocol_native_ext {
-#define PW_VERSION_PROTOCOL_NATIVE_EXT	0
+#define PW_VERSION_PROTOCOL_NATIVE_EXT	2
 	uint32_t version;
 
 	struct spa_pod_builder * (*begin_proxy) (struct pw_proxy *proxy,
@@ -62,6 +62,27 @@ struct pw_protocol_native_ext {
 	void (*end_resource) (struct pw_resource *resource,
 			      struct spa_pod_builder *builder);
 
+	/** like end_resource but replaces a queued info event of the resource,
+	 * since version 1 */
+	void (*end_resource_info) (struct pw_resource *resource,
+				   struct spa_pod_builder *builder);
+
+	/** queue the info event that was serialized for \a info with
+	 * \a change_mask when it was sent to another resource of the same
+	 * object. Returns 0 on success or -ENOENT when the info needs to be
+	 * serialized with begin_resource, since version 2 */
+	int (*send_resource_snapshot) (struct pw_resource *resource,
+				       uint8_t opcode,
+				       const void *info,
+				       uint64_t change_mask);
+
+	/** like end_resource_info but also keeps the serialized info for
+	 * send_resource_snapshot, since version 2 */
+	void (*end_resource_snapshot) (struct pw_resource *resource,
+				       struct spa_pod_builder *builder,
+				       uint8_t opcode,
+				       const void *info,
+				       uint64_t change_mask);
 };
 
 #define pw_protocol_native_begin_proxy(p,...)		pw_protocol_ext(pw_proxy_get_protocol(p),struct pw_protocol_native_ext,begin_proxy,p,__VA_ARGS__)
@@ -73,6 +94,9 @@ struct pw_protocol_native_ext {
 #define pw_protocol_native_add_resource_fd(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,add_resource_fd,r,__VA_ARGS__)
 #define pw_protocol_native_get_resource_fd(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,get_resource_fd,r,__VA_ARGS__)
 #define pw_protocol_native_end_resource(r,...)		pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,end_resource,r,__VA_ARGS__)
+#define pw_protocol_native_end_resource_info(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,end_resource_info,r,__VA_ARGS__)
+#define pw_protocol_native_send_resource_snapshot(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,send_resource_snapshot,r,__VA_ARGS__)
+#define pw_protocol_native_end_resource_snapshot(r,...)	pw_protocol_ext(pw_resource_get_protocol(r),struct pw_protocol_native_ext,end_resource_snapshot,r,__VA_ARGS__)
 
 #ifdef __cplusplus
 }  /* extern "C" */
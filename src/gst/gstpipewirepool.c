@@ -85,8 +85,10 @@ void gst_pipewire_pool_wrap_buffer (GstPipeWirePool *pool, struct pw_buffer *b)
 
     GST_LOG_OBJECT (pool, "wrap buffer %d %d", d->mapoffset, d->maxsize);
     if (d->type == t->data.MemFd) {
+      /* the buffers are reused for the lifetime of the stream, keep the
+       * memory mapped instead of mapping it for every gst_buffer_map() */
       gmem = gst_fd_allocator_alloc (pool->fd_allocator, dup (d->fd),
-                d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_NONE);
+                d->mapoffset + d->maxsize, GST_FD_MEMORY_FLAG_KEEP_MAPPED);
       gst_memory_resize (gmem, d->mapoffset, d->maxsize);
       data->offset = d->mapoffset;
     }
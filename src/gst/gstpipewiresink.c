@@ -38,6 +38,9 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 
+#include <gst/video/video.h>
+#include <gst/audio/audio.h>
+
 #include "gstpipewireformat.h"
 
 GST_DEBUG_CATEGORY_STATIC (pipewire_sink_debug);
@@ -128,8 +131,40 @@ static gboolean
 gst_pipewire_sink_propose_allocation (GstBaseSink * bsink, GstQuery * query)
 {
   GstPipeWireSink *pwsink = GST_PIPEWIRE_SINK (bsink);
+  GstBufferPool *pool = GST_BUFFER_POOL_CAST (pwsink->pool);
+  GstStructure *config;
+  GstCaps *caps;
+  GstVideoInfo vinfo;
+  GstAudioInfo ainfo;
+  guint size = 0;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  /* upstream can only configure the pool when it is not active, it was
+   * activated when we had to copy buffers before */
+  if (gst_buffer_pool_is_active (pool) && !gst_buffer_pool_set_active (pool, FALSE)) {
+    GST_WARNING_OBJECT (pwsink, "can't deactivate pool, not proposing it");
+    return TRUE;
+  }
 
-  gst_query_add_allocation_pool (query, GST_BUFFER_POOL_CAST (pwsink->pool), 0, 0, 0);
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_get_params (config, NULL, &size, NULL, NULL);
+
+  /* propose our pool with the size of a frame or about 20ms of audio so
+   * that upstream renders directly into the PipeWire memory and render
+   * does not need to copy. Keep the configured size for audio, upstream
+   * has set its own buffer size in it. */
+  if (caps && gst_video_info_from_caps (&vinfo, caps))
+    size = GST_VIDEO_INFO_SIZE (&vinfo);
+  else if (caps && gst_audio_info_from_caps (&ainfo, caps) && size == 0)
+    size = GST_AUDIO_INFO_BPF (&ainfo) * (GST_AUDIO_INFO_RATE (&ainfo) / 50);
+
+  gst_buffer_pool_config_set_params (config, caps, size, 0, 0);
+  if (!gst_buffer_pool_set_config (pool, config))
+    GST_WARNING_OBJECT (pwsink, "can't configure pool");
+
+  GST_DEBUG_OBJECT (pwsink, "propose pool with size %u", size);
+  gst_query_add_allocation_pool (query, pool, size, 0, 0);
   return TRUE;
 }
 
@@ -264,6 +299,12 @@ pool_activated (GstPipeWirePool *pool, GstPipeWireSink *sink)
 static void
 gst_pipewire_sink_init (GstPipeWireSink * sink)
 {
+  struct spa_dict_item items[] = {
+    /* the lock is handed to the streaming thread for every buffer */
+    { PW_THREAD_LOOP_PROP_FUTEX, "1" },
+  };
+  struct spa_dict loop_props = SPA_DICT_INIT (items, SPA_N_ELEMENTS (items));
+
   sink->pool =  gst_pipewire_pool_new ();
   sink->client_name = pw_get_client_name();
   sink->mode = DEFAULT_PROP_MODE;
@@ -274,7 +315,7 @@ gst_pipewire_sink_init (GstPipeWireSink * sink)
   g_queue_init (&sink->queue);
 
   sink->loop = pw_loop_new (NULL);
-  sink->main_loop = pw_thread_loop_new (sink->loop, "pipewire-sink-loop");
+  sink->main_loop = pw_thread_loop_new_full (sink->loop, "pipewire-sink-loop", &loop_props);
   sink->core = pw_core_new (sink->loop, NULL);
   sink->type = pw_core_get_type (sink->core);
   sink->pool->t = sink->type;
@@ -595,6 +636,8 @@ gst_pipewire_sink_render (GstBaseSink * bsink, GstBuffer * buffer)
     if ((res = gst_buffer_pool_acquire_buffer (GST_BUFFER_POOL_CAST (pwsink->pool), &b, NULL)) != GST_FLOW_OK)
       goto done;
 
+    GST_LOG_OBJECT (pwsink, "copy buffer %p not from our pool", buffer);
+
     gst_buffer_map (b, &info, GST_MAP_WRITE);
     gst_buffer_extract (buffer, 0, info.data, info.size);
     gst_buffer_unmap (b, &info);
@@ -310,6 +310,12 @@ gst_pipewire_src_class_init (GstPipeWireSrcClass * klass)
 static void
 gst_pipewire_src_init (GstPipeWireSrc * src)
 {
+  struct spa_dict_item items[] = {
+    /* the lock is handed to the streaming thread for every buffer */
+    { PW_THREAD_LOOP_PROP_FUTEX, "1" },
+  };
+  struct spa_dict loop_props = SPA_DICT_INIT (items, SPA_N_ELEMENTS (items));
+
   /* we operate in time */
   gst_base_src_set_format (GST_BASE_SRC (src), GST_FORMAT_TIME);
 
@@ -324,7 +330,7 @@ gst_pipewire_src_init (GstPipeWireSrc * src)
 
   src->pool =  gst_pipewire_pool_new ();
   src->loop = pw_loop_new (NULL);
-  src->main_loop = pw_thread_loop_new (src->loop, "pipewire-main-loop");
+  src->main_loop = pw_thread_loop_new_full (src->loop, "pipewire-main-loop", &loop_props);
   src->core = pw_core_new (src->loop, NULL);
   src->type = pw_core_get_type (src->core);
   src->pool->t = src->type;
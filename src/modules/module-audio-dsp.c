@@ -20,7 +20,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
-#include <math.h>
+#include <stdlib.h>
 
 #include "config.h"
 
@@ -36,10 +36,13 @@
 #include "pipewire/type.h"
 #include "pipewire/private.h"
 
+#include "module-audio-dsp/conv.h"
+
 #define NAME "dsp"
 
 #define MAX_PORTS	256
 #define MAX_BUFFERS	8
+#define MAX_SAMPLES	2048
 
 struct type {
 	struct spa_type_media_type media_type;
@@ -70,6 +73,8 @@ struct impl {
 
 	int node_count;
 
+	struct conv_ops ops;
+
 	struct spa_list node_list;
 };
 
@@ -115,10 +120,21 @@ struct node {
 
 	struct impl *impl;
 
+	/* direction of the port that talks to the device */
+	enum pw_direction direction;
+
 	int channels;
 	int sample_rate;
 	int buffer_size;
 
+	bool have_format;
+	uint32_t format;
+	int conv;
+
+	/* used for missing input and output ports */
+	float silence[MAX_SAMPLES];
+	float scratch[MAX_SAMPLES];
+
 	struct spa_node node_impl;
 
 	struct port *in_ports[MAX_PORTS];
@@ -239,27 +255,6 @@ static struct buffer * dequeue_buffer(struct node *n, struct port *p)
         return b;
 }
 
-static void conv_f32_s16(int16_t *out, float *in, int n_samples, int stride)
-{
-	int i;
-	for (i = 0; i < n_samples; i++) {
-		if (in[i] < -1.0f)
-			*out = -32767;
-		else if (in[i] >= 1.0f)
-			*out = 32767;
-		else
-			*out = lrintf(in[i] * 32767.0f);
-		out += stride;
-	}
-}
-static void fill_s16(int16_t *out, int n_samples, int stride)
-{
-	int i;
-	for (i = 0; i < n_samples; i++) {
-		*out = 0;
-		out += stride;
-	}
-}
 #if 0
 static void add_f32(float *out, float *in, int n_samples)
 {
@@ -269,84 +264,160 @@ static void add_f32(float *out, float *in, int n_samples)
 }
 #endif
 
-static int node_process_input(struct spa_node *node)
+static int process_interleave(struct node *n)
 {
-	struct node *n = SPA_CONTAINER_OF(node, struct node, node_impl);
-	struct pw_node *this = n->node;
 	struct port *outp = GET_OUT_PORT(n, 0);
 	struct spa_io_buffers *outio = outp->io;
+	const float *src[MAX_PORTS];
 	struct buffer *out;
-	int16_t *op;
 	int i;
 
-	pw_log_trace(NAME " %p: process input", this);
-
         if (outio->status == SPA_STATUS_HAVE_BUFFER)
 		return SPA_STATUS_HAVE_BUFFER;
 
 	out = dequeue_buffer(n, outp);
 	if (out == NULL) {
-		pw_log_warn(NAME " %p: out of buffers", this);
+		pw_log_warn(NAME " %p: out of buffers", n->node);
 		return -EPIPE;
 	}
 
-	outio->buffer_id = out->outbuf->id;
-	outio->status = SPA_STATUS_HAVE_BUFFER;
-
-	op = out->ptr;
-
 	for (i = 0; i < n->n_in_ports; i++) {
 		struct port *inp = GET_IN_PORT(n, i);
 		struct spa_io_buffers *inio = inp->io;
-		struct buffer *in;
-		int stride = 2;
 
-		if (inio->buffer_id < inp->n_buffers && inio->status == SPA_STATUS_HAVE_BUFFER) {
-			in = &inp->buffers[inio->buffer_id];
-			conv_f32_s16(op, in->ptr, n->buffer_size, stride);
-		}
-		else {
-			fill_s16(op, n->buffer_size, stride);
-		}
-		op++;
-		inio->status = SPA_STATUS_NEED_BUFFER;
+		if (inio != NULL && inio->buffer_id < inp->n_buffers &&
+		    inio->status == SPA_STATUS_HAVE_BUFFER)
+			src[i] = inp->buffers[inio->buffer_id].ptr;
+		else
+			src[i] = n->silence;
+
+		if (inio != NULL)
+			inio->status = SPA_STATUS_NEED_BUFFER;
 	}
 
+	n->impl->ops.interleave[n->conv](out->ptr, src, n->n_in_ports, n->buffer_size);
+
 	out->outbuf->datas[0].chunk->offset = 0;
-	out->outbuf->datas[0].chunk->size = n->buffer_size * sizeof(int16_t) * 2;
+	out->outbuf->datas[0].chunk->size = n->buffer_size * n->n_in_ports *
+		n->impl->ops.sample_size[n->conv];
 	out->outbuf->datas[0].chunk->stride = 0;
 
-	return outio->status;
+	outio->buffer_id = out->outbuf->id;
+	outio->status = SPA_STATUS_HAVE_BUFFER;
+
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+static int process_deinterleave(struct node *n)
+{
+	struct port *inp = GET_IN_PORT(n, 0);
+	struct spa_io_buffers *inio = inp->io;
+	float *dst[MAX_PORTS];
+	struct spa_data *d;
+	int i, n_samples, frame_size;
+
+	if (inio->buffer_id >= inp->n_buffers || inio->status != SPA_STATUS_HAVE_BUFFER)
+		return SPA_STATUS_NEED_BUFFER;
+
+	d = inp->buffers[inio->buffer_id].outbuf->datas;
+	frame_size = n->n_out_ports * n->impl->ops.sample_size[n->conv];
+	n_samples = SPA_MIN(d[0].chunk->size / frame_size, n->buffer_size);
+
+	for (i = 0; i < n->n_out_ports; i++) {
+		struct port *outp = GET_OUT_PORT(n, i);
+		struct spa_io_buffers *outio = outp->io;
+		struct buffer *out;
+
+		/* ports that are not linked or did not consume the previous
+		 * buffer yet get their data dropped in the scratch area */
+		if (outio == NULL || outio->status == SPA_STATUS_HAVE_BUFFER ||
+		    (out = dequeue_buffer(n, outp)) == NULL) {
+			dst[i] = n->scratch;
+			continue;
+		}
+		dst[i] = out->ptr;
+
+		out->outbuf->datas[0].chunk->offset = 0;
+		out->outbuf->datas[0].chunk->size = n_samples * sizeof(float);
+		out->outbuf->datas[0].chunk->stride = 0;
+
+		outio->buffer_id = out->outbuf->id;
+		outio->status = SPA_STATUS_HAVE_BUFFER;
+	}
+
+	n->impl->ops.deinterleave[n->conv](dst,
+			SPA_MEMBER(d[0].data, d[0].chunk->offset, void),
+			n->n_out_ports, n_samples);
+
+	inio->status = SPA_STATUS_NEED_BUFFER;
+
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
+static int node_process_input(struct spa_node *node)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node_impl);
+
+	pw_log_trace(NAME " %p: process input", n->node);
+
+	if (!n->have_format)
+		return -EIO;
+
+	if (n->direction == PW_DIRECTION_OUTPUT)
+		return process_interleave(n);
+	else
+		return process_deinterleave(n);
 }
 
 static int node_process_output(struct spa_node *node)
 {
 	struct node *n = SPA_CONTAINER_OF(node, struct node, node_impl);
 	struct pw_node *this = n->node;
-	struct port *outp = GET_OUT_PORT(n, 0);
-	struct spa_io_buffers *outio = outp->io;
 	int i;
 
 	pw_log_trace(NAME " %p: process output", this);
 
-        if (outio->status == SPA_STATUS_HAVE_BUFFER)
-		return SPA_STATUS_HAVE_BUFFER;
+	if (n->direction == PW_DIRECTION_OUTPUT) {
+		struct port *outp = GET_OUT_PORT(n, 0);
+		struct spa_io_buffers *outio = outp->io;
 
-	if (outio->buffer_id < outp->n_buffers) {
-		recycle_buffer(n, outp, outio->buffer_id);
-		outio->buffer_id = SPA_ID_INVALID;
-	}
+		if (outio->status == SPA_STATUS_HAVE_BUFFER)
+			return SPA_STATUS_HAVE_BUFFER;
 
-	for (i = 0; i < n->n_in_ports; i++) {
-		struct port *inp = GET_IN_PORT(n, i);
+		if (outio->buffer_id < outp->n_buffers) {
+			recycle_buffer(n, outp, outio->buffer_id);
+			outio->buffer_id = SPA_ID_INVALID;
+		}
+
+		for (i = 0; i < n->n_in_ports; i++) {
+			struct port *inp = GET_IN_PORT(n, i);
+			struct spa_io_buffers *inio = inp->io;
+
+			if (inio == NULL || inp->n_buffers == 0)
+				continue;
+
+			inio->status = SPA_STATUS_NEED_BUFFER;
+		}
+		return outio->status = SPA_STATUS_NEED_BUFFER;
+	}
+	else {
+		struct port *inp = GET_IN_PORT(n, 0);
 		struct spa_io_buffers *inio = inp->io;
 
-		if (inio == NULL || inp->n_buffers == 0)
-			continue;
+		for (i = 0; i < n->n_out_ports; i++) {
+			struct port *outp = GET_OUT_PORT(n, i);
+			struct spa_io_buffers *outio = outp->io;
+
+			if (outio == NULL || outio->status == SPA_STATUS_HAVE_BUFFER)
+				continue;
 
-		inio->status = SPA_STATUS_NEED_BUFFER;
+			if (outio->buffer_id < outp->n_buffers) {
+				recycle_buffer(n, outp, outio->buffer_id);
+				outio->buffer_id = SPA_ID_INVALID;
+			}
+		}
+		return inio->status = SPA_STATUS_NEED_BUFFER;
 	}
-	return outio->status = SPA_STATUS_NEED_BUFFER;
 }
 
 
@@ -424,7 +495,11 @@ static int port_enum_formats(struct spa_node *node,
 			type->param.idEnumFormat, type->spa_format,
 			"I", t->media_type.audio,
 			"I", t->media_subtype.raw,
-                        ":", t->format_audio.format,   "I", t->audio_format.S16,
+                        ":", t->format_audio.format,   "Ieu", t->audio_format.S16,
+				SPA_POD_PROP_ENUM(4, t->audio_format.S16,
+						     t->audio_format.S24,
+						     t->audio_format.S32,
+						     t->audio_format.F32),
                         ":", t->format_audio.rate,     "i", n->sample_rate,
                         ":", t->format_audio.channels, "i", n->channels);
 	}
@@ -432,6 +507,37 @@ static int port_enum_formats(struct spa_node *node,
 	return 1;
 }
 
+static int port_get_format(struct spa_node *node,
+			   enum spa_direction direction, uint32_t port_id,
+			   uint32_t *index,
+			   const struct spa_pod *filter,
+			   struct spa_pod **param,
+			   struct spa_pod_builder *builder)
+{
+	struct node *n = SPA_CONTAINER_OF(node, struct node, node_impl);
+	struct port *p = GET_PORT(n, direction, port_id);
+	struct pw_type *type = n->impl->t;
+	struct type *t = &n->impl->type;
+
+	if (SPA_FLAG_CHECK(p->flags, PORT_FLAG_DSP))
+		return port_enum_formats(node, direction, port_id, index, filter, param, builder);
+
+	if (!n->have_format)
+		return -EIO;
+	if (*index > 0)
+		return 0;
+
+	*param = spa_pod_builder_object(builder,
+		type->param.idFormat, type->spa_format,
+		"I", t->media_type.audio,
+		"I", t->media_subtype.raw,
+		":", t->format_audio.format,   "I", n->format,
+		":", t->format_audio.rate,     "i", n->sample_rate,
+		":", t->format_audio.channels, "i", n->channels);
+
+	return 1;
+}
+
 static int port_enum_params(struct spa_node *node,
 			    enum spa_direction direction, uint32_t port_id,
 			    uint32_t id, uint32_t *index,
@@ -454,16 +560,26 @@ static int port_enum_params(struct spa_node *node,
 			return res;
 	}
 	else if (id == t->param.idFormat) {
-		if ((res = port_enum_formats(node, direction, port_id, index, filter, &param, &b)) <= 0)
+		if ((res = port_get_format(node, direction, port_id, index, filter, &param, &b)) <= 0)
 			return res;
 	}
 	else if (id == t->param.idBuffers) {
+		struct port *p = GET_PORT(n, direction, port_id);
+		int size;
+
 		if (*index > 0)
 			return 0;
 
+		if (SPA_FLAG_CHECK(p->flags, PORT_FLAG_DSP))
+			size = n->buffer_size * sizeof(float);
+		else if (n->have_format)
+			size = n->buffer_size * n->channels * n->impl->ops.sample_size[n->conv];
+		else
+			return -EIO;
+
 		param = spa_pod_builder_object(&b,
 			id, t->param_buffers.Buffers,
-			":", t->param_buffers.size,    "i", n->buffer_size * sizeof(float),
+			":", t->param_buffers.size,    "i", size,
 			":", t->param_buffers.stride,  "i", 0,
 			":", t->param_buffers.buffers, "ir", 2,
 				SPA_POD_PROP_MIN_MAX(1, MAX_BUFFERS),
@@ -480,14 +596,30 @@ static int port_enum_params(struct spa_node *node,
 	return 1;
 }
 
+static int format_to_conv(struct type *t, uint32_t format)
+{
+	if (format == t->audio_format.S16)
+		return CONV_S16;
+	else if (format == t->audio_format.S24)
+		return CONV_S24;
+	else if (format == t->audio_format.S32)
+		return CONV_S32;
+	else if (format == t->audio_format.F32)
+		return CONV_F32;
+	return -1;
+}
+
 static int port_set_format(struct spa_node *node, struct port *p,
 			   uint32_t flags, const struct spa_pod *format)
 {
 	struct spa_audio_info info = { 0 };
 	struct node *n = SPA_CONTAINER_OF(node, struct node, node_impl);
 	struct type *t = &n->impl->type;
+	int conv;
 
 	if (format == NULL) {
+		if (!SPA_FLAG_CHECK(p->flags, PORT_FLAG_DSP))
+			n->have_format = false;
 		clear_buffers(n, p);
 		return 0;
 	}
@@ -503,6 +635,23 @@ static int port_set_format(struct spa_node *node, struct port *p,
 	if (spa_format_audio_raw_parse(format, &info.info.raw, &t->format_audio) < 0)
 		return -EINVAL;
 
+	if (SPA_FLAG_CHECK(p->flags, PORT_FLAG_DSP)) {
+		if (info.info.raw.format != t->audio_format.F32 ||
+		    info.info.raw.channels != 1)
+			return -EINVAL;
+	}
+	else {
+		if ((conv = format_to_conv(t, info.info.raw.format)) < 0 ||
+		    info.info.raw.channels != n->channels)
+			return -EINVAL;
+
+		if (!(flags & SPA_NODE_PARAM_FLAG_TEST_ONLY)) {
+			n->format = info.info.raw.format;
+			n->conv = conv;
+			n->have_format = true;
+		}
+	}
+
 	pw_log_info(NAME " %p: set format on port %p", n, p);
 
 	return 0;
@@ -739,7 +888,7 @@ static struct pw_node *make_node(struct impl *impl, const struct pw_properties *
 	struct pw_node *node;
 	struct node *n;
 	struct port *p;
-	const char *alias;
+	const char *alias, *str;
 	char node_name[128];
 	int i;
 
@@ -762,9 +911,14 @@ static struct pw_node *make_node(struct impl *impl, const struct pw_properties *
 	n->node = node;
 	n->impl = impl;
 	n->node_impl = node_impl;
+	n->direction = direction;
 	n->channels = 2;
 	n->sample_rate = 44100;
 	n->buffer_size = 1024 / sizeof(float);
+	if ((str = pw_properties_get(props, "audio.channels")) != NULL)
+		n->channels = SPA_CLAMP(atoi(str), 1, MAX_PORTS);
+	if ((str = pw_properties_get(props, "audio.rate")) != NULL)
+		n->sample_rate = atoi(str);
 	pw_node_set_implementation(node, &n->node_impl);
 
 	p = make_port(n, direction, 0, 0, NULL);
@@ -914,6 +1068,7 @@ static int module_init(struct pw_module *module, struct pw_properties *propertie
 	impl->properties = properties;
 
 	init_type(&impl->type, core->type.map);
+	conv_get_ops(&impl->ops);
 
 	spa_list_init(&impl->node_list);
 
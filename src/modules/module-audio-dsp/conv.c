@@ -0,0 +1,496 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "conv.h"
+
+#define S16_SCALE	32767.0f
+#define S24_SCALE	8388607.0f
+#define S32_SCALE	2147483648.0f
+/* largest float below 2^31, anything above overflows the conversion */
+#define S32_MAX_F	2147483520.0f
+
+static inline int16_t f32_to_s16(float v)
+{
+	if (v <= -1.0f)
+		return -32767;
+	else if (v >= 1.0f)
+		return 32767;
+	else
+		return lrintf(v * S16_SCALE);
+}
+
+static inline int32_t f32_to_s24(float v)
+{
+	if (v <= -1.0f)
+		return -8388607;
+	else if (v >= 1.0f)
+		return 8388607;
+	else
+		return lrintf(v * S24_SCALE);
+}
+
+static inline int32_t f32_to_s32(float v)
+{
+	if (v <= -1.0f)
+		return INT32_MIN;
+	else if (v * S32_SCALE >= S32_MAX_F)
+		return (int32_t) S32_MAX_F;
+	else
+		return lrintf(v * S32_SCALE);
+}
+
+static inline void write_s24(uint8_t *d, int32_t v)
+{
+	d[0] = v;
+	d[1] = v >> 8;
+	d[2] = v >> 16;
+}
+
+static inline int32_t read_s24(const uint8_t *s)
+{
+	return (int32_t) (s[0] | (s[1] << 8) | ((int8_t) s[2] << 16));
+}
+
+/* packed 24 bits samples don't map well on vectors, these are always scalar */
+
+static void
+interleave_s24_c(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	uint8_t *d = dst;
+	int c, s, stride = 3 * n_channels;
+
+	for (c = 0; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			write_s24(&d[s * stride + 3 * c], f32_to_s24(src[c][s]));
+}
+
+static void
+deinterleave_s24_c(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const uint8_t *s = src;
+	int c, i, stride = 3 * n_channels;
+
+	for (c = 0; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = read_s24(&s[i * stride + 3 * c]) * (1.0f / S24_SCALE);
+}
+
+#if !defined(__SSE2__)
+/* scalar versions, used when there are no vector versions */
+
+static void
+interleave_f32_c(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	float *d = dst;
+	int c, s;
+
+	for (c = 0; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			d[s * n_channels + c] = src[c][s];
+}
+
+static void
+interleave_s16_c(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	int16_t *d = dst;
+	int c, s;
+
+	for (c = 0; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			d[s * n_channels + c] = f32_to_s16(src[c][s]);
+}
+
+static void
+interleave_s32_c(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	int32_t *d = dst;
+	int c, s;
+
+	for (c = 0; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			d[s * n_channels + c] = f32_to_s32(src[c][s]);
+}
+
+static void
+deinterleave_f32_c(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const float *s = src;
+	int c, i;
+
+	for (c = 0; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = s[i * n_channels + c];
+}
+
+static void
+deinterleave_s16_c(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const int16_t *s = src;
+	int c, i;
+
+	for (c = 0; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = s[i * n_channels + c] * (1.0f / S16_SCALE);
+}
+
+static void
+deinterleave_s32_c(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const int32_t *s = src;
+	int c, i;
+
+	for (c = 0; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = s[i * n_channels + c] * (1.0f / S32_SCALE);
+}
+#endif
+
+#if defined(__SSE2__)
+/* The vector versions work on blocks of 4 channels by 4 samples. A block is
+ * loaded as 4 vectors, transposed and stored, so that any channel count is
+ * handled with full width loads and stores. Leftover channels and samples
+ * are done one by one. Stereo, the most common layout, has its own path. */
+
+#define LOAD_PLANAR(v,src,c,s)				\
+	v##0 = _mm_loadu_ps(&src[(c) + 0][s]);		\
+	v##1 = _mm_loadu_ps(&src[(c) + 1][s]);		\
+	v##2 = _mm_loadu_ps(&src[(c) + 2][s]);		\
+	v##3 = _mm_loadu_ps(&src[(c) + 3][s]);		\
+	_MM_TRANSPOSE4_PS(v##0, v##1, v##2, v##3);
+
+static void
+interleave_f32_sse2(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	float *d = dst;
+	int c, s, c4 = n_channels & ~3, s4 = n_samples & ~3;
+	__m128 v0, v1, v2, v3;
+
+	if (n_channels == 1) {
+		memcpy(dst, src[0], n_samples * sizeof(float));
+		return;
+	}
+	if (n_channels == 2) {
+		for (s = 0; s < s4; s += 4) {
+			v0 = _mm_loadu_ps(&src[0][s]);
+			v1 = _mm_loadu_ps(&src[1][s]);
+			_mm_storeu_ps(&d[2 * s + 0], _mm_unpacklo_ps(v0, v1));
+			_mm_storeu_ps(&d[2 * s + 4], _mm_unpackhi_ps(v0, v1));
+		}
+		for (; s < n_samples; s++) {
+			d[2 * s + 0] = src[0][s];
+			d[2 * s + 1] = src[1][s];
+		}
+		return;
+	}
+	for (c = 0; c < c4; c += 4) {
+		for (s = 0; s < s4; s += 4) {
+			LOAD_PLANAR(v, src, c, s);
+			_mm_storeu_ps(&d[(s + 0) * n_channels + c], v0);
+			_mm_storeu_ps(&d[(s + 1) * n_channels + c], v1);
+			_mm_storeu_ps(&d[(s + 2) * n_channels + c], v2);
+			_mm_storeu_ps(&d[(s + 3) * n_channels + c], v3);
+		}
+		for (; s < n_samples; s++) {
+			d[s * n_channels + c + 0] = src[c + 0][s];
+			d[s * n_channels + c + 1] = src[c + 1][s];
+			d[s * n_channels + c + 2] = src[c + 2][s];
+			d[s * n_channels + c + 3] = src[c + 3][s];
+		}
+	}
+	for (; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			d[s * n_channels + c] = src[c][s];
+}
+
+static inline __m128i f32_to_s16x4(__m128 v)
+{
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+	return _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(S16_SCALE)));
+}
+
+static void
+interleave_s16_sse2(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	int16_t *d = dst;
+	int c, s, c4 = n_channels & ~3, s4 = n_samples & ~3;
+	__m128 v0, v1, v2, v3;
+	__m128i p0, p1;
+
+	if (n_channels == 2) {
+		for (s = 0; s < s4; s += 4) {
+			v0 = _mm_loadu_ps(&src[0][s]);
+			v1 = _mm_loadu_ps(&src[1][s]);
+			p0 = _mm_packs_epi32(f32_to_s16x4(_mm_unpacklo_ps(v0, v1)),
+					     f32_to_s16x4(_mm_unpackhi_ps(v0, v1)));
+			_mm_storeu_si128((__m128i*)&d[2 * s], p0);
+		}
+		for (; s < n_samples; s++) {
+			d[2 * s + 0] = f32_to_s16(src[0][s]);
+			d[2 * s + 1] = f32_to_s16(src[1][s]);
+		}
+		return;
+	}
+	for (c = 0; c < c4; c += 4) {
+		for (s = 0; s < s4; s += 4) {
+			LOAD_PLANAR(v, src, c, s);
+			p0 = _mm_packs_epi32(f32_to_s16x4(v0), f32_to_s16x4(v1));
+			p1 = _mm_packs_epi32(f32_to_s16x4(v2), f32_to_s16x4(v3));
+			_mm_storel_epi64((__m128i*)&d[(s + 0) * n_channels + c], p0);
+			_mm_storel_epi64((__m128i*)&d[(s + 1) * n_channels + c],
+					 _mm_unpackhi_epi64(p0, p0));
+			_mm_storel_epi64((__m128i*)&d[(s + 2) * n_channels + c], p1);
+			_mm_storel_epi64((__m128i*)&d[(s + 3) * n_channels + c],
+					 _mm_unpackhi_epi64(p1, p1));
+		}
+		for (; s < n_samples; s++) {
+			d[s * n_channels + c + 0] = f32_to_s16(src[c + 0][s]);
+			d[s * n_channels + c + 1] = f32_to_s16(src[c + 1][s]);
+			d[s * n_channels + c + 2] = f32_to_s16(src[c + 2][s]);
+			d[s * n_channels + c + 3] = f32_to_s16(src[c + 3][s]);
+		}
+	}
+	for (; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			d[s * n_channels + c] = f32_to_s16(src[c][s]);
+}
+
+static inline __m128i f32_to_s32x4(__m128 v)
+{
+	v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+	v = _mm_min_ps(_mm_mul_ps(v, _mm_set1_ps(S32_SCALE)), _mm_set1_ps(S32_MAX_F));
+	return _mm_cvtps_epi32(v);
+}
+
+static void
+interleave_s32_sse2(void *dst, const float *src[], int n_channels, int n_samples)
+{
+	int32_t *d = dst;
+	int c, s, c4 = n_channels & ~3, s4 = n_samples & ~3;
+	__m128 v0, v1, v2, v3;
+
+	if (n_channels == 2) {
+		for (s = 0; s < s4; s += 4) {
+			v0 = _mm_loadu_ps(&src[0][s]);
+			v1 = _mm_loadu_ps(&src[1][s]);
+			_mm_storeu_si128((__m128i*)&d[2 * s + 0], f32_to_s32x4(_mm_unpacklo_ps(v0, v1)));
+			_mm_storeu_si128((__m128i*)&d[2 * s + 4], f32_to_s32x4(_mm_unpackhi_ps(v0, v1)));
+		}
+		for (; s < n_samples; s++) {
+			d[2 * s + 0] = f32_to_s32(src[0][s]);
+			d[2 * s + 1] = f32_to_s32(src[1][s]);
+		}
+		return;
+	}
+	for (c = 0; c < c4; c += 4) {
+		for (s = 0; s < s4; s += 4) {
+			LOAD_PLANAR(v, src, c, s);
+			_mm_storeu_si128((__m128i*)&d[(s + 0) * n_channels + c], f32_to_s32x4(v0));
+			_mm_storeu_si128((__m128i*)&d[(s + 1) * n_channels + c], f32_to_s32x4(v1));
+			_mm_storeu_si128((__m128i*)&d[(s + 2) * n_channels + c], f32_to_s32x4(v2));
+			_mm_storeu_si128((__m128i*)&d[(s + 3) * n_channels + c], f32_to_s32x4(v3));
+		}
+		for (; s < n_samples; s++) {
+			d[s * n_channels + c + 0] = f32_to_s32(src[c + 0][s]);
+			d[s * n_channels + c + 1] = f32_to_s32(src[c + 1][s]);
+			d[s * n_channels + c + 2] = f32_to_s32(src[c + 2][s]);
+			d[s * n_channels + c + 3] = f32_to_s32(src[c + 3][s]);
+		}
+	}
+	for (; c < n_channels; c++)
+		for (s = 0; s < n_samples; s++)
+			d[s * n_channels + c] = f32_to_s32(src[c][s]);
+}
+
+#define STORE_PLANAR(v,dst,c,s)				\
+	_MM_TRANSPOSE4_PS(v##0, v##1, v##2, v##3);	\
+	_mm_storeu_ps(&dst[(c) + 0][s], v##0);		\
+	_mm_storeu_ps(&dst[(c) + 1][s], v##1);		\
+	_mm_storeu_ps(&dst[(c) + 2][s], v##2);		\
+	_mm_storeu_ps(&dst[(c) + 3][s], v##3);
+
+static void
+deinterleave_f32_sse2(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const float *s = src;
+	int c, i, c4 = n_channels & ~3, s4 = n_samples & ~3;
+	__m128 v0, v1, v2, v3;
+
+	if (n_channels == 1) {
+		memcpy(dst[0], src, n_samples * sizeof(float));
+		return;
+	}
+	if (n_channels == 2) {
+		for (i = 0; i < s4; i += 4) {
+			v0 = _mm_loadu_ps(&s[2 * i + 0]);
+			v1 = _mm_loadu_ps(&s[2 * i + 4]);
+			_mm_storeu_ps(&dst[0][i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(&dst[1][i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		for (; i < n_samples; i++) {
+			dst[0][i] = s[2 * i + 0];
+			dst[1][i] = s[2 * i + 1];
+		}
+		return;
+	}
+	for (c = 0; c < c4; c += 4) {
+		for (i = 0; i < s4; i += 4) {
+			v0 = _mm_loadu_ps(&s[(i + 0) * n_channels + c]);
+			v1 = _mm_loadu_ps(&s[(i + 1) * n_channels + c]);
+			v2 = _mm_loadu_ps(&s[(i + 2) * n_channels + c]);
+			v3 = _mm_loadu_ps(&s[(i + 3) * n_channels + c]);
+			STORE_PLANAR(v, dst, c, i);
+		}
+		for (; i < n_samples; i++) {
+			dst[c + 0][i] = s[i * n_channels + c + 0];
+			dst[c + 1][i] = s[i * n_channels + c + 1];
+			dst[c + 2][i] = s[i * n_channels + c + 2];
+			dst[c + 3][i] = s[i * n_channels + c + 3];
+		}
+	}
+	for (; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = s[i * n_channels + c];
+}
+
+static inline __m128 s16x4_to_f32(const int16_t *s)
+{
+	__m128i v = _mm_loadl_epi64((const __m128i*)s);
+	v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+	return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / S16_SCALE));
+}
+
+static void
+deinterleave_s16_sse2(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const int16_t *s = src;
+	int c, i, c4 = n_channels & ~3, s4 = n_samples & ~3;
+	__m128 v0, v1, v2, v3;
+
+	if (n_channels == 2) {
+		for (i = 0; i < s4; i += 4) {
+			v0 = s16x4_to_f32(&s[2 * i + 0]);
+			v1 = s16x4_to_f32(&s[2 * i + 4]);
+			_mm_storeu_ps(&dst[0][i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(&dst[1][i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		for (; i < n_samples; i++) {
+			dst[0][i] = s[2 * i + 0] * (1.0f / S16_SCALE);
+			dst[1][i] = s[2 * i + 1] * (1.0f / S16_SCALE);
+		}
+		return;
+	}
+	for (c = 0; c < c4; c += 4) {
+		for (i = 0; i < s4; i += 4) {
+			v0 = s16x4_to_f32(&s[(i + 0) * n_channels + c]);
+			v1 = s16x4_to_f32(&s[(i + 1) * n_channels + c]);
+			v2 = s16x4_to_f32(&s[(i + 2) * n_channels + c]);
+			v3 = s16x4_to_f32(&s[(i + 3) * n_channels + c]);
+			STORE_PLANAR(v, dst, c, i);
+		}
+		for (; i < n_samples; i++) {
+			dst[c + 0][i] = s[i * n_channels + c + 0] * (1.0f / S16_SCALE);
+			dst[c + 1][i] = s[i * n_channels + c + 1] * (1.0f / S16_SCALE);
+			dst[c + 2][i] = s[i * n_channels + c + 2] * (1.0f / S16_SCALE);
+			dst[c + 3][i] = s[i * n_channels + c + 3] * (1.0f / S16_SCALE);
+		}
+	}
+	for (; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = s[i * n_channels + c] * (1.0f / S16_SCALE);
+}
+
+static inline __m128 s32x4_to_f32(const int32_t *s)
+{
+	__m128i v = _mm_loadu_si128((const __m128i*)s);
+	return _mm_mul_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(1.0f / S32_SCALE));
+}
+
+static void
+deinterleave_s32_sse2(float *dst[], const void *src, int n_channels, int n_samples)
+{
+	const int32_t *s = src;
+	int c, i, c4 = n_channels & ~3, s4 = n_samples & ~3;
+	__m128 v0, v1, v2, v3;
+
+	if (n_channels == 2) {
+		for (i = 0; i < s4; i += 4) {
+			v0 = s32x4_to_f32(&s[2 * i + 0]);
+			v1 = s32x4_to_f32(&s[2 * i + 4]);
+			_mm_storeu_ps(&dst[0][i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2, 0, 2, 0)));
+			_mm_storeu_ps(&dst[1][i], _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3, 1, 3, 1)));
+		}
+		for (; i < n_samples; i++) {
+			dst[0][i] = s[2 * i + 0] * (1.0f / S32_SCALE);
+			dst[1][i] = s[2 * i + 1] * (1.0f / S32_SCALE);
+		}
+		return;
+	}
+	for (c = 0; c < c4; c += 4) {
+		for (i = 0; i < s4; i += 4) {
+			v0 = s32x4_to_f32(&s[(i + 0) * n_channels + c]);
+			v1 = s32x4_to_f32(&s[(i + 1) * n_channels + c]);
+			v2 = s32x4_to_f32(&s[(i + 2) * n_channels + c]);
+			v3 = s32x4_to_f32(&s[(i + 3) * n_channels + c]);
+			STORE_PLANAR(v, dst, c, i);
+		}
+		for (; i < n_samples; i++) {
+			dst[c + 0][i] = s[i * n_channels + c + 0] * (1.0f / S32_SCALE);
+			dst[c + 1][i] = s[i * n_channels + c + 1] * (1.0f / S32_SCALE);
+			dst[c + 2][i] = s[i * n_channels + c + 2] * (1.0f / S32_SCALE);
+			dst[c + 3][i] = s[i * n_channels + c + 3] * (1.0f / S32_SCALE);
+		}
+	}
+	for (; c < n_channels; c++)
+		for (i = 0; i < n_samples; i++)
+			dst[c][i] = s[i * n_channels + c] * (1.0f / S32_SCALE);
+}
+#endif
+
+void conv_get_ops(struct conv_ops *ops)
+{
+	ops->sample_size[CONV_S16] = sizeof(int16_t);
+	ops->sample_size[CONV_S24] = 3;
+	ops->sample_size[CONV_S32] = sizeof(int32_t);
+	ops->sample_size[CONV_F32] = sizeof(float);
+
+	ops->interleave[CONV_S24] = interleave_s24_c;
+	ops->deinterleave[CONV_S24] = deinterleave_s24_c;
+#if defined(__SSE2__)
+	ops->interleave[CONV_S16] = interleave_s16_sse2;
+	ops->interleave[CONV_S32] = interleave_s32_sse2;
+	ops->interleave[CONV_F32] = interleave_f32_sse2;
+	ops->deinterleave[CONV_S16] = deinterleave_s16_sse2;
+	ops->deinterleave[CONV_S32] = deinterleave_s32_sse2;
+	ops->deinterleave[CONV_F32] = deinterleave_f32_sse2;
+#else
+	ops->interleave[CONV_S16] = interleave_s16_c;
+	ops->interleave[CONV_S32] = interleave_s32_c;
+	ops->interleave[CONV_F32] = interleave_f32_c;
+	ops->deinterleave[CONV_S16] = deinterleave_s16_c;
+	ops->deinterleave[CONV_S32] = deinterleave_s32_c;
+	ops->deinterleave[CONV_F32] = deinterleave_f32_c;
+#endif
+}
@@ -0,0 +1,53 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_AUDIO_DSP_CONV_H__
+#define __PIPEWIRE_AUDIO_DSP_CONV_H__
+
+#include <stdint.h>
+
+#include <spa/utils/defs.h>
+
+/** Interleave \a n_channels planar float channels of \a n_samples
+ * samples each into \a dst in the sample format of the function */
+typedef void (*conv_interleave_func_t) (void *dst, const float *src[],
+					int n_channels, int n_samples);
+
+/** Split \a src with \a n_channels interleaved channels into \a n_channels
+ * planar float channels of \a n_samples samples each */
+typedef void (*conv_deinterleave_func_t) (float *dst[], const void *src,
+					  int n_channels, int n_samples);
+
+enum {
+	CONV_S16,
+	CONV_S24,
+	CONV_S32,
+	CONV_F32,
+	CONV_MAX,
+};
+
+struct conv_ops {
+	int sample_size[CONV_MAX];
+	conv_interleave_func_t interleave[CONV_MAX];
+	conv_deinterleave_func_t deinterleave[CONV_MAX];
+};
+
+void conv_get_ops(struct conv_ops *ops);
+
+#endif /* __PIPEWIRE_AUDIO_DSP_CONV_H__ */
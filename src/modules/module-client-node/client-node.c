@@ -128,6 +128,7 @@ struct impl {
 	struct pw_client_node this;
 
 	bool client_reuse;
+	bool pipelined;		/**< the client produces one cycle ahead */
 
 	struct pw_core *core;
 	struct pw_type *t;
@@ -146,10 +147,17 @@ struct impl {
 
 	uint32_t input_ready;
 	bool out_pending;
+
+	/* pipelined output: the output of the client for the next cycle */
+	struct spa_io_buffers *out_next;
+	bool out_ready;		/**< out_next holds output of the client */
+	bool out_waiting;	/**< the graph waits for the client */
 };
 
 /** \endcond */
 
+static void reset_pipeline(struct impl *impl);
+
 static struct mem *ensure_mem(struct impl *impl, int fd, uint32_t type, uint32_t flags)
 {
 	struct mem *m, *f = NULL;
@@ -291,6 +299,9 @@ static int impl_node_send_command(struct spa_node *node, const struct spa_comman
 	if (SPA_COMMAND_TYPE(command) == t->command_node.ClockUpdate) {
 		pw_client_node_resource_command(this->resource, this->seq++, command);
 	} else {
+		if (SPA_COMMAND_TYPE(command) == t->command_node.Pause)
+			reset_pipeline(this->impl);
+
 		/* send start */
 		pw_client_node_resource_command(this->resource, this->seq, command);
 		res = SPA_RESULT_RETURN_ASYNC(this->seq++);
@@ -577,6 +588,9 @@ impl_node_port_set_param(struct spa_node *node,
 	if (this->resource == NULL)
 		return 0;
 
+	if (direction == SPA_DIRECTION_OUTPUT && id == this->impl->t->param.idFormat)
+		reset_pipeline(this->impl);
+
 	pw_client_node_resource_port_set_param(this->resource,
 					       this->seq,
 					       direction, port_id,
@@ -669,6 +683,9 @@ impl_node_port_use_buffers(struct spa_node *node,
 	if (!port->have_format)
 		return -EIO;
 
+	if (direction == SPA_DIRECTION_OUTPUT)
+		reset_pipeline(impl);
+
 	clear_buffers(this, port);
 
 	if (n_buffers > 0) {
@@ -709,7 +726,7 @@ impl_node_port_use_buffers(struct spa_node *node,
 			data_size += buffers[i]->metas[j].size;
 		}
 		for (j = 0; j < buffers[i]->n_datas; j++) {
-			struct spa_data *d = buffers[i]->datas;
+			struct spa_data *d = &buffers[i]->datas[j];
 			data_size += sizeof(struct spa_chunk);
 			if (d->type == t->data.MemPtr)
 				data_size += d->maxsize;
@@ -872,6 +889,80 @@ static int impl_node_process_input(struct spa_node *node)
 	return res;
 }
 
+static void request_output(struct impl *impl)
+{
+	impl->out_pending = true;
+	pw_client_node_transport_add_message(impl->transport,
+			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT));
+	do_flush(&impl->node);
+}
+
+static int do_reset_pipeline(struct spa_loop *loop,
+			     bool async,
+			     uint32_t seq,
+			     const void *data,
+			     size_t size,
+			     void *user_data)
+{
+	struct impl *impl = user_data;
+	uint32_t i;
+
+	impl->out_ready = false;
+	impl->out_waiting = false;
+	for (i = 0; i < impl->transport->area->max_output_ports; i++) {
+		impl->out_next[i].status = SPA_STATUS_NEED_BUFFER;
+		impl->out_next[i].buffer_id = SPA_ID_INVALID;
+		impl->transport->outputs[i].buffer_id = SPA_ID_INVALID;
+	}
+	return 0;
+}
+
+/* forget the output the client made for the next cycle, it refers to buffers
+ * that are not used anymore after a pause, a new format or new buffers */
+static void reset_pipeline(struct impl *impl)
+{
+	if (!impl->pipelined || impl->out_next == NULL)
+		return;
+
+	spa_loop_invoke(impl->node.data_loop,
+			do_reset_pipeline,
+			SPA_ID_INVALID,
+			NULL,
+			0,
+			true,
+			impl);
+}
+
+/* The client produces the output for the next cycle while the graph consumes
+ * the output it made in the previous cycle. When the client did not finish
+ * in time, the graph waits for it like in the synchronous case. */
+static int process_output_pipelined(struct impl *impl)
+{
+	struct spa_graph_node *n = &impl->this.node->rt.node;
+	struct spa_graph_port *p;
+	bool ready = impl->out_ready;
+
+	if (!impl->out_pending) {
+		/* pass the buffers to recycle and ask for the next cycle */
+		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
+			impl->transport->outputs[p->port_id] = *p->io;
+			p->io->buffer_id = SPA_ID_INVALID;
+		}
+		impl->out_ready = false;
+		request_output(impl);
+	}
+	if (!ready) {
+		pw_log_trace("client-node %p: client late, wait for output", impl);
+		impl->out_waiting = true;
+		return SPA_STATUS_OK;
+	}
+
+	spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link)
+		*p->io = impl->out_next[p->port_id];
+
+	return SPA_STATUS_HAVE_BUFFER;
+}
+
 static int impl_node_process_output(struct spa_node *node)
 {
 	struct node *this;
@@ -883,6 +974,9 @@ static int impl_node_process_output(struct spa_node *node)
 	impl = this->impl;
 	n = &impl->this.node->rt.node;
 
+	if (impl->pipelined)
+		return process_output_pipelined(impl);
+
 	if (impl->out_pending)
 		goto done;
 
@@ -899,9 +993,7 @@ static int impl_node_process_output(struct spa_node *node)
 	}
 
       done:
-	pw_client_node_transport_add_message(impl->transport,
-			       &PW_CLIENT_NODE_MESSAGE_INIT(PW_CLIENT_NODE_MESSAGE_PROCESS_OUTPUT));
-	do_flush(this);
+	request_output(impl);
 
 	return SPA_STATUS_OK;
 }
@@ -916,11 +1008,33 @@ static int handle_node_message(struct node *this, struct pw_client_node_message
 
 	switch (PW_CLIENT_NODE_MESSAGE_TYPE(message)) {
 	case PW_CLIENT_NODE_MESSAGE_HAVE_OUTPUT:
+		impl->out_pending = false;
+
+		if (impl->pipelined && !impl->out_waiting) {
+			/* keep it for the next cycle */
+			spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link)
+				impl->out_next[p->port_id] = impl->transport->outputs[p->port_id];
+			impl->out_ready = true;
+			break;
+		}
 		spa_list_for_each(p, &n->ports[SPA_DIRECTION_OUTPUT], link) {
-			*p->io = impl->transport->outputs[p->port_id];
+			struct spa_io_buffers *tio = &impl->transport->outputs[p->port_id];
+			uint32_t recycle = p->io->buffer_id;
+
+			*p->io = *tio;
 			pw_log_trace("have output %d %d", p->io->status, p->io->buffer_id);
+
+			if (impl->pipelined) {
+				/* fill the pipeline again, give back the buffer the
+				 * graph consumed while we were waiting, if any */
+				tio->status = SPA_STATUS_NEED_BUFFER;
+				tio->buffer_id = recycle;
+			}
+		}
+		if (impl->pipelined) {
+			impl->out_waiting = false;
+			request_output(impl);
 		}
-		impl->out_pending = false;
 		this->callbacks->have_output(this->callbacks_data);
 		break;
 
@@ -949,15 +1063,28 @@ static int handle_node_message(struct node *this, struct pw_client_node_message
 	return 0;
 }
 
-static void setup_transport(struct impl *impl)
+static int setup_transport(struct impl *impl)
 {
 	uint32_t max_inputs = 0, max_outputs = 0, n_inputs = 0, n_outputs = 0;
 
 	spa_node_get_n_ports(&impl->node.node, &n_inputs, &max_inputs, &n_outputs, &max_outputs);
 
+	if (impl->pipelined && max_outputs > 0) {
+		impl->out_next = calloc(max_outputs, sizeof(struct spa_io_buffers));
+		if (impl->out_next == NULL)
+			return -ENOMEM;
+	}
+
 	impl->transport = pw_client_node_transport_new(max_inputs, max_outputs);
+	if (impl->transport == NULL) {
+		free(impl->out_next);
+		impl->out_next = NULL;
+		return -ENOMEM;
+	}
 	impl->transport->area->n_input_ports = n_inputs;
 	impl->transport->area->n_output_ports = n_outputs;
+
+	return 0;
 }
 
 static void
@@ -967,7 +1094,7 @@ client_node_done(void *data, int seq, int res)
 	struct node *this = &impl->node;
 
 	if (seq == 0 && res == 0 && impl->transport == NULL)
-		setup_transport(impl);
+		res = setup_transport(impl);
 
 	this->callbacks->done(this->callbacks_data, seq, res);
 }
@@ -1236,6 +1363,7 @@ static void node_free(void *data)
 
 	if (impl->transport)
 		pw_client_node_transport_destroy(impl->transport);
+	free(impl->out_next);
 
 	spa_hook_remove(&impl->node_listener);
 
@@ -1318,6 +1446,9 @@ struct pw_client_node *pw_client_node_new(struct pw_resource *resource,
 	str = pw_properties_get(properties, "pipewire.client.reuse");
 	impl->client_reuse = str && pw_properties_parse_bool(str);
 
+	str = pw_properties_get(properties, "pipewire.client.pipelined");
+	impl->pipelined = str && pw_properties_parse_bool(str);
+
 	pw_resource_add_listener(this->resource,
 				 &impl->resource_listener,
 				 &resource_events,
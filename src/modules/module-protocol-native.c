@@ -21,6 +21,8 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
+#include <inttypes.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 #include <sys/stat.h>
@@ -65,11 +67,22 @@ static bool debug_messages = 0;
 
 void pw_protocol_native_init(struct pw_protocol *protocol);
 
+/* an info event serialized for all the resources of an object */
+struct snapshot {
+	uint32_t type;		/**< interface type of the resources */
+	uint8_t opcode;
+	const void *info;
+	uint64_t change_mask;
+	uint32_t serial;	/**< core info_serial when it was made */
+	struct pw_array data;	/**< the message body */
+};
+
 struct protocol_data {
 	struct pw_module *module;
 	struct spa_hook module_listener;
 	struct pw_protocol *protocol;
 	struct pw_properties *properties;
+	struct pw_array snapshots;
 };
 
 struct client {
@@ -83,6 +96,7 @@ struct client {
 
         bool disconnecting;
 	bool flush_signaled;
+	bool need_out;
         struct spa_source *flush_event;
 };
 
@@ -99,41 +113,63 @@ struct server {
 	struct spa_hook hook;
 };
 
+/* clients that have more than this queued for longer than MAX_QUEUED_TIME
+ * or more than 4 times this at any time are disconnected */
+#define MAX_QUEUED_SIZE		(1024 * 1024)
+#define MAX_QUEUED_TIME		(5 * SPA_NSEC_PER_SEC)
+
 struct client_data {
 	struct pw_client *client;
 	struct spa_hook client_listener;
 	struct spa_source *source;
 	struct pw_protocol_native_connection *connection;
 	bool busy;
+	bool need_out;		/**< wait until the socket is writable */
+	uint64_t over_time;	/**< when the queue went over MAX_QUEUED_SIZE or 0 */
 };
 
-static bool pod_remap_data(uint32_t type, void *body, uint32_t size, struct pw_map *types)
+/* check that the type id is known and rewrite it when it has a different id
+ * on our side. The first n_same ids are known and the same on both sides. */
+static inline bool remap_id(uint32_t *id, struct pw_map *types, uint32_t n_same)
 {
 	void *t;
 
+	if (*id < n_same)
+		return true;
+	if ((t = pw_map_lookup(types, *id)) == NULL)
+		return false;
+	if (PW_MAP_PTR_TO_ID(t) != *id)
+		*id = PW_MAP_PTR_TO_ID(t);
+	return true;
+}
+
+/* checks that all type ids in the pod are known and rewrites the ones that
+ * have a different id on our side, the others are left untouched */
+static bool pod_remap_data(uint32_t type, void *body, uint32_t size, struct pw_map *types,
+			   uint32_t n_same)
+{
 	switch (type) {
 	case SPA_POD_TYPE_ID:
-		if ((t = pw_map_lookup(types, *(int32_t *) body)) == NULL)
+		if (!remap_id(body, types, n_same))
 			return false;
-		*(int32_t *) body = PW_MAP_PTR_TO_ID(t);
 		break;
 
 	case SPA_POD_TYPE_PROP:
 	{
 		struct spa_pod_prop_body *b = body;
 
-		if ((t = pw_map_lookup(types, b->key)) == NULL)
+		if (!remap_id(&b->key, types, n_same))
 			return false;
-		b->key = PW_MAP_PTR_TO_ID(t);
 
 		if (b->value.type == SPA_POD_TYPE_ID) {
 			void *alt;
-			if (!pod_remap_data
-			    (b->value.type, SPA_POD_BODY(&b->value), b->value.size, types))
+			if (!pod_remap_data(b->value.type, SPA_POD_BODY(&b->value),
+					    b->value.size, types, n_same))
 				return false;
 
 			SPA_POD_PROP_ALTERNATIVE_FOREACH(b, size, alt)
-				if (!pod_remap_data(b->value.type, alt, b->value.size, types))
+				if (!pod_remap_data(b->value.type, alt, b->value.size,
+						    types, n_same))
 					return false;
 		}
 		break;
@@ -143,17 +179,14 @@ static bool pod_remap_data(uint32_t type, void *body, uint32_t size, struct pw_m
 		struct spa_pod_object_body *b = body;
 		struct spa_pod *p;
 
-		if ((t = pw_map_lookup(types, b->id)) != NULL)
-			b->id = PW_MAP_PTR_TO_ID(t);
-		else
+		if (!remap_id(&b->id, types, n_same))
 			b->id = SPA_ID_INVALID;
 
-		if ((t = pw_map_lookup(types, b->type)) == NULL)
+		if (!remap_id(&b->type, types, n_same))
 			return false;
-		b->type = PW_MAP_PTR_TO_ID(t);
 
 		SPA_POD_OBJECT_BODY_FOREACH(b, size, p)
-			if (!pod_remap_data(p->type, SPA_POD_BODY(p), p->size, types))
+			if (!pod_remap_data(p->type, SPA_POD_BODY(p), p->size, types, n_same))
 				return false;
 		break;
 	}
@@ -162,7 +195,7 @@ static bool pod_remap_data(uint32_t type, void *body, uint32_t size, struct pw_m
 		struct spa_pod *b = body, *p;
 
 		SPA_POD_FOREACH(b, size, p)
-			if (!pod_remap_data(p->type, SPA_POD_BODY(p), p->size, types))
+			if (!pod_remap_data(p->type, SPA_POD_BODY(p), p->size, types, n_same))
 				return false;
 		break;
 	}
@@ -226,8 +259,12 @@ process_messages(struct client_data *data)
 			continue;
 		}
 
+		/* always walk the types of untrusted clients, this rejects type
+		 * ids the client did not announce. The ids below the first one
+		 * that differs from ours are not looked up */
 		if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP)
-			if (!pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &client->types))
+			if (!pod_remap_data(SPA_POD_TYPE_STRUCT, message, size,
+					    &client->types, client->n_types_same))
 				goto invalid_message;
 
 		if (debug_messages) {
@@ -253,20 +290,28 @@ process_messages(struct client_data *data)
 	goto done;
 }
 
+static void update_io(struct client_data *c)
+{
+	enum spa_io mask = SPA_IO_ERR | SPA_IO_HUP;
+
+	if (!c->busy)
+		mask |= SPA_IO_IN;
+	if (c->need_out)
+		mask |= SPA_IO_OUT;
+
+	pw_loop_update_io(c->client->core->main_loop, c->source, mask);
+}
+
 static void
 client_busy_changed(void *data, bool busy)
 {
 	struct client_data *c = data;
 	struct pw_client *client = c->client;
-	enum spa_io mask = SPA_IO_ERR | SPA_IO_HUP;
 
 	c->busy = busy;
 
-	if (!busy)
-		mask |= SPA_IO_IN;
-
 	pw_log_debug("protocol-native %p: busy changed %d", client->protocol, busy);
-	pw_loop_update_io(client->core->main_loop, c->source, mask);
+	update_io(c);
 
 	if (!busy)
 		process_messages(c);
@@ -285,6 +330,12 @@ connection_data(void *data, int fd, enum spa_io mask)
 		return;
 	}
 
+	if (mask & SPA_IO_OUT) {
+		if (pw_protocol_native_connection_flush(this->connection) != -EAGAIN) {
+			this->need_out = false;
+			update_io(this);
+		}
+	}
 	if (mask & SPA_IO_IN)
 		process_messages(this);
 }
@@ -442,8 +493,7 @@ socket_data(void *data, int fd, enum spa_io mask)
 	}
 	c = client->user_data;
 
-	pw_loop_update_io(client->protocol->core->main_loop,
-			  c->source, SPA_IO_IN | SPA_IO_ERR | SPA_IO_HUP);
+	update_io(c);
 }
 
 static bool add_socket(struct pw_protocol *protocol, struct server *s)
@@ -513,6 +563,25 @@ static int impl_steal_fd(struct pw_protocol_client *client)
 	return fd;
 }
 
+static void do_flush(struct client *impl)
+{
+	struct pw_remote *remote = impl->this.remote;
+	int res;
+
+	res = pw_protocol_native_connection_flush(impl->connection);
+	if (res < 0 && res != -EAGAIN) {
+		impl->this.disconnect(&impl->this);
+		return;
+	}
+	/* when the socket is full, wait until it is writable again */
+	if (impl->source && impl->need_out != (res == -EAGAIN)) {
+		impl->need_out = res == -EAGAIN;
+		pw_loop_update_io(remote->core->main_loop, impl->source,
+				  SPA_IO_IN | SPA_IO_HUP | SPA_IO_ERR |
+				  (impl->need_out ? SPA_IO_OUT : 0));
+	}
+}
+
 static void
 on_remote_data(void *data, int fd, enum spa_io mask)
 {
@@ -529,6 +598,9 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 		return;
         }
 
+	if (mask & SPA_IO_OUT)
+		do_flush(impl);
+
         if (mask & SPA_IO_IN) {
                 uint8_t opcode;
                 uint32_t id;
@@ -564,8 +636,12 @@ on_remote_data(void *data, int fd, enum spa_io mask)
 				continue;
 			}
 
-			if (demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP) {
-				if (!pod_remap_data(SPA_POD_TYPE_STRUCT, message, size, &this->types)) {
+			/* the server is trusted, only walk the message when some
+			 * of its type ids differ from ours */
+			if ((demarshal[opcode].flags & PW_PROTOCOL_NATIVE_REMAP) &&
+			    this->n_types_remapped > 0) {
+				if (!pod_remap_data(SPA_POD_TYPE_STRUCT, message, size,
+						    &this->types, this->n_types_same)) {
                                         pw_log_error
                                             ("protocol-native %p: invalid message received %u for %u", this,
                                              opcode, id);
@@ -591,8 +667,7 @@ static void do_flush_event(void *data, uint64_t count)
         struct client *impl = data;
 	impl->flush_signaled = false;
         if (impl->connection)
-                if (!pw_protocol_native_connection_flush(impl->connection))
-                        impl->this.disconnect(&impl->this);
+		do_flush(impl);
 }
 
 static void on_need_flush(void *data)
@@ -617,6 +692,7 @@ static int impl_connect_fd(struct pw_protocol_client *client, int fd)
 	struct pw_remote *remote = client->remote;
 
 	impl->disconnecting = false;
+	impl->need_out = false;
 
 	impl->connection = pw_protocol_native_connection_new(remote->core, fd);
 	if (impl->connection == NULL)
@@ -740,10 +816,43 @@ static void on_before_hook(void *_data)
 	struct pw_protocol_server *this = &server->this;
 	struct pw_client *client, *tmp;
 	struct client_data *data;
+	struct timespec ts;
+	uint64_t now = 0;
+	uint64_t over;
+	size_t queued;
 
 	spa_list_for_each_safe(client, tmp, &this->client_list, protocol_link) {
 		data = client->user_data;
-		pw_protocol_native_connection_flush(data->connection);
+
+		if (!data->need_out) {
+			if (pw_protocol_native_connection_flush(data->connection) != -EAGAIN) {
+				data->over_time = 0;
+				continue;
+			}
+			/* the client does not read fast enough, wait until we can write */
+			data->need_out = true;
+			update_io(data);
+		}
+
+		queued = pw_protocol_native_connection_get_queued(data->connection);
+		if (queued <= MAX_QUEUED_SIZE) {
+			data->over_time = 0;
+			continue;
+		}
+		if (now == 0) {
+			clock_gettime(CLOCK_MONOTONIC, &ts);
+			now = SPA_TIMESPEC_TO_TIME(&ts);
+		}
+		if (data->over_time == 0)
+			data->over_time = now;
+
+		over = now - data->over_time;
+		if (queued > 4 * MAX_QUEUED_SIZE || over > MAX_QUEUED_TIME) {
+			over /= SPA_NSEC_PER_MSEC;
+			pw_log_warn("protocol-native %p: client %p has %zd bytes queued for %"
+				    PRIu64 "ms, disconnecting", client->protocol, client, queued, over);
+			pw_client_destroy(client);
+		}
 	}
 }
 
@@ -866,6 +975,85 @@ static void impl_ext_end_resource(struct pw_resource *resource,
 	pw_protocol_native_connection_end(data->connection, builder);
 }
 
+static void impl_ext_end_resource_info(struct pw_resource *resource,
+				       struct spa_pod_builder *builder)
+{
+	struct client_data *data = resource->client->user_data;
+	pw_protocol_native_connection_end_info(data->connection, builder);
+}
+
+static struct snapshot *find_snapshot(struct protocol_data *d, uint32_t type, uint8_t opcode)
+{
+	struct snapshot *sn;
+
+	pw_array_for_each(sn, &d->snapshots) {
+		if (sn->type == type && sn->opcode == opcode)
+			return sn;
+	}
+	return NULL;
+}
+
+static int impl_ext_send_resource_snapshot(struct pw_resource *resource,
+					   uint8_t opcode,
+					   const void *info,
+					   uint64_t change_mask)
+{
+	struct protocol_data *d = pw_protocol_get_user_data(resource->client->protocol);
+	struct client_data *data = resource->client->user_data;
+	struct spa_pod_builder *b;
+	struct snapshot *sn;
+
+	/* infos sent with everything changed are sent when binding, the info
+	 * might have changed since the last time it was sent to all resources */
+	if (change_mask == (uint64_t) ~0)
+		return -ENOENT;
+
+	sn = find_snapshot(d, resource->type, opcode);
+	if (sn == NULL || sn->info != info || sn->change_mask != change_mask ||
+	    sn->serial != resource->core->info_serial || sn->data.size == 0)
+		return -ENOENT;
+
+	b = pw_protocol_native_connection_begin_resource(data->connection, resource, opcode);
+	spa_pod_builder_raw(b, sn->data.data, sn->data.size);
+	pw_protocol_native_connection_end_info(data->connection, b);
+
+	return 0;
+}
+
+static void impl_ext_end_resource_snapshot(struct pw_resource *resource,
+					   struct spa_pod_builder *builder,
+					   uint8_t opcode,
+					   const void *info,
+					   uint64_t change_mask)
+{
+	struct protocol_data *d = pw_protocol_get_user_data(resource->client->protocol);
+	struct client_data *data = resource->client->user_data;
+	struct snapshot *sn;
+	uint32_t size = builder->state.offset;
+
+	if (change_mask == (uint64_t) ~0 || builder->data == NULL)
+		goto done;
+
+	if ((sn = find_snapshot(d, resource->type, opcode)) == NULL) {
+		if ((sn = pw_array_add(&d->snapshots, sizeof(struct snapshot))) == NULL)
+			goto done;
+		sn->type = resource->type;
+		sn->opcode = opcode;
+		pw_array_init(&sn->data, 1024);
+	}
+	/* copy the body before ending, a queued info can be merged into it */
+	sn->data.size = 0;
+	if (pw_array_add(&sn->data, size) == NULL)
+		goto done;
+	memcpy(sn->data.data, builder->data, size);
+	sn->info = info;
+	sn->change_mask = change_mask;
+	sn->serial = resource->core->info_serial;
+
+      done:
+	pw_protocol_native_connection_end_info(data->connection, builder);
+}
+
 const static struct pw_protocol_native_ext protocol_ext_impl = {
 	PW_VERSION_PROTOCOL_NATIVE_EXT,
 	impl_ext_begin_proxy,
@@ -876,14 +1064,22 @@ const static struct pw_protocol_native_ext protocol_ext_impl = {
 	impl_ext_add_resource_fd,
 	impl_ext_get_resource_fd,
 	impl_ext_end_resource,
+	impl_ext_end_resource_info,
+	impl_ext_send_resource_snapshot,
+	impl_ext_end_resource_snapshot,
 };
 
 static void module_destroy(void *data)
 {
 	struct protocol_data *d = data;
+	struct snapshot *sn;
 
 	spa_hook_remove(&d->module_listener);
 
+	pw_array_for_each(sn, &d->snapshots)
+		pw_array_clear(&sn->data);
+	pw_array_clear(&d->snapshots);
+
 	if (d->properties)
 		pw_properties_free(d->properties);
 
@@ -922,6 +1118,7 @@ static int module_init(struct pw_module *module, struct pw_properties *propertie
 	d->protocol = this;
 	d->module = module;
 	d->properties = properties;
+	pw_array_init(&d->snapshots, 8 * sizeof(struct snapshot));
 
 	val = getenv("PIPEWIRE_DAEMON");
 	if (val == NULL)
@@ -19,10 +19,12 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 
 #include <spa/debug/pod.h>
@@ -51,13 +53,43 @@ struct buffer {
 	bool update;
 };
 
+/* the fds of the message at offset in the out buffer. The fd indexes in the
+ * message are relative to this chunk and the fds are sent along with the
+ * first byte of the message. */
+struct fd_chunk {
+	size_t offset;
+	uint32_t n_fds;
+	int fds[MAX_FDS];	/* our own copies, closed once sent */
+};
+
+/* an info event in the out buffer that can be replaced by a newer one */
+struct queued_info {
+	uint32_t dest_id;
+	uint8_t opcode;
+	size_t offset;		/* offset of the message header in the out buffer */
+	size_t size;		/* size of the message including the header */
+};
+
+/* a replaced info event that is removed from the out buffer before it is
+ * written */
+struct dropped_info {
+	size_t offset;
+	size_t size;
+};
+
 struct impl {
 	struct pw_protocol_native_connection this;
 
 	struct buffer in, out;
+	struct pw_array chunks;	/* fd_chunk for the out buffer */
+	struct pw_array infos;	/* queued_info for the out buffer */
+	struct pw_array dropped;	/* dropped_info for the out buffer */
+	size_t dropped_size;
 
 	uint32_t dest_id;
 	uint8_t opcode;
+	uint32_t msg_fds;	/* fds added by the message being built */
+	int msg_src_fds[MAX_FDS];
 	struct spa_pod_builder builder;
 
 	struct pw_core *core;
@@ -87,30 +119,73 @@ int pw_protocol_native_connection_get_fd(struct pw_protocol_native_connection *c
  *
  * \param conn the connection
  * \param fd the fd to add
- * \return the index of the fd or -1 when an error occured
+ * \return the index of the fd in the current message or -1 when an
+ *         error occured
+ *
+ * The connection sends a copy of \a fd, it can be closed after the
+ * message is ended.
  *
  * \memberof pw_protocol_native_connection
  */
 uint32_t pw_protocol_native_connection_add_fd(struct pw_protocol_native_connection *conn, int fd)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
-	uint32_t index, i;
+	struct fd_chunk *c;
+	uint32_t i;
+	int copy;
 
-	for (i = 0; i < impl->out.n_fds; i++) {
-		if (impl->out.fds[i] == fd)
+	/* the same fd in one message is only sent once */
+	for (i = 0; i < impl->msg_fds; i++) {
+		if (impl->msg_src_fds[i] == fd)
 			return i;
 	}
-
-	index = impl->out.n_fds;
-	if (index >= MAX_FDS) {
+	if (impl->msg_fds >= MAX_FDS) {
 		pw_log_error("connection %p: too many fds", conn);
 		return -1;
 	}
 
-	impl->out.fds[index] = fd;
-	impl->out.n_fds++;
+	/* the fd is sent later, the caller is free to close it */
+	if ((copy = fcntl(fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+		pw_log_error("connection %p: can't dup fd %d: %s", conn, fd, strerror(errno));
+		return -1;
+	}
+
+	/* every message with fds starts a new chunk */
+	if (impl->msg_fds == 0) {
+		if ((c = pw_array_add(&impl->chunks, sizeof(struct fd_chunk))) == NULL) {
+			close(copy);
+			return -1;
+		}
+		c->offset = impl->out.buffer_size;
+		c->n_fds = 0;
+	} else {
+		c = pw_array_get_unchecked(&impl->chunks,
+				pw_array_get_len(&impl->chunks, struct fd_chunk) - 1,
+				struct fd_chunk);
+	}
+
+	impl->msg_src_fds[impl->msg_fds++] = fd;
+	c->fds[c->n_fds] = copy;
+
+	return c->n_fds++;
+}
+
+static void close_chunk(struct fd_chunk *c)
+{
+	uint32_t i;
+
+	for (i = 0; i < c->n_fds; i++)
+		close(c->fds[i]);
+	c->n_fds = 0;
+}
+
+static void clear_chunks(struct impl *impl)
+{
+	struct fd_chunk *c;
 
-	return index;
+	pw_array_for_each(c, &impl->chunks)
+		close_chunk(c);
+	impl->chunks.size = 0;
 }
 
 static void *connection_ensure_size(struct pw_protocol_native_connection *conn, struct buffer *buf, size_t size)
@@ -219,6 +294,9 @@ struct pw_protocol_native_connection *pw_protocol_native_connection_new(struct p
 	impl->in.buffer_maxsize = MAX_BUFFER_SIZE;
 	impl->in.update = true;
 	impl->core = core;
+	pw_array_init(&impl->chunks, 4 * sizeof(struct fd_chunk));
+	pw_array_init(&impl->infos, 64);
+	pw_array_init(&impl->dropped, 64);
 
 	if (impl->out.buffer_data == NULL || impl->in.buffer_data == NULL)
 		goto no_mem;
@@ -248,6 +326,10 @@ void pw_protocol_native_connection_destroy(struct pw_protocol_native_connection
 
 	free(impl->out.buffer_data);
 	free(impl->in.buffer_data);
+	clear_chunks(impl);
+	pw_array_clear(&impl->chunks);
+	pw_array_clear(&impl->infos);
+	pw_array_clear(&impl->dropped);
 	free(impl);
 }
 
@@ -383,6 +465,7 @@ pw_protocol_native_connection_begin_resource(struct pw_protocol_native_connectio
 
 	impl->dest_id = resource->id;
 	impl->opcode = opcode;
+	impl->msg_fds = 0;
 	impl->builder = (struct spa_pod_builder) { NULL, 0, write_pod };
 
 	return &impl->builder;
@@ -412,6 +495,7 @@ pw_protocol_native_connection_begin_proxy(struct pw_protocol_native_connection *
 
 	impl->dest_id = proxy->id;
 	impl->opcode = opcode;
+	impl->msg_fds = 0;
 	impl->builder = (struct spa_pod_builder) { NULL, 0, write_pod, };
 
 	return &impl->builder;
@@ -441,16 +525,210 @@ pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
 			struct pw_protocol_native_connection_events, need_flush, 0);
 }
 
+/* the change_mask of an info event, all info events start with the id
+ * followed by the change_mask */
+static uint64_t *info_change_mask(struct buffer *buf, size_t offset)
+{
+	uint8_t *body = buf->buffer_data + offset + 8;
+	struct spa_pod *s = (struct spa_pod *) body;
+	struct spa_pod *id = SPA_MEMBER(s, sizeof(struct spa_pod), struct spa_pod);
+	struct spa_pod *mask = SPA_MEMBER(id, SPA_ROUND_UP_N(SPA_POD_SIZE(id), 8), struct spa_pod);
+
+	if (s->type != SPA_POD_TYPE_STRUCT || s->size < 32 ||
+	    id->type != SPA_POD_TYPE_INT || mask->type != SPA_POD_TYPE_LONG)
+		return NULL;
+
+	return SPA_POD_BODY(mask);
+}
+
+static int compare_dropped(const void *a, const void *b)
+{
+	const struct dropped_info *da = a, *db = b;
+	return da->offset < db->offset ? -1 : da->offset > db->offset;
+}
+
+/* the number of dropped bytes before offset, dropped is sorted */
+static size_t dropped_before(struct impl *impl, size_t offset)
+{
+	struct dropped_info *d;
+	size_t size = 0;
+
+	pw_array_for_each(d, &impl->dropped) {
+		if (d->offset >= offset)
+			break;
+		size += d->size;
+	}
+	return size;
+}
+
+/* remove the dropped infos from the out buffer in one pass, before it is
+ * written. Many infos can be replaced between two flushes of a slow client,
+ * the queue is only moved once for all of them. */
+static void compact_out(struct impl *impl)
+{
+	struct buffer *buf = &impl->out;
+	struct dropped_info *d;
+	struct queued_info *qi;
+	struct fd_chunk *c;
+	size_t n_dropped, src, dst, len, i;
+
+	n_dropped = pw_array_get_len(&impl->dropped, struct dropped_info);
+	if (n_dropped == 0)
+		return;
+
+	qsort(impl->dropped.data, n_dropped, sizeof(struct dropped_info), compare_dropped);
+
+	pw_array_for_each(qi, &impl->infos)
+		qi->offset -= dropped_before(impl, qi->offset);
+	pw_array_for_each(c, &impl->chunks)
+		c->offset -= dropped_before(impl, c->offset);
+
+	d = impl->dropped.data;
+	dst = d[0].offset;
+	for (i = 0; i < n_dropped; i++) {
+		src = d[i].offset + d[i].size;
+		len = (i + 1 < n_dropped ? d[i + 1].offset : buf->buffer_size) - src;
+		memmove(buf->buffer_data + dst, buf->buffer_data + src, len);
+		dst += len;
+	}
+	buf->buffer_size = dst;
+
+	impl->dropped.size = 0;
+	impl->dropped_size = 0;
+}
+
+/* drop a queued info, it is replaced by a newer one at the end of the out
+ * buffer */
+static bool drop_queued_info(struct impl *impl, struct queued_info *info)
+{
+	struct dropped_info *d;
+	struct fd_chunk *c;
+
+	/* the fds of a chunk are sent with its first message */
+	pw_array_for_each(c, &impl->chunks) {
+		if (c->offset == info->offset)
+			return false;
+	}
+	if ((d = pw_array_add(&impl->dropped, sizeof(struct dropped_info))) == NULL)
+		return false;
+
+	d->offset = info->offset;
+	d->size = info->size;
+	impl->dropped_size += info->size;
+	return true;
+}
+
+/** End an info event
+ *
+ * \param conn the connection
+ * \param builder the builder used to make the event
+ *
+ * Like pw_protocol_native_connection_end() but an info event for the same
+ * object that is still queued is dropped and its change_mask is merged into
+ * the new one. Info events contain the complete state so a client that does
+ * not read fast enough only gets the latest one. The new info stays at the
+ * end of the queue, after the type updates it might need.
+ *
+ * \memberof pw_protocol_native_connection
+ */
+void
+pw_protocol_native_connection_end_info(struct pw_protocol_native_connection *conn,
+				       struct spa_pod_builder *builder)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	struct buffer *buf = &impl->out;
+	struct queued_info *qi, *found = NULL;
+	size_t offset = buf->buffer_size, size = 8 + builder->state.offset;
+	uint64_t *old_mask, *new_mask;
+
+	pw_protocol_native_connection_end(conn, builder);
+	if (buf->buffer_size != offset + size)
+		return;
+
+	pw_array_for_each(qi, &impl->infos) {
+		if (qi->dest_id == impl->dest_id && qi->opcode == impl->opcode) {
+			found = qi;
+			break;
+		}
+	}
+	if (found) {
+		old_mask = info_change_mask(buf, found->offset);
+		new_mask = info_change_mask(buf, offset);
+		if (old_mask == NULL || new_mask == NULL) {
+			found->offset = offset;
+			found->size = size;
+			return;
+		}
+		if (drop_queued_info(impl, found)) {
+			*new_mask |= *old_mask;
+			pw_log_trace("connection %p: replace info %u %u", conn,
+				     found->dest_id, found->opcode);
+		}
+		found->offset = offset;
+		found->size = size;
+		return;
+	}
+	if ((found = pw_array_add(&impl->infos, sizeof(struct queued_info))) == NULL)
+		return;
+
+	found->dest_id = impl->dest_id;
+	found->opcode = impl->opcode;
+	found->offset = offset;
+	found->size = size;
+}
+
+/* remove the first len bytes that were written from the out buffer, forget
+ * the queued infos that were (partly) written */
+static void consume_out(struct impl *impl, size_t len)
+{
+	struct buffer *buf = &impl->out;
+	struct queued_info *qi;
+	struct fd_chunk *c;
+	size_t i = 0;
+
+	buf->buffer_size -= len;
+	memmove(buf->buffer_data, buf->buffer_data + len, buf->buffer_size);
+
+	while (i < pw_array_get_len(&impl->infos, struct queued_info)) {
+		qi = pw_array_get_unchecked(&impl->infos, i, struct queued_info);
+		if (qi->offset < len) {
+			impl->infos.size -= sizeof(struct queued_info);
+			*qi = *pw_array_get_unchecked(&impl->infos,
+					pw_array_get_len(&impl->infos, struct queued_info),
+					struct queued_info);
+			continue;
+		}
+		qi->offset -= len;
+		i++;
+	}
+	pw_array_for_each(c, &impl->chunks)
+		c->offset -= len;
+}
+
+/** Get the number of bytes in the out buffer
+ *
+ * \param conn the connection object
+ * \return the number of bytes waiting to be written
+ *
+ * \memberof pw_protocol_native_connection
+ */
+size_t pw_protocol_native_connection_get_queued(struct pw_protocol_native_connection *conn)
+{
+	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
+	return impl->out.buffer_size - impl->dropped_size;
+}
+
 /** Flush the connection object
  *
  * \param conn the connection object
- * \return true on success
+ * \return 0 when all data was written, -EAGAIN when the socket is full
+ *         and some data is still queued, < 0 on error
  *
  * Write the queued messages on the connection to the socket
  *
  * \memberof pw_protocol_native_connection
  */
-bool pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
+int pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn)
 {
 	struct impl *impl = SPA_CONTAINER_OF(conn, struct impl, this);
 	ssize_t len;
@@ -458,60 +736,84 @@ bool pw_protocol_native_connection_flush(struct pw_protocol_native_connection *c
 	struct iovec iov[1];
 	struct cmsghdr *cmsg;
 	char cmsgbuf[CMSG_SPACE(MAX_FDS * sizeof(int))];
-	int *cm;
-	uint32_t i, fds_len;
 	struct buffer *buf;
+	struct fd_chunk *c, *next;
+	uint32_t n_chunks, fds_len;
+	size_t end;
+	int res;
 
 	buf = &impl->out;
 
-	if (buf->buffer_size == 0)
-		return true;
+	compact_out(impl);
 
-	fds_len = buf->n_fds * sizeof(int);
+	/* send the messages up to the next chunk of fds at a time so that the
+	 * fds of a chunk go out with its first message */
+	while (buf->buffer_size > 0) {
+		n_chunks = pw_array_get_len(&impl->chunks, struct fd_chunk);
+		c = n_chunks > 0 ? pw_array_get_unchecked(&impl->chunks, 0, struct fd_chunk) : NULL;
+		next = n_chunks > 1 ? pw_array_get_unchecked(&impl->chunks, 1, struct fd_chunk) : NULL;
 
-	iov[0].iov_base = buf->buffer_data;
-	iov[0].iov_len = buf->buffer_size;
-	msg.msg_iov = iov;
-	msg.msg_iovlen = 1;
+		if (c != NULL && c->offset == 0) {
+			end = next ? next->offset : buf->buffer_size;
+		} else {
+			end = c ? c->offset : buf->buffer_size;
+			c = NULL;
+		}
 
-	if (buf->n_fds > 0) {
-		msg.msg_control = cmsgbuf;
-		msg.msg_controllen = CMSG_SPACE(fds_len);
-		cmsg = CMSG_FIRSTHDR(&msg);
-		cmsg->cmsg_level = SOL_SOCKET;
-		cmsg->cmsg_type = SCM_RIGHTS;
-		cmsg->cmsg_len = CMSG_LEN(fds_len);
-		cm = (int *) CMSG_DATA(cmsg);
-		for (i = 0; i < buf->n_fds; i++)
-			cm[i] = buf->fds[i] > 0 ? buf->fds[i] : -buf->fds[i];
-		msg.msg_controllen = cmsg->cmsg_len;
-	} else {
-		msg.msg_control = NULL;
-		msg.msg_controllen = 0;
-	}
+		iov[0].iov_base = buf->buffer_data;
+		iov[0].iov_len = end;
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 1;
+
+		if (c != NULL && c->n_fds > 0) {
+			fds_len = c->n_fds * sizeof(int);
+			msg.msg_control = cmsgbuf;
+			msg.msg_controllen = CMSG_SPACE(fds_len);
+			cmsg = CMSG_FIRSTHDR(&msg);
+			cmsg->cmsg_level = SOL_SOCKET;
+			cmsg->cmsg_type = SCM_RIGHTS;
+			cmsg->cmsg_len = CMSG_LEN(fds_len);
+			memcpy(CMSG_DATA(cmsg), c->fds, fds_len);
+			msg.msg_controllen = cmsg->cmsg_len;
+		} else {
+			msg.msg_control = NULL;
+			msg.msg_controllen = 0;
+		}
 
-	while (true) {
-		len = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
-		if (len < 0) {
-			if (errno == EINTR)
-				continue;
-			else
+		while (true) {
+			len = sendmsg(conn->fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+			if (len < 0) {
+				if (errno == EINTR)
+					continue;
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+					return -EAGAIN;
 				goto send_error;
+			}
+			break;
 		}
-		break;
-	}
-	pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, len,
-		     buf->n_fds);
-
-	buf->buffer_size -= len;
-	buf->n_fds = 0;
+		pw_log_trace("connection %p: %d written %zd bytes and %u fds", conn, conn->fd, len,
+			     c ? c->n_fds : 0);
+
+		/* the fds went out with the first byte, the rest of the chunk
+		 * is sent without them */
+		if (c != NULL) {
+			close_chunk(c);
+			impl->chunks.size -= sizeof(struct fd_chunk);
+			memmove(c, c + 1, impl->chunks.size);
+		}
+		consume_out(impl, len);
 
-	return true;
+		/* the socket is full, keep the rest for later */
+		if ((size_t) len < end)
+			return -EAGAIN;
+	}
+	return 0;
 
 	/* ERRORS */
       send_error:
+	res = -errno;
 	pw_log_error("could not sendmsg: %s", strerror(errno));
-	return false;
+	return res;
 }
 
 /** Clear the connection object
@@ -530,6 +832,10 @@ bool pw_protocol_native_connection_clear(struct pw_protocol_native_connection *c
 	clear_buffer(&impl->out);
 	clear_buffer(&impl->in);
 	impl->in.update = true;
+	clear_chunks(impl);
+	impl->infos.size = 0;
+	impl->dropped.size = 0;
+	impl->dropped_size = 0;
 
 	return true;
 }
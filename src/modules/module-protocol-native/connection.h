@@ -89,7 +89,14 @@ void
 pw_protocol_native_connection_end(struct pw_protocol_native_connection *conn,
                                   struct spa_pod_builder *builder);
 
-bool
+void
+pw_protocol_native_connection_end_info(struct pw_protocol_native_connection *conn,
+                                       struct spa_pod_builder *builder);
+
+size_t
+pw_protocol_native_connection_get_queued(struct pw_protocol_native_connection *conn);
+
+int
 pw_protocol_native_connection_flush(struct pw_protocol_native_connection *conn);
 
 bool
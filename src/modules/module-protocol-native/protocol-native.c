@@ -290,6 +290,10 @@ static void core_marshal_info(void *object, struct pw_core_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_CORE_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_CORE_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -312,7 +316,8 @@ static void core_marshal_info(void *object, struct pw_core_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_CORE_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static void core_marshal_done(void *object, uint32_t seq)
@@ -607,6 +612,10 @@ static void module_marshal_info(void *object, struct pw_module_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_MODULE_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_MODULE_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -627,7 +636,8 @@ static void module_marshal_info(void *object, struct pw_module_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_MODULE_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static int module_demarshal_info(void *object, void *data, size_t size)
@@ -666,6 +676,10 @@ static void factory_marshal_info(void *object, struct pw_factory_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_FACTORY_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_FACTORY_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -686,7 +700,8 @@ static void factory_marshal_info(void *object, struct pw_factory_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_FACTORY_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static int factory_demarshal_info(void *object, void *data, size_t size)
@@ -726,6 +741,10 @@ static void node_marshal_info(void *object, struct pw_node_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_NODE_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_NODE_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -750,7 +769,8 @@ static void node_marshal_info(void *object, struct pw_node_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_NODE_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static int node_demarshal_info(void *object, void *data, size_t size)
@@ -862,6 +882,10 @@ static void port_marshal_info(void *object, struct pw_port_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_PORT_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_PORT_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -880,7 +904,8 @@ static void port_marshal_info(void *object, struct pw_port_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_PORT_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static int port_demarshal_info(void *object, void *data, size_t size)
@@ -986,6 +1011,10 @@ static void client_marshal_info(void *object, struct pw_client_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_CLIENT_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_CLIENT_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -1003,7 +1032,8 @@ static void client_marshal_info(void *object, struct pw_client_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_CLIENT_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static int client_demarshal_info(void *object, void *data, size_t size)
@@ -1040,6 +1070,10 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 	struct spa_pod_builder *b;
 	uint32_t i, n_items;
 
+	if (pw_protocol_native_send_resource_snapshot(resource, PW_LINK_PROXY_EVENT_INFO,
+						      info, info->change_mask) == 0)
+		return;
+
 	b = pw_protocol_native_begin_resource(resource, PW_LINK_PROXY_EVENT_INFO);
 
 	n_items = info->props ? info->props->n_items : 0;
@@ -1062,7 +1096,8 @@ static void link_marshal_info(void *object, struct pw_link_info *info)
 	}
 	spa_pod_builder_add(b, "]", NULL);
 
-	pw_protocol_native_end_resource(resource, b);
+	pw_protocol_native_end_resource_snapshot(resource, b, PW_LINK_PROXY_EVENT_INFO,
+						info, info->change_mask);
 }
 
 static int link_demarshal_info(void *object, void *data, size_t size)
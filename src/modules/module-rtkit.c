@@ -38,9 +38,13 @@
 #include "pipewire/interfaces.h"
 #include "pipewire/link.h"
 #include "pipewire/log.h"
+#include "pipewire/loop.h"
 #include "pipewire/module.h"
 #include "pipewire/utils.h"
 
+#define DEFAULT_RT_PRIO		20
+#define DEFAULT_RT_TIME		20000
+
 struct impl {
 	struct pw_core *core;
 	struct pw_type *type;
@@ -50,6 +54,13 @@ struct impl {
 	struct spa_source source;
 
 	struct spa_hook module_listener;
+
+	int rt_prio;
+	long long rt_time;
+
+	pid_t tid;		/**< the data loop thread */
+	pthread_t thread;	/**< thread that talks to rtkit */
+	bool thread_started;
 };
 
 /***
@@ -383,6 +394,9 @@ static void module_destroy(void *data)
 
 	spa_hook_remove(&impl->module_listener);
 
+	if (impl->thread_started)
+		pthread_join(impl->thread, NULL);
+
 	if (impl->properties)
 		pw_properties_free(impl->properties);
 
@@ -394,28 +408,22 @@ static const struct pw_module_events module_events = {
 	.destroy = module_destroy,
 };
 
-static void idle_func(struct spa_source *source)
+/* ask rtkit to make the data thread realtime, this does blocking dbus
+ * calls so it runs in its own thread, the data loop keeps running in the
+ * meantime */
+static void *rtkit_thread(void *data)
 {
-	struct impl *impl = source->data;
-	struct sched_param sp;
+	struct impl *impl = data;
 	struct pw_rtkit_bus *system_bus;
 	struct rlimit rl;
-	int r, rtprio;
-	long long rttime;
-	uint64_t count;
+	int r, rtprio = impl->rt_prio, max_prio;
+	long long rttime = impl->rt_time;
 
-	rtprio = 20;
-	rttime = 20000;
-
-	spa_zero(sp);
-	sp.sched_priority = rtprio;
-
-	if (pthread_setschedparam(pthread_self(), SCHED_OTHER | SCHED_RESET_ON_FORK, &sp) == 0) {
-		pw_log_debug("SCHED_OTHER|SCHED_RESET_ON_FORK worked.");
-		return;
-	}
-	system_bus = pw_rtkit_bus_get_system();
+	if ((system_bus = pw_rtkit_bus_get_system()) == NULL)
+		return NULL;
 
+	/* rtkit refuses threads of processes without RLIMIT_RTTIME, the limit
+	 * is per process so it can be set from here */
 	rl.rlim_cur = rl.rlim_max = rttime;
 	if ((r = setrlimit(RLIMIT_RTTIME, &rl)) < 0)
 		pw_log_debug("setrlimit() failed: %s", strerror(errno));
@@ -431,14 +439,61 @@ static void idle_func(struct spa_source *source)
 		}
 	}
 
-	if ((r = pw_rtkit_make_realtime(system_bus, 0, rtprio)) < 0) {
-		pw_log_debug("could not make thread realtime: %s", strerror(r));
+	if ((max_prio = pw_rtkit_get_max_realtime_priority(system_bus)) > 0 &&
+	    rtprio > max_prio) {
+		pw_log_debug("Clamping priority %d to %d for RealtimeKit", rtprio, max_prio);
+		rtprio = max_prio;
+	}
+
+	if ((r = pw_rtkit_make_realtime(system_bus, impl->tid, rtprio)) < 0) {
+		pw_log_debug("could not make thread %d realtime: %s", impl->tid, strerror(-r));
 	} else {
-		pw_log_debug("thread made realtime");
+		pw_log_info("thread %d made realtime with priority %d by rtkit", impl->tid, rtprio);
 	}
 	pw_rtkit_bus_free(system_bus);
 
+	return NULL;
+}
+
+static void idle_func(struct spa_source *source)
+{
+	struct impl *impl = source->data;
+	struct sched_param sp;
+	uint64_t count;
+	int r, policy;
+
 	read(impl->source.fd, &count, sizeof(uint64_t));
+
+	if (impl->tid != 0)
+		return;
+
+	impl->tid = _gettid();
+
+	/* the data loop was already made realtime with loop.rt-priority, keep
+	 * that priority so that it matches what the node info reports */
+	if (pthread_getschedparam(pthread_self(), &policy, &sp) == 0 &&
+	    (policy == SCHED_FIFO || policy == SCHED_RR)) {
+		pw_log_info("thread %d already realtime with priority %d", impl->tid,
+			    sp.sched_priority);
+		return;
+	}
+
+	/* switch to realtime directly when we are allowed to, because of
+	 * CAP_SYS_NICE or a large enough RLIMIT_RTPRIO, this avoids rtkit */
+	spa_zero(sp);
+	sp.sched_priority = impl->rt_prio;
+
+	if ((r = pthread_setschedparam(pthread_self(), SCHED_FIFO | SCHED_RESET_ON_FORK, &sp)) == 0) {
+		pw_log_info("thread %d made realtime with priority %d", impl->tid, impl->rt_prio);
+		return;
+	}
+	pw_log_debug("SCHED_FIFO failed: %s, trying rtkit", strerror(r));
+
+	if ((r = pthread_create(&impl->thread, NULL, rtkit_thread, impl)) != 0) {
+		pw_log_error("can't create rtkit thread: %s", strerror(r));
+		return;
+	}
+	impl->thread_started = true;
 }
 
 static int module_init(struct pw_module *module, struct pw_properties *properties)
@@ -448,6 +503,7 @@ static int module_init(struct pw_module *module, struct pw_properties *propertie
 	struct spa_loop *loop;
 	const struct spa_support *support;
 	uint32_t n_support;
+	const char *str;
 
 	support = pw_core_get_support(core, &n_support);
 
@@ -466,6 +522,19 @@ static int module_init(struct pw_module *module, struct pw_properties *propertie
 	impl->properties = properties;
 	impl->loop = loop;
 
+	impl->rt_prio = DEFAULT_RT_PRIO;
+	impl->rt_time = DEFAULT_RT_TIME;
+	if ((str = pw_properties_get(pw_core_get_properties(core),
+				     PW_LOOP_PROP_RT_PRIORITY)) != NULL &&
+	    pw_properties_parse_int(str) > 0)
+		impl->rt_prio = pw_properties_parse_int(str);
+	if (properties) {
+		if ((str = pw_properties_get(properties, "rt.prio")) != NULL)
+			impl->rt_prio = pw_properties_parse_int(str);
+		if ((str = pw_properties_get(properties, "rt.time")) != NULL)
+			impl->rt_time = pw_properties_parse_int64(str);
+	}
+
 	impl->source.loop = loop;
 	impl->source.func = idle_func;
 	impl->source.data = impl;
@@ -480,5 +549,5 @@ static int module_init(struct pw_module *module, struct pw_properties *propertie
 
 int pipewire__module_init(struct pw_module *module, const char *args)
 {
-	return module_init(module, NULL);
+	return module_init(module, args ? pw_properties_new_string(args) : NULL);
 }
@@ -54,7 +54,6 @@ const struct pw_module_events module_events = {
 
 int pipewire__module_init(struct pw_module *module, const char *args)
 {
-	const char *dir;
 	char **argv;
 	int n_tokens;
 	struct pw_spa_monitor *monitor;
@@ -67,12 +66,9 @@ int pipewire__module_init(struct pw_module *module, const char *args)
 	if (n_tokens < 3)
 		goto not_enough_arguments;
 
-	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL)
-		dir = PLUGINDIR;
-
 	monitor = pw_spa_monitor_load(pw_module_get_core(module),
 				      pw_module_get_global(module),
-				      dir, argv[0], argv[1], argv[2],
+				      argv[0], argv[1], argv[2],
 				      sizeof(struct data));
 	if (monitor == NULL)
 		return -ENOMEM;
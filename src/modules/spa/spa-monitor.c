@@ -18,7 +18,6 @@
  */
 
 #include <stdio.h>
-#include <dlfcn.h>
 #include <errno.h>
 #include <poll.h>
 #include <string.h>
@@ -34,6 +33,7 @@
 #include <pipewire/log.h>
 #include <pipewire/type.h>
 #include <pipewire/node.h>
+#include <pipewire/pipewire.h>
 
 #include "spa-monitor.h"
 #include "spa-node.h"
@@ -52,8 +52,6 @@ struct impl {
 	struct pw_type *t;
 	struct pw_global *parent;
 
-	void *hnd;
-
 	struct spa_list item_list;
 };
 
@@ -252,7 +250,6 @@ static const struct spa_monitor_callbacks callbacks = {
 
 struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 					   struct pw_global *parent,
-					   const char *dir,
 					   const char *lib,
 					   const char *factory_name,
 					   const char *system_name,
@@ -263,42 +260,17 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	struct spa_handle *handle;
 	int res;
 	void *iface;
-	void *hnd;
 	uint32_t index;
-	spa_handle_factory_enum_func_t enum_func;
-	const struct spa_handle_factory *factory;
-	char *filename;
 	const struct spa_support *support;
 	uint32_t n_support;
 	struct pw_type *t = pw_core_get_type(core);
 
-	asprintf(&filename, "%s/%s.so", dir, lib);
+	support = pw_core_get_support(core, &n_support);
 
-	if ((hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-		pw_log_error("can't load %s: %s", filename, dlerror());
+	if ((res = pw_load_spa_handle(lib, factory_name, NULL,
+				      n_support, support, &handle)) < 0)
 		goto open_failed;
-	}
-	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-		pw_log_error("can't find enum function");
-		goto no_symbol;
-	}
 
-	for (index = 0;;) {
-		if ((res = enum_func(&factory, &index)) <= 0) {
-			if (res != 0)
-				pw_log_error("can't enumerate factories: %s", spa_strerror(res));
-			goto enum_failed;
-		}
-		if (strcmp(factory->name, factory_name) == 0)
-			break;
-	}
-	support = pw_core_get_support(core, &n_support);
-	handle = calloc(1, factory->size);
-	if ((res = spa_handle_factory_init(factory,
-					   handle, NULL, support, n_support)) < 0) {
-		pw_log_error("can't make factory instance: %d", res);
-		goto init_failed;
-	}
 	if ((res = spa_handle_get_interface(handle, t->spa_monitor, &iface)) < 0) {
 		pw_log_error("can't get MONITOR interface: %d", res);
 		goto interface_failed;
@@ -308,11 +280,10 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	impl->core = core;
 	impl->t = t;
 	impl->parent = parent;
-	impl->hnd = hnd;
 
 	this = &impl->this;
 	this->monitor = iface;
-	this->lib = filename;
+	this->lib = strdup(lib);
 	this->factory_name = strdup(factory_name);
 	this->system_name = strdup(system_name);
 	this->handle = handle;
@@ -342,14 +313,8 @@ struct pw_spa_monitor *pw_spa_monitor_load(struct pw_core *core,
 	return this;
 
       interface_failed:
-	spa_handle_clear(handle);
-      init_failed:
-	free(handle);
-      enum_failed:
-      no_symbol:
-	dlclose(hnd);
+	pw_unload_spa_handle(handle);
       open_failed:
-	free(filename);
 	return NULL;
 
 }
@@ -364,12 +329,10 @@ void pw_spa_monitor_destroy(struct pw_spa_monitor *monitor)
 	spa_list_for_each_safe(mitem, tmp, &impl->item_list, link)
 		destroy_item(mitem);
 
-	spa_handle_clear(monitor->handle);
-	free(monitor->handle);
+	pw_unload_spa_handle(monitor->handle);
 	free(monitor->lib);
 	free(monitor->factory_name);
 	free(monitor->system_name);
 
-	dlclose(impl->hnd);
 	free(impl);
 }
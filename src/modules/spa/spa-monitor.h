@@ -42,7 +42,6 @@ struct pw_spa_monitor {
 struct pw_spa_monitor *
 pw_spa_monitor_load(struct pw_core *core,
 		    struct pw_global *parent,
-		    const char *dir,
 		    const char *lib,
 		    const char *factory_name,
 		    const char *system_name,
@@ -23,7 +23,6 @@
 
 #include <string.h>
 #include <stdio.h>
-#include <dlfcn.h>
 
 #include <spa/node/node.h>
 #include <spa/param/props.h>
@@ -44,7 +43,6 @@ struct impl {
 	enum pw_spa_node_flags flags;
 	bool async_init;
 
-	void *hnd;
         struct spa_handle *handle;
         struct spa_node *node;          /**< handle to SPA node */
 	char *lib;
@@ -63,14 +61,10 @@ static void pw_spa_node_destroy(void *data)
 	pw_log_debug("spa-node %p: destroy", node);
 
 	spa_hook_remove(&impl->node_listener);
-	if (impl->handle) {
-		spa_handle_clear(impl->handle);
-		free(impl->handle);
-	}
+	if (impl->handle)
+		pw_unload_spa_handle(impl->handle);
 	free(impl->lib);
 	free(impl->factory_name);
-	if (impl->hnd)
-		dlclose(impl->hnd);
 }
 
 static void complete_init(struct impl *impl)
@@ -243,52 +237,18 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 	struct spa_node *spa_node;
 	int res;
 	struct spa_handle *handle;
-	void *hnd;
-	uint32_t index;
-	spa_handle_factory_enum_func_t enum_func;
-	const struct spa_handle_factory *factory;
 	void *iface;
-	char *filename;
-	const char *dir;
 	const struct spa_support *support;
 	uint32_t n_support;
 	struct pw_type *t = pw_core_get_type(core);
 
-	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL)
-		dir = PLUGINDIR;
-
-	asprintf(&filename, "%s/%s.so", dir, lib);
+	support = pw_core_get_support(core, &n_support);
 
-	if ((hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-		pw_log_error("can't load %s: %s", filename, dlerror());
+	if ((res = pw_load_spa_handle(lib, factory_name,
+				      properties ? &properties->dict : NULL,
+				      n_support, support, &handle)) < 0)
 		goto open_failed;
-	}
-	if ((enum_func = dlsym(hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-		pw_log_error("can't find enum function");
-		goto no_symbol;
-	}
 
-	for (index = 0;;) {
-		if ((res = enum_func(&factory, &index)) <= 0) {
-			if (res != 0)
-				pw_log_error("can't enumerate factories: %s", spa_strerror(res));
-			goto enum_failed;
-		}
-		if (strcmp(factory->name, factory_name) == 0)
-			break;
-	}
-
-	support = pw_core_get_support(core, &n_support);
-
-	handle = calloc(1, factory->size);
-	if ((res = spa_handle_factory_init(factory,
-					   handle,
-					   properties ? &properties->dict : NULL,
-					   support,
-					   n_support)) < 0) {
-		pw_log_error("can't make factory instance: %d", res);
-		goto init_failed;
-	}
 	if (SPA_RESULT_IS_ASYNC(res))
 		flags |= PW_SPA_NODE_FLAG_ASYNC;
 
@@ -308,21 +268,14 @@ struct pw_node *pw_spa_node_load(struct pw_core *core,
 			       spa_node, handle, properties, user_data_size);
 
 	impl = this->user_data;
-	impl->hnd = hnd;
 	impl->handle = handle;
-	impl->lib = filename;
+	impl->lib = strdup(lib);
 	impl->factory_name = strdup(factory_name);
 
 	return this;
 
       interface_failed:
-	spa_handle_clear(handle);
-      init_failed:
-	free(handle);
-      enum_failed:
-      no_symbol:
-	dlclose(hnd);
+	pw_unload_spa_handle(handle);
       open_failed:
-	free(filename);
 	return NULL;
 }
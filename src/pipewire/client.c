@@ -372,6 +372,7 @@ int pw_client_update_properties(struct pw_client *client, const struct spa_dict
 	client->info.props = client->properties ? &client->properties->dict : NULL;
 
 	pw_client_events_info_changed(client, &client->info);
+	client->core->info_serial++;
 
 	spa_list_for_each(resource, &client->resource_list, link)
 		pw_client_resource_info(resource, &client->info);
@@ -270,13 +270,20 @@ static void core_update_types(void *object, uint32_t first_id, const char **type
 	struct pw_resource *resource = object;
 	struct pw_core *this = resource->core;
 	struct pw_client *client = resource->client;
+	void *t;
 	int i;
 
+	if (first_id < client->n_types_same)
+		client->n_types_same = first_id;
+
 	for (i = 0; i < n_types; i++, first_id++) {
 		uint32_t this_id = spa_type_map_get_id(this->type.map, types[i]);
 		if (!pw_map_insert_at(&client->types, first_id, PW_MAP_ID_TO_PTR(this_id)))
 			pw_log_error("can't add type %d->%d for client", first_id, this_id);
 	}
+	while ((t = pw_map_lookup(&client->types, client->n_types_same)) != NULL &&
+	       PW_MAP_PTR_TO_ID(t) == client->n_types_same)
+		client->n_types_same++;
 }
 
 static const struct pw_core_proxy_methods core_methods = {
@@ -338,6 +345,38 @@ global_bind(void *_data,
 	return;
 }
 
+static void graph_trace_process(void *data, struct spa_graph_node *node,
+				enum spa_direction direction,
+				uint64_t start, uint64_t end, int res)
+{
+	struct pw_node *n = node->scheduler_data;
+	struct spa_graph_port *p;
+	uint32_t id;
+
+	/* port mixers have no pw_node */
+	if (n == NULL)
+		return;
+
+	id = n->info.id;
+	pw_trace_event(start, PW_TRACE_EVENT_PROCESS_BEGIN, id, direction, 0);
+	pw_trace_event(end, PW_TRACE_EVENT_PROCESS_END, id, direction, res);
+
+	if (res < 0) {
+		pw_trace_event(end, PW_TRACE_EVENT_XRUN, id, direction, res);
+		return;
+	}
+	spa_list_for_each(p, &node->ports[SPA_DIRECTION_OUTPUT], link) {
+		struct spa_io_buffers *io = p->io;
+		if (io && io->status == SPA_STATUS_HAVE_BUFFER)
+			pw_trace_event(end, PW_TRACE_EVENT_BUFFER, id, p->port_id, io->buffer_id);
+	}
+}
+
+static const struct spa_graph_trace graph_trace = {
+	SPA_VERSION_GRAPH_TRACE,
+	.process = graph_trace_process,
+};
+
 static void global_destroy(void *object)
 {
 	struct pw_core *core = object;
@@ -390,6 +429,8 @@ struct pw_core *pw_core_new(struct pw_loop *main_loop, struct pw_properties *pro
 
 	spa_graph_init(&this->rt.graph);
 	spa_graph_set_callbacks(&this->rt.graph, &spa_graph_impl_default, NULL);
+	if (pw_trace_enabled())
+		spa_graph_set_trace(&this->rt.graph, &graph_trace, this);
 
 	this->dbus_iface = pw_get_spa_dbus(this->main_loop);
 
@@ -566,6 +607,7 @@ int pw_core_update_properties(struct pw_core *core, const struct spa_dict *dict)
 	core->info.props = &core->properties->dict;
 
 	pw_core_events_info_changed(core, &core->info);
+	core->info_serial++;
 
 	spa_list_for_each(resource, &core->resource_list, link)
 		pw_core_resource_info(resource, &core->info);
@@ -52,6 +52,8 @@ static void do_stop(void *data, uint64_t count)
 }
 
 /** Create a new \ref pw_data_loop.
+ * \param properties extra properties, the PW_LOOP_PROP_ properties configure
+ *        the thread of the loop
  * \return a newly allocated data loop
  *
  * \memberof pw_data_loop
@@ -70,6 +72,9 @@ struct pw_data_loop *pw_data_loop_new(struct pw_properties *properties)
 	if (this->loop == NULL)
 		goto no_loop;
 
+	this->properties = properties ? pw_properties_copy(properties) : NULL;
+	this->applied = pw_properties_new(NULL, NULL);
+
 	spa_hook_list_init(&this->listener_list);
 
 	this->event = pw_loop_add_event(this->loop, do_stop, this);
@@ -95,6 +100,10 @@ void pw_data_loop_destroy(struct pw_data_loop *loop)
 
 	pw_loop_destroy_source(loop->loop, loop->event);
 	pw_loop_destroy(loop->loop);
+	if (loop->properties)
+		pw_properties_free(loop->properties);
+	if (loop->applied)
+		pw_properties_free(loop->applied);
 	free(loop);
 }
 
@@ -126,10 +135,12 @@ int pw_data_loop_start(struct pw_data_loop *loop)
 		int err;
 
 		loop->running = true;
-		if ((err = pthread_create(&loop->thread, NULL, do_loop, loop)) != 0) {
-			pw_log_warn("data-loop %p: can't create thread: %s", loop, strerror(err));
+		if ((err = pw_thread_create(&loop->thread,
+					    loop->properties ? &loop->properties->dict : NULL,
+					    do_loop, loop, loop->applied)) < 0) {
+			pw_log_warn("data-loop %p: can't create thread: %s", loop, strerror(-err));
 			loop->running = false;
-			return -err;
+			return err;
 		}
 	}
 	return 0;
@@ -153,6 +164,18 @@ int pw_data_loop_stop(struct pw_data_loop *loop)
 	return 0;
 }
 
+/** Get the thread settings that were applied
+ * \param loop the data loop
+ * \return the PW_LOOP_PROP_ properties that were applied to the thread
+ *
+ * \memberof pw_data_loop
+ */
+const struct pw_properties *
+pw_data_loop_get_properties(struct pw_data_loop *loop)
+{
+	return loop->applied;
+}
+
 /** Check if we are inside the data loop
  * \param loop the data loop to check
  * \return true is the current thread is the data loop thread
@@ -67,6 +67,10 @@ int pw_data_loop_start(struct pw_data_loop *loop);
 /** Stop the processing thread */
 int pw_data_loop_stop(struct pw_data_loop *loop);
 
+/** Get the settings that were applied to the processing thread */
+const struct pw_properties *
+pw_data_loop_get_properties(struct pw_data_loop *loop);
+
 /** Check if the current thread is the processing thread */
 bool pw_data_loop_in_thread(struct pw_data_loop *loop);
 
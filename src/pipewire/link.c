@@ -37,6 +37,7 @@
 #include <spa/debug/format.h>
 
 #define MAX_BUFFERS     16
+#define MAX_BLOCKS      4
 
 /** \cond */
 struct impl {
@@ -69,6 +70,8 @@ static void pw_link_update_state(struct pw_link *link, enum pw_link_state state,
 		pw_log_debug("link %p: update state %s -> %s (%s)", link,
 			     pw_link_state_as_string(old), pw_link_state_as_string(state), error);
 
+		pw_trace(PW_TRACE_EVENT_LINK_STATE, link->info.id, state, old);
+
 		link->state = state;
 		if (link->error)
 			free(link->error);
@@ -224,6 +227,7 @@ static int do_negotiate(struct pw_link *this, uint32_t in_state, uint32_t out_st
 		this->info.change_mask |= PW_LINK_CHANGE_MASK_FORMAT;
 
 		pw_link_events_info_changed(this, &this->info);
+		this->core->info_serial++;
 
 		spa_list_for_each(resource, &this->resource_list, link)
 			pw_link_resource_info(resource, &this->info);
@@ -280,7 +284,7 @@ static struct spa_pod *find_param(struct spa_pod **params, uint32_t n_params, ui
  *  ||  | ... <n_metas>                | more metas follow
  *  ||  +------------------------------+
  *  |+->| struct spa_data              |
- *  |   |   uint32_t type              | memory type, either MemFd or INVALID
+ *  |   |   uint32_t type              | memory type, MemFd, DmaBuf or INVALID
  *  |   |   uint32_t flags             |
  *  |   |   int fd                     | fd of shared memory block
  *  |   |   uint32_t mapoffset         | offset in shared memory of data
@@ -581,10 +585,10 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		uint8_t buffer[4096];
 		struct spa_pod_builder b = SPA_POD_BUILDER_INIT(buffer, sizeof(buffer));
 		uint32_t i, offset, n_params;
-		uint32_t max_buffers;
+		uint32_t max_buffers, blocks;
 		size_t minsize = 1024, stride = 0;
-		size_t data_sizes[1];
-		ssize_t data_strides[1];
+		size_t *data_sizes;
+		ssize_t *data_strides;
 
 		n_params = param_filter(this, input, output, t->param.idBuffers, &b);
 		n_params += param_filter(this, input, output, t->param.idMeta, &b);
@@ -601,24 +605,27 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 
 		max_buffers = MAX_BUFFERS;
 		minsize = stride = 0;
+		blocks = 1;
 		param = find_param(params, n_params, t->param_buffers.Buffers);
 		if (param) {
 			uint32_t qmax_buffers = max_buffers,
-			    qminsize = minsize, qstride = stride;
+			    qminsize = minsize, qstride = stride, qblocks = blocks;
 
 			spa_pod_object_parse(param,
 				":", t->param_buffers.size, "i", &qminsize,
 				":", t->param_buffers.stride, "i", &qstride,
-				":", t->param_buffers.buffers, "i", &qmax_buffers, NULL);
+				":", t->param_buffers.buffers, "i", &qmax_buffers,
+				":", t->param_buffers.blocks, "?i", &qblocks, NULL);
 
 			max_buffers =
 			    qmax_buffers == 0 ? max_buffers : SPA_MIN(qmax_buffers,
 							      max_buffers);
 			minsize = SPA_MAX(minsize, qminsize);
 			stride = SPA_MAX(stride, qstride);
+			blocks = SPA_CLAMP(qblocks, 1, MAX_BLOCKS);
 
-			pw_log_debug("%d %d %d -> %zd %zd %d", qminsize, qstride, qmax_buffers,
-				     minsize, stride, max_buffers);
+			pw_log_debug("%d %d %d %d -> %zd %zd %d %d", qminsize, qstride, qmax_buffers,
+				     qblocks, minsize, stride, max_buffers, blocks);
 		} else {
 			pw_log_warn("no buffers param");
 			minsize = 1024;
@@ -630,14 +637,18 @@ static int do_allocation(struct pw_link *this, uint32_t in_state, uint32_t out_s
 		    (out_flags & SPA_PORT_INFO_FLAG_CAN_ALLOC_BUFFERS))
 			minsize = 0;
 
-		data_sizes[0] = minsize;
-		data_strides[0] = stride;
+		data_sizes = alloca(blocks * sizeof(size_t));
+		data_strides = alloca(blocks * sizeof(ssize_t));
+		for (i = 0; i < blocks; i++) {
+			data_sizes[i] = minsize;
+			data_strides[i] = stride;
+		}
 
 		if ((res = alloc_buffers(this,
 					 max_buffers,
 					 n_params,
 					 params,
-					 1,
+					 blocks,
 					 data_sizes, data_strides,
 					 &allocation)) < 0) {
 			asprintf(&error, "error alloc buffers: %d", res);
@@ -40,6 +40,11 @@ struct pw_loop {
 	struct spa_loop_utils *utils;		/**< loop utils */
 };
 
+/** Properties for the thread of a data loop or thread loop */
+#define PW_LOOP_PROP_CPU_AFFINITY	"loop.cpu-affinity"	/**< cpus to run on, like "2,3" or "2-3" */
+#define PW_LOOP_PROP_RT_PRIORITY	"loop.rt-priority"	/**< SCHED_FIFO priority, 0 to not change it */
+#define PW_LOOP_PROP_STACK_SIZE		"loop.stack-size"	/**< stack size in bytes */
+
 struct pw_loop *
 pw_loop_new(struct pw_properties *properties);
 
@@ -152,30 +152,10 @@ static const struct pw_global_events global_events = {
 	.bind = global_bind,
 };
 
-/** Load a module
- *
- * \param core a \ref pw_core
- * \param name name of the module to load
- * \param args A string with arguments for the module
- * \param[out] error Return location for an error string, or NULL
- * \return A \ref pw_module if the module could be loaded, or NULL on failure.
- *
- * \memberof pw_module
- */
-struct pw_module *
-pw_module_load(struct pw_core *core,
-	       const char *name, const char *args,
-	       struct pw_client *owner,
-	       struct pw_global *parent,
-	       struct pw_properties *properties)
+static char *find_module_file(const char *name)
 {
-	struct pw_module *this;
-	struct impl *impl;
-	void *hnd;
 	char *filename = NULL;
 	const char *module_dir;
-	int res;
-	pw_module_init_func_t init_func;
 
 	module_dir = getenv("PIPEWIRE_MODULE_DIR");
 	if (module_dir != NULL) {
@@ -196,8 +176,69 @@ pw_module_load(struct pw_core *core,
 
 		filename = find_module(MODULEDIR, name);
 	}
+	return filename;
+}
+
+/** Preload the library of a module
+ *
+ * \param name name of the module
+ * \return an opaque handle to release with pw_module_release_preload() or
+ *         NULL when the module could not be loaded
+ *
+ * Loads the library of the module and its dependencies without
+ * initializing the module. This can be called from any thread, a
+ * pw_module_load() of the module in the main thread will then only need
+ * to initialize it.
+ *
+ * \memberof pw_module
+ */
+void *pw_module_preload(const char *name)
+{
+	char *filename;
+	void *hnd;
+
+	if ((filename = find_module_file(name)) == NULL)
+		return NULL;
+
+	if ((hnd = dlopen(filename, RTLD_NOW | RTLD_LOCAL)) == NULL)
+		pw_log_debug("can't preload module %s: %s", filename, dlerror());
+
+	free(filename);
+	return hnd;
+}
+
+/** Release a preloaded module library \memberof pw_module */
+void pw_module_release_preload(void *preload)
+{
+	if (preload)
+		dlclose(preload);
+}
+
+/** Load a module
+ *
+ * \param core a \ref pw_core
+ * \param name name of the module to load
+ * \param args A string with arguments for the module
+ * \param[out] error Return location for an error string, or NULL
+ * \return A \ref pw_module if the module could be loaded, or NULL on failure.
+ *
+ * \memberof pw_module
+ */
+struct pw_module *
+pw_module_load(struct pw_core *core,
+	       const char *name, const char *args,
+	       struct pw_client *owner,
+	       struct pw_global *parent,
+	       struct pw_properties *properties)
+{
+	struct pw_module *this;
+	struct impl *impl;
+	void *hnd;
+	char *filename;
+	int res;
+	pw_module_init_func_t init_func;
 
-	if (filename == NULL)
+	if ((filename = find_module_file(name)) == NULL)
 		goto not_found;
 
 	pw_log_debug("trying to load module: %s (%s)", name, filename);
@@ -73,6 +73,13 @@ pw_module_load(struct pw_core *core,
 	       struct pw_global *parent,	/**< parent global */
 	       struct pw_properties *properties	/**< extra global properties */);
 
+/** Load the library of a module without initializing it, can be called
+ * from any thread */
+void *pw_module_preload(const char *name);
+
+/** Release the library loaded with pw_module_preload() */
+void pw_module_release_preload(void *preload);
+
 /** Get the core of a module */
 struct pw_core * pw_module_get_core(struct pw_module *module);
 
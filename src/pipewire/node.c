@@ -346,6 +346,18 @@ int pw_node_register(struct pw_node *this,
 
 	pw_node_update_ports(this);
 
+	/* report the settings of the data loop thread the node runs in */
+	if (this->data_loop == core->data_loop && core->data_loop_impl->applied) {
+		const char *key;
+		void *state = NULL;
+
+		while ((key = pw_properties_iterate(core->data_loop_impl->applied, &state))) {
+			if (pw_properties_get(this->properties, key) == NULL)
+				pw_properties_set(this->properties, key,
+					pw_properties_get(core->data_loop_impl->applied, key));
+		}
+	}
+
 	pw_loop_invoke(this->data_loop, do_node_add, 1, NULL, 0, false, this);
 
 	if ((str = pw_properties_get(this->properties, "media.class")) != NULL)
@@ -441,6 +453,8 @@ struct pw_node *pw_node_new(struct pw_core *core,
 	pw_map_init(&this->output_port_map, 64, 64);
 
 	spa_graph_node_init(&this->rt.node);
+	spa_graph_node_set_stats(&this->rt.node, &this->rt.process);
+	this->rt.node.scheduler_data = this;
 
 	return this;
 
@@ -488,6 +502,7 @@ int pw_node_update_properties(struct pw_node *node, const struct spa_dict *dict)
 
 	node->info.change_mask |= PW_NODE_CHANGE_MASK_PROPS;
 	pw_node_events_info_changed(node, &node->info);
+	node->core->info_serial++;
 
 	spa_list_for_each(resource, &node->resource_list, link)
 		pw_node_resource_info(resource, &node->info);
@@ -521,17 +536,37 @@ static void node_event(void *data, struct spa_event *event)
 static void node_need_input(void *data)
 {
 	struct pw_node *node = data;
+	uint64_t start = spa_graph_stats_now(), end;
+
 	pw_log_trace("node %p: need input", node);
 	pw_node_events_need_input(node);
 	spa_graph_need_input(node->rt.graph, &node->rt.node);
+
+	end = spa_graph_stats_now();
+	spa_graph_stats_update(&node->rt.cycle, end - start, false);
+
+	if (pw_trace_enabled()) {
+		pw_trace_event(start, PW_TRACE_EVENT_CYCLE_BEGIN, node->info.id, SPA_DIRECTION_INPUT, 0);
+		pw_trace_event(end, PW_TRACE_EVENT_CYCLE_END, node->info.id, SPA_DIRECTION_INPUT, 0);
+	}
 }
 
 static void node_have_output(void *data)
 {
 	struct pw_node *node = data;
+	uint64_t start = spa_graph_stats_now(), end;
+
 	pw_log_trace("node %p: have output", node);
 	spa_graph_have_output(node->rt.graph, &node->rt.node);
 	pw_node_events_have_output(node);
+
+	end = spa_graph_stats_now();
+	spa_graph_stats_update(&node->rt.cycle, end - start, false);
+
+	if (pw_trace_enabled()) {
+		pw_trace_event(start, PW_TRACE_EVENT_CYCLE_BEGIN, node->info.id, SPA_DIRECTION_OUTPUT, 0);
+		pw_trace_event(end, PW_TRACE_EVENT_CYCLE_END, node->info.id, SPA_DIRECTION_OUTPUT, 0);
+	}
 }
 
 static void node_reuse_buffer(void *data, uint32_t port_id, uint32_t buffer_id)
@@ -678,6 +713,65 @@ int pw_node_for_each_port(struct pw_node *node,
 	return 0;
 }
 
+static struct spa_pod *build_profile(struct pw_node *node, uint32_t index,
+				     struct spa_pod_builder *b)
+{
+	struct pw_type *t = &node->core->type;
+	struct spa_graph_stats stats;
+	const char *name;
+
+	switch (index) {
+	case 0:
+		name = "process";
+		spa_graph_stats_read(&node->rt.process, &stats);
+		break;
+	case 1:
+		name = "cycle";
+		spa_graph_stats_read(&node->rt.cycle, &stats);
+		break;
+	default:
+		return NULL;
+	}
+
+	return spa_pod_builder_object(b,
+		t->param_profile.idProfile, t->param_profile.Profile,
+		":", t->param_profile.name,	"s", name,
+		":", t->param_profile.count,	"l", stats.count,
+		":", t->param_profile.xruns,	"i", stats.errors,
+		":", t->param_profile.min,	"l", stats.min,
+		":", t->param_profile.avg,	"l", stats.count ? stats.total / stats.count : 0,
+		":", t->param_profile.max,	"l", stats.max,
+		":", t->param_profile.histogram, "a", sizeof(uint32_t), SPA_POD_TYPE_INT,
+			SPA_GRAPH_STATS_HISTOGRAM, stats.histogram);
+}
+
+static int for_each_profile(struct pw_node *node,
+			    uint32_t index, uint32_t max,
+			    const struct spa_pod *filter,
+			    int (*callback) (void *data,
+					     uint32_t id, uint32_t index, uint32_t next,
+					     struct spa_pod *param),
+			    void *data)
+{
+	int res = 0;
+	uint32_t count;
+	uint8_t buf[1024];
+	struct spa_pod_builder b = { 0 };
+	struct spa_pod *param;
+
+	for (count = 0; count < max; count++, index++) {
+		spa_pod_builder_init(&b, buf, sizeof(buf));
+
+		if ((param = build_profile(node, index, &b)) == NULL)
+			break;
+
+		if ((res = callback(data, node->core->type.param_profile.idProfile,
+				    index, index + 1, param)) != 0)
+			break;
+	}
+	return res;
+}
+
 int pw_node_for_each_param(struct pw_node *node,
 			   uint32_t param_id,
 			   uint32_t index, uint32_t max,
@@ -696,6 +790,9 @@ int pw_node_for_each_param(struct pw_node *node,
 	if (max == 0)
 		max = UINT32_MAX;
 
+	if (param_id == node->core->type.param_profile.idProfile)
+		return for_each_profile(node, index, max, filter, callback, data);
+
 	for (count = 0; count < max; count++) {
 		spa_pod_builder_init(&b, buf, sizeof(buf));
 
@@ -933,6 +1030,7 @@ void pw_node_update_state(struct pw_node *node, enum pw_node_state state, char *
 
 		node->info.change_mask |= PW_NODE_CHANGE_MASK_STATE;
 		pw_node_events_info_changed(node, &node->info);
+		node->core->info_serial++;
 
 		spa_list_for_each(resource, &node->resource_list, link)
 			pw_node_resource_info(resource, &node->info);
@@ -28,18 +28,38 @@
 #include <pwd.h>
 #include <errno.h>
 #include <dlfcn.h>
+#include <stdarg.h>
+#include <pthread.h>
 
 #include <spa/support/dbus.h>
 
 #include "pipewire.h"
 #include "private.h"
+#include "trace.h"
 #include "version.h"
 
 static char **categories = NULL;
 
-static struct support_info {
+struct plugin {
+	struct spa_list link;
+	int ref;
+	char *filename;
 	void *hnd;
 	spa_handle_factory_enum_func_t enum_func;
+	struct pw_array factories;	/**< the enumerated factories */
+};
+
+struct handle {
+	struct spa_list link;
+	struct plugin *plugin;
+	/* the spa_handle follows at HANDLE_OFFSET */
+};
+
+/* keep the spa_handle aligned for any type the plugin puts in it */
+#define HANDLE_OFFSET	SPA_ROUND_UP_N(sizeof(struct handle), 16)
+
+static struct support_info {
+	struct plugin *plugin;
 	struct spa_support support[16];
 	uint32_t n_support;
 } support_info;
@@ -52,83 +72,248 @@ struct interface {
 };
 
 struct registry {
+	pthread_mutex_t lock;
+	struct spa_list plugins;
+	struct spa_list handles;
 	struct spa_list interfaces;
 };
 
-static struct registry global_registry;
+static struct registry global_registry = {
+	PTHREAD_MUTEX_INITIALIZER,
+	{ &global_registry.plugins, &global_registry.plugins },
+	{ &global_registry.handles, &global_registry.handles },
+	{ &global_registry.interfaces, &global_registry.interfaces },
+};
 
-static bool
-open_support(const char *path,
-	     const char *lib,
-	     struct support_info *info)
+/* errors can happen before the logger is loaded, print them on stderr then */
+static void plugin_error(const char *fmt, ...)
 {
+	va_list args;
+
+	va_start(args, fmt);
+	if (pw_log_get() != NULL) {
+		pw_log_logv(SPA_LOG_LEVEL_ERROR, __FILE__, __LINE__, __func__, fmt, args);
+	} else {
+		vfprintf(stderr, fmt, args);
+		fputc('\n', stderr);
+	}
+	va_end(args);
+}
+
+static const char *get_plugin_dir(void)
+{
+	const char *dir;
+
+	if ((dir = getenv("SPA_PLUGIN_DIR")) == NULL)
+		dir = PLUGINDIR;
+	return dir;
+}
+
+/* must be called with the registry lock */
+static struct plugin *open_plugin(const char *lib)
+{
+	struct registry *registry = &global_registry;
+	struct plugin *plugin;
+	const struct spa_handle_factory *factory, **f;
 	char *filename;
+	uint32_t index;
+	int res;
 
-        if (asprintf(&filename, "%s/%s.so", path, lib) < 0)
+        if (asprintf(&filename, "%s/%s.so", get_plugin_dir(), lib) < 0)
 		goto no_filename;
 
-        if ((info->hnd = dlopen(filename, RTLD_NOW)) == NULL) {
-                fprintf(stderr, "can't load %s: %s\n", filename, dlerror());
+	/* plugins stay loaded while one of their handles is in use, the
+	 * factories are enumerated only when the plugin is first loaded */
+	spa_list_for_each(plugin, &registry->plugins, link) {
+		if (strcmp(plugin->filename, filename) == 0) {
+			plugin->ref++;
+			free(filename);
+			return plugin;
+		}
+	}
+
+	if ((plugin = calloc(1, sizeof(struct plugin))) == NULL)
+		goto no_mem;
+
+        if ((plugin->hnd = dlopen(filename, RTLD_NOW)) == NULL) {
+                plugin_error("can't load %s: %s", filename, dlerror());
                 goto open_failed;
         }
-        if ((info->enum_func = dlsym(info->hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
-                fprintf(stderr, "can't find enum function\n");
+        if ((plugin->enum_func = dlsym(plugin->hnd, SPA_HANDLE_FACTORY_ENUM_FUNC_NAME)) == NULL) {
+                plugin_error("can't find enum function in %s", filename);
                 goto no_symbol;
         }
-	free(filename);
-	return true;
 
-      no_filename:
-	return false;
+	pw_array_init(&plugin->factories, 8 * sizeof(factory));
+        for (index = 0;;) {
+                if ((res = plugin->enum_func(&factory, &index)) <= 0) {
+                        if (res != 0)
+                                plugin_error("can't enumerate factories: %s", spa_strerror(res));
+                        break;
+                }
+		if ((f = pw_array_add(&plugin->factories, sizeof(factory))) != NULL)
+			*f = factory;
+	}
+
+	plugin->ref = 1;
+	plugin->filename = filename;
+	spa_list_append(&registry->plugins, &plugin->link);
+
+	return plugin;
+
       no_symbol:
-	dlclose(info->hnd);
+	dlclose(plugin->hnd);
       open_failed:
+	free(plugin);
+      no_mem:
         free(filename);
-	return false;
+      no_filename:
+	return NULL;
 }
 
-static const struct spa_handle_factory *get_factory(struct support_info *info, const char *factory_name)
+/* must be called with the registry lock */
+static void unref_plugin(struct plugin *plugin)
 {
-	int res;
-	uint32_t index;
-        const struct spa_handle_factory *factory;
+	if (--plugin->ref > 0)
+		return;
 
-        for (index = 0;;) {
-                if ((res = info->enum_func(&factory, &index)) <= 0) {
-                        if (res != 0)
-                                fprintf(stderr, "can't enumerate factories: %s\n", spa_strerror(res));
-                        break;
-                }
-                if (strcmp(factory->name, factory_name) == 0)
-                        return factory;
+	spa_list_remove(&plugin->link);
+	pw_array_clear(&plugin->factories);
+	dlclose(plugin->hnd);
+	free(plugin->filename);
+	free(plugin);
+}
+
+static const struct spa_handle_factory *find_factory(struct plugin *plugin, const char *factory_name)
+{
+	const struct spa_handle_factory **f;
+
+	pw_array_for_each(f, &plugin->factories) {
+		if (strcmp((*f)->name, factory_name) == 0)
+			return *f;
 	}
 	return NULL;
 }
 
+/** Load a handle from a SPA plugin
+ * \param lib the plugin to load, relative to the plugin directory and
+ *        without extension
+ * \param factory_name the name of the factory in \a lib
+ * \param info extra info for the handle
+ * \param n_support number of elements in \a support
+ * \param support support items for the handle
+ * \param[out] handle the new handle
+ * \return the result of the factory init, which can be async, or < 0 on error
+ *
+ * Plugins are only loaded once and their factories enumerated once, they
+ * are unloaded when the last handle is unloaded with pw_unload_spa_handle().
+ *
+ * \memberof pw_pipewire
+ */
+int pw_load_spa_handle(const char *lib,
+		       const char *factory_name,
+		       const struct spa_dict *info,
+		       uint32_t n_support,
+		       const struct spa_support support[],
+		       struct spa_handle **handle)
+{
+	struct registry *registry = &global_registry;
+	const struct spa_handle_factory *factory;
+	struct plugin *plugin;
+	struct handle *h;
+	struct spa_handle *hnd;
+	int res;
+
+	pthread_mutex_lock(&registry->lock);
+
+	if ((plugin = open_plugin(lib)) == NULL) {
+		res = -ENOENT;
+		goto exit;
+	}
+	if ((factory = find_factory(plugin, factory_name)) == NULL) {
+		plugin_error("can't find factory %s in %s", factory_name, plugin->filename);
+		res = -ENOENT;
+		goto exit_unref;
+	}
+	if ((h = calloc(1, HANDLE_OFFSET + factory->size)) == NULL) {
+		res = -ENOMEM;
+		goto exit_unref;
+	}
+	hnd = SPA_MEMBER(h, HANDLE_OFFSET, struct spa_handle);
+
+	/* our ref keeps the plugin loaded, don't hold the lock while the
+	 * plugin initializes, it can take a while or load other handles */
+	pthread_mutex_unlock(&registry->lock);
+	res = spa_handle_factory_init(factory, hnd, info, support, n_support);
+	pthread_mutex_lock(&registry->lock);
+
+	if (res < 0) {
+                plugin_error("can't make factory instance %s: %s", factory_name, spa_strerror(res));
+		free(h);
+		goto exit_unref;
+        }
+	h->plugin = plugin;
+	spa_list_append(&registry->handles, &h->link);
+	*handle = hnd;
+
+	goto exit;
+
+      exit_unref:
+	unref_plugin(plugin);
+      exit:
+	pthread_mutex_unlock(&registry->lock);
+	return res;
+}
+
+/** Unload a handle that was loaded with pw_load_spa_handle()
+ * \param handle the handle to unload
+ * \return 0 on success, < 0 on error
+ * \memberof pw_pipewire
+ */
+int pw_unload_spa_handle(struct spa_handle *handle)
+{
+	struct registry *registry = &global_registry;
+	struct handle *h;
+	int res = -ENOENT;
+
+	pthread_mutex_lock(&registry->lock);
+	spa_list_for_each(h, &registry->handles, link) {
+		if (SPA_MEMBER(h, HANDLE_OFFSET, struct spa_handle) != handle)
+			continue;
+
+		spa_list_remove(&h->link);
+
+		pthread_mutex_unlock(&registry->lock);
+		spa_handle_clear(handle);
+		pthread_mutex_lock(&registry->lock);
+
+		unref_plugin(h->plugin);
+		free(h);
+		res = 0;
+		break;
+	}
+	pthread_mutex_unlock(&registry->lock);
+
+	return res;
+}
+
 static struct interface *
 load_interface(struct support_info *info,
+	       const char *lib,
 	       const char *factory_name,
 	       const char *type)
 {
         int res;
         struct spa_handle *handle;
         uint32_t type_id;
-        const struct spa_handle_factory *factory;
 	struct interface *iface;
         void *ptr;
 	struct spa_type_map *map = NULL;
 
-	factory = get_factory(info, factory_name);
-	if (factory == NULL)
+	if ((res = pw_load_spa_handle(lib, factory_name, NULL,
+				      info->n_support, info->support, &handle)) < 0)
 		goto not_found;
 
-        handle = calloc(1, factory->size);
-        if ((res = spa_handle_factory_init(factory,
-                                           handle, NULL, info->support, info->n_support)) < 0) {
-                fprintf(stderr, "can't make factory instance: %d\n", res);
-                goto init_failed;
-        }
-
 	map = pw_get_support_interface(SPA_TYPE__TypeMap);
 	type_id = map ? spa_type_map_get_id(map, type) : 0;
 
@@ -149,9 +334,7 @@ load_interface(struct support_info *info,
 
       alloc_failed:
       interface_failed:
-	spa_handle_clear(handle);
-      init_failed:
-	free(handle);
+	pw_unload_spa_handle(handle);
       not_found:
 	return NULL;
 }
@@ -169,6 +352,24 @@ static void configure_debug(const char *str)
 		categories = pw_split_strv(level[1], ",", INT_MAX, &n_tokens);
 }
 
+static void configure_trace(const char *str)
+{
+	char **tokens;
+	int n_tokens;
+	uint32_t n_events = PW_TRACE_DEFAULT_EVENTS;
+	char path[PATH_MAX];
+
+	tokens = pw_split_strv(str, ":", 2, &n_tokens);
+	if (n_tokens > 1)
+		n_events = atoi(tokens[1]);
+	/* every process that inherits the environment records in its own
+	 * file, a client must not truncate the trace of the daemon */
+	if (n_tokens > 0 &&
+	    snprintf(path, sizeof(path), "%s.%d", tokens[0], (int) getpid()) < (int) sizeof(path))
+		pw_trace_open(path, n_events);
+	pw_free_strv(tokens);
+}
+
 /** Get a support interface
  * \param type the interface type
  * \return the interface or NULL when not configured
@@ -186,7 +387,9 @@ void *pw_get_support_interface(const char *type)
 
 const struct spa_handle_factory *pw_get_support_factory(const char *factory_name)
 {
-	return get_factory(&support_info, factory_name);
+	if (support_info.plugin == NULL)
+		return NULL;
+	return find_factory(support_info.plugin, factory_name);
 }
 
 const struct spa_support *pw_get_support(uint32_t *n_support)
@@ -198,7 +401,6 @@ const struct spa_support *pw_get_support(uint32_t *n_support)
 void *pw_get_spa_dbus(struct pw_loop *loop)
 {
 	struct support_info dbus_support_info;
-	const char *str;
 	struct interface *iface;
 
 	dbus_support_info.n_support = support_info.n_support;
@@ -208,14 +410,10 @@ void *pw_get_spa_dbus(struct pw_loop *loop)
 	dbus_support_info.support[dbus_support_info.n_support++] =
 			SPA_SUPPORT_INIT(SPA_TYPE__LoopUtils, loop->utils);
 
-	if ((str = getenv("SPA_PLUGIN_DIR")) == NULL)
-		str = PLUGINDIR;
+	iface = load_interface(&dbus_support_info, "support/libspa-dbus", "dbus", SPA_TYPE__DBus);
+	if (iface != NULL)
+		return iface->iface;
 
-	if (open_support(str, "support/libspa-dbus", &dbus_support_info)) {
-		iface = load_interface(&dbus_support_info, "dbus", SPA_TYPE__DBus);
-		if (iface != NULL)
-			return iface->iface;
-	}
 	return NULL;
 }
 static struct interface *find_interface(void *iface)
@@ -236,8 +434,7 @@ int pw_release_spa_dbus(void *dbus)
 		return -ENOENT;
 
 	spa_list_remove(&iface->link);
-	spa_handle_clear(iface->handle);
-	free(iface->handle);
+	pw_unload_spa_handle(iface->handle);
 	free(iface);
 	return 0;
 }
@@ -251,6 +448,8 @@ int pw_release_spa_dbus(void *dbus)
  * by \a argc and \a argv and set up debugging.
  *
  * The environment variable \a PIPEWIRE_DEBUG
+ * The environment variable \a PIPEWIRE_TRACE=<file>[:<events>] records a
+ * binary trace of the graph activity in \a file.<pid>, see \ref pw_trace.
  *
  * \memberof pw_pipewire
  */
@@ -263,20 +462,24 @@ void pw_init(int *argc, char **argv[])
 	if ((str = getenv("PIPEWIRE_DEBUG")))
 		configure_debug(str);
 
-	if ((str = getenv("SPA_PLUGIN_DIR")) == NULL)
-		str = PLUGINDIR;
+	if (support_info.n_support == 0 && (str = getenv("PIPEWIRE_TRACE")))
+		configure_trace(str);
 
 	if (support_info.n_support > 0)
 		return;
 
-	spa_list_init(&global_registry.interfaces);
-
-	if (open_support(str, "support/libspa-support", info)) {
-		iface = load_interface(info, "mapper", SPA_TYPE__TypeMap);
+	/* keep the support plugin loaded for pw_get_support_factory() */
+	if (info->plugin == NULL) {
+		pthread_mutex_lock(&global_registry.lock);
+		info->plugin = open_plugin("support/libspa-support");
+		pthread_mutex_unlock(&global_registry.lock);
+	}
+	if (info->plugin != NULL) {
+		iface = load_interface(info, "support/libspa-support", "mapper", SPA_TYPE__TypeMap);
 		if (iface != NULL)
 			info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__TypeMap, iface->iface);
 
-		iface = load_interface(info, "logger", SPA_TYPE__Log);
+		iface = load_interface(info, "support/libspa-support", "logger", SPA_TYPE__Log);
 		if (iface != NULL) {
 			info->support[info->n_support++] = SPA_SUPPORT_INIT(SPA_TYPE__Log, iface->iface);
 			pw_log_set(iface->iface);
@@ -44,6 +44,7 @@ extern "C" {
 #include <pipewire/resource.h>
 #include <pipewire/stream.h>
 #include <pipewire/thread-loop.h>
+#include <pipewire/trace.h>
 #include <pipewire/type.h>
 #include <pipewire/utils.h>
 #include <pipewire/version.h>
@@ -142,6 +143,15 @@ pw_get_support_factory(const char *factory_name);
 const struct spa_support *
 pw_get_support(uint32_t *n_support);
 
+int pw_load_spa_handle(const char *lib,
+		       const char *factory_name,
+		       const struct spa_dict *info,
+		       uint32_t n_support,
+		       const struct spa_support support[],
+		       struct spa_handle **handle);
+
+int pw_unload_spa_handle(struct spa_handle *handle);
+
 #ifdef __cplusplus
 }
 #endif
@@ -256,6 +256,7 @@ int pw_port_update_properties(struct pw_port *port, const struct spa_dict *dict)
 
 	port->info.change_mask |= PW_PORT_CHANGE_MASK_PROPS;
 	pw_port_events_info_changed(port, &port->info);
+	port->node->core->info_serial++;
 
 	spa_list_for_each(resource, &port->resource_list, link)
 		pw_port_resource_info(resource, &port->info);
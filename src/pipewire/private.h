@@ -107,6 +107,7 @@ struct pw_client {
 	struct pw_map objects;		/**< list of resource objects */
 	uint32_t n_types;		/**< number of client types */
 	struct pw_map types;		/**< map of client types */
+	uint32_t n_types_same;		/**< number of first client types with our id */
 
 	struct spa_list resource_list;	/**< The list of resources of this client */
 
@@ -190,6 +191,10 @@ struct pw_core {
 
 	struct pw_client *current_client;	/**< client currently executing code in mainloop */
 
+	uint32_t info_serial;		/**< incremented before an info is sent to all the
+					  *  resources of an object, protocols can use it
+					  *  to serialize the info only once */
+
 	long sc_pagesize;
 
 	struct {
@@ -207,10 +212,17 @@ struct pw_data_loop {
 
         struct spa_source *event;
 
+	struct pw_properties *properties;	/**< thread settings */
+	struct pw_properties *applied;		/**< thread settings that were applied */
+
         bool running;
         pthread_t thread;
 };
 
+int pw_thread_create(pthread_t *thread, const struct spa_dict *props,
+		     void *(*func) (void *data), void *data,
+		     struct pw_properties *applied);
+
 #define pw_main_loop_events_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_main_loop_events, m, v, ##__VA_ARGS__)
 #define pw_main_loop_events_destroy(o) pw_main_loop_events_emit(o, destroy, 0)
 
@@ -359,6 +371,8 @@ struct pw_node {
 	struct {
 		struct spa_graph *graph;
 		struct spa_graph_node node;
+		struct spa_graph_stats process;	/**< timing of the process calls */
+		struct spa_graph_stats cycle;	/**< timing of the cycles we drive */
 	} rt;
 
         void *user_data;                /**< extra user data */
@@ -479,6 +493,8 @@ struct pw_remote {
 
 	uint32_t n_types;			/**< number of client types */
 	struct pw_map types;			/**< client types */
+	uint32_t n_types_remapped;		/**< number of server types with a different id */
+	uint32_t n_types_same;			/**< number of first server types with our id */
 
 	struct spa_list proxy_list;		/**< list of \ref pw_proxy objects */
 	struct spa_list stream_list;		/**< list of \ref pw_stream objects */
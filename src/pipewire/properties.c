@@ -18,48 +18,266 @@
  */
 
 #include <stdio.h>
+#include <pthread.h>
 
 #include "pipewire/pipewire.h"
 #include "pipewire/properties.h"
 
 /** \cond */
+/* properties with fewer items are searched linearly */
+#define HASH_MIN_ITEMS	8
+
 struct properties {
 	struct pw_properties this;
 
 	struct pw_array items;
+	uint32_t *hashes;	/**< hash of the key of each item */
+	uint32_t *index;	/**< open addressing table of item index + 1 */
+	uint32_t index_size;	/**< size of index, power of 2 or 0 */
+	uint32_t hashes_size;	/**< allocated size of hashes */
+};
+
+/* keys that are used in many properties, they are shared instead of
+ * allocated for each item. Other keys are copied, a client can send any
+ * number of different keys and we don't want to keep them around. */
+static const char * const static_keys[] = {
+	PW_CLIENT_PROP_PROTOCOL,
+	PW_CLIENT_PROP_UCRED_PID,
+	PW_CLIENT_PROP_UCRED_UID,
+	PW_CLIENT_PROP_UCRED_GID,
+	PW_CORE_PROP_USER_NAME,
+	PW_CORE_PROP_HOST_NAME,
+	PW_CORE_PROP_NAME,
+	PW_CORE_PROP_VERSION,
+	PW_CORE_PROP_DAEMON,
+	PW_LINK_PROP_PASSIVE,
+	PW_MODULE_PROP_NAME,
+	PW_NODE_PROP_MEDIA,
+	PW_NODE_PROP_CATEGORY,
+	PW_NODE_PROP_ROLE,
+	PW_NODE_PROP_EXCLUSIVE,
+	PW_NODE_PROP_AUTOCONNECT,
+	PW_NODE_PROP_TARGET_NODE,
+	PW_REMOTE_PROP_REMOTE_NAME,
+	PW_STREAM_PROP_IS_LIVE,
+	PW_STREAM_PROP_LATENCY_MIN,
+	PW_STREAM_PROP_LATENCY_MAX,
+	"application.name",
+	"application.prgname",
+	"application.language",
+	"application.process.id",
+	"application.process.user",
+	"application.process.host",
+	"media.class",
+	"media.name",
+	"node.name",
+	"port.name",
+	"factory.name",
+};
+
+static uint32_t static_key_hashes[SPA_N_ELEMENTS(static_keys)];
+static pthread_once_t static_key_once = PTHREAD_ONCE_INIT;
+
+/* values that are common enough to not allocate them */
+static const char * const static_values[] = {
+	"0", "1", "true", "false",
+	"Audio", "Video", "Midi",
+	"Playback", "Capture", "Duplex", "Source", "Sink",
 };
 /** \endcond */
 
-static int add_func(struct pw_properties *this, char *key, char *value)
+static inline uint32_t hash_string(const char *str)
+{
+	uint32_t h = 2166136261u;
+
+	while (*str)
+		h = (h ^ (uint8_t) *str++) * 16777619u;
+	return h;
+}
+
+static void init_static_keys(void)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(static_keys); i++)
+		static_key_hashes[i] = hash_string(static_keys[i]);
+}
+
+static char *copy_key(const char *key, uint32_t hash)
+{
+	uint32_t i;
+
+	pthread_once(&static_key_once, init_static_keys);
+
+	for (i = 0; i < SPA_N_ELEMENTS(static_keys); i++)
+		if (static_key_hashes[i] == hash && strcmp(key, static_keys[i]) == 0)
+			return (char *) static_keys[i];
+
+	return strdup(key);
+}
+
+static void free_key(const char *key)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(static_keys); i++)
+		if (key == static_keys[i])
+			return;
+
+	free((char *) key);
+}
+
+static char *copy_value(const char *value)
+{
+	uint32_t i;
+
+	if (value == NULL)
+		return NULL;
+
+	for (i = 0; i < SPA_N_ELEMENTS(static_values); i++)
+		if (strcmp(value, static_values[i]) == 0)
+			return (char *) static_values[i];
+
+	return strdup(value);
+}
+
+static void free_value(const char *value)
+{
+	uint32_t i;
+
+	for (i = 0; i < SPA_N_ELEMENTS(static_values); i++)
+		if (value == static_values[i])
+			return;
+
+	free((char *) value);
+}
+
+static inline uint32_t n_items(struct properties *impl)
+{
+	return pw_array_get_len(&impl->items, struct spa_dict_item);
+}
+
+static void index_insert(struct properties *impl, uint32_t hash, uint32_t idx)
+{
+	uint32_t i, mask = impl->index_size - 1;
+
+	for (i = hash & mask; impl->index[i]; i = (i + 1) & mask);
+	impl->index[i] = idx + 1;
+}
+
+/* rebuild the index for the current items, it is at most half full */
+static void index_rebuild(struct properties *impl)
+{
+	uint32_t i, n = n_items(impl), size;
+
+	if (n < HASH_MIN_ITEMS) {
+		free(impl->index);
+		impl->index = NULL;
+		impl->index_size = 0;
+		return;
+	}
+
+	for (size = 16; size < n * 2; size <<= 1);
+
+	if (size != impl->index_size) {
+		uint32_t *index = realloc(impl->index, size * sizeof(uint32_t));
+		if (index == NULL) {
+			/* fall back to a linear search */
+			free(impl->index);
+			impl->index = NULL;
+			impl->index_size = 0;
+			return;
+		}
+		impl->index = index;
+		impl->index_size = size;
+	}
+	memset(impl->index, 0, size * sizeof(uint32_t));
+
+	for (i = 0; i < n; i++)
+		index_insert(impl, impl->hashes[i], i);
+}
+
+static void update_dict(struct properties *impl)
+{
+	impl->this.dict.items = impl->items.data;
+	impl->this.dict.n_items = n_items(impl);
+}
+
+static int add_func(struct pw_properties *this, const char *key, char *value)
 {
-	struct spa_dict_item *item;
 	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
+	struct spa_dict_item *item;
+	uint32_t n = n_items(impl), hash = hash_string(key);
+	char *k;
+
+	if (n >= impl->hashes_size) {
+		uint32_t size = impl->hashes_size ? impl->hashes_size * 2 : 16;
+		uint32_t *hashes = realloc(impl->hashes, size * sizeof(uint32_t));
+		if (hashes == NULL)
+			goto no_mem;
+		impl->hashes = hashes;
+		impl->hashes_size = size;
+	}
+	if ((k = copy_key(key, hash)) == NULL)
+		goto no_mem;
 
 	item = pw_array_add(&impl->items, sizeof(struct spa_dict_item));
-	item->key = key;
+	if (item == NULL) {
+		free_key(k);
+		goto no_mem;
+	}
+
+	item->key = k;
 	item->value = value;
+	impl->hashes[n] = hash;
 
-	this->dict.items = impl->items.data;
-	this->dict.n_items = pw_array_get_len(&impl->items, struct spa_dict_item);
+	if (impl->index && (n + 1) * 2 <= impl->index_size)
+		index_insert(impl, hash, n);
+	else if (n + 1 >= HASH_MIN_ITEMS)
+		index_rebuild(impl);
+
+	update_dict(impl);
 	return 0;
+
+      no_mem:
+	free_value(value);
+	return -ENOMEM;
 }
 
 static void clear_item(struct spa_dict_item *item)
 {
-	free((char *) item->key);
-	free((char *) item->value);
+	free_key(item->key);
+	free_value(item->value);
 }
 
 static int find_index(const struct pw_properties *this, const char *key)
 {
 	struct properties *impl = SPA_CONTAINER_OF(this, struct properties, this);
-	int i, len = pw_array_get_len(&impl->items, struct spa_dict_item);
+	uint32_t i, idx, mask, hash;
 
-	for (i = 0; i < len; i++) {
-		struct spa_dict_item *item =
-		    pw_array_get_unchecked(&impl->items, i, struct spa_dict_item);
+	if (impl->index == NULL) {
+		uint32_t len = n_items(impl);
+
+		for (i = 0; i < len; i++) {
+			struct spa_dict_item *item =
+			    pw_array_get_unchecked(&impl->items, i, struct spa_dict_item);
+			if (strcmp(item->key, key) == 0)
+				return i;
+		}
+		return -1;
+	}
+
+	hash = hash_string(key);
+	mask = impl->index_size - 1;
+
+	for (i = hash & mask; (idx = impl->index[i]) != 0; i = (i + 1) & mask) {
+		struct spa_dict_item *item;
+
+		if (impl->hashes[--idx] != hash)
+			continue;
+		item = pw_array_get_unchecked(&impl->items, idx, struct spa_dict_item);
 		if (strcmp(item->key, key) == 0)
-			return i;
+			return idx;
 	}
 	return -1;
 }
@@ -98,7 +316,7 @@ struct pw_properties *pw_properties_new(const char *key, ...)
 	va_start(varargs, key);
 	while (key != NULL) {
 		value = va_arg(varargs, char *);
-		add_func(&impl->this, strdup(key), value ? strdup(value) : NULL);
+		add_func(&impl->this, key, copy_value(value));
 		key = va_arg(varargs, char *);
 	}
 	va_end(varargs);
@@ -124,8 +342,8 @@ struct pw_properties *pw_properties_new_dict(const struct spa_dict *dict)
 
 	for (i = 0; i < dict->n_items; i++) {
 		if (dict->items[i].key != NULL)
-			add_func(&impl->this, strdup(dict->items[i].key),
-				 dict->items[i].value ? strdup(dict->items[i].value) : NULL);
+			add_func(&impl->this, dict->items[i].key,
+				 copy_value(dict->items[i].value));
 	}
 
 	return &impl->this;
@@ -161,8 +379,9 @@ pw_properties_new_string(const char *str)
 		eq = strchr(val, '=');
 		if (eq) {
 			*eq = '\0';
-			add_func(&impl->this, val, strdup(eq+1));
+			add_func(&impl->this, val, copy_value(eq+1));
 		}
+		free(val);
 		s = pw_split_walk(str, " \t\n\r", &len, &state);
 	}
 	return &impl->this;
@@ -186,7 +405,7 @@ struct pw_properties *pw_properties_copy(const struct pw_properties *properties)
 		return NULL;
 
 	pw_array_for_each(item, &impl->items)
-	    add_func(copy, strdup(item->key), item->value ? strdup(item->value) : NULL);
+	    add_func(copy, item->key, copy_value(item->value));
 
 	return copy;
 }
@@ -244,6 +463,8 @@ void pw_properties_free(struct pw_properties *properties)
 	    clear_item(item);
 
 	pw_array_clear(&impl->items);
+	free(impl->hashes);
+	free(impl->index);
 	free(impl);
 }
 
@@ -253,21 +474,24 @@ static int do_replace(struct pw_properties *properties, const char *key, char *v
 	int index = find_index(properties, key);
 
 	if (index == -1) {
-		add_func(properties, strdup(key), value);
+		return add_func(properties, key, value);
 	} else {
 		struct spa_dict_item *item =
 		    pw_array_get_unchecked(&impl->items, index, struct spa_dict_item);
 
-		clear_item(item);
 		if (value == NULL) {
+			uint32_t last = n_items(impl) - 1;
 			struct spa_dict_item *other = pw_array_get_unchecked(&impl->items,
-						     pw_array_get_len(&impl->items, struct spa_dict_item) - 1,
-						     struct spa_dict_item);
+						     last, struct spa_dict_item);
+			clear_item(item);
 			item->key = other->key;
 			item->value = other->value;
+			impl->hashes[index] = impl->hashes[last];
 			impl->items.size -= sizeof(struct spa_dict_item);
+			index_rebuild(impl);
+			update_dict(impl);
 		} else {
-			item->key = strdup(key);
+			free_value(item->value);
 			item->value = value;
 		}
 	}
@@ -288,7 +512,7 @@ static int do_replace(struct pw_properties *properties, const char *key, char *v
  */
 int pw_properties_set(struct pw_properties *properties, const char *key, const char *value)
 {
-	return do_replace(properties, key, value ? strdup(value) : NULL);
+	return do_replace(properties, key, copy_value(value));
 }
 
 /** Set a property value by format
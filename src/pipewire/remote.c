@@ -191,13 +191,27 @@ static void
 core_event_update_types(void *data, uint32_t first_id, const char **types, uint32_t n_types)
 {
 	struct pw_remote *this = data;
+	void *old;
 	int i;
 
+	if (first_id < this->n_types_same)
+		this->n_types_same = first_id;
+
 	for (i = 0; i < n_types; i++, first_id++) {
 		uint32_t this_id = spa_type_map_get_id(this->core->type.map, types[i]);
+
+		old = pw_map_lookup(&this->types, first_id);
+
+		if (old != NULL && PW_MAP_PTR_TO_ID(old) != first_id)
+			this->n_types_remapped--;
 		if (!pw_map_insert_at(&this->types, first_id, PW_MAP_ID_TO_PTR(this_id)))
 			pw_log_error("can't add type for client");
+		else if (this_id != first_id)
+			this->n_types_remapped++;
 	}
+	while ((old = pw_map_lookup(&this->types, this->n_types_same)) != NULL &&
+	       PW_MAP_PTR_TO_ID(old) == this->n_types_same)
+		this->n_types_same++;
 }
 
 static const struct pw_core_proxy_events core_proxy_events = {
@@ -450,6 +464,8 @@ int pw_remote_disconnect(struct pw_remote *remote)
 	pw_map_clear(&remote->objects);
 	pw_map_clear(&remote->types);
 	remote->n_types = 0;
+	remote->n_types_remapped = 0;
+	remote->n_types_same = 0;
 
 	if (remote->info) {
 		pw_core_info_free (remote->info);
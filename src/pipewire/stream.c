@@ -212,6 +212,9 @@ static int unmap_data(struct stream *impl, struct spa_data *data)
 {
 	struct pw_map_range range;
 
+	if (data->data == NULL)
+		return 0;
+
 	pw_map_range_init(&range, data->mapoffset, data->maxsize,
 			impl->this.remote->core->sc_pagesize);
 
@@ -507,6 +510,27 @@ set_init_params(struct pw_stream *stream,
 	}
 }
 
+/* a pipelined stream holds the buffer it made for the next cycle while
+ * the graph consumes the previous one, ask for one more buffer */
+static void add_pipeline_buffer(struct pw_stream *stream, struct spa_pod *param)
+{
+	struct pw_type *t = &stream->remote->core->type;
+	struct spa_pod_object *obj = (struct spa_pod_object *) param;
+	struct spa_pod_prop *prop;
+	int32_t *alt;
+
+	if (param->type != SPA_POD_TYPE_OBJECT || obj->body.type != t->param_buffers.Buffers)
+		return;
+
+	if ((prop = spa_pod_find_prop(param, t->param_buffers.buffers)) == NULL ||
+	    prop->body.value.type != SPA_POD_TYPE_INT)
+		return;
+
+	(*(int32_t *) SPA_POD_BODY(&prop->body.value))++;
+	SPA_POD_PROP_ALTERNATIVE_FOREACH(&prop->body, prop->pod.size, alt)
+		(*alt)++;
+}
+
 static void set_params(struct pw_stream *stream, int n_params, const struct spa_pod **params)
 {
 	struct stream *impl = SPA_CONTAINER_OF(stream, struct stream, this);
@@ -521,8 +545,11 @@ static void set_params(struct pw_stream *stream, int n_params, const struct spa_
 	impl->n_params = n_params;
 	if (n_params > 0) {
 		impl->params = malloc(n_params * sizeof(struct spa_pod *));
-		for (i = 0; i < n_params; i++)
+		for (i = 0; i < n_params; i++) {
 			impl->params[i] = pw_spa_pod_copy(params[i]);
+			if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_PIPELINED))
+				add_pipeline_buffer(stream, impl->params[i]);
+		}
 	}
 }
 
@@ -1099,9 +1126,13 @@ client_node_port_use_buffers(void *data,
 				pw_log_debug(" data %d %u -> fd %d", j, bm->id, bm->fd);
 
 				if (SPA_FLAG_CHECK(impl->flags, PW_STREAM_FLAG_MAP_BUFFERS)) {
-					if (map_data(impl, d, prot) < 0)
-						return;
-					SPA_FLAG_SET(bid->flags, BUFFER_FLAG_MAPPED);
+					if (map_data(impl, d, prot) < 0) {
+						/* a DmaBuf is still usable through its fd */
+						if (d->type != t->data.DmaBuf)
+							return;
+						d->data = NULL;
+					} else
+						SPA_FLAG_SET(bid->flags, BUFFER_FLAG_MAPPED);
 				}
 			} else if (d->type == t->data.MemPtr) {
 				d->data = SPA_MEMBER(bid->ptr,
@@ -1275,6 +1306,8 @@ pw_stream_connect(struct pw_stream *stream,
 		pw_properties_set(stream->properties, PW_NODE_PROP_TARGET_NODE, port_path);
 	if (flags & PW_STREAM_FLAG_AUTOCONNECT)
 		pw_properties_set(stream->properties, PW_NODE_PROP_AUTOCONNECT, "1");
+	if (flags & PW_STREAM_FLAG_PIPELINED)
+		pw_properties_set(stream->properties, "pipewire.client.pipelined", "1");
 
 	impl->node_proxy = pw_core_proxy_create_object(stream->remote->core_proxy,
 			       "client-node",
@@ -215,6 +215,13 @@ enum pw_stream_flags {
 	PW_STREAM_FLAG_NO_CONVERT	= (1 << 5),	/**< don't convert format */
 	PW_STREAM_FLAG_EXCLUSIVE	= (1 << 6),	/**< require exclusive access to the
 							  *  device */
+	PW_STREAM_FLAG_PIPELINED	= (1 << 7),	/**< produce the output one cycle
+							  *  ahead of the graph. This adds
+							  *  one cycle of latency but the
+							  *  stream can be late by up to a
+							  *  cycle without stalling the
+							  *  graph. One extra buffer is
+							  *  added to the buffers param */
 };
 
 /** Create a new unconneced \ref pw_stream \memberof pw_stream
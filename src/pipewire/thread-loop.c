@@ -17,22 +17,55 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#include <errno.h>
+#include <limits.h>
 #include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
+#include <linux/futex.h>
 
 #include "pipewire.h"
 #include "thread-loop.h"
+#include "private.h"
 
 #define pw_thread_loop_events_emit(o,m,v,...) spa_hook_list_call(&o->listener_list, struct pw_thread_loop_events, m, v, ##__VA_ARGS__)
 #define pw_thread_loop_events_destroy(o)	pw_thread_loop_events_emit(o, destroy, 0)
 
 /** \cond */
+#define SPIN_COUNT	100
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax()	__builtin_ia32_pause()
+#else
+#define cpu_relax()	__asm__ __volatile__("" ::: "memory")
+#endif
+
+/* recursive lock, state is 0 when unlocked, 1 when locked and 2 when
+ * locked and other threads might be sleeping on it */
+struct futex_lock {
+	uint32_t state;
+	int spin;		/**< times to spin before sleeping, 0 on one cpu */
+	int depth;
+	pthread_t owner;
+};
+
+struct futex_cond {
+	uint32_t seq;
+};
+
 struct pw_thread_loop {
 	struct pw_loop *loop;
 	char *name;
+	struct pw_properties *properties;	/**< thread settings */
 
 	struct spa_hook_list listener_list;
 
+	bool futex;			/**< use the futex lock and conditions */
+	struct futex_lock flock;
+	struct futex_cond fcond;
+	struct futex_cond faccept_cond;
+
 	pthread_mutex_t lock;
 	pthread_cond_t cond;
 	pthread_cond_t accept_cond;
@@ -49,16 +82,124 @@ struct pw_thread_loop {
 };
 /** \endcond */
 
+static inline int futex_wait(uint32_t *addr, uint32_t val, const struct timespec *abstime)
+{
+	if (abstime)
+		return syscall(SYS_futex, addr, FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME,
+			       val, abstime, NULL, FUTEX_BITSET_MATCH_ANY);
+	return syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(uint32_t *addr, int n)
+{
+	syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+
+static void futex_lock_acquire(struct futex_lock *l)
+{
+	uint32_t c = 0;
+	int i;
+
+	if (__atomic_compare_exchange_n(&l->state, &c, 1, false,
+					__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return;
+
+	/* the loop thread usually holds the lock only briefly, spin a little
+	 * before going to sleep */
+	for (i = 0; i < l->spin; i++) {
+		c = 0;
+		if (__atomic_load_n(&l->state, __ATOMIC_RELAXED) == 0 &&
+		    __atomic_compare_exchange_n(&l->state, &c, 1, false,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+			return;
+		cpu_relax();
+	}
+	while (__atomic_exchange_n(&l->state, 2, __ATOMIC_ACQUIRE) != 0)
+		futex_wait(&l->state, 2, NULL);
+}
+
+static void futex_lock_release(struct futex_lock *l)
+{
+	if (__atomic_exchange_n(&l->state, 0, __ATOMIC_RELEASE) == 2)
+		futex_wake(&l->state, 1);
+}
+
+static void futex_lock(struct futex_lock *l)
+{
+	pthread_t self = pthread_self();
+
+	if (__atomic_load_n(&l->owner, __ATOMIC_RELAXED) == self) {
+		l->depth++;
+		return;
+	}
+	futex_lock_acquire(l);
+	__atomic_store_n(&l->owner, self, __ATOMIC_RELAXED);
+	l->depth = 1;
+}
+
+static void futex_unlock(struct futex_lock *l)
+{
+	if (--l->depth > 0)
+		return;
+	__atomic_store_n(&l->owner, 0, __ATOMIC_RELAXED);
+	futex_lock_release(l);
+}
+
+/* must be called with the lock held, the lock is fully released while
+ * waiting and taken again with the same depth */
+static int futex_cond_wait(struct futex_cond *c, struct futex_lock *l,
+			   const struct timespec *abstime)
+{
+	uint32_t seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+	pthread_t owner = l->owner;
+	int depth = l->depth, res = 0;
+
+	l->depth = 0;
+	__atomic_store_n(&l->owner, 0, __ATOMIC_RELAXED);
+	futex_lock_release(l);
+
+	if (futex_wait(&c->seq, seq, abstime) < 0 && errno == ETIMEDOUT)
+		res = ETIMEDOUT;
+
+	futex_lock_acquire(l);
+	__atomic_store_n(&l->owner, owner, __ATOMIC_RELAXED);
+	l->depth = depth;
+
+	return res;
+}
+
+static void futex_cond_wake(struct futex_cond *c, int n)
+{
+	__atomic_fetch_add(&c->seq, 1, __ATOMIC_RELAXED);
+	futex_wake(&c->seq, n);
+}
+
+static inline void loop_lock(struct pw_thread_loop *this)
+{
+	if (this->futex)
+		futex_lock(&this->flock);
+	else
+		pthread_mutex_lock(&this->lock);
+}
+
+static inline void loop_unlock(struct pw_thread_loop *this)
+{
+	if (this->futex)
+		futex_unlock(&this->flock);
+	else
+		pthread_mutex_unlock(&this->lock);
+}
+
 static void before(void *data)
 {
 	struct pw_thread_loop *this = data;
-	pthread_mutex_unlock(&this->lock);
+	loop_unlock(this);
 }
 
 static void after(void *data)
 {
 	struct pw_thread_loop *this = data;
-	pthread_mutex_lock(&this->lock);
+	loop_lock(this);
 }
 
 static const struct spa_loop_control_hooks impl_hooks = {
@@ -89,8 +230,29 @@ static void do_stop(void *data, uint64_t count)
  */
 struct pw_thread_loop *pw_thread_loop_new(struct pw_loop *loop,
 					  const char *name)
+{
+	return pw_thread_loop_new_full(loop, name, NULL);
+}
+
+/** Create a new \ref pw_thread_loop with thread settings
+ *
+ * \param loop the loop to wrap
+ * \param name the name of the thread or NULL
+ * \param props thread settings like PW_LOOP_PROP_RT_PRIORITY or NULL
+ * \return a newly allocated \ref  pw_thread_loop
+ *
+ * When PW_THREAD_LOOP_PROP_FUTEX is true in \a props, the loop uses a
+ * lock that spins a little before sleeping on a futex and futex based
+ * wait and signal instead of a pthread mutex and condition variables.
+ *
+ * \memberof pw_thread_loop
+ */
+struct pw_thread_loop *pw_thread_loop_new_full(struct pw_loop *loop,
+					       const char *name,
+					       const struct spa_dict *props)
 {
 	struct pw_thread_loop *this;
+	const char *str;
 	pthread_mutexattr_t attr;
 	pthread_condattr_t cattr;
 
@@ -102,6 +264,10 @@ struct pw_thread_loop *pw_thread_loop_new(struct pw_loop *loop,
 
 	this->loop = loop;
 	this->name = name ? strdup(name) : NULL;
+	this->properties = props ? pw_properties_new_dict(props) : NULL;
+	if (props && (str = spa_dict_lookup(props, PW_THREAD_LOOP_PROP_FUTEX)) != NULL)
+		this->futex = pw_properties_parse_bool(str);
+	this->flock.spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPIN_COUNT : 0;
 
 	pw_loop_add_hook(loop, &this->hook, &impl_hooks, this);
 
@@ -129,6 +295,8 @@ void pw_thread_loop_destroy(struct pw_thread_loop *loop)
 
 	if (loop->name)
 		free(loop->name);
+	if (loop->properties)
+		pw_properties_free(loop->properties);
 	pthread_mutex_destroy(&loop->lock);
 	pthread_cond_destroy(&loop->cond);
 	pthread_cond_destroy(&loop->accept_cond);
@@ -157,7 +325,7 @@ static void *do_loop(void *user_data)
 	struct pw_thread_loop *this = user_data;
 	int res;
 
-	pthread_mutex_lock(&this->lock);
+	loop_lock(this);
 	pw_log_debug("thread-loop %p: enter thread", this);
 	pw_loop_enter(this->loop);
 
@@ -167,7 +335,7 @@ static void *do_loop(void *user_data)
 	}
 	pw_log_debug("thread-loop %p: leave thread", this);
 	pw_loop_leave(this->loop);
-	pthread_mutex_unlock(&this->lock);
+	loop_unlock(this);
 
 	return NULL;
 }
@@ -185,11 +353,13 @@ int pw_thread_loop_start(struct pw_thread_loop *loop)
 		int err;
 
 		loop->running = true;
-		if ((err = pthread_create(&loop->thread, NULL, do_loop, loop)) != 0) {
+		if ((err = pw_thread_create(&loop->thread,
+					loop->properties ? &loop->properties->dict : NULL,
+					do_loop, loop, NULL)) < 0) {
 			pw_log_warn("thread-loop %p: can't create thread: %s", loop,
-				    strerror(err));
+				    strerror(-err));
 			loop->running = false;
-			return -err;
+			return err;
 		}
 	}
 	return 0;
@@ -223,7 +393,7 @@ void pw_thread_loop_stop(struct pw_thread_loop *loop)
  */
 void pw_thread_loop_lock(struct pw_thread_loop *loop)
 {
-	pthread_mutex_lock(&loop->lock);
+	loop_lock(loop);
 }
 
 /** Unlock the mutex associated with \a loop
@@ -234,7 +404,7 @@ void pw_thread_loop_lock(struct pw_thread_loop *loop)
  */
 void pw_thread_loop_unlock(struct pw_thread_loop *loop)
 {
-	pthread_mutex_unlock(&loop->lock);
+	loop_unlock(loop);
 }
 
 /** Signal the thread
@@ -249,14 +419,22 @@ void pw_thread_loop_unlock(struct pw_thread_loop *loop)
  */
 void pw_thread_loop_signal(struct pw_thread_loop *loop, bool wait_for_accept)
 {
-	if (loop->n_waiting > 0)
-		pthread_cond_broadcast(&loop->cond);
+	if (loop->n_waiting > 0) {
+		if (loop->futex)
+			futex_cond_wake(&loop->fcond, INT_MAX);
+		else
+			pthread_cond_broadcast(&loop->cond);
+	}
 
 	if (wait_for_accept) {
 		loop->n_waiting_for_accept++;
 
-		while (loop->n_waiting_for_accept > 0)
-			pthread_cond_wait(&loop->accept_cond, &loop->lock);
+		while (loop->n_waiting_for_accept > 0) {
+			if (loop->futex)
+				futex_cond_wait(&loop->faccept_cond, &loop->flock, NULL);
+			else
+				pthread_cond_wait(&loop->accept_cond, &loop->lock);
+		}
 	}
 }
 
@@ -269,7 +447,10 @@ void pw_thread_loop_signal(struct pw_thread_loop *loop, bool wait_for_accept)
 void pw_thread_loop_wait(struct pw_thread_loop *loop)
 {
 	loop->n_waiting++;
-	pthread_cond_wait(&loop->cond, &loop->lock);
+	if (loop->futex)
+		futex_cond_wait(&loop->fcond, &loop->flock, NULL);
+	else
+		pthread_cond_wait(&loop->cond, &loop->lock);
 	loop->n_waiting--;
 }
 
@@ -292,7 +473,10 @@ int pw_thread_loop_timed_wait(struct pw_thread_loop *loop, int wait_max_sec)
 	timeout.tv_sec += wait_max_sec;
 
 	loop->n_waiting++;
-	ret = pthread_cond_timedwait(&loop->cond, &loop->lock, &timeout);
+	if (loop->futex)
+		ret = futex_cond_wait(&loop->fcond, &loop->flock, &timeout);
+	else
+		ret = pthread_cond_timedwait(&loop->cond, &loop->lock, &timeout);
 	loop->n_waiting--;
 	return ret;
 }
@@ -306,7 +490,10 @@ int pw_thread_loop_timed_wait(struct pw_thread_loop *loop, int wait_max_sec)
 void pw_thread_loop_accept(struct pw_thread_loop *loop)
 {
 	loop->n_waiting_for_accept--;
-	pthread_cond_signal(&loop->accept_cond);
+	if (loop->futex)
+		futex_cond_wake(&loop->faccept_cond, 1);
+	else
+		pthread_cond_signal(&loop->accept_cond);
 }
 
 /** Check if we are inside the thread of the loop
@@ -98,10 +98,21 @@ struct pw_thread_loop_events {
         void (*destroy) (void *data);
 };
 
+/** Use a futex based lock and wait/signal for the loop, "1" or "true"
+ * to enable. The lock spins briefly before sleeping, which is cheaper when
+ * the lock is handed between the loop and an application thread for
+ * every buffer. */
+#define PW_THREAD_LOOP_PROP_FUTEX	"thread-loop.futex"
+
 /** Make a new thread loop with the given name */
 struct pw_thread_loop *
 pw_thread_loop_new(struct pw_loop *loop, const char *name);
 
+/** Make a new thread loop with the given name and thread settings */
+struct pw_thread_loop *
+pw_thread_loop_new_full(struct pw_loop *loop, const char *name,
+			const struct spa_dict *props);
+
 /** Destroy a thread loop */
 void pw_thread_loop_destroy(struct pw_thread_loop *loop);
 
@@ -0,0 +1,133 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipewire/log.h"
+#include "pipewire/loop.h"
+#include "pipewire/private.h"
+
+/* parse a cpu list like "1,3-5" */
+static int parse_cpu_list(const char *str, cpu_set_t *set)
+{
+	char *end;
+	long first, last, i;
+
+	CPU_ZERO(set);
+
+	while (*str) {
+		first = strtol(str, &end, 10);
+		if (end == str || first < 0 || first >= CPU_SETSIZE)
+			return -EINVAL;
+		last = first;
+		str = end;
+		if (*str == '-') {
+			str++;
+			last = strtol(str, &end, 10);
+			if (end == str || last < first || last >= CPU_SETSIZE)
+				return -EINVAL;
+			str = end;
+		}
+		for (i = first; i <= last; i++)
+			CPU_SET(i, set);
+
+		if (*str == ',')
+			str++;
+		else if (*str != '\0')
+			return -EINVAL;
+	}
+	return CPU_COUNT(set) > 0 ? 0 : -EINVAL;
+}
+
+/** Create a thread with the settings of a loop
+ *
+ * \param thread the new thread
+ * \param props properties with the settings or NULL
+ * \param func the thread function
+ * \param data data for \a func
+ * \param applied properties where the applied settings are stored or NULL
+ * \return 0 on success, < 0 when the thread could not be created
+ *
+ * PW_LOOP_PROP_STACK_SIZE is used when creating the thread. The thread
+ * is pinned to the cpus in PW_LOOP_PROP_CPU_AFFINITY and switched to
+ * SCHED_FIFO with PW_LOOP_PROP_RT_PRIORITY right after it is created. When
+ * one of these fails, a warning is logged but the thread keeps running with
+ * the default.
+ */
+int pw_thread_create(pthread_t *thread, const struct spa_dict *props,
+		     void *(*func) (void *data), void *data,
+		     struct pw_properties *applied)
+{
+	pthread_attr_t attr;
+	struct sched_param sp;
+	cpu_set_t cpus;
+	const char *str;
+	size_t stack_size = 0;
+	int res, prio = 0;
+
+	pthread_attr_init(&attr);
+
+	if (props && (str = spa_dict_lookup(props, PW_LOOP_PROP_STACK_SIZE)) != NULL) {
+		stack_size = strtoul(str, NULL, 0);
+		if (stack_size < PTHREAD_STACK_MIN ||
+		    (res = pthread_attr_setstacksize(&attr, stack_size)) != 0) {
+			pw_log_warn("thread: invalid stack size %s", str);
+			stack_size = 0;
+		}
+	}
+	if (stack_size == 0)
+		pthread_attr_getstacksize(&attr, &stack_size);
+
+	res = pthread_create(thread, &attr, func, data);
+	pthread_attr_destroy(&attr);
+	if (res != 0)
+		return -res;
+
+	if (applied)
+		pw_properties_setf(applied, PW_LOOP_PROP_STACK_SIZE, "%zu", stack_size);
+
+	if (props && (str = spa_dict_lookup(props, PW_LOOP_PROP_CPU_AFFINITY)) != NULL) {
+		if (parse_cpu_list(str, &cpus) < 0) {
+			pw_log_warn("thread: invalid cpu list %s", str);
+		} else if ((res = pthread_setaffinity_np(*thread, sizeof(cpus), &cpus)) != 0) {
+			pw_log_warn("thread: can't set affinity %s: %s", str, strerror(res));
+		} else if (applied) {
+			pw_properties_set(applied, PW_LOOP_PROP_CPU_AFFINITY, str);
+		}
+	}
+
+	if (props && (str = spa_dict_lookup(props, PW_LOOP_PROP_RT_PRIORITY)) != NULL &&
+	    (prio = atoi(str)) > 0) {
+		spa_zero(sp);
+		sp.sched_priority = prio;
+		if ((res = pthread_setschedparam(*thread, SCHED_FIFO | SCHED_RESET_ON_FORK, &sp)) != 0) {
+			pw_log_warn("thread: can't set realtime priority %d: %s", prio, strerror(res));
+			prio = 0;
+		}
+	}
+	if (applied)
+		pw_properties_setf(applied, PW_LOOP_PROP_RT_PRIORITY, "%d", prio);
+
+	return 0;
+}
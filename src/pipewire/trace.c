@@ -0,0 +1,136 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <pipewire/log.h>
+#include <pipewire/trace.h>
+
+struct pw_trace_header *pw_trace_active = NULL;
+
+static struct pw_trace_event *trace_events;
+static size_t trace_size;
+
+static inline uint64_t get_time(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return SPA_TIMESPEC_TO_TIME(&now);
+}
+
+/** Start recording trace events in \a path
+ * \param path the file to record in, it is truncated
+ * \param n_events the number of events to keep, rounded up to a power of 2
+ * \return 0 on success, < 0 on error
+ * \memberof pw_trace
+ */
+int pw_trace_open(const char *path, uint32_t n_events)
+{
+	struct pw_trace_header *h;
+	int fd, res;
+	uint32_t n;
+
+	if (pw_trace_active)
+		return -EBUSY;
+
+	for (n = 1; n < n_events && n < (1u << 26); n <<= 1);
+
+	trace_size = sizeof(struct pw_trace_header) + n * sizeof(struct pw_trace_event);
+
+	if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+		res = -errno;
+		goto error;
+	}
+	if (ftruncate(fd, trace_size) < 0) {
+		res = -errno;
+		goto error_close;
+	}
+	h = mmap(NULL, trace_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (h == MAP_FAILED) {
+		res = -errno;
+		goto error_close;
+	}
+	close(fd);
+
+	memcpy(h->magic, PW_TRACE_MAGIC, sizeof(h->magic));
+	h->version = PW_TRACE_VERSION;
+	h->n_events = n;
+	h->start_time = get_time();
+	h->writeindex = 0;
+	h->event_size = sizeof(struct pw_trace_event);
+
+	trace_events = SPA_MEMBER(h, sizeof(struct pw_trace_header), struct pw_trace_event);
+	__atomic_store_n(&pw_trace_active, h, __ATOMIC_RELEASE);
+
+	pw_log_info("trace: recording %u events in %s", n, path);
+	return 0;
+
+      error_close:
+	close(fd);
+      error:
+	pw_log_error("trace: can't record in %s: %s", path, strerror(-res));
+	return res;
+}
+
+/** Stop recording trace events
+ *
+ * The file stays mapped because other threads might still be recording
+ * an event.
+ * \memberof pw_trace
+ */
+void pw_trace_close(void)
+{
+	struct pw_trace_header *h = pw_trace_active;
+
+	if (h == NULL)
+		return;
+
+	__atomic_store_n(&pw_trace_active, NULL, __ATOMIC_RELEASE);
+	msync(h, trace_size, MS_ASYNC);
+}
+
+void pw_trace_event(uint64_t time, uint32_t type, uint32_t id, uint32_t arg, int32_t res)
+{
+	struct pw_trace_header *h = __atomic_load_n(&pw_trace_active, __ATOMIC_ACQUIRE);
+	struct pw_trace_event *ev;
+	uint64_t index;
+
+	if (h == NULL)
+		return;
+
+	index = __atomic_fetch_add(&h->writeindex, 1, __ATOMIC_RELAXED);
+	ev = &trace_events[index & (h->n_events - 1)];
+
+	/* invalidate the slot while we overwrite it */
+	__atomic_store_n(&ev->seq, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	ev->time = time ? time : get_time();
+	ev->type = type;
+	ev->id = id;
+	ev->arg = arg;
+	ev->res = res;
+
+	__atomic_store_n(&ev->seq, (uint32_t) index + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,108 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __PIPEWIRE_TRACE_H__
+#define __PIPEWIRE_TRACE_H__
+
+#include <stdint.h>
+
+#include <spa/utils/defs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \class pw_trace
+ *
+ * Binary trace recording of the graph activity.
+ *
+ * When the PIPEWIRE_TRACE environment variable is set to a file name,
+ * optionally followed by a colon and the number of events to keep, events
+ * are recorded into a ring of fixed size records in that file name with
+ * the pid of the process appended, like trace.1234. The file is
+ * mapped in memory so that recording an event is only a few stores and the
+ * events survive a crash of the process. Use pipewire-trace to convert the
+ * file for offline analysis.
+ */
+
+#define PW_TRACE_MAGIC		"PWTRACE1"
+#define PW_TRACE_VERSION	0
+#define PW_TRACE_DEFAULT_EVENTS	(1 << 16)
+
+enum pw_trace_event_type {
+	PW_TRACE_EVENT_CYCLE_BEGIN,	/**< a driver node started a cycle, id: node */
+	PW_TRACE_EVENT_CYCLE_END,	/**< the cycle ended, id: node */
+	PW_TRACE_EVENT_PROCESS_BEGIN,	/**< process call started, id: node, arg: direction */
+	PW_TRACE_EVENT_PROCESS_END,	/**< process call ended, id: node, arg: direction,
+					  *  res: result */
+	PW_TRACE_EVENT_BUFFER,		/**< buffer on an output port, id: node,
+					  *  arg: port id, res: buffer id */
+	PW_TRACE_EVENT_XRUN,		/**< process call failed, id: node, res: error */
+	PW_TRACE_EVENT_LINK_STATE,	/**< link state changed, id: link, arg: new state,
+					  *  res: old state */
+};
+
+/** header at the start of the trace file */
+struct pw_trace_header {
+	char magic[8];			/**< PW_TRACE_MAGIC */
+	uint32_t version;		/**< PW_TRACE_VERSION */
+	uint32_t n_events;		/**< number of events in the ring, power of 2 */
+	uint64_t start_time;		/**< CLOCK_MONOTONIC time when recording started */
+	uint64_t writeindex;		/**< number of events ever recorded */
+	uint32_t event_size;		/**< sizeof(struct pw_trace_event) */
+	uint32_t padding[7];
+	/* n_events struct pw_trace_event follow */
+};
+
+/** an event in the trace file */
+struct pw_trace_event {
+	uint64_t time;			/**< CLOCK_MONOTONIC time in nanoseconds */
+	uint32_t seq;			/**< low 32 bits of the event index + 1, set
+					  *  after the event is complete */
+	uint32_t type;			/**< enum pw_trace_event_type */
+	uint32_t id;			/**< global id of the object */
+	uint32_t arg;			/**< extra argument, depends on the type */
+	int32_t res;			/**< result, depends on the type */
+	uint32_t padding;
+};
+
+/** the header of the active recording or NULL when not recording */
+extern struct pw_trace_header *pw_trace_active;
+
+int pw_trace_open(const char *path, uint32_t n_events);
+
+void pw_trace_close(void);
+
+/** Record an event at \a time, or now when \a time is 0. Safe to call from
+ * any thread. \memberof pw_trace */
+void pw_trace_event(uint64_t time, uint32_t type, uint32_t id, uint32_t arg, int32_t res);
+
+/** Check if trace recording is enabled \memberof pw_trace */
+#define pw_trace_enabled()	SPA_UNLIKELY(pw_trace_active != NULL)
+
+#define pw_trace(type,id,arg,res)				\
+({								\
+	if (pw_trace_enabled())					\
+		pw_trace_event(0,type,id,arg,res);		\
+})
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __PIPEWIRE_TRACE_H__ */
@@ -65,5 +65,15 @@ int pw_type_init(struct pw_type *type)
 	spa_type_param_buffers_map(type->map, &type->param_buffers);
 	spa_type_param_meta_map(type->map, &type->param_meta);
 	spa_type_param_io_map(type->map, &type->param_io);
+	pw_type_param_profile_map(type->map, &type->param_profile);
+
+	spa_type_media_type_map(type->map, &type->media_type);
+	spa_type_media_subtype_map(type->map, &type->media_subtype);
+	spa_type_media_subtype_audio_map(type->map, &type->media_subtype_audio);
+	spa_type_media_subtype_video_map(type->map, &type->media_subtype_video);
+	spa_type_format_audio_map(type->map, &type->format_audio);
+	spa_type_format_video_map(type->map, &type->format_video);
+	spa_type_audio_format_map(type->map, &type->audio_format);
+	spa_type_video_format_map(type->map, &type->video_format);
 	return 0;
 }
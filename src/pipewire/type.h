@@ -31,6 +31,8 @@ extern "C" {
 #include <spa/param/buffers.h>
 #include <spa/param/meta.h>
 #include <spa/param/io.h>
+#include <spa/param/audio/format-utils.h>
+#include <spa/param/video/format-utils.h>
 #include <spa/node/io.h>
 
 #include <pipewire/map.h>
@@ -43,6 +45,53 @@ extern "C" {
 #define PW_TYPE__Interface	PW_TYPE_BASE "Interface"
 #define PW_TYPE_INTERFACE_BASE	PW_TYPE__Interface ":"
 
+/** Timing statistics of a node, enumerate them with the Profile param id.
+ * Index 0 has the times of the process calls of the node, index 1 the wall
+ * time of the graph cycles the node started as a driver. */
+#define PW_TYPE_PARAM_ID__Profile	SPA_TYPE_PARAM_ID_BASE "Profile"
+
+#define PW_TYPE_PARAM__Profile		SPA_TYPE_PARAM_BASE "Profile"
+#define PW_TYPE_PARAM_PROFILE_BASE	PW_TYPE_PARAM__Profile ":"
+/** "process" or "cycle" */
+#define PW_TYPE_PARAM_PROFILE__name	PW_TYPE_PARAM_PROFILE_BASE "name"
+#define PW_TYPE_PARAM_PROFILE__count	PW_TYPE_PARAM_PROFILE_BASE "count"
+/** number of calls that failed */
+#define PW_TYPE_PARAM_PROFILE__xruns	PW_TYPE_PARAM_PROFILE_BASE "xruns"
+/** min, average and max time in nanoseconds */
+#define PW_TYPE_PARAM_PROFILE__min	PW_TYPE_PARAM_PROFILE_BASE "min"
+#define PW_TYPE_PARAM_PROFILE__avg	PW_TYPE_PARAM_PROFILE_BASE "avg"
+#define PW_TYPE_PARAM_PROFILE__max	PW_TYPE_PARAM_PROFILE_BASE "max"
+/** array of ints with the number of calls below 1, 2, 4, 8, ... microseconds */
+#define PW_TYPE_PARAM_PROFILE__histogram	PW_TYPE_PARAM_PROFILE_BASE "histogram"
+
+struct pw_type_param_profile {
+	uint32_t idProfile;
+	uint32_t Profile;
+	uint32_t name;
+	uint32_t count;
+	uint32_t xruns;
+	uint32_t min;
+	uint32_t avg;
+	uint32_t max;
+	uint32_t histogram;
+};
+
+static inline void
+pw_type_param_profile_map(struct spa_type_map *map, struct pw_type_param_profile *type)
+{
+	if (type->idProfile == 0) {
+		type->idProfile = spa_type_map_get_id(map, PW_TYPE_PARAM_ID__Profile);
+		type->Profile = spa_type_map_get_id(map, PW_TYPE_PARAM__Profile);
+		type->name = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__name);
+		type->count = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__count);
+		type->xruns = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__xruns);
+		type->min = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__min);
+		type->avg = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__avg);
+		type->max = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__max);
+		type->histogram = spa_type_map_get_id(map, PW_TYPE_PARAM_PROFILE__histogram);
+	}
+}
+
 /** \class pw_type
  * \brief PipeWire type support struct
  *
@@ -77,6 +126,18 @@ struct pw_type {
 	struct spa_type_param_buffers param_buffers;
 	struct spa_type_param_meta param_meta;
 	struct spa_type_param_io param_io;
+	struct pw_type_param_profile param_profile;
+
+	/* not used by pipewire itself but registered in the same order in
+	 * every process so that formats use the same type ids everywhere */
+	struct spa_type_media_type media_type;
+	struct spa_type_media_subtype media_subtype;
+	struct spa_type_media_subtype_audio media_subtype_audio;
+	struct spa_type_media_subtype_video media_subtype_video;
+	struct spa_type_format_audio format_audio;
+	struct spa_type_format_video format_video;
+	struct spa_type_audio_format audio_format;
+	struct spa_type_video_format video_format;
 };
 
 int pw_type_init(struct pw_type *type);
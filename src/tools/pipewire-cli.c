@@ -27,6 +27,7 @@
 
 #include <spa/debug/pod.h>
 #include <spa/debug/format.h>
+#include <spa/pod/parser.h>
 
 #include <pipewire/pipewire.h>
 #include <pipewire/command.h>
@@ -178,6 +179,7 @@ static bool do_create_link(struct data *data, const char *cmd, char *args, char
 static bool do_export_node(struct data *data, const char *cmd, char *args, char **error);
 static bool do_node_params(struct data *data, const char *cmd, char *args, char **error);
 static bool do_port_params(struct data *data, const char *cmd, char *args, char **error);
+static bool do_profile(struct data *data, const char *cmd, char *args, char **error);
 
 static struct command command_list[] = {
 	{ "help", "Show this help", do_help },
@@ -195,6 +197,7 @@ static struct command command_list[] = {
 	{ "export-node", "Export a local node to the current remote. <node-id> [remote-var]", do_export_node },
 	{ "node-params", "Enumerate params of a node <node-id> [<param-id-name>]", do_node_params },
 	{ "port-params", "Enumerate params of a port <port-id> [<param-id-name>]", do_port_params },
+	{ "profile", "Show the processing times of a node <node-id>", do_profile },
 };
 
 static bool do_help(struct data *data, const char *cmd, char *args, char **error)
@@ -663,6 +666,46 @@ static void node_event_info(void *object, struct pw_node_info *info)
 	}
 }
 
+static void print_profile(struct pw_type *t, const struct spa_pod *param)
+{
+	const char *name = "unknown";
+	int64_t count = 0, min = 0, avg = 0, max = 0;
+	int32_t xruns = 0, *h;
+	struct spa_pod *array = NULL;
+	struct spa_pod_array_body *body;
+	uint32_t i = 0;
+
+	spa_pod_object_parse(param,
+		":", t->param_profile.name,	 "?s", &name,
+		":", t->param_profile.count,	 "?l", &count,
+		":", t->param_profile.xruns,	 "?i", &xruns,
+		":", t->param_profile.min,	 "?l", &min,
+		":", t->param_profile.avg,	 "?l", &avg,
+		":", t->param_profile.max,	 "?l", &max,
+		":", t->param_profile.histogram, "?P", &array, NULL);
+
+	fprintf(stdout, "\t%s: %"PRIi64" calls, %d xruns\n", name, count, xruns);
+	if (count == 0)
+		return;
+
+	fprintf(stdout, "\t\tmin %"PRIi64"us avg %"PRIi64"us max %"PRIi64"us\n",
+			min / 1000, avg / 1000, max / 1000);
+
+	if (array == NULL || SPA_POD_TYPE(array) != SPA_POD_TYPE_ARRAY)
+		return;
+
+	body = SPA_POD_BODY(array);
+	if (body->child.type != SPA_POD_TYPE_INT)
+		return;
+
+	SPA_POD_ARRAY_BODY_FOREACH(body, SPA_POD_BODY_SIZE(array), h) {
+		if (*h > 0)
+			fprintf(stdout, "\t\t< %8uus: %8d %5.1f%%\n", 1u << i, *h,
+					100.0 * *h / count);
+		i++;
+	}
+}
+
 static void node_event_param(void *object, uint32_t id, uint32_t index, uint32_t next,
 		const struct spa_pod *param)
 {
@@ -673,7 +716,9 @@ static void node_event_param(void *object, uint32_t id, uint32_t index, uint32_t
 	fprintf(stdout, "remote %d node %d param %d index %d\n",
 			rd->id, data->global->id, id, index);
 
-	if (spa_pod_is_object_type(param, t->spa_format))
+	if (spa_pod_is_object_type(param, t->param_profile.Profile))
+		print_profile(t, param);
+	else if (spa_pod_is_object_type(param, t->spa_format))
 		spa_debug_format(2, t->map, param);
 	else
 		spa_debug_pod(2, t->map, param);
@@ -1134,6 +1179,42 @@ static bool do_node_params(struct data *data, const char *cmd, char *args, char
 	return true;
 }
 
+static bool do_profile(struct data *data, const char *cmd, char *args, char **error)
+{
+	struct pw_type *t = data->t;
+	struct remote_data *rd = data->current;
+	char *a[1];
+        int n;
+	uint32_t id;
+	struct global *global;
+
+	n = pw_split_ip(args, WHITESPACE, 1, a);
+	if (n < 1) {
+		asprintf(error, "%s <node-id>", cmd);
+		return false;
+	}
+
+	id = atoi(a[0]);
+	global = pw_map_lookup(&rd->globals, id);
+	if (global == NULL) {
+		asprintf(error, "%s: unknown global %d", cmd, id);
+		return false;
+	}
+	if (global->type != t->node) {
+		asprintf(error, "object %d is not a node", atoi(a[0]));
+		return false;
+	}
+	if (global->proxy == NULL) {
+		if (!bind_global(rd, global, error))
+			return false;
+	}
+
+	pw_node_proxy_enum_params((struct pw_node_proxy*)global->proxy,
+			t->param_profile.idProfile, 0, 0, NULL);
+
+	return true;
+}
+
 static bool do_port_params(struct data *data, const char *cmd, char *args, char **error)
 {
 	struct pw_type *t = data->t;
@@ -0,0 +1,245 @@
+/* PipeWire
+ * Copyright (C) 2018 Wim Taymans <wim.taymans@gmail.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <spa/utils/defs.h>
+
+#include <pipewire/trace.h>
+
+/* Convert a trace file recorded with PIPEWIRE_TRACE=<file>, named
+ * <file>.<pid>, to the Chrome trace event format, which can be loaded in
+ * chrome://tracing or Perfetto and shown as a flame chart, or to plain
+ * text. */
+
+enum format {
+	FORMAT_CHROME,
+	FORMAT_TEXT,
+};
+
+struct data {
+	enum format format;
+	FILE *out;
+	uint64_t start_time;
+	bool first;
+};
+
+static const char *type_names[] = {
+	[PW_TRACE_EVENT_CYCLE_BEGIN] = "cycle-begin",
+	[PW_TRACE_EVENT_CYCLE_END] = "cycle-end",
+	[PW_TRACE_EVENT_PROCESS_BEGIN] = "process-begin",
+	[PW_TRACE_EVENT_PROCESS_END] = "process-end",
+	[PW_TRACE_EVENT_BUFFER] = "buffer",
+	[PW_TRACE_EVENT_XRUN] = "xrun",
+	[PW_TRACE_EVENT_LINK_STATE] = "link-state",
+};
+
+static const char *type_name(uint32_t type)
+{
+	if (type < SPA_N_ELEMENTS(type_names) && type_names[type])
+		return type_names[type];
+	return "unknown";
+}
+
+static void print_text(struct data *d, const struct pw_trace_event *ev)
+{
+	fprintf(d->out, "%14.3f %-14s id:%-5u arg:%-5u res:%d\n",
+		(ev->time - d->start_time) / 1000.0, type_name(ev->type),
+		ev->id, ev->arg, ev->res);
+}
+
+static void print_chrome(struct data *d, const struct pw_trace_event *ev)
+{
+	double ts = (int64_t) (ev->time - d->start_time) / 1000.0;
+	const char *sep = d->first ? "" : ",\n";
+
+	d->first = false;
+
+	/* cycles go in process 1, node process calls in process 2, both with
+	 * a thread per node id so that the flame chart shows a row per node */
+	switch (ev->type) {
+	case PW_TRACE_EVENT_CYCLE_BEGIN:
+	case PW_TRACE_EVENT_CYCLE_END:
+		fprintf(d->out, "%s{\"name\":\"cycle %s\",\"cat\":\"cycle\",\"ph\":\"%s\","
+			"\"ts\":%.3f,\"pid\":1,\"tid\":%u}", sep,
+			ev->arg == 0 ? "input" : "output",
+			ev->type == PW_TRACE_EVENT_CYCLE_BEGIN ? "B" : "E", ts, ev->id);
+		break;
+	case PW_TRACE_EVENT_PROCESS_BEGIN:
+		fprintf(d->out, "%s{\"name\":\"process %s\",\"cat\":\"process\",\"ph\":\"B\","
+			"\"ts\":%.3f,\"pid\":2,\"tid\":%u}", sep,
+			ev->arg == 0 ? "input" : "output", ts, ev->id);
+		break;
+	case PW_TRACE_EVENT_PROCESS_END:
+		fprintf(d->out, "%s{\"ph\":\"E\",\"ts\":%.3f,\"pid\":2,\"tid\":%u,"
+			"\"args\":{\"res\":%d}}", sep, ts, ev->id, ev->res);
+		break;
+	case PW_TRACE_EVENT_BUFFER:
+		fprintf(d->out, "%s{\"name\":\"buffer\",\"cat\":\"buffer\",\"ph\":\"i\",\"s\":\"t\","
+			"\"ts\":%.3f,\"pid\":2,\"tid\":%u,\"args\":{\"port\":%u,\"buffer\":%d}}",
+			sep, ts, ev->id, ev->arg, ev->res);
+		break;
+	case PW_TRACE_EVENT_XRUN:
+		fprintf(d->out, "%s{\"name\":\"xrun\",\"cat\":\"xrun\",\"ph\":\"i\",\"s\":\"p\","
+			"\"ts\":%.3f,\"pid\":2,\"tid\":%u,\"args\":{\"res\":%d}}",
+			sep, ts, ev->id, ev->res);
+		break;
+	case PW_TRACE_EVENT_LINK_STATE:
+		fprintf(d->out, "%s{\"name\":\"link %u\",\"cat\":\"link\",\"ph\":\"i\",\"s\":\"g\","
+			"\"ts\":%.3f,\"pid\":3,\"tid\":%u,\"args\":{\"state\":%d,\"old\":%d}}",
+			sep, ev->id, ts, ev->id, (int32_t) ev->arg, ev->res);
+		break;
+	default:
+		d->first = sep[0] == '\0';
+		break;
+	}
+}
+
+static int convert(struct data *d, const char *path)
+{
+	const struct pw_trace_header *h;
+	const struct pw_trace_event *events;
+	struct stat st;
+	uint64_t index, end, skipped = 0;
+	int fd, res = 0;
+	void *mem;
+
+	if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0 || fstat(fd, &st) < 0) {
+		res = -errno;
+		fprintf(stderr, "can't open %s: %s\n", path, strerror(errno));
+		goto exit_close;
+	}
+	if ((size_t) st.st_size < sizeof(struct pw_trace_header)) {
+		res = -EINVAL;
+		fprintf(stderr, "%s: file too small\n", path);
+		goto exit_close;
+	}
+	mem = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED) {
+		res = -errno;
+		fprintf(stderr, "can't map %s: %s\n", path, strerror(errno));
+		goto exit_close;
+	}
+
+	h = mem;
+	if (memcmp(h->magic, PW_TRACE_MAGIC, sizeof(h->magic)) != 0 ||
+	    h->version != PW_TRACE_VERSION ||
+	    h->event_size != sizeof(struct pw_trace_event) ||
+	    h->n_events == 0 ||
+	    (h->n_events & (h->n_events - 1)) != 0 ||
+	    sizeof(struct pw_trace_header) + (size_t) h->n_events * h->event_size > (size_t) st.st_size) {
+		res = -EINVAL;
+		fprintf(stderr, "%s: not a valid trace file\n", path);
+		goto exit_unmap;
+	}
+
+	events = SPA_MEMBER(h, sizeof(struct pw_trace_header), const struct pw_trace_event);
+	end = __atomic_load_n(&h->writeindex, __ATOMIC_ACQUIRE);
+	index = end > h->n_events ? end - h->n_events : 0;
+	d->start_time = h->start_time;
+	d->first = true;
+
+	if (d->format == FORMAT_CHROME)
+		fprintf(d->out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+
+	for (; index < end; index++) {
+		struct pw_trace_event ev;
+		const struct pw_trace_event *e = &events[index & (h->n_events - 1)];
+
+		/* skip events that are overwritten or still being written */
+		if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != (uint32_t) index + 1) {
+			skipped++;
+			continue;
+		}
+		ev = *e;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) != (uint32_t) index + 1) {
+			skipped++;
+			continue;
+		}
+
+		if (d->format == FORMAT_CHROME)
+			print_chrome(d, &ev);
+		else
+			print_text(d, &ev);
+	}
+
+	if (d->format == FORMAT_CHROME)
+		fprintf(d->out, "\n]}\n");
+
+	fprintf(stderr, "%s: %" PRIu64 " events recorded, %" PRIu64 " converted, %" PRIu64 " skipped\n",
+		path, end, end - (end > h->n_events ? end - h->n_events : 0) - skipped, skipped);
+
+      exit_unmap:
+	munmap(mem, st.st_size);
+      exit_close:
+	if (fd >= 0)
+		close(fd);
+	return res;
+}
+
+static void usage(const char *name)
+{
+	fprintf(stderr, "usage: %s [-t] [-o output] <trace-file>\n"
+		"  -t         print the events as text instead of Chrome trace JSON\n"
+		"  -o output  write to output instead of stdout\n", name);
+}
+
+int main(int argc, char *argv[])
+{
+	struct data data = { FORMAT_CHROME, stdout, };
+	int opt, res;
+
+	while ((opt = getopt(argc, argv, "to:h")) != -1) {
+		switch (opt) {
+		case 't':
+			data.format = FORMAT_TEXT;
+			break;
+		case 'o':
+			if ((data.out = fopen(optarg, "w")) == NULL) {
+				fprintf(stderr, "can't open %s: %s\n", optarg, strerror(errno));
+				return 1;
+			}
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	res = convert(&data, argv[optind]);
+
+	if (data.out != stdout)
+		fclose(data.out);
+
+	return res < 0 ? 1 : 0;
+}